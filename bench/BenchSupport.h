@@ -0,0 +1,129 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PG_BENCH_HAS_CYCLE_COUNTER 1
+#endif
+
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+namespace pg {
+namespace audio_tap {
+    namespace bench {
+
+        // Time-stamp counter on x86: reference cycles at a constant rate, which track core
+        // cycles closely on a machine without frequency scaling. Zero elsewhere.
+        inline auto readCycleCounter() -> uint64_t
+        {
+#if PG_BENCH_HAS_CYCLE_COUNTER
+            return __rdtsc();
+#else
+            return 0;
+#endif
+        }
+
+        constexpr bool kHasCycleCounter =
+#if PG_BENCH_HAS_CYCLE_COUNTER
+                true;
+#else
+                false;
+#endif
+
+        struct Measurement
+        {
+            double nanoseconds{0.0};
+            double cycles{0.0};
+
+            auto per(double count) const -> Measurement
+            {
+                return {nanoseconds / count, cycles / count};
+            }
+        };
+
+        // Runs `fn` once and returns how long it took.
+        template <typename Fn>
+        auto measure(Fn &&fn) -> Measurement
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const uint64_t startCycles = readCycleCounter();
+            fn();
+            const uint64_t endCycles = readCycleCounter();
+            const std::chrono::duration<double, std::nano> elapsed =
+                    std::chrono::steady_clock::now() - start;
+            return {elapsed.count(), static_cast<double>(endCycles - startCycles)};
+        }
+
+        // Runs `fn` `repetitions` times per trial and returns the fastest trial per repetition,
+        // which is the least disturbed by other work on the machine.
+        template <typename Fn>
+        auto measureBest(int trials, int repetitions, Fn &&fn) -> Measurement
+        {
+            Measurement best{};
+            for (int trial = 0; trial < trials; ++trial) {
+                const Measurement m = measure(
+                        [&]
+                        {
+                            for (int i = 0; i < repetitions; ++i) { fn(); }
+                        });
+                if (trial == 0 || m.nanoseconds < best.nanoseconds) { best = m; }
+            }
+            return best.per(repetitions);
+        }
+
+        // Keeps the optimiser from discarding a value or the stores that produced it.
+        template <typename T>
+        inline void doNotOptimize(const T &value)
+        {
+            asm volatile("" : : "r,m"(value) : "memory");
+        }
+
+        inline void clobberMemory()
+        {
+            asm volatile("" : : : "memory");
+        }
+
+        // Current resident set, which unlike the peak can fall, so the difference across one
+        // configuration is that configuration's own footprint. Zero where it cannot be read.
+        inline auto getResidentMegabytes() -> double
+        {
+#if defined(__APPLE__)
+            mach_task_basic_info info{};
+            mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+            if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                          reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) {
+                return 0.0;
+            }
+            return static_cast<double>(info.resident_size) / (1024.0 * 1024.0);
+#else
+            std::FILE *file = std::fopen("/proc/self/statm", "r");
+            if (file == nullptr) { return 0.0; }
+            unsigned long size = 0, resident = 0;
+            const bool ok = std::fscanf(file, "%lu %lu", &size, &resident) == 2;
+            std::fclose(file);
+            if (!ok) { return 0.0; }
+            return static_cast<double>(resident) * static_cast<double>(sysconf(_SC_PAGESIZE)) /
+                   (1024.0 * 1024.0);
+#endif
+        }
+
+        // Prints a cycle count, or a dash where the machine has no cycle counter.
+        inline void printCycles(double cycles, int width = 9, int precision = 2)
+        {
+            if (kHasCycleCounter) {
+                std::printf(" %*.*f", width, precision, cycles);
+            } else {
+                std::printf(" %*s", width, "-");
+            }
+        }
+
+    } // namespace bench
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,158 @@
+// Measures what `CallbackTimer` adds to each capture callback: two clock reads and two
+// histogram updates. An `IOProcHandle` runs on a `bench::DirectCallBackend` once with and once
+// without a timer, around an empty sink and around a `LevelMeter` doing a callback's worth of
+// work, and its callback is called as a backend's IOProc would. Overhead is also given as a
+// share of the callback's real-time budget at 48 kHz, and the cost of one clock read is shown
+// for reference.
+//
+// Usage: bench_callback_timer [--quick]
+
+#include "BenchSupport.h"
+#include "DirectCallBackend.h"
+#include "IOProcHandle.h"
+#include "LatencyHistogram.h"
+#include "LevelMeter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr double kSampleRate = 48000.0;
+    constexpr uint32_t kChannelCount = 2;
+    constexpr int kTrials = 7;
+
+    // Stands in for a sink that does nothing, to isolate the dispatch and timing.
+    struct EmptySink
+    {
+        void process(const AudioBufferList *inputData, const AudioTimeStamp *)
+        {
+            bench::doNotOptimize(inputData);
+        }
+    };
+
+    // Meters each buffer, a typical amount of real-time work per callback.
+    struct MeteringSink
+    {
+        LevelMeter meter{kChannelCount, kSampleRate};
+
+        void process(const AudioBufferList *inputData, const AudioTimeStamp *)
+        {
+            meter.process(static_cast<const float *>(inputData->mBuffers[0].mData),
+                          inputData->mBuffers[0].mDataByteSize / sizeof(float));
+        }
+    };
+
+    // Nanoseconds and cycles per callback of `Sink` on buffers of `frameCount`.
+    template <typename Sink>
+    auto measureCallback(bench::DirectCallBackend &backend, Sink &sink, bool timed,
+                         size_t frameCount) -> bench::Measurement
+    {
+        std::vector<float> samples(frameCount * kChannelCount);
+        for (size_t i = 0; i < samples.size(); ++i) {
+            samples[i] = 0.25f * static_cast<float>(std::sin(0.01 * static_cast<double>(i)));
+        }
+        AudioBufferList list{};
+        list.mNumberBuffers = 1;
+        list.mBuffers[0].mNumberChannels = kChannelCount;
+        list.mBuffers[0].mDataByteSize = static_cast<UInt32>(samples.size() * sizeof(float));
+        list.mBuffers[0].mData = samples.data();
+        AudioTimeStamp time{};
+
+        const auto timer = timed ? std::make_shared<CallbackTimer>() : nullptr;
+        IOProcHandle<Sink> handle(bench::DirectCallBackend::kDeviceID, sink, timer);
+        AudioHardwareBackend::IOCallback callback = backend.getCallback();
+        // The backend calls through a pointer it cannot see into; so does this.
+        bench::doNotOptimize(callback);
+
+        // About a million samples per trial, so short buffers make many calls.
+        const int repetitions =
+                static_cast<int>(std::max<size_t>(1000, (size_t{1} << 20) / samples.size()));
+        const bench::Measurement perCall = bench::measureBest(kTrials, repetitions,
+                                                              [&]
+                                                              {
+                                                                  callback(&list, &time);
+                                                                  bench::clobberMemory();
+                                                              });
+        if (timer) { bench::doNotOptimize(timer->getSummary().duration.count); }
+        return perCall;
+    }
+
+    template <typename Sink>
+    void run(bench::DirectCallBackend &backend, const char *sinkName, size_t frameCount)
+    {
+        Sink untimedSink;
+        Sink timedSink;
+        const bench::Measurement untimed =
+                measureCallback(backend, untimedSink, false, frameCount);
+        const bench::Measurement timed = measureCallback(backend, timedSink, true, frameCount);
+        const double overhead = timed.nanoseconds - untimed.nanoseconds;
+        const double budget = 1e9 * static_cast<double>(frameCount) / kSampleRate;
+
+        std::printf("%-6s %6zu %9.1f %9.1f %9.1f", sinkName, frameCount, untimed.nanoseconds,
+                    timed.nanoseconds, overhead);
+        bench::printCycles(timed.cycles - untimed.cycles, 9, 1);
+        std::printf(" %9.4f\n", 100.0 * overhead / budget);
+    }
+
+    // Cost of the clock `IOProcHandle` reads twice per timed callback.
+    void runClock()
+    {
+        const bench::Measurement perRead = bench::measureBest(
+                kTrials, 1000000,
+                [] { bench::doNotOptimize(std::chrono::steady_clock::now()); });
+        std::printf("steady_clock::now(): %.1f ns", perRead.nanoseconds);
+        if (bench::kHasCycleCounter) { std::printf(", %.1f cycles", perRead.cycles); }
+        std::printf("\n");
+    }
+
+    // Cost of reading the histograms, which the UI does while the callback runs.
+    void runSummary()
+    {
+        CallbackTimer timer;
+        for (uint64_t i = 1; i <= 100000; ++i) {
+            timer.begin(i * 10666667);
+            timer.end(i * 10666667 + 20000 + (i * 7919) % 50000);
+        }
+        const bench::Measurement perSummary =
+                bench::measureBest(kTrials, 1000,
+                                   [&] { bench::doNotOptimize(timer.getSummary().duration.p99); });
+        std::printf("getSummary(): %.0f ns", perSummary.nanoseconds);
+        if (bench::kHasCycleCounter) { std::printf(", %.0f cycles", perSummary.cycles); }
+        std::printf("\n");
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool quick = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else {
+            std::fprintf(stderr, "Usage: %s [--quick]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const std::vector<size_t> frameCounts =
+            quick ? std::vector<size_t>{512} : std::vector<size_t>{32, 128, 512, 4096};
+    const auto backend = std::make_shared<bench::DirectCallBackend>();
+    setAudioHardwareBackend(backend);
+
+    std::printf("%u channels at %.0f Hz; cycles are %s\n", kChannelCount, kSampleRate,
+                bench::kHasCycleCounter ? "TSC reference cycles" : "unavailable");
+    std::printf("%-6s %6s %9s %9s %9s %9s %9s\n", "sink", "frames", "ns", "timed ns",
+                "+ns", "+cyc", "%budget");
+    for (const size_t frames : frameCounts) { run<EmptySink>(*backend, "empty", frames); }
+    for (const size_t frames : frameCounts) { run<MeteringSink>(*backend, "meter", frames); }
+    runClock();
+    runSummary();
+    return 0;
+}
@@ -0,0 +1,208 @@
+// Feeds synthetic buffer lists through `AudioDataHandler::process()` into a CAF file, as the
+// IOProc would, and reports the cost per frame on the capturing thread together with its heap
+// allocations and the bytes that reached the file. Setting the handler up and finishing it
+// (stopping the writer thread and finalizing the file) are timed separately. rssMB is how much
+// the resident set grew from before setup to the end of the capture, so each row shows its own
+// footprint rather than the process's peak so far.
+//
+// Usage: bench_capture_pipeline [--seconds N] [--quick]
+
+#include "AudioDataHandler.h"
+#include "BenchSupport.h"
+#include "CafFileWriter.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <new>
+#include <vector>
+
+namespace {
+    // Allocations made by the thread that calls `process()` while it is being measured.
+    std::atomic<uint64_t> allocationCount{0};
+    thread_local bool countAllocations = false;
+} // namespace
+
+void *operator new(size_t size)
+{
+    if (countAllocations) { allocationCount.fetch_add(1, std::memory_order_relaxed); }
+    if (void *pointer = std::malloc(size == 0 ? 1 : size)) { return pointer; }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+namespace {
+    using namespace pg::audio_tap;
+
+    struct Config
+    {
+        double sampleRate;
+        UInt32 channelCount;
+        UInt32 framesPerBuffer;
+        bool nonInterleaved;
+    };
+
+    // Owns the buffers behind an `AudioBufferList` laid out as the HAL would for `config`.
+    class SyntheticInput
+    {
+    public:
+        explicit SyntheticInput(const Config &config)
+          : buffers_(config.nonInterleaved ? config.channelCount : 1),
+            storage_(sizeof(AudioBufferList) + buffers_.size() * sizeof(AudioBuffer))
+        {
+            const size_t samplesPerBuffer = config.nonInterleaved
+                                                    ? config.framesPerBuffer
+                                                    : config.framesPerBuffer * config.channelCount;
+            auto *list = get();
+            list->mNumberBuffers = static_cast<UInt32>(buffers_.size());
+            for (size_t i = 0; i < buffers_.size(); ++i) {
+                buffers_[i].resize(samplesPerBuffer);
+                for (size_t j = 0; j < samplesPerBuffer; ++j) {
+                    buffers_[i][j] = 0.25f * static_cast<float>((j * 7 + i * 13) % 64) / 64.0f;
+                }
+                list->mBuffers[i].mNumberChannels = config.nonInterleaved ? 1
+                                                                          : config.channelCount;
+                list->mBuffers[i].mDataByteSize =
+                        static_cast<UInt32>(samplesPerBuffer * sizeof(float));
+                list->mBuffers[i].mData = buffers_[i].data();
+            }
+        }
+
+        auto get() -> AudioBufferList *
+        {
+            return reinterpret_cast<AudioBufferList *>(storage_.data());
+        }
+
+    private:
+        std::vector<std::vector<float>> buffers_;
+        std::vector<unsigned char> storage_;
+    };
+
+    void run(const Config &config, double seconds, const std::string &path)
+    {
+        AudioStreamBasicDescription format{};
+        format.mSampleRate = config.sampleRate;
+        format.mFormatID = kAudioFormatLinearPCM;
+        format.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked |
+                              (config.nonInterleaved ? UInt32{kAudioFormatFlagIsNonInterleaved}
+                                                     : UInt32{0});
+        format.mChannelsPerFrame = config.channelCount;
+        format.mBitsPerChannel = 32;
+
+        const double residentBefore = bench::getResidentMegabytes();
+        auto sink = CafFileWriter::open(path, {config.sampleRate, config.channelCount});
+        if (!sink) {
+            std::fprintf(stderr, "Cannot create %s\n", path.c_str());
+            std::exit(1);
+        }
+
+        // The input arrives much faster than real time, so the queue holds all of it and is
+        // prefaulted throughout; otherwise the rows would measure dropped blocks. Setting it up
+        // is timed separately.
+        AudioDataHandler::BufferOptions options;
+        options.durationInSeconds = static_cast<int>(seconds) + 1;
+        options.prefaultedSeconds = options.durationInSeconds;
+        std::unique_ptr<AudioDataHandler> handler;
+        const bench::Measurement setup = bench::measure(
+                [&]
+                {
+                    handler = std::make_unique<AudioDataHandler>(format, std::move(sink),
+                                                                 options);
+                    handler->start();
+                });
+
+        SyntheticInput input(config);
+        AudioTimeStamp inputTime{};
+        inputTime.mFlags = kAudioTimeStampSampleTimeValid;
+        const auto totalFrames = static_cast<uint64_t>(config.sampleRate * seconds);
+        uint64_t frames = 0;
+
+        allocationCount.store(0);
+        countAllocations = true;
+        const bench::Measurement capture = bench::measure(
+                [&]
+                {
+                    for (; frames < totalFrames; frames += config.framesPerBuffer) {
+                        inputTime.mSampleTime = static_cast<double>(frames);
+                        handler->process(input.get(), &inputTime);
+                    }
+                });
+        countAllocations = false;
+        const double resident = bench::getResidentMegabytes() - residentBefore;
+
+        const bench::Measurement finish = bench::measure([&] { handler->finish(); });
+        const uint64_t dropped = handler->getDroppedSampleCount();
+        handler.reset();
+
+        std::error_code error;
+        const auto bytes = std::filesystem::file_size(path, error);
+        const bench::Measurement perFrame = capture.per(static_cast<double>(frames));
+
+        std::printf("%6u %3u %6.0f %-6s %9.3f", config.framesPerBuffer, config.channelCount,
+                    config.sampleRate, config.nonInterleaved ? "planar" : "inter",
+                    perFrame.nanoseconds);
+        bench::printCycles(perFrame.cycles);
+        std::printf(" %8.2f %8.2f %7llu %7.1f %11llu %8llu\n", setup.nanoseconds / 1e6,
+                    finish.nanoseconds / 1e6,
+                    static_cast<unsigned long long>(allocationCount.load()), resident,
+                    static_cast<unsigned long long>(error ? 0 : bytes),
+                    static_cast<unsigned long long>(dropped));
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    double seconds = 5.0;
+    bool quick = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else {
+            std::fprintf(stderr, "Usage: %s [--seconds N] [--quick]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const std::vector<double> rates = quick ? std::vector<double>{48000.0}
+                                            : std::vector<double>{44100.0, 48000.0, 96000.0};
+    const std::vector<UInt32> channelCounts =
+            quick ? std::vector<UInt32>{2} : std::vector<UInt32>{1, 2, 6, 8};
+    const std::vector<UInt32> bufferSizes =
+            quick ? std::vector<UInt32>{32, 512, 4096}
+                  : std::vector<UInt32>{32, 64, 128, 256, 512, 1024, 2048, 4096};
+
+    const std::string path =
+            (std::filesystem::temp_directory_path() / "pg_bench_capture_pipeline.caf").string();
+
+    std::printf("%.1f s of audio per row; cycles are %s\n", seconds,
+                bench::kHasCycleCounter ? "TSC reference cycles" : "unavailable");
+    std::printf("%6s %3s %6s %-6s %9s %9s %8s %8s %7s %7s %11s %8s\n", "frames", "ch", "rate",
+                "layout", "ns/frame", "cyc/frame", "setupMs", "finishMs", "allocs", "rssMB",
+                "bytes", "dropped");
+    for (const double rate : rates) {
+        for (const UInt32 channels : channelCounts) {
+            for (const bool planar : {false, true}) {
+                for (const UInt32 frames : bufferSizes) {
+                    run({rate, channels, frames, planar}, seconds, path);
+                }
+            }
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    return 0;
+}
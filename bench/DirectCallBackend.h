@@ -0,0 +1,52 @@
+#pragma once
+
+#include "AudioHardwareBackend.h"
+
+namespace pg {
+namespace audio_tap {
+    namespace bench {
+
+        // `AudioHardwareBackend` whose IOProcs never run on their own: it keeps the callback of
+        // the last `startIOProc()`, and a benchmark calls it on its own thread exactly as a
+        // backend's IOProc would. Everything else succeeds without doing anything. Install it
+        // with `setAudioHardwareBackend()` before creating an `IOProcHandle`.
+        class DirectCallBackend : public AudioHardwareBackend
+        {
+        public:
+            static constexpr AudioDeviceID kDeviceID = 2;
+
+            auto getDefaultOutputDevice() -> AudioDeviceID override { return kDeviceID; }
+            auto getStreamFormat(AudioDeviceID, AudioStreamBasicDescription &) -> bool override
+            {
+                return false;
+            }
+            auto createTap(AudioDeviceID, AudioObjectID &, AudioDeviceID &) -> bool override
+            {
+                return false;
+            }
+            void destroyTap(AudioObjectID, AudioDeviceID) override {}
+            auto addPropertyListener(AudioDeviceID, PropertyListener) -> Token override
+            {
+                return 1;
+            }
+            void removePropertyListener(Token) override {}
+
+            auto startIOProc(AudioDeviceID, IOCallback callback) -> Token override
+            {
+                callback_ = callback;
+                return 1;
+            }
+            void stopIOProc(Token) override { callback_ = {}; }
+
+            auto getHostClockFrequency() -> double override { return 1e9; }
+
+            // The running IOProc's callback; empty once it is stopped.
+            auto getCallback() const -> IOCallback { return callback_; }
+
+        private:
+            IOCallback callback_;
+        };
+
+    } // namespace bench
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,250 @@
+// Measures `FlacFileWriter` as the writer thread runs it: stereo float blocks of 512 frames in,
+// dithered and encoded, written to a temporary file and finalized. For each input and bit depth
+// it reports frames per second, how many times faster than real time that is on one core, and
+// the size of the file relative to the float input and to plain PCM at the same depth.
+//
+// Inputs:
+//   tone     a -6 dBFS 1 kHz sine, the best case for the fixed predictors;
+//   noise    full-band white noise at -6 dBFS, which leaves nothing to predict;
+//   silence  digital zero, which still carries the dither;
+//   music    notes with harmonics, envelopes and panning over a -70 dBFS noise floor, standing
+//            in for recorded material;
+//   file     a recording, if one is given: a stereo float32 CAF such as a default take.
+//
+// Usage: bench_flac_encoder [--quick] [recording.caf]
+
+#include "BenchSupport.h"
+#include "FlacFileWriter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr double kSampleRate = 48000.0;
+    constexpr uint32_t kChannelCount = 2;
+    constexpr size_t kBlockFrames = 512;
+    constexpr double kTwoPi = 6.283185307179586;
+
+    struct Input
+    {
+        std::string name;
+        double sampleRate;
+        std::vector<float> samples; // Interleaved stereo.
+    };
+
+    auto makeTone(size_t frameCount) -> std::vector<float>
+    {
+        std::vector<float> samples(frameCount * kChannelCount);
+        for (size_t f = 0; f < frameCount; ++f) {
+            const auto value = static_cast<float>(
+                    0.5 * std::sin(kTwoPi * 1000.0 * static_cast<double>(f) / kSampleRate));
+            samples[f * kChannelCount] = value;
+            samples[f * kChannelCount + 1] = value;
+        }
+        return samples;
+    }
+
+    auto makeNoise(size_t frameCount) -> std::vector<float>
+    {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+        std::vector<float> samples(frameCount * kChannelCount);
+        for (auto &sample : samples) { sample = distribution(random); }
+        return samples;
+    }
+
+    // A new note every quarter second: a few harmonics with a decaying envelope, panned at
+    // random, ringing over the next ones, on top of a faint noise floor.
+    auto makeMusic(size_t frameCount) -> std::vector<float>
+    {
+        std::mt19937 random(2);
+        std::uniform_int_distribution<int> semitone(-24, 12);
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        std::normal_distribution<double> floor(0.0, std::pow(10.0, -70.0 / 20.0));
+
+        struct Note
+        {
+            size_t start;
+            double frequency;
+            double pan;
+        };
+        std::vector<Note> notes;
+        const auto noteFrames = static_cast<size_t>(kSampleRate / 4.0);
+        for (size_t start = 0; start < frameCount; start += noteFrames) {
+            notes.push_back({start, 440.0 * std::pow(2.0, semitone(random) / 12.0), unit(random)});
+        }
+
+        std::vector<float> samples(frameCount * kChannelCount);
+        for (size_t f = 0; f < frameCount; ++f) {
+            double left = floor(random);
+            double right = floor(random);
+            for (const Note &note : notes) {
+                if (note.start > f) { break; }
+                const double t = static_cast<double>(f - note.start) / kSampleRate;
+                if (t > 2.0) { continue; }
+                double value = 0.0;
+                for (int harmonic = 1; harmonic <= 6; ++harmonic) {
+                    value += std::sin(kTwoPi * note.frequency * harmonic * t) / harmonic;
+                }
+                value *= 0.12 * std::exp(-3.0 * t);
+                left += value * (1.0 - note.pan);
+                right += value * note.pan;
+            }
+            samples[f * kChannelCount] = static_cast<float>(left);
+            samples[f * kChannelCount + 1] = static_cast<float>(right);
+        }
+        return samples;
+    }
+
+    auto readBigEndian(const std::vector<uint8_t> &bytes, size_t offset, int byteCount)
+            -> uint64_t
+    {
+        uint64_t value = 0;
+        for (int i = 0; i < byteCount; ++i) { value = (value << 8) | bytes[offset + i]; }
+        return value;
+    }
+
+    // Reads a little-endian stereo float32 CAF. Returns false if `path` is not one.
+    auto readRecording(const std::string &path, Input &input) -> bool
+    {
+        std::vector<uint8_t> bytes;
+        if (std::FILE *file = std::fopen(path.c_str(), "rb")) {
+            uint8_t buffer[64 * 1024];
+            size_t count = 0;
+            while ((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+                bytes.insert(bytes.end(), buffer, buffer + count);
+            }
+            std::fclose(file);
+        }
+        if (bytes.size() < 8 || std::memcmp(bytes.data(), "caff", 4) != 0) { return false; }
+
+        bool isStereoFloat = false;
+        for (size_t offset = 8; offset + 12 <= bytes.size();) {
+            const auto size = static_cast<int64_t>(readBigEndian(bytes, offset + 4, 8));
+            const size_t body = offset + 12;
+            if (std::memcmp(bytes.data() + offset, "desc", 4) == 0 && body + 32 <= bytes.size()) {
+                const uint64_t rateBits = readBigEndian(bytes, body, 8);
+                std::memcpy(&input.sampleRate, &rateBits, sizeof(double));
+                const auto flags = readBigEndian(bytes, body + 12, 4);
+                const auto channels = readBigEndian(bytes, body + 24, 4);
+                const auto bits = readBigEndian(bytes, body + 28, 4);
+                isStereoFloat = std::memcmp(bytes.data() + body + 8, "lpcm", 4) == 0 &&
+                                (flags & 3) == 3 && channels == kChannelCount && bits == 32;
+            } else if (std::memcmp(bytes.data() + offset, "data", 4) == 0) {
+                if (!isStereoFloat) { return false; }
+                const size_t begin = body + 4; // After the edit count.
+                size_t end = size < 0 ? bytes.size()
+                                      : std::min(bytes.size(), body + static_cast<size_t>(size));
+                end -= (end - begin) % (sizeof(float) * kChannelCount);
+                input.samples.resize((end - begin) / sizeof(float));
+                // Little-endian, as checked above, which is how the recorder writes floats.
+                std::memcpy(input.samples.data(), bytes.data() + begin, end - begin);
+                return !input.samples.empty();
+            }
+            if (size < 0) { return false; }
+            offset = body + static_cast<size_t>(size);
+        }
+        return false;
+    }
+
+    void run(const Input &input, SampleFormat sampleFormat, const std::string &path, int trials)
+    {
+        const size_t frameCount = input.samples.size() / kChannelCount;
+        OutputFormat outputFormat;
+        outputFormat.fileType = FileType::Flac;
+        outputFormat.sampleFormat = sampleFormat;
+
+        bench::Measurement best{};
+        uint64_t fileBytes = 0;
+        for (int trial = 0; trial < trials; ++trial) {
+            bool ok = true;
+            const bench::Measurement m = bench::measure(
+                    [&]
+                    {
+                        auto writer = FlacFileWriter::open(
+                                path, {input.sampleRate, kChannelCount}, outputFormat);
+                        ok = writer != nullptr;
+                        for (size_t frame = 0; ok && frame < frameCount; frame += kBlockFrames) {
+                            ok = writer->write(input.samples.data() + frame * kChannelCount,
+                                               std::min(kBlockFrames, frameCount - frame));
+                        }
+                        ok = ok && writer->finalize();
+                        if (writer) { fileBytes = writer->getBytesWritten(); }
+                    });
+            if (!ok) {
+                std::fprintf(stderr, "Could not write %s\n", path.c_str());
+                return;
+            }
+            if (trial == 0 || m.nanoseconds < best.nanoseconds) { best = m; }
+        }
+
+        const bench::Measurement perFrame = best.per(static_cast<double>(frameCount));
+        const double framesPerSecond = 1e9 / perFrame.nanoseconds;
+        const uint32_t bitsPerSample = sampleFormat == SampleFormat::Int16 ? 16 : 24;
+        const double floatBytes = static_cast<double>(input.samples.size() * sizeof(float));
+        const double pcmBytes = static_cast<double>(input.samples.size() * bitsPerSample / 8);
+
+        std::printf("%-8s %4u %9.2f", input.name.c_str(), bitsPerSample, perFrame.nanoseconds);
+        bench::printCycles(perFrame.cycles, 9, 1);
+        std::printf(" %11.0f %8.0f %9.3f %9.3f\n", framesPerSecond,
+                    framesPerSecond / input.sampleRate, static_cast<double>(fileBytes) / floatBytes,
+                    static_cast<double>(fileBytes) / pcmBytes);
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool quick = false;
+    std::string recordingPath;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else if (argv[i][0] != '-' && recordingPath.empty()) {
+            recordingPath = argv[i];
+        } else {
+            std::fprintf(stderr, "Usage: %s [--quick] [recording.caf]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const auto frameCount = static_cast<size_t>(kSampleRate * (quick ? 2.0 : 20.0));
+    const int trials = quick ? 2 : 5;
+
+    std::vector<Input> inputs;
+    inputs.push_back({"tone", kSampleRate, makeTone(frameCount)});
+    inputs.push_back({"noise", kSampleRate, makeNoise(frameCount)});
+    inputs.push_back({"silence", kSampleRate, std::vector<float>(frameCount * kChannelCount)});
+    inputs.push_back({"music", kSampleRate, makeMusic(frameCount)});
+    if (!recordingPath.empty()) {
+        Input recording{"file", 0.0, {}};
+        if (!readRecording(recordingPath, recording)) {
+            std::fprintf(stderr, "%s is not a stereo float32 CAF\n", recordingPath.c_str());
+            return 1;
+        }
+        inputs.push_back(std::move(recording));
+    }
+
+    const std::string path =
+            (std::filesystem::temp_directory_path() / "pg_bench_flac_encoder.flac").string();
+
+    std::printf("Stereo, dithered, %zu-frame writes, best of %d; cycles are %s\n", kBlockFrames,
+                trials, bench::kHasCycleCounter ? "TSC reference cycles" : "unavailable");
+    std::printf("%-8s %4s %9s %9s %11s %8s %9s %9s\n", "input", "bits", "ns/frame", "cyc/frame",
+                "frames/s", "x rt", "out/float", "out/pcm");
+    for (const Input &input : inputs) {
+        run(input, SampleFormat::Int16, path, trials);
+        run(input, SampleFormat::Int24, path, trials);
+    }
+
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    return 0;
+}
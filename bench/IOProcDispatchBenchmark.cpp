@@ -0,0 +1,135 @@
+// Compares the two ways the IOProc has reached its sink, per callback in nanoseconds and cycles:
+//
+//   typed     the `AudioHardwareBackend::IOCallback` an `IOProcHandle<Sink>` registers, which
+//             calls `Sink::process()` directly (the current path);
+//   function  a `std::function` stored by the backend calling the recorder's `std::function`
+//             handler, which checks it has a sink and calls it (the path before it).
+//
+// The handle runs on a `bench::DirectCallBackend`, so the typed row times the shipped callback;
+// a backend's own IOProc adds the same hop in front of both. Each runs around an empty sink,
+// which leaves only the dispatch, and around a `LevelMeter` on a short buffer, where the
+// difference is a share of real work.
+//
+// Usage: bench_ioproc_dispatch [--quick]
+
+#include "BenchSupport.h"
+#include "DirectCallBackend.h"
+#include "IOProcHandle.h"
+#include "LevelMeter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr double kSampleRate = 48000.0;
+    constexpr uint32_t kChannelCount = 2;
+    constexpr int kTrials = 7;
+
+    struct EmptySink
+    {
+        void process(const AudioBufferList *inputData, const AudioTimeStamp *)
+        {
+            bench::doNotOptimize(inputData);
+        }
+    };
+
+    struct MeteringSink
+    {
+        LevelMeter meter{kChannelCount, kSampleRate};
+
+        void process(const AudioBufferList *inputData, const AudioTimeStamp *)
+        {
+            meter.process(static_cast<const float *>(inputData->mBuffers[0].mData),
+                          inputData->mBuffers[0].mDataByteSize / sizeof(float));
+        }
+    };
+
+    using FunctionCallback = std::function<void(const AudioBufferList *, const AudioTimeStamp *)>;
+
+    // Nanoseconds and cycles per call of `callback`, which must not be visible to the optimiser.
+    template <typename Callback>
+    auto measureCalls(Callback &callback, const AudioBufferList &list, int repetitions)
+            -> bench::Measurement
+    {
+        AudioTimeStamp time{};
+        return bench::measureBest(kTrials, repetitions,
+                                  [&]
+                                  {
+                                      callback(&list, &time);
+                                      bench::clobberMemory();
+                                  });
+    }
+
+    template <typename Sink>
+    void run(bench::DirectCallBackend &backend, const char *sinkName, size_t frameCount,
+             int repetitions)
+    {
+        std::vector<float> samples(frameCount * kChannelCount);
+        for (size_t i = 0; i < samples.size(); ++i) {
+            samples[i] = 0.25f * static_cast<float>(std::sin(0.01 * static_cast<double>(i)));
+        }
+        AudioBufferList list{};
+        list.mNumberBuffers = 1;
+        list.mBuffers[0].mNumberChannels = kChannelCount;
+        list.mBuffers[0].mDataByteSize = static_cast<UInt32>(samples.size() * sizeof(float));
+        list.mBuffers[0].mData = samples.data();
+
+        Sink typedSink;
+        IOProcHandle<Sink> handle(bench::DirectCallBackend::kDeviceID, typedSink);
+        AudioHardwareBackend::IOCallback typed = backend.getCallback();
+        // The backend calls through a pointer it cannot see into; so does this.
+        bench::doNotOptimize(typed);
+        const bench::Measurement typedCall = measureCalls(typed, list, repetitions);
+
+        Sink functionSink;
+        Sink *handler = &functionSink;
+        FunctionCallback recorderCallback =
+                [&handler](const AudioBufferList *inputData, const AudioTimeStamp *inputTime)
+        {
+            if (handler) { handler->process(inputData, inputTime); }
+        };
+        FunctionCallback backendCallback = [&recorderCallback](const AudioBufferList *inputData,
+                                                               const AudioTimeStamp *inputTime)
+        { recorderCallback(inputData, inputTime); };
+        bench::doNotOptimize(handler);
+        bench::doNotOptimize(backendCallback);
+        const bench::Measurement functionCall = measureCalls(backendCallback, list, repetitions);
+
+        std::printf("%-6s %6zu %9.2f", sinkName, frameCount, typedCall.nanoseconds);
+        bench::printCycles(typedCall.cycles, 9, 1);
+        std::printf(" %9.2f", functionCall.nanoseconds);
+        bench::printCycles(functionCall.cycles, 9, 1);
+        std::printf(" %9.2f\n", functionCall.nanoseconds - typedCall.nanoseconds);
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool quick = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else {
+            std::fprintf(stderr, "Usage: %s [--quick]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const int repetitions = quick ? 1000000 : 10000000;
+    const auto backend = std::make_shared<bench::DirectCallBackend>();
+    setAudioHardwareBackend(backend);
+
+    std::printf("%d calls per trial; cycles are %s\n", repetitions,
+                bench::kHasCycleCounter ? "TSC reference cycles" : "unavailable");
+    std::printf("%-6s %6s %9s %9s %9s %9s %9s\n", "sink", "frames", "typed ns", "typed cyc",
+                "func ns", "func cyc", "saved ns");
+    run<EmptySink>(*backend, "empty", 32, repetitions);
+    run<MeteringSink>(*backend, "meter", 32, repetitions / 10);
+    return 0;
+}
@@ -0,0 +1,171 @@
+// Measures the planar <-> interleaved kernels for each channel layout and block size, in
+// nanoseconds and cycles per frame and in GB/s moved (bytes read plus bytes written). The "x"
+// columns give the speed-up over the generic strided loop that channel counts without a
+// specialised kernel use, run on the same buffers; rows where the kernel's output differs from
+// the loop's are flagged.
+//
+// The instruction set is the one the kernels select at run time; bench_interleave_sse2 and
+// bench_interleave_portable are built with it capped, for comparison on the same machine.
+//
+// Usage: bench_interleave [--quick]
+
+#include "BenchSupport.h"
+#include "InterleaveKernels.h"
+
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    // Each row moves about this many frames per trial, whatever the block size.
+    constexpr size_t kFramesPerTrial = size_t{1} << 21;
+    constexpr int kTrials = 7;
+
+    // The generic strided loops of InterleaveKernels.cpp, as the baseline for every layout.
+    void interleaveGeneric(const float *const *planes, uint32_t channelCount, size_t frameCount,
+                           float *destination)
+    {
+        for (uint32_t ch = 0; ch < channelCount; ++ch) {
+            const float *plane = planes[ch];
+            float *out = destination + ch;
+            for (size_t i = 0; i < frameCount; ++i) { out[i * channelCount] = plane[i]; }
+        }
+    }
+
+    void deinterleaveGeneric(const float *source, uint32_t channelCount, size_t frameCount,
+                             float *const *planes)
+    {
+        for (uint32_t ch = 0; ch < channelCount; ++ch) {
+            const float *in = source + ch;
+            float *plane = planes[ch];
+            for (size_t i = 0; i < frameCount; ++i) { plane[i] = in[i * channelCount]; }
+        }
+    }
+
+    struct Buffers
+    {
+        Buffers(uint32_t channelCount, size_t frameCount)
+          : planes(channelCount, std::vector<float>(frameCount)),
+            interleaved(channelCount * frameCount)
+        {
+            for (uint32_t ch = 0; ch < channelCount; ++ch) {
+                for (size_t i = 0; i < frameCount; ++i) {
+                    planes[ch][i] = static_cast<float>(ch * frameCount + i);
+                }
+                in.push_back(planes[ch].data());
+                out.push_back(planes[ch].data());
+            }
+        }
+
+        std::vector<std::vector<float>> planes;
+        std::vector<float> interleaved;
+        std::vector<const float *> in;
+        std::vector<float *> out;
+    };
+
+    void printRate(const bench::Measurement &perFrame, const bench::Measurement &generic,
+                   uint32_t channelCount)
+    {
+        const double bytesPerFrame = 2.0 * channelCount * sizeof(float);
+        std::printf(" %9.3f", perFrame.nanoseconds);
+        bench::printCycles(perFrame.cycles);
+        std::printf(" %7.2f %5.2f", bytesPerFrame / perFrame.nanoseconds,
+                    generic.nanoseconds / perFrame.nanoseconds);
+    }
+
+    // Whether `interleave` and `deinterleave` produce what the generic loops do.
+    auto matchesGeneric(kernels::InterleaveFn interleave, kernels::DeinterleaveFn deinterleave,
+                        uint32_t channelCount, size_t frameCount) -> bool
+    {
+        Buffers buffers(channelCount, frameCount);
+        std::vector<float> expected(buffers.interleaved.size());
+        interleave(buffers.in.data(), channelCount, frameCount, buffers.interleaved.data());
+        interleaveGeneric(buffers.in.data(), channelCount, frameCount, expected.data());
+        if (buffers.interleaved != expected) { return false; }
+
+        Buffers expectedPlanes(channelCount, frameCount);
+        deinterleave(expected.data(), channelCount, frameCount, buffers.out.data());
+        deinterleaveGeneric(expected.data(), channelCount, frameCount,
+                            expectedPlanes.out.data());
+        return buffers.planes == expectedPlanes.planes;
+    }
+
+    // Best time per frame of `interleave` and `deinterleave` on `buffers`.
+    auto measurePair(Buffers &buffers, kernels::InterleaveFn interleave,
+                     kernels::DeinterleaveFn deinterleave, uint32_t channelCount,
+                     size_t frameCount) -> std::pair<bench::Measurement, bench::Measurement>
+    {
+        // Called through pointers, as the capture path does, so neither side is inlined.
+        bench::doNotOptimize(interleave);
+        bench::doNotOptimize(deinterleave);
+        const int repetitions = static_cast<int>(kFramesPerTrial / frameCount);
+
+        const bench::Measurement interleaved = bench::measureBest(
+                kTrials, repetitions,
+                [&]
+                {
+                    interleave(buffers.in.data(), channelCount, frameCount,
+                               buffers.interleaved.data());
+                    bench::clobberMemory();
+                });
+        const bench::Measurement deinterleaved = bench::measureBest(
+                kTrials, repetitions,
+                [&]
+                {
+                    deinterleave(buffers.interleaved.data(), channelCount, frameCount,
+                                 buffers.out.data());
+                    bench::clobberMemory();
+                });
+        const auto frames = static_cast<double>(frameCount);
+        return {interleaved.per(frames), deinterleaved.per(frames)};
+    }
+
+    void run(uint32_t channelCount, size_t frameCount)
+    {
+        Buffers buffers(channelCount, frameCount);
+        const auto interleave = kernels::selectInterleave(channelCount);
+        const auto deinterleave = kernels::selectDeinterleave(channelCount);
+
+        const auto [interleaved, deinterleaved] =
+                measurePair(buffers, interleave, deinterleave, channelCount, frameCount);
+        const auto [genericInterleaved, genericDeinterleaved] = measurePair(
+                buffers, interleaveGeneric, deinterleaveGeneric, channelCount, frameCount);
+
+        std::printf("%3u %6zu", channelCount, frameCount);
+        printRate(interleaved, genericInterleaved, channelCount);
+        printRate(deinterleaved, genericDeinterleaved, channelCount);
+        const bool matches = matchesGeneric(interleave, deinterleave, channelCount, frameCount);
+        std::printf("%s\n", matches ? "" : "  MISMATCH");
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool quick = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else {
+            std::fprintf(stderr, "Usage: %s [--quick]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const std::vector<uint32_t> channelCounts =
+            quick ? std::vector<uint32_t>{2, 8} : std::vector<uint32_t>{1, 2, 3, 4, 6, 8};
+    const std::vector<size_t> frameCounts =
+            quick ? std::vector<size_t>{512} : std::vector<size_t>{64, 256, 1024, 4096};
+
+    std::printf("Instruction set: %s; cycles are %s\n", kernels::getActiveInstructionSet(),
+                bench::kHasCycleCounter ? "TSC reference cycles" : "unavailable");
+    std::printf("%10s %-33s %-33s\n", "", "interleave", "deinterleave");
+    std::printf("%3s %6s %9s %9s %7s %5s %9s %9s %7s %5s\n", "ch", "frames", "ns/frame",
+                "cyc/frame", "GB/s", "x", "ns/frame", "cyc/frame", "GB/s", "x");
+    for (const uint32_t channels : channelCounts) {
+        for (const size_t frames : frameCounts) { run(channels, frames); }
+    }
+    return 0;
+}
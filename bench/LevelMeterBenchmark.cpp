@@ -0,0 +1,78 @@
+// Measures `LevelMeter::process()` for each channel layout and block size, in nanoseconds and
+// cycles per sample, including publishing a snapshot at the end of every 20 ms window.
+//
+// The instruction set is the one the kernels select at run time; bench_level_meter_sse2 and
+// bench_level_meter_portable are built with it capped, for comparison on the same machine.
+//
+// Usage: bench_level_meter [--quick]
+
+#include "BenchSupport.h"
+#include "InterleaveKernels.h"
+#include "LevelMeter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr double kSampleRate = 48000.0;
+    // Each row meters about this many samples per trial, whatever the block size.
+    constexpr size_t kSamplesPerTrial = size_t{1} << 22;
+    constexpr int kTrials = 7;
+
+    void run(uint32_t channelCount, size_t frameCount)
+    {
+        const size_t sampleCount = frameCount * channelCount;
+        std::vector<float> samples(sampleCount);
+        for (size_t i = 0; i < sampleCount; ++i) {
+            samples[i] = 0.5f * static_cast<float>(std::sin(0.01 * static_cast<double>(i)));
+        }
+
+        LevelMeter meter(channelCount, kSampleRate);
+        const int repetitions = static_cast<int>(kSamplesPerTrial / sampleCount);
+        const bench::Measurement perSample =
+                bench::measureBest(kTrials, repetitions,
+                                   [&]
+                                   {
+                                       meter.process(samples.data(), sampleCount);
+                                       bench::clobberMemory();
+                                   })
+                        .per(static_cast<double>(sampleCount));
+
+        LevelSnapshot levels;
+        bench::doNotOptimize(meter.read(levels));
+
+        std::printf("%3u %6zu %9.3f", channelCount, frameCount, perSample.nanoseconds);
+        bench::printCycles(perSample.cycles, 9, 3);
+        std::printf(" %9.1f\n", 1e3 / perSample.nanoseconds);
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool quick = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else {
+            std::fprintf(stderr, "Usage: %s [--quick]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const std::vector<uint32_t> channelCounts =
+            quick ? std::vector<uint32_t>{2} : std::vector<uint32_t>{1, 2, 6, 8};
+    const std::vector<size_t> frameCounts =
+            quick ? std::vector<size_t>{512} : std::vector<size_t>{32, 128, 512, 4096};
+
+    std::printf("Instruction set: %s; cycles are %s\n", kernels::getActiveInstructionSet(),
+                bench::kHasCycleCounter ? "TSC reference cycles" : "unavailable");
+    std::printf("%3s %6s %9s %9s %9s\n", "ch", "frames", "ns/smp", "cyc/smp", "Msmp/s");
+    for (const uint32_t channels : channelCounts) {
+        for (const size_t frames : frameCounts) { run(channels, frames); }
+    }
+    return 0;
+}
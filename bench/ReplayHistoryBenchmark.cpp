@@ -0,0 +1,177 @@
+// Measures `ReplayHistoryBuffer` as instant replay uses it: a stereo 48 kHz history of 30 s plus
+// the recorder's 5 s of snapshot headroom. First the writer's cost per callback at several
+// buffer sizes, then a 30 s snapshot into a sink that discards it, taken with no writer, with a
+// writer thread delivering 512-frame blocks at real time, and with one writing flat out. For
+// the snapshot it reports the time taken, the cost per frame saved and how much of the 30 s came
+// out before the writer overtook it; a snapshot cut short is timed only up to the cut.
+//
+// Usage: bench_replay_history [--quick]
+
+#include "BenchSupport.h"
+#include "ReplayHistoryBuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr double kSampleRate = 48000.0;
+    constexpr uint32_t kChannelCount = 2;
+    constexpr int kHistorySeconds = 30;
+    constexpr int kHeadroomSeconds = 5;
+    constexpr size_t kRealTimeBlockFrames = 512;
+
+    class DiscardingSink : public SampleSink
+    {
+    public:
+        auto write(const float *interleaved, size_t frameCount) -> bool override
+        {
+            bench::doNotOptimize(interleaved[frameCount * kChannelCount - 1]);
+            return true;
+        }
+        auto finalize() -> bool override { return true; }
+    };
+
+    auto makeBlock(size_t frameCount) -> std::vector<float>
+    {
+        std::vector<float> samples(frameCount * kChannelCount);
+        for (size_t i = 0; i < samples.size(); ++i) {
+            samples[i] = 0.25f * static_cast<float>(std::sin(0.01 * static_cast<double>(i)));
+        }
+        return samples;
+    }
+
+    // Fills the whole history once, so every later measurement runs on resident memory.
+    void fillHistory(ReplayHistoryBuffer &history)
+    {
+        const std::vector<float> block = makeBlock(4096);
+        for (size_t frame = 0; frame < history.getCapacityInFrames(); frame += 4096) {
+            history.write(block.data(), block.size());
+        }
+    }
+
+    void runWrite(ReplayHistoryBuffer &history, size_t frameCount, int trials)
+    {
+        const std::vector<float> block = makeBlock(frameCount);
+        const int repetitions = static_cast<int>(std::max<size_t>(1000, (1u << 20) / block.size()));
+        const bench::Measurement perCall = bench::measureBest(
+                trials, repetitions,
+                [&]
+                {
+                    history.write(block.data(), block.size());
+                    bench::clobberMemory();
+                });
+        const bench::Measurement perFrame = perCall.per(static_cast<double>(frameCount));
+        const double budget = 1e9 * static_cast<double>(frameCount) / kSampleRate;
+
+        std::printf("%6zu %9.1f %9.3f", frameCount, perCall.nanoseconds, perFrame.nanoseconds);
+        bench::printCycles(perFrame.cycles);
+        std::printf(" %9.4f\n", 100.0 * perCall.nanoseconds / budget);
+    }
+
+    enum class Writer
+    {
+        None,
+        RealTime,
+        FlatOut,
+    };
+
+    void runSnapshot(ReplayHistoryBuffer &history, Writer writer, int trials)
+    {
+        std::atomic<bool> running{true};
+        std::thread thread;
+        if (writer != Writer::None) {
+            thread = std::thread(
+                    [&]
+                    {
+                        const std::vector<float> block = makeBlock(kRealTimeBlockFrames);
+                        const auto interval = std::chrono::duration_cast<
+                                std::chrono::steady_clock::duration>(std::chrono::duration<double>(
+                                static_cast<double>(kRealTimeBlockFrames) / kSampleRate));
+                        auto next = std::chrono::steady_clock::now();
+                        while (running.load(std::memory_order_relaxed)) {
+                            history.write(block.data(), block.size());
+                            if (writer == Writer::RealTime) {
+                                next += interval;
+                                std::this_thread::sleep_until(next);
+                            }
+                        }
+                    });
+        }
+
+        const auto frames = static_cast<size_t>(kHistorySeconds * kSampleRate);
+        // A snapshot cut short is quicker, so trials are compared by the cost per frame saved.
+        bench::Measurement best{};
+        size_t bestSaved = 0;
+        size_t fewestSaved = frames;
+        for (int trial = 0; trial < trials; ++trial) {
+            DiscardingSink sink;
+            size_t saved = 0;
+            const bench::Measurement m =
+                    bench::measure([&] { saved = history.writeLatestTo(sink, frames); });
+            fewestSaved = std::min(fewestSaved, saved);
+            if (saved == 0) { continue; }
+            const double perSaved = m.nanoseconds / static_cast<double>(saved);
+            if (bestSaved == 0 || perSaved < best.nanoseconds / static_cast<double>(bestSaved)) {
+                best = m;
+                bestSaved = saved;
+            }
+        }
+        running.store(false);
+        if (thread.joinable()) { thread.join(); }
+
+        const char *name = writer == Writer::None       ? "none"
+                           : writer == Writer::RealTime ? "realtime"
+                                                        : "flat-out";
+        const bench::Measurement perFrame =
+                best.per(static_cast<double>(std::max<size_t>(bestSaved, 1)));
+        std::printf("%-8s %9.2f %9.3f", name, best.nanoseconds / 1e6, perFrame.nanoseconds);
+        bench::printCycles(perFrame.cycles);
+        std::printf(" %7.1f\n", 100.0 * static_cast<double>(fewestSaved) /
+                                        static_cast<double>(frames));
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool quick = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else {
+            std::fprintf(stderr, "Usage: %s [--quick]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const int trials = quick ? 3 : 7;
+    const std::vector<size_t> frameCounts =
+            quick ? std::vector<size_t>{512} : std::vector<size_t>{32, 128, 512, 4096};
+
+    ReplayHistoryBuffer history(
+            kChannelCount,
+            static_cast<size_t>((kHistorySeconds + kHeadroomSeconds) * kSampleRate));
+    fillHistory(history);
+
+    std::printf("%u channels at %.0f Hz, %d s history plus %d s headroom; cycles are %s\n",
+                kChannelCount, kSampleRate, kHistorySeconds, kHeadroomSeconds,
+                bench::kHasCycleCounter ? "TSC reference cycles" : "unavailable");
+    std::printf("%6s %9s %9s %9s %9s\n", "frames", "ns/write", "ns/frame", "cyc/frame",
+                "%budget");
+    for (const size_t frames : frameCounts) { runWrite(history, frames, trials); }
+
+    std::printf("\n%d s snapshot, best of %d; saved%% is the worst trial\n", kHistorySeconds,
+                trials);
+    std::printf("%-8s %9s %9s %9s %7s\n", "writer", "ms", "ns/frame", "cyc/frame", "saved%");
+    for (const Writer writer : {Writer::None, Writer::RealTime, Writer::FlatOut}) {
+        runSnapshot(history, writer, trials);
+    }
+    return 0;
+}
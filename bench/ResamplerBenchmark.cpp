@@ -0,0 +1,210 @@
+// Measures the resampler for each quality preset and common rate pairs: throughput in
+// nanoseconds and cycles per input frame (stereo, 512-frame blocks) and how many times faster
+// than real time that is, plus two measures of conversion quality:
+//
+//   - THD+N of a 1 kHz tone at -1 dBFS: everything in the output but the tone, relative to it.
+//     Images left by upsampling count as noise here.
+//   - Aliasing when downsampling: a tone between the output and input Nyquist frequencies
+//     cannot be represented, so whatever comes out is aliased energy, relative to the input.
+//
+// The instruction set is the one the kernels select at run time; bench_resampler_sse2 and
+// bench_resampler_portable are built with it capped, for comparison on the same machine.
+//
+// Usage: bench_resampler [--quick]
+
+#include "BenchSupport.h"
+#include "InterleaveKernels.h"
+#include "Resampler.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr uint32_t kChannelCount = 2;
+    constexpr size_t kBlockFrames = 512;
+    constexpr double kTwoPi = 6.283185307179586;
+
+    struct RatePair
+    {
+        double input;
+        double output;
+    };
+
+    auto getName(ResamplerQuality quality) -> const char *
+    {
+        switch (quality) {
+        case ResamplerQuality::Fast: return "fast";
+        case ResamplerQuality::Balanced: return "balanced";
+        case ResamplerQuality::Best: return "best";
+        }
+        return "";
+    }
+
+    auto makeTone(double frequency, double rate, size_t frameCount, double amplitude)
+            -> std::vector<float>
+    {
+        std::vector<float> samples(frameCount * kChannelCount);
+        for (size_t f = 0; f < frameCount; ++f) {
+            const auto value = static_cast<float>(
+                    amplitude * std::sin(kTwoPi * frequency * static_cast<double>(f) / rate));
+            for (uint32_t ch = 0; ch < kChannelCount; ++ch) {
+                samples[f * kChannelCount + ch] = value;
+            }
+        }
+        return samples;
+    }
+
+    // Converts all of `input` in blocks, as `ResamplingSink` does, and flushes.
+    auto convert(Resampler &resampler, const std::vector<float> &input) -> std::vector<float>
+    {
+        std::vector<float> output;
+        output.reserve(input.size() * 3);
+        const size_t frameCount = input.size() / kChannelCount;
+        for (size_t frame = 0; frame < frameCount; frame += kBlockFrames) {
+            resampler.process(input.data() + frame * kChannelCount,
+                              std::min(kBlockFrames, frameCount - frame), output);
+        }
+        resampler.flush(output);
+        return output;
+    }
+
+    auto toDecibels(double ratio) -> double
+    {
+        return 20.0 * std::log10(std::max(ratio, 1e-12));
+    }
+
+    // Ratio of everything but the `frequency` tone to the tone in the first channel of
+    // `samples`, skipping the edges where the filter is still filling. The tone is fitted by
+    // least squares, so its phase and level do not have to be known.
+    auto measureThdPlusNoise(const std::vector<float> &samples, double frequency, double rate)
+            -> double
+    {
+        const size_t frameCount = samples.size() / kChannelCount;
+        const size_t edge = frameCount / 8;
+        double ss = 0.0, sc = 0.0, cc = 0.0, ys = 0.0, yc = 0.0;
+        for (size_t f = edge; f < frameCount - edge; ++f) {
+            const double t = kTwoPi * frequency * static_cast<double>(f) / rate;
+            const double s = std::sin(t), c = std::cos(t), y = samples[f * kChannelCount];
+            ss += s * s;
+            sc += s * c;
+            cc += c * c;
+            ys += y * s;
+            yc += y * c;
+        }
+        const double determinant = ss * cc - sc * sc;
+        const double a = (ys * cc - yc * sc) / determinant;
+        const double b = (yc * ss - ys * sc) / determinant;
+
+        double tone = 0.0, residual = 0.0;
+        for (size_t f = edge; f < frameCount - edge; ++f) {
+            const double t = kTwoPi * frequency * static_cast<double>(f) / rate;
+            const double fitted = a * std::sin(t) + b * std::cos(t);
+            const double error = samples[f * kChannelCount] - fitted;
+            tone += fitted * fitted;
+            residual += error * error;
+        }
+        return std::sqrt(residual / tone);
+    }
+
+    auto measureRms(const std::vector<float> &samples) -> double
+    {
+        const size_t frameCount = samples.size() / kChannelCount;
+        const size_t edge = frameCount / 8;
+        double sum = 0.0;
+        for (size_t f = edge; f < frameCount - edge; ++f) {
+            sum += double{samples[f * kChannelCount]} * samples[f * kChannelCount];
+        }
+        return std::sqrt(sum / static_cast<double>(frameCount - 2 * edge));
+    }
+
+    void run(ResamplerQuality quality, const RatePair &rates, double seconds)
+    {
+        const auto inputFrames = static_cast<size_t>(rates.input * seconds);
+        const std::vector<float> music = makeTone(997.0, rates.input, inputFrames, 0.5);
+
+        // Throughput: the best of several runs over fresh resamplers, not counting set-up.
+        bench::Measurement best{};
+        size_t taps = 0;
+        for (int trial = 0; trial < 5; ++trial) {
+            Resampler resampler(kChannelCount, rates.input, rates.output, quality);
+            taps = resampler.getTapCount();
+            std::vector<float> output;
+            output.reserve(static_cast<size_t>(inputFrames * rates.output / rates.input + 1024) *
+                           kChannelCount);
+            const bench::Measurement m = bench::measure(
+                    [&]
+                    {
+                        for (size_t frame = 0; frame < inputFrames; frame += kBlockFrames) {
+                            resampler.process(music.data() + frame * kChannelCount,
+                                              std::min(kBlockFrames, inputFrames - frame),
+                                              output);
+                        }
+                        resampler.flush(output);
+                    });
+            bench::doNotOptimize(output.data());
+            if (trial == 0 || m.nanoseconds < best.nanoseconds) { best = m; }
+        }
+        const bench::Measurement perFrame = best.per(static_cast<double>(inputFrames));
+        const double realTime = 1e9 / (perFrame.nanoseconds * rates.input);
+
+        // Quality, on a second of audio.
+        const size_t qualityFrames = static_cast<size_t>(rates.input);
+        Resampler toneResampler(kChannelCount, rates.input, rates.output, quality);
+        const std::vector<float> tone = convert(
+                toneResampler, makeTone(1000.0, rates.input, qualityFrames, std::pow(10.0, -0.05)));
+        const double thdPlusNoise = measureThdPlusNoise(tone, 1000.0, rates.output);
+
+        std::printf("%-8s %6.0f %6.0f %5zu %9.2f", getName(quality), rates.input, rates.output,
+                    taps, perFrame.nanoseconds);
+        bench::printCycles(perFrame.cycles, 10, 1);
+        std::printf(" %8.0f %8.1f", realTime, toDecibels(thdPlusNoise));
+
+        if (rates.output < rates.input) {
+            // Not a simple fraction of either rate, which could line up with filter zeros.
+            const double frequency = rates.output / 2.0 + 0.37 * (rates.input - rates.output) / 2.0;
+            const std::vector<float> input =
+                    makeTone(frequency, rates.input, qualityFrames, std::pow(10.0, -0.05));
+            Resampler aliasResampler(kChannelCount, rates.input, rates.output, quality);
+            const std::vector<float> aliased = convert(aliasResampler, input);
+            std::printf(" %8.1f\n", toDecibels(measureRms(aliased) / measureRms(input)));
+        } else {
+            std::printf(" %8s\n", "-");
+        }
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool quick = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else {
+            std::fprintf(stderr, "Usage: %s [--quick]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // 47999 has no small common factor with 44100, so it exercises interpolated phases.
+    const std::vector<RatePair> pairs =
+            quick ? std::vector<RatePair>{{48000.0, 44100.0}}
+                  : std::vector<RatePair>{{44100.0, 48000.0}, {48000.0, 44100.0},
+                                          {48000.0, 96000.0}, {96000.0, 48000.0},
+                                          {44100.0, 47999.0}};
+    const double seconds = quick ? 1.0 : 4.0;
+
+    std::printf("Instruction set: %s; stereo; cycles are %s\n",
+                kernels::getActiveInstructionSet(),
+                bench::kHasCycleCounter ? "TSC reference cycles" : "unavailable");
+    std::printf("%-8s %6s %6s %5s %9s %10s %8s %8s %8s\n", "quality", "in", "out", "taps",
+                "ns/frame", "cyc/frame", "xRT", "THD+N", "alias");
+    for (const ResamplerQuality quality :
+         {ResamplerQuality::Fast, ResamplerQuality::Balanced, ResamplerQuality::Best}) {
+        for (const RatePair &rates : pairs) { run(quality, rates, seconds); }
+    }
+    return 0;
+}
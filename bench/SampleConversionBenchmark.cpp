@@ -0,0 +1,117 @@
+// Measures float to integer PCM conversion for each output format, with and without TPDF
+// dither, in samples per second and cycles per sample. Dithered rows include generating the
+// noise, as the writers do.
+//
+// The instruction set is the one the kernels select at run time; bench_sample_conversion_sse2
+// and bench_sample_conversion_portable are built with it capped, for comparison on the same
+// machine.
+//
+// Usage: bench_sample_conversion [--quick]
+
+#include "BenchSupport.h"
+#include "InterleaveKernels.h"
+#include "SampleConversion.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    // Each row converts about this many samples per trial, whatever the block size.
+    constexpr size_t kSamplesPerTrial = size_t{1} << 22;
+    constexpr int kTrials = 7;
+
+    enum class Format
+    {
+        Int16,
+        Int24,
+        Int32
+    };
+
+    auto getName(Format format) -> const char *
+    {
+        switch (format) {
+        case Format::Int16: return "int16";
+        case Format::Int24: return "int24";
+        case Format::Int32: return "int32/24";
+        }
+        return "";
+    }
+
+    void run(Format format, bool dither, size_t sampleCount)
+    {
+        std::vector<float> source(sampleCount);
+        for (size_t i = 0; i < sampleCount; ++i) {
+            // Slightly beyond full scale now and then, so clamping is exercised.
+            source[i] = 1.1f * static_cast<float>(static_cast<int>(i * 7919 % 2001) - 1000) /
+                        1000.0f;
+        }
+        std::vector<float> noise(sampleCount);
+        std::vector<int16_t> int16(sampleCount);
+        std::vector<uint8_t> int24(sampleCount * 3);
+        std::vector<int32_t> int32(sampleCount);
+        TpdfDither generator;
+
+        const int repetitions = static_cast<int>(kSamplesPerTrial / sampleCount);
+        const bench::Measurement total = bench::measureBest(
+                kTrials, repetitions,
+                [&]
+                {
+                    const float *noisePointer = nullptr;
+                    if (dither) {
+                        generator.generate(noise.data(), sampleCount);
+                        noisePointer = noise.data();
+                    }
+                    switch (format) {
+                    case Format::Int16:
+                        kernels::floatToInt16(source.data(), noisePointer, sampleCount,
+                                              int16.data());
+                        break;
+                    case Format::Int24:
+                        kernels::floatToInt24(source.data(), noisePointer, sampleCount,
+                                              int24.data());
+                        break;
+                    case Format::Int32:
+                        kernels::floatToInt32(source.data(), noisePointer, sampleCount, 24,
+                                              int32.data());
+                        break;
+                    }
+                    bench::clobberMemory();
+                });
+        const bench::Measurement perSample = total.per(static_cast<double>(sampleCount));
+
+        std::printf("%-8s %-6s %6zu %9.3f", getName(format), dither ? "tpdf" : "none",
+                    sampleCount, perSample.nanoseconds);
+        bench::printCycles(perSample.cycles);
+        std::printf(" %10.1f\n", 1e3 / perSample.nanoseconds);
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool quick = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else {
+            std::fprintf(stderr, "Usage: %s [--quick]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const std::vector<size_t> sampleCounts =
+            quick ? std::vector<size_t>{1024} : std::vector<size_t>{256, 1024, 8192};
+
+    std::printf("Instruction set: %s; cycles are %s\n", kernels::getActiveInstructionSet(),
+                bench::kHasCycleCounter ? "TSC reference cycles" : "unavailable");
+    std::printf("%-8s %-6s %6s %9s %9s %10s\n", "format", "dither", "count", "ns/smp",
+                "cyc/smp", "Msmp/s");
+    for (const Format format : {Format::Int16, Format::Int24, Format::Int32}) {
+        for (const bool dither : {false, true}) {
+            for (const size_t count : sampleCounts) { run(format, dither, count); }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+// Replays a synthetic listening session through the file sink chain the recorder builds
+// (`utils::createFileSink`), once without silence gating and once with it, for CAF and FLAC.
+// The session is songs separated by gaps, half of them digital silence and half a -66 dBFS
+// noise floor, with longer silence before the first song and after the last, like a side of a
+// record being digitised. The gate closes after one second below -60 dBFS.
+//
+// Reported per configuration: the bytes written per second of session, the file size and the
+// share of the session it stores, and the writer's cost in nanoseconds per frame and as a
+// multiple of real time on one core. Only the sink calls are timed, not generating the audio.
+//
+// Usage: bench_silence_gating [--quick]
+
+#include "BenchSupport.h"
+#include "FileSinkFactory.h"
+#include "SilenceIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr double kSampleRate = 48000.0;
+    constexpr uint32_t kChannelCount = 2;
+    constexpr size_t kBlockFrames = 512;
+    constexpr double kTwoPi = 6.283185307179586;
+    constexpr float kThreshold = 0.001f; // -60 dBFS
+    constexpr double kHoldSeconds = 1.0;
+
+    struct Part
+    {
+        enum class Kind
+        {
+            Song,
+            Silence,
+            Noise,
+        };
+        Kind kind;
+        uint64_t frameCount;
+        double frequency; // Songs only.
+    };
+
+    auto makeSession(int songCount, double songSeconds) -> std::vector<Part>
+    {
+        std::mt19937 random(3);
+        std::uniform_real_distribution<double> gapSeconds(2.0, 8.0);
+        std::uniform_int_distribution<int> semitone(-12, 12);
+        auto frames = [](double seconds) { return static_cast<uint64_t>(seconds * kSampleRate); };
+
+        std::vector<Part> parts{{Part::Kind::Silence, frames(20.0), 0.0}};
+        for (int song = 0; song < songCount; ++song) {
+            if (song > 0) {
+                const auto kind = song % 2 == 0 ? Part::Kind::Silence : Part::Kind::Noise;
+                parts.push_back({kind, frames(gapSeconds(random)), 0.0});
+            }
+            parts.push_back({Part::Kind::Song, frames(songSeconds),
+                             220.0 * std::pow(2.0, semitone(random) / 12.0)});
+        }
+        parts.push_back({Part::Kind::Silence, frames(30.0), 0.0});
+        return parts;
+    }
+
+    // Renders the session block by block, so an hour of it needs no more than a block of memory.
+    class SessionPlayer
+    {
+    public:
+        explicit SessionPlayer(const std::vector<Part> &parts) : parts_(parts) {}
+
+        // Fills up to `kBlockFrames` frames; returns how many, zero at the end.
+        auto render(float *interleaved) -> size_t
+        {
+            size_t rendered = 0;
+            while (rendered < kBlockFrames && part_ < parts_.size()) {
+                const Part &part = parts_[part_];
+                const auto count = static_cast<size_t>(
+                        std::min<uint64_t>(kBlockFrames - rendered, part.frameCount - position_));
+                float *out = interleaved + rendered * kChannelCount;
+                for (size_t f = 0; f < count; ++f) {
+                    float left = 0.0f, right = 0.0f;
+                    if (part.kind == Part::Kind::Noise) {
+                        left = floor_(random_);
+                        right = floor_(random_);
+                    } else if (part.kind == Part::Kind::Song) {
+                        const double t = static_cast<double>(position_ + f) / kSampleRate;
+                        const double phase = kTwoPi * part.frequency * t;
+                        // A chord with a slow swell, so the level varies through the song.
+                        const double level = 0.2 + 0.1 * std::sin(kTwoPi * 0.1 * t);
+                        const double chord = std::sin(phase) + 0.5 * std::sin(1.25 * phase) +
+                                             0.3 * std::sin(1.5 * phase);
+                        left = static_cast<float>(level * chord + floor_(random_));
+                        right = static_cast<float>(level * (chord + 0.2 * std::sin(2.0 * phase)) +
+                                                   floor_(random_));
+                    }
+                    out[f * kChannelCount] = left;
+                    out[f * kChannelCount + 1] = right;
+                }
+                rendered += count;
+                position_ += count;
+                if (position_ == part.frameCount) {
+                    ++part_;
+                    position_ = 0;
+                }
+            }
+            return rendered;
+        }
+
+    private:
+        const std::vector<Part> &parts_;
+        size_t part_{0};
+        uint64_t position_{0};
+        std::mt19937 random_{4};
+        std::uniform_real_distribution<float> floor_{-0.0005f, 0.0005f}; // About -66 dBFS
+    };
+
+    auto makeDeviceFormat() -> AudioStreamBasicDescription
+    {
+        AudioStreamBasicDescription format{};
+        format.mSampleRate = kSampleRate;
+        format.mFormatID = kAudioFormatLinearPCM;
+        format.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked;
+        format.mBitsPerChannel = 32;
+        format.mChannelsPerFrame = kChannelCount;
+        format.mFramesPerPacket = 1;
+        format.mBytesPerFrame = kChannelCount * sizeof(float);
+        format.mBytesPerPacket = format.mBytesPerFrame;
+        return format;
+    }
+
+    void run(const std::vector<Part> &parts, FileType fileType, bool gated,
+             const std::string &directory)
+    {
+        OutputFormat outputFormat;
+        outputFormat.fileType = fileType;
+        outputFormat.sampleFormat = fileType == FileType::Flac ? SampleFormat::Int24
+                                                               : SampleFormat::Float32;
+        if (gated) { outputFormat.silence = {kThreshold, kHoldSeconds}; }
+        const std::string path =
+                directory + (fileType == FileType::Flac ? "/session.flac" : "/session.caf");
+
+        auto sink = utils::createFileSink(makeDeviceFormat(), path, outputFormat);
+        if (!sink) {
+            std::fprintf(stderr, "Could not create %s\n", path.c_str());
+            return;
+        }
+
+        SessionPlayer player(parts);
+        std::vector<float> block(kBlockFrames * kChannelCount);
+        uint64_t frameCount = 0;
+        double nanoseconds = 0.0;
+        double cycles = 0.0;
+        bool ok = true;
+        for (size_t count = 0; ok && (count = player.render(block.data())) > 0;) {
+            const bench::Measurement m =
+                    bench::measure([&] { ok = sink->write(block.data(), count); });
+            nanoseconds += m.nanoseconds;
+            cycles += m.cycles;
+            frameCount += count;
+        }
+        const bench::Measurement finish = bench::measure([&] { ok = sink->finalize() && ok; });
+        nanoseconds += finish.nanoseconds;
+        cycles += finish.cycles;
+        if (!ok) {
+            std::fprintf(stderr, "Could not write %s\n", path.c_str());
+            return;
+        }
+
+        std::error_code error;
+        const auto fileBytes = static_cast<double>(std::filesystem::file_size(path, error));
+        const auto index = SilenceIndex::load(SilenceIndex::getIndexPath(path));
+        const uint64_t silentFrames = index ? index->getSilentFrameCount() : 0;
+        const double seconds = static_cast<double>(frameCount) / kSampleRate;
+        const double perFrame = nanoseconds / static_cast<double>(frameCount);
+
+        std::printf("%-5s %-4s %8.0f %9.1f %9.2f %7.1f %9.2f",
+                    fileType == FileType::Flac ? "flac" : "caf", gated ? "on" : "off", seconds,
+                    fileBytes / seconds / 1000.0, fileBytes / 1e6,
+                    100.0 * static_cast<double>(frameCount - silentFrames) /
+                            static_cast<double>(frameCount),
+                    perFrame);
+        bench::printCycles(cycles / static_cast<double>(frameCount), 9, 1);
+        std::printf(" %8.0f\n", 1e9 / (perFrame * kSampleRate));
+
+        std::filesystem::remove(path, error);
+        std::filesystem::remove(SilenceIndex::getIndexPath(path), error);
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool quick = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else {
+            std::fprintf(stderr, "Usage: %s [--quick]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const std::vector<Part> parts = quick ? makeSession(3, 20.0) : makeSession(8, 180.0);
+    const std::filesystem::path directory =
+            std::filesystem::temp_directory_path() / "pg_bench_silence_gating";
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+
+    std::printf("Stereo 48 kHz, %zu-frame writes; gate at -60 dBFS held for %.0f s; "
+                "cycles are %s\n",
+                kBlockFrames, kHoldSeconds,
+                bench::kHasCycleCounter ? "TSC reference cycles" : "unavailable");
+    std::printf("%-5s %-4s %8s %9s %9s %7s %9s %9s %8s\n", "file", "gate", "session", "kB/s",
+                "MB", "stored%", "ns/frame", "cyc/frame", "x rt");
+    for (const FileType fileType : {FileType::Caf, FileType::Flac}) {
+        run(parts, fileType, false, directory.string());
+        run(parts, fileType, true, directory.string());
+    }
+
+    std::filesystem::remove_all(directory, error);
+    return 0;
+}
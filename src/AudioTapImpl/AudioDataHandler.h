@@ -1,9 +1,20 @@
 #pragma once
 
-#include <CoreAudio/CoreAudio.h>
-#include <JuceHeader.h>
-#include <atomic>
-#include <functional>
+#include "CaptureBroadcaster.h"
+#include "CaptureTimeline.h"
+#include "CaptureWriter.h"
+#include "CoreAudioTypes.h"
+#include "DropoutDetector.h"
+#include "DropoutLog.h"
+#include "InterleaveKernels.h"
+#include "LevelMeter.h"
+#include "MetricsRegistry.h"
+#include "RealtimeMemoryPool.h"
+#include "SampleSink.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 namespace pg {
@@ -12,21 +23,104 @@ namespace audio_tap {
     class AudioDataHandler
     {
     public:
-        AudioDataHandler(const AudioStreamBasicDescription &format, int durationInSeconds);
+        struct BufferOptions
+        {
+            // Sizes the queue between the IOProc and the writer thread. It bounds how long the
+            // writer may stall, not how long the recording may last.
+            int durationInSeconds{30};
+            // Audio kept prefaulted ahead of the IOProc so it never writes to a cold page.
+            int prefaultedSeconds{2};
+            // Additionally lock the prefaulted pages into RAM.
+            bool lockMemory{false};
+            // How often the file is flushed and its header updated, bounding what a crash can
+            // lose. Zero disables checkpoints.
+            int checkpointIntervalSeconds{2};
+        };
+
+        AudioDataHandler(const AudioStreamBasicDescription &format,
+                         std::unique_ptr<SampleSink> sink, const BufferOptions &options);
+
+        // Also publishes every interleaved block to `broadcaster`. Call before `start()`.
+        void setBroadcaster(std::shared_ptr<CaptureBroadcaster> broadcaster);
+
+        // Also meters every interleaved block with `meter`. Call before `start()`.
+        void setMeter(std::shared_ptr<LevelMeter> meter);
+
+        // Where this handler's audio starts in the recording, and the recording's sample rate.
+        // Positions given to the timeline and dropout log are in recording frames. Defaults to
+        // frame zero at the capture rate. Call before `start()`.
+        void setRecordingPosition(uint64_t firstFrame, double recordingRate);
+
+        // Also notes in `timeline` where each callback's audio lands in the recording and when
+        // it was captured. Call before `start()`.
+        void setTimeline(std::shared_ptr<CaptureTimeline> timeline);
+
+        // Also checks the device sample times for gaps and overlaps and reports them, along
+        // with blocks the writer had to drop, to `log`. With `fillGaps`, gaps are written as
+        // silence and overlaps trimmed so the recording stays sample-accurate. Filling runs on
+        // the IOProc, so at most one second of silence is written per gap; the rest of a longer
+        // gap is logged as unfilled and the recording falls behind by that much. Call before
+        // `start()`.
+        void setDropoutLog(std::shared_ptr<DropoutLog> log, bool fillGaps);
 
-        // Called from the real-time audio thread (IOProc)
-        void process(const AudioBufferList *inInputData);
+        // Reports the time from `requested` to the first callback as the time-to-first-sample
+        // metric. Call before `start()`, and only for the handler that begins a recording.
+        void setStartRequestTime(std::chrono::steady_clock::time_point requested);
 
-        // Called from the main thread to save the buffer
-        void saveToFile(const juce::File &file, const AudioStreamBasicDescription &format);
+        // Called from the main thread before the IOProc is started.
+        auto start() -> bool;
 
-        // Set a callback to be invoked when the buffer is full
-        void setBufferFullCallback(std::function<void()> callback);
+        // Called from the real-time audio thread (IOProc). Accepts interleaved or non-interleaved
+        // buffer lists, as described by the session format, and always emits interleaved audio.
+        // `inputTime` is the time stamp of the first sample, if the device provided one.
+        void process(const AudioBufferList *inInputData,
+                     const AudioTimeStamp *inputTime = nullptr);
+
+        // Called from the main thread after the IOProc has been stopped. Writes out any queued
+        // audio and closes the sink. Returns false if any part of the recording failed to write.
+        auto finish() -> bool;
+
+        auto getDroppedSampleCount() const -> uint64_t;
+
+        // Diagnostics: count page faults taken inside `process()`. Off by default since it adds
+        // two system calls per callback.
+        void setPageFaultTrackingEnabled(bool shouldBeEnabled);
+        auto getRealtimePageFaultCount() const -> uint64_t;
 
     private:
-        std::vector<float> audioBuffer_;
-        std::atomic<size_t> bufferIndex_{0};
-        std::function<void()> onBufferFull_;
+        void processNonInterleaved(const AudioBufferList *inInputData, size_t skipFrames);
+        void deliver(const float *interleaved, size_t sampleCount);
+
+        void recordTimestamp(const AudioTimeStamp &inputTime);
+        // Returns the frames to leave out at the start of the callback.
+        auto checkContinuity(const AudioTimeStamp &inputTime, size_t frameCount) -> size_t;
+        void pushSilence(size_t frameCount);
+        auto getFrameCount(const AudioBufferList *inInputData) const -> size_t;
+        auto getRecordingFrame() const -> uint64_t;
+        auto toRecordingFrames(uint64_t captureFrames) const -> uint64_t;
+
+        const bool isNonInterleaved_;
+        const kernels::InterleaveFn interleave_; // Specialised for the session's channel count.
+        const double sampleRate_;
+        CaptureWriter writer_;
+        std::shared_ptr<CaptureBroadcaster> broadcaster_;
+        std::shared_ptr<LevelMeter> meter_;
+        std::shared_ptr<CaptureTimeline> timeline_;
+        std::shared_ptr<DropoutLog> dropouts_;
+        bool fillGaps_{false};
+        DropoutDetector detector_;
+        std::vector<float> silence_; // Zeros for filling gaps.
+        uint64_t firstRecordingFrame_{0};
+        double recordingRate_;
+        uint64_t queuedFrames_{0}; // Frames accepted by `writer_`; IOProc only.
+        std::vector<float> interleaveScratch_; // IOProc only.
+        PageFaultCounter pageFaults_;
+
+        MetricCounter &framesMetric_;
+        MetricCounter &droppedBlocksMetric_;
+        MetricGauge &firstSampleMetric_;
+        std::chrono::steady_clock::time_point startRequestTime_{};
+        bool awaitingFirstSample_{false}; // IOProc only once started.
     };
 
 } // namespace audio_tap
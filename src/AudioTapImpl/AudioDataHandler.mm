@@ -1,45 +1,273 @@
 #include "AudioDataHandler.h"
-#include "AudioDeviceUtils.h"
+#include "InterleaveKernels.h"
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
 
 namespace pg {
 namespace audio_tap {
 
+    namespace {
+        // Frames interleaved per pass when the device delivers one buffer per channel.
+        constexpr size_t kInterleaveChunkFrames = 1024;
+
+        // Upper bound on channels for the non-interleaved path, so the plane table can live on
+        // the stack.
+        constexpr UInt32 kMaxPlanarChannels = 64;
+
+        // Most silence written for one gap; the rest of a longer one (e.g. across a sleep) is
+        // logged as unfilled, so the IOProc never spends long filling.
+        constexpr double kMaxGapFillSeconds = 1.0;
+    } // namespace
+
     AudioDataHandler::AudioDataHandler(const AudioStreamBasicDescription &format,
-                                       int durationInSeconds)
+                                       std::unique_ptr<SampleSink> sink,
+                                       const BufferOptions &options)
+      : isNonInterleaved_((format.mFormatFlags & kAudioFormatFlagIsNonInterleaved) != 0),
+        interleave_(kernels::selectInterleave(format.mChannelsPerFrame)),
+        sampleRate_(format.mSampleRate),
+        writer_(format.mChannelsPerFrame,
+                {static_cast<size_t>(format.mSampleRate * options.durationInSeconds),
+                 static_cast<size_t>(format.mSampleRate * options.prefaultedSeconds),
+                 options.lockMemory, static_cast<double>(options.checkpointIntervalSeconds)},
+                std::move(sink)),
+        recordingRate_(format.mSampleRate),
+        interleaveScratch_(isNonInterleaved_ ? kInterleaveChunkFrames * format.mChannelsPerFrame
+                                             : 0),
+        framesMetric_(MetricsRegistry::getDefault().counter(
+                "pg_capture_frames_captured_total",
+                "Frames queued for writing, including silence written over gaps.")),
+        droppedBlocksMetric_(MetricsRegistry::getDefault().counter(
+                "pg_capture_dropped_blocks_total",
+                "Callback blocks dropped because the writer had fallen behind.")),
+        firstSampleMetric_(MetricsRegistry::getDefault().gauge(
+                "pg_capture_time_to_first_sample_seconds",
+                "Time from the last recording request to its first captured audio."))
     {
-        audioBuffer_ = utils::allocateBufferForFormat(format, durationInSeconds);
     }
 
-    void AudioDataHandler::process(const AudioBufferList *inInputData)
+    void AudioDataHandler::setBroadcaster(std::shared_ptr<CaptureBroadcaster> broadcaster)
     {
-        for (UInt32 i = 0; i < inInputData->mNumberBuffers; ++i) {
-            auto *inputData = static_cast<float *>(inInputData->mBuffers[i].mData);
-            size_t samplesInBuffer = inInputData->mBuffers[i].mDataByteSize / sizeof(float);
-
-            size_t currentIndex = bufferIndex_.load();
-            if (currentIndex + samplesInBuffer < audioBuffer_.size()) {
-                std::copy(inputData, inputData + samplesInBuffer,
-                          audioBuffer_.begin() + currentIndex);
-                bufferIndex_.fetch_add(samplesInBuffer);
-            } else {
-                if (onBufferFull_) {
-                    onBufferFull_();
-                    onBufferFull_ = {}; // Reset after calling to make it a one-shot.
+        broadcaster_ = std::move(broadcaster);
+    }
+
+    void AudioDataHandler::setMeter(std::shared_ptr<LevelMeter> meter)
+    {
+        meter_ = std::move(meter);
+    }
+
+    void AudioDataHandler::setRecordingPosition(uint64_t firstFrame, double recordingRate)
+    {
+        firstRecordingFrame_ = firstFrame;
+        if (recordingRate > 0.0) { recordingRate_ = recordingRate; }
+    }
+
+    void AudioDataHandler::setTimeline(std::shared_ptr<CaptureTimeline> timeline)
+    {
+        timeline_ = std::move(timeline);
+    }
+
+    void AudioDataHandler::setDropoutLog(std::shared_ptr<DropoutLog> log, bool fillGaps)
+    {
+        dropouts_ = std::move(log);
+        fillGaps_ = fillGaps;
+        silence_.assign(fillGaps ? kInterleaveChunkFrames * writer_.getChannelCount() : 0, 0.0f);
+    }
+
+    void AudioDataHandler::setStartRequestTime(std::chrono::steady_clock::time_point requested)
+    {
+        startRequestTime_ = requested;
+        awaitingFirstSample_ = true;
+    }
+
+    auto AudioDataHandler::start() -> bool
+    {
+        return writer_.start();
+    }
+
+    void AudioDataHandler::process(const AudioBufferList *inInputData,
+                                   const AudioTimeStamp *inputTime)
+    {
+        PG_TRACE_SCOPE("AudioDataHandler::process");
+        pageFaults_.begin();
+
+        if (awaitingFirstSample_) {
+            awaitingFirstSample_ = false;
+            const std::chrono::duration<double> elapsed =
+                    std::chrono::steady_clock::now() - startRequestTime_;
+            firstSampleMetric_.set(elapsed.count());
+        }
+
+        // Gap filling moves the recording position, so it comes before the time stamp.
+        size_t skipFrames = 0;
+        if (dropouts_ && inputTime) {
+            skipFrames = checkContinuity(*inputTime, getFrameCount(inInputData));
+        }
+        if (timeline_ && inputTime) { recordTimestamp(*inputTime); }
+
+        if (isNonInterleaved_) {
+            processNonInterleaved(inInputData, skipFrames);
+        } else {
+            const UInt32 channelCount = writer_.getChannelCount();
+            for (UInt32 i = 0; i < inInputData->mNumberBuffers; ++i) {
+                const auto *samples = static_cast<const float *>(inInputData->mBuffers[i].mData);
+                const size_t sampleCount = inInputData->mBuffers[i].mDataByteSize / sizeof(float);
+                const size_t skipSamples = std::min(skipFrames * channelCount, sampleCount);
+                skipFrames -= skipSamples / channelCount;
+                if (skipSamples < sampleCount) {
+                    deliver(samples + skipSamples, sampleCount - skipSamples);
                 }
             }
         }
+
+        pageFaults_.end();
+    }
+
+    void AudioDataHandler::recordTimestamp(const AudioTimeStamp &inputTime)
+    {
+        if ((inputTime.mFlags & kAudioTimeStampHostTimeValid) == 0) { return; }
+
+        const double rateScalar = (inputTime.mFlags & kAudioTimeStampRateScalarValid) != 0
+                                          ? inputTime.mRateScalar
+                                          : 1.0;
+        timeline_->record(getRecordingFrame(), inputTime.mHostTime, rateScalar);
+    }
+
+    auto AudioDataHandler::checkContinuity(const AudioTimeStamp &inputTime, size_t frameCount)
+            -> size_t
+    {
+        if ((inputTime.mFlags & kAudioTimeStampSampleTimeValid) == 0) { return 0; }
+
+        const int64_t jump =
+                detector_.process(inputTime.mSampleTime, static_cast<uint32_t>(frameCount));
+        if (jump > 0) {
+            const auto missing = static_cast<uint64_t>(jump);
+            const uint64_t filled =
+                    fillGaps_ ? std::min(missing, static_cast<uint64_t>(sampleRate_ *
+                                                                        kMaxGapFillSeconds))
+                              : 0;
+            dropouts_->report({Dropout::Kind::Gap, getRecordingFrame(),
+                               toRecordingFrames(missing), toRecordingFrames(missing - filled)});
+            pushSilence(static_cast<size_t>(filled));
+            return 0;
+        }
+        if (jump < 0) {
+            const auto repeated = static_cast<uint64_t>(-jump);
+            dropouts_->report(
+                    {Dropout::Kind::Overlap, getRecordingFrame(), toRecordingFrames(repeated)});
+            return fillGaps_ ? static_cast<size_t>(std::min<uint64_t>(repeated, frameCount)) : 0;
+        }
+        return 0;
+    }
+
+    void AudioDataHandler::pushSilence(size_t frameCount)
+    {
+        const UInt32 channelCount = writer_.getChannelCount();
+        for (size_t offset = 0; offset < frameCount; offset += kInterleaveChunkFrames) {
+            const size_t chunkFrames = std::min(kInterleaveChunkFrames, frameCount - offset);
+            if (!writer_.push(silence_.data(), chunkFrames * channelCount)) {
+                droppedBlocksMetric_.add();
+                dropouts_->report({Dropout::Kind::Overflow, getRecordingFrame(),
+                                   toRecordingFrames(frameCount - offset)});
+                return;
+            }
+            queuedFrames_ += chunkFrames;
+            framesMetric_.add(chunkFrames);
+        }
+    }
+
+    auto AudioDataHandler::getFrameCount(const AudioBufferList *inInputData) const -> size_t
+    {
+        if (inInputData->mNumberBuffers == 0) { return 0; }
+        if (isNonInterleaved_) { return inInputData->mBuffers[0].mDataByteSize / sizeof(float); }
+
+        size_t sampleCount = 0;
+        for (UInt32 i = 0; i < inInputData->mNumberBuffers; ++i) {
+            sampleCount += inInputData->mBuffers[i].mDataByteSize / sizeof(float);
+        }
+        return sampleCount / writer_.getChannelCount();
+    }
+
+    auto AudioDataHandler::getRecordingFrame() const -> uint64_t
+    {
+        // Dropped blocks never reach the file, so only accepted frames advance the position.
+        return firstRecordingFrame_ + toRecordingFrames(queuedFrames_);
+    }
+
+    auto AudioDataHandler::toRecordingFrames(uint64_t captureFrames) const -> uint64_t
+    {
+        if (recordingRate_ == sampleRate_) { return captureFrames; }
+        return static_cast<uint64_t>(
+                std::llround(static_cast<double>(captureFrames) * recordingRate_ / sampleRate_));
+    }
+
+    void AudioDataHandler::processNonInterleaved(const AudioBufferList *inInputData,
+                                                 size_t skipFrames)
+    {
+        const UInt32 channelCount = writer_.getChannelCount();
+        if (inInputData->mNumberBuffers != channelCount || channelCount > kMaxPlanarChannels) {
+            return; // Does not match the session format; nothing sensible to record.
+        }
+
+        std::array<const float *, kMaxPlanarChannels> planes{};
+        size_t frameCount = SIZE_MAX;
+        for (UInt32 ch = 0; ch < channelCount; ++ch) {
+            planes[ch] = static_cast<const float *>(inInputData->mBuffers[ch].mData);
+            frameCount = std::min<size_t>(frameCount,
+                                          inInputData->mBuffers[ch].mDataByteSize / sizeof(float));
+        }
+
+        for (size_t offset = std::min(skipFrames, frameCount); offset < frameCount;
+             offset += kInterleaveChunkFrames) {
+            const size_t chunkFrames = std::min(kInterleaveChunkFrames, frameCount - offset);
+            std::array<const float *, kMaxPlanarChannels> chunkPlanes{};
+            for (UInt32 ch = 0; ch < channelCount; ++ch) { chunkPlanes[ch] = planes[ch] + offset; }
+
+            interleave_(chunkPlanes.data(), channelCount, chunkFrames, interleaveScratch_.data());
+            deliver(interleaveScratch_.data(), chunkFrames * channelCount);
+        }
+    }
+
+    void AudioDataHandler::deliver(const float *interleaved, size_t sampleCount)
+    {
+        // A full queue means the writer thread has stalled; the block is dropped and counted
+        // by the writer rather than holding up the IOProc.
+        const size_t frameCount = sampleCount / writer_.getChannelCount();
+        if (writer_.push(interleaved, sampleCount)) {
+            queuedFrames_ += frameCount;
+            framesMetric_.add(frameCount);
+        } else {
+            droppedBlocksMetric_.add();
+            if (dropouts_) {
+                dropouts_->report({Dropout::Kind::Overflow, getRecordingFrame(),
+                                   toRecordingFrames(frameCount)});
+            }
+        }
+        if (broadcaster_) { broadcaster_->publish(interleaved, sampleCount); }
+        if (meter_) { meter_->process(interleaved, sampleCount); }
+    }
+
+    auto AudioDataHandler::finish() -> bool
+    {
+        return writer_.stop();
+    }
+
+    auto AudioDataHandler::getDroppedSampleCount() const -> uint64_t
+    {
+        return writer_.getDroppedSampleCount();
     }
 
-    void AudioDataHandler::saveToFile(const juce::File &file,
-                                      const AudioStreamBasicDescription &format)
+    void AudioDataHandler::setPageFaultTrackingEnabled(bool shouldBeEnabled)
     {
-        audioBuffer_.resize(bufferIndex_.load());
-        if (!audioBuffer_.empty()) { utils::saveBufferToFile(format, file, audioBuffer_); }
+        pageFaults_.setEnabled(shouldBeEnabled);
     }
 
-    void AudioDataHandler::setBufferFullCallback(std::function<void()> callback)
+    auto AudioDataHandler::getRealtimePageFaultCount() const -> uint64_t
     {
-        onBufferFull_ = std::move(callback);
+        return pageFaults_.getFaultCount();
     }
 
 } // namespace audio_tap
@@ -1,40 +1,69 @@
 #pragma once
 
-#include <CoreAudio/CoreAudio.h>
-#include <vector>
+#include "CaptureFormat.h"
+#include "FileSinkFactory.h"
+#include "SampleSink.h"
+
+#include "CoreAudioTypes.h"
+#include <memory>
 
 namespace juce {
+class AudioFormatReader;
 class File;
 }
 
 namespace pg {
 namespace audio_tap {
+    class WaveformPyramid;
+
     namespace utils {
 
         /**
-         * @brief Finds the default audio output device for the system.
-         * @return The AudioDeviceID of the default output device, or kAudioObjectUnknown if not
-         * found or an error occurs.
+         * @brief Opens a CAF or FLAC file for incremental writing of captured audio.
+         *
+         * Audio is appended in chunks while recording is in progress, so closing the file at the
+         * end of a take only has to patch the header.
+         * @param format The ASBD describing the interleaved float audio that will be written.
+         * @param file The destination file. The file will be overwritten if it exists.
+         * @param outputFormat Container and sample format stored in the file. Integer conversion,
+         * dithering and FLAC encoding all run on the writer thread. If segmentation is enabled,
+         * `file` names the set: segments are written next to it with a numeric suffix, along
+         * with a `.segments` index. If silence gating is enabled, long silences are left out
+         * and listed in a `.silence` index; read the result with `createRecordingReader()`.
+         * A non-zero `outputFormat.sampleRate` converts the audio to that rate on the way in;
+         * `format` still describes the capture stream.
+         * @param waveform If given, fed with the audio as the file stores it (after rate
+         * conversion, before silence gating) and saved as a sidecar when the sink is finalized.
+         * It must have been created at the file's sample rate.
+         * @return A sink that appends to the file on every write, or nullptr if the file could
+         * not be created.
          */
-        AudioDeviceID getDefaultOutputDevice();
+        auto createFileSink(const AudioStreamBasicDescription &format, const juce::File &file,
+                            const OutputFormat &outputFormat = {},
+                            std::shared_ptr<WaveformPyramid> waveform = nullptr)
+                -> std::unique_ptr<SampleSink>;
 
         /**
-         * @brief Allocates a buffer to hold audio for a given format and duration.
-         * @param format The ASBD describing the audio format.
-         * @param durationInSeconds The desired duration of the buffer in seconds.
-         * @return A std::vector<float> pre-sized to hold the audio data.
+         * @brief Opens a single-file recording for reading.
+         *
+         * If the recording has a `.silence` index, the reader presents the full timeline and
+         * returns the silences left out by gating as zeros, so callers never see the gaps.
+         * @param file A CAF or FLAC file written by a sink from `createFileSink`.
+         * @return A float reader, or nullptr if the file cannot be opened.
          */
-        auto allocateBufferForFormat(const AudioStreamBasicDescription &format,
-                                     int durationInSeconds) -> std::vector<float>;
+        auto createRecordingReader(const juce::File &file)
+                -> std::unique_ptr<juce::AudioFormatReader>;
 
         /**
-         * @brief Saves a raw float audio buffer to a CAF file.
-         * @param format The ASBD describing the audio format of the raw buffer.
-         * @param file The destination file. The file will be overwritten if it exists.
-         * @param buffer The buffer containing the raw float audio data.
+         * @brief Writes a copy of a recording with any gated silence expanded back in.
+         * @param source A single-file recording, gated or not.
+         * @param destination The file to create. It will be overwritten if it exists.
+         * @param outputFormat Container, sample format and sample rate of the copy. Gating
+         * settings are ignored, so the copy is always full length.
+         * @return true if the whole recording was copied.
          */
-        void saveBufferToFile(const AudioStreamBasicDescription &format, const juce::File &file,
-                              const std::vector<float> &buffer);
+        auto exportRecording(const juce::File &source, const juce::File &destination,
+                             const OutputFormat &outputFormat = {}) -> bool;
 
     } // namespace utils
 } // namespace audio_tap
@@ -1,78 +1,145 @@
 #include "AudioDeviceUtils.h"
+#include "InterleaveKernels.h"
+#include "SilenceIndex.h"
 
 #include "JuceHeader.h"
-#include <AudioToolbox/ExtendedAudioFile.h>
+
+#include <algorithm>
+#include <utility>
 #include <vector>
 
 namespace pg {
 namespace audio_tap {
     namespace utils {
 
-        AudioDeviceID getDefaultOutputDevice()
+        namespace {
+            // Frames copied per pass by `exportRecording()`.
+            constexpr int kExportFramesPerBlock = 65536;
+
+            // Presents a silence-gated recording as its full timeline: stored audio comes from
+            // the wrapped reader, silent spans read as zeros.
+            class SilenceExpandingReader : public juce::AudioFormatReader
+            {
+            public:
+                SilenceExpandingReader(std::unique_ptr<juce::AudioFormatReader> source,
+                                       std::unique_ptr<SilenceIndex> index)
+                  : juce::AudioFormatReader(nullptr, source->getFormatName()),
+                    source_(std::move(source)),
+                    index_(std::move(index))
+                {
+                    sampleRate = source_->sampleRate;
+                    bitsPerSample = 32;
+                    usesFloatingPointData = true;
+                    numChannels = source_->numChannels;
+                    lengthInSamples = source_->lengthInSamples +
+                                      static_cast<juce::int64>(index_->getSilentFrameCount());
+                }
+
+                bool readSamples(int *const *destChannels, int numDestChannels,
+                                 int startOffsetInDestBuffer, juce::int64 startSampleInFile,
+                                 int numSamples) override
+                {
+                    const auto start =
+                            static_cast<uint64_t>(std::max<juce::int64>(startSampleInFile, 0));
+                    return index_->forEachRun(
+                            start, static_cast<uint64_t>(std::max(numSamples, 0)),
+                            [&](const SilenceIndex::Run &run, uint64_t offset, uint64_t frames)
+                            {
+                                const int done = static_cast<int>(offset);
+                                const int count = static_cast<int>(frames);
+                                if (!run.silent) {
+                                    buffer_.setSize(static_cast<int>(numChannels), count, false,
+                                                    false, true);
+                                    source_->read(&buffer_, 0, count,
+                                                  static_cast<juce::int64>(run.storedFrame), true,
+                                                  true);
+                                }
+                                for (int ch = 0; ch < numDestChannels; ++ch) {
+                                    if (destChannels[ch] == nullptr) { continue; }
+                                    auto *dest = reinterpret_cast<float *>(destChannels[ch]) +
+                                                 startOffsetInDestBuffer + done;
+                                    if (run.silent || ch >= static_cast<int>(numChannels)) {
+                                        std::fill(dest, dest + count, 0.0f);
+                                    } else {
+                                        std::copy_n(buffer_.getReadPointer(ch), count, dest);
+                                    }
+                                }
+                                return true;
+                            });
+                }
+
+            private:
+                std::unique_ptr<juce::AudioFormatReader> source_;
+                std::unique_ptr<SilenceIndex> index_;
+                juce::AudioBuffer<float> buffer_;
+            };
+        } // namespace
+
+        auto createFileSink(const AudioStreamBasicDescription &format, const juce::File &file,
+                            const OutputFormat &outputFormat,
+                            std::shared_ptr<WaveformPyramid> waveform)
+                -> std::unique_ptr<SampleSink>
         {
-            AudioDeviceID deviceID = kAudioObjectUnknown;
-            UInt32 propertySize = sizeof(deviceID);
-            AudioObjectPropertyAddress propertyAddress = {kAudioHardwarePropertyDefaultOutputDevice,
-                                                          kAudioObjectPropertyScopeGlobal,
-                                                          kAudioObjectPropertyElementMain};
-
-            OSStatus status = AudioObjectGetPropertyData(kAudioObjectSystemObject, &propertyAddress,
-                                                         0, nullptr, &propertySize, &deviceID);
-            if (status != kAudioHardwareNoError) { return kAudioObjectUnknown; }
-
-            return deviceID;
+            return createFileSink(format, file.getFullPathName().toStdString(), outputFormat,
+                                  std::move(waveform));
         }
 
-        auto allocateBufferForFormat(const AudioStreamBasicDescription &format,
-                                     int durationInSeconds) -> std::vector<float>
+        auto createRecordingReader(const juce::File &file)
+                -> std::unique_ptr<juce::AudioFormatReader>
         {
-            if (format.mSampleRate <= 0 || format.mChannelsPerFrame == 0) { return {}; }
-            const size_t totalSamples = static_cast<size_t>(format.mSampleRate * durationInSeconds *
-                                                            format.mChannelsPerFrame);
-            return std::vector<float>(totalSamples);
+            juce::AudioFormatManager formats;
+            formats.registerBasicFormats();
+            std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(file));
+            if (!reader) { return nullptr; }
+
+            auto index = SilenceIndex::load(
+                    SilenceIndex::getIndexPath(file.getFullPathName().toStdString()));
+            if (!index || index->getSpans().empty()) { return reader; }
+            return std::make_unique<SilenceExpandingReader>(std::move(reader), std::move(index));
         }
 
-        void saveBufferToFile(const AudioStreamBasicDescription &format, const juce::File &file,
-                              const std::vector<float> &buffer)
+        auto exportRecording(const juce::File &source, const juce::File &destination,
+                             const OutputFormat &outputFormat) -> bool
         {
-            if (buffer.empty()) { return; }
-
-            CFURLRef fileURL = CFURLCreateFromFileSystemRepresentation(
-                    kCFAllocatorDefault, (const UInt8 *)file.getFullPathName().toRawUTF8(),
-                    strlen(file.getFullPathName().toRawUTF8()), false);
-
-            if (!fileURL) { return; }
-
-            ExtAudioFileRef audioFile = nullptr;
-            AudioStreamBasicDescription fileFormat = format;
-
-            OSStatus status =
-                    ExtAudioFileCreateWithURL(fileURL, kAudioFileCAFType, &fileFormat, nullptr,
-                                              kAudioFileFlags_EraseFile, &audioFile);
-
-            CFRelease(fileURL);
-
-            if (status != noErr) { return; }
-
-            AudioStreamBasicDescription clientFormat = format;
-            status = ExtAudioFileSetProperty(audioFile, kExtAudioFileProperty_ClientDataFormat,
-                                             sizeof(clientFormat), &clientFormat);
-
-            if (status != noErr) {
-                ExtAudioFileDispose(audioFile);
-                return;
+            auto reader = createRecordingReader(source);
+            if (!reader || reader->numChannels == 0) { return false; }
+
+            const auto channelCount = static_cast<UInt32>(reader->numChannels);
+            AudioStreamBasicDescription format{};
+            format.mSampleRate = reader->sampleRate;
+            format.mFormatID = kAudioFormatLinearPCM;
+            format.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked;
+            format.mBitsPerChannel = 32;
+            format.mChannelsPerFrame = channelCount;
+            format.mFramesPerPacket = 1;
+            format.mBytesPerFrame = channelCount * sizeof(float);
+            format.mBytesPerPacket = format.mBytesPerFrame;
+
+            OutputFormat fullLength = outputFormat;
+            fullLength.silence = {};
+            auto sink = createFileSink(format, destination, fullLength);
+            if (!sink) { return false; }
+
+            juce::AudioBuffer<float> planar(static_cast<int>(channelCount),
+                                            kExportFramesPerBlock);
+            std::vector<float> interleaved(static_cast<size_t>(kExportFramesPerBlock) *
+                                           channelCount);
+            std::vector<const float *> planes(channelCount);
+            for (UInt32 ch = 0; ch < channelCount; ++ch) {
+                planes[ch] = planar.getReadPointer(static_cast<int>(ch));
             }
 
-            AudioBufferList bufferList;
-            bufferList.mNumberBuffers = 1;
-            bufferList.mBuffers[0].mNumberChannels = format.mChannelsPerFrame;
-            bufferList.mBuffers[0].mDataByteSize = (UInt32)(buffer.size() * sizeof(float));
-            bufferList.mBuffers[0].mData = const_cast<float *>(buffer.data());
-
-            UInt32 framesToWrite = (UInt32)(buffer.size() / format.mChannelsPerFrame);
-            status = ExtAudioFileWrite(audioFile, framesToWrite, &bufferList);
-
-            ExtAudioFileDispose(audioFile);
+            bool ok = true;
+            for (juce::int64 position = 0; ok && position < reader->lengthInSamples;) {
+                const int count = static_cast<int>(std::min<juce::int64>(
+                        kExportFramesPerBlock, reader->lengthInSamples - position));
+                reader->read(&planar, 0, count, position, true, true);
+                kernels::interleave(planes.data(), channelCount, static_cast<size_t>(count),
+                                    interleaved.data());
+                ok = sink->write(interleaved.data(), static_cast<size_t>(count));
+                position += count;
+            }
+            return sink->finalize() && ok;
         }
 
     } // namespace utils
@@ -0,0 +1,40 @@
+#include "AudioHardwareBackend.h"
+
+#if defined(__APPLE__)
+#include "CoreAudioBackend.h"
+#else
+#include "SimulatedAudioBackend.h"
+#endif
+
+#include <mutex>
+#include <utility>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        std::mutex backendMutex;
+        std::shared_ptr<AudioHardwareBackend> currentBackend;
+    } // namespace
+
+    auto getAudioHardwareBackend() -> std::shared_ptr<AudioHardwareBackend>
+    {
+        std::lock_guard<std::mutex> lock(backendMutex);
+        if (!currentBackend) {
+#if defined(__APPLE__)
+            currentBackend = std::make_shared<CoreAudioBackend>();
+#else
+            currentBackend = std::make_shared<SimulatedAudioBackend>();
+#endif
+        }
+        return currentBackend;
+    }
+
+    void setAudioHardwareBackend(std::shared_ptr<AudioHardwareBackend> backend)
+    {
+        std::lock_guard<std::mutex> lock(backendMutex);
+        currentBackend = std::move(backend);
+    }
+
+} // namespace audio_tap
+} // namespace pg
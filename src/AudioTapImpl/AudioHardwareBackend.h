@@ -0,0 +1,91 @@
+#pragma once
+
+#include "CoreAudioTypes.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace pg {
+namespace audio_tap {
+
+    enum class DevicePropertyChangeReason
+    {
+        StreamFormatChanged,
+        StreamConfigurationChanged,
+        DeviceIsAliveChanged,
+    };
+
+    // The audio hardware calls the capture pipeline makes: finding the output device, tapping
+    // it, reading its format, watching it for changes and running an IOProc on the tap.
+    //
+    // `CoreAudioBackend` forwards them to the HAL. `SimulatedAudioBackend` plays a
+    // deterministic virtual device instead, so the recorder can run without Core Audio, e.g.
+    // for load tests on Linux.
+    //
+    // All calls come from non-real-time threads.
+    class AudioHardwareBackend
+    {
+    public:
+        // A plain function and its context rather than a `std::function`, so the backend's own
+        // IOProc reaches the caller's code through one indirect call.
+        struct IOCallback
+        {
+            using Function = void (*)(void *context, const AudioBufferList *inputData,
+                                      const AudioTimeStamp *inputTime);
+
+            Function function{nullptr};
+            void *context{nullptr};
+
+            explicit operator bool() const { return function != nullptr; }
+            void operator()(const AudioBufferList *inputData,
+                            const AudioTimeStamp *inputTime) const
+            {
+                function(context, inputData, inputTime);
+            }
+        };
+        using PropertyListener = std::function<void(DevicePropertyChangeReason)>;
+        using Token = uint64_t; // Zero is never a valid token.
+
+        virtual ~AudioHardwareBackend() = default;
+
+        virtual auto getDefaultOutputDevice() -> AudioDeviceID = 0;
+
+        // Reads the output stream format of `device`. Returns false if it cannot be read.
+        virtual auto getStreamFormat(AudioDeviceID device, AudioStreamBasicDescription &format)
+                -> bool = 0;
+
+        // Creates a private tap on everything `outputDevice` plays and an aggregate device
+        // whose input is the tap. Returns false, creating nothing, on failure.
+        virtual auto createTap(AudioDeviceID outputDevice, AudioObjectID &tapID,
+                               AudioDeviceID &aggregateDeviceID) -> bool = 0;
+        virtual void destroyTap(AudioObjectID tapID, AudioDeviceID aggregateDeviceID) = 0;
+
+        // Calls `listener` when the format, configuration or liveness of `device` changes, on
+        // a thread of the backend's choosing. Returns zero on failure.
+        virtual auto addPropertyListener(AudioDeviceID device, PropertyListener listener)
+                -> Token = 0;
+        // No call to the listener is in progress or follows once this returns.
+        virtual void removePropertyListener(Token token) = 0;
+
+        // Starts calling `callback` from the real-time thread of `device` with each input
+        // buffer. Its context must stay valid until the IOProc is stopped. Returns zero on
+        // failure.
+        virtual auto startIOProc(AudioDeviceID device, IOCallback callback) -> Token = 0;
+        // No call to the callback is in progress or follows once this returns.
+        virtual void stopIOProc(Token token) = 0;
+
+        // Ticks per second of the host time in `AudioTimeStamp::mHostTime`.
+        virtual auto getHostClockFrequency() -> double = 0;
+    };
+
+    // The backend the pipeline uses. Defaults to Core Audio on Apple platforms and to a
+    // `SimulatedAudioBackend` with default settings elsewhere.
+    auto getAudioHardwareBackend() -> std::shared_ptr<AudioHardwareBackend>;
+
+    // Replaces the backend. Sessions and IOProcs keep the backend they were created with, so
+    // call this before acquiring a session.
+    void setAudioHardwareBackend(std::shared_ptr<AudioHardwareBackend> backend);
+
+} // namespace audio_tap
+} // namespace pg
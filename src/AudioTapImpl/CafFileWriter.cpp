@@ -0,0 +1,209 @@
+#include "CafFileWriter.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        // Size of the staging buffer that batches samples into a single fwrite.
+        constexpr size_t kChunkSizeInBytes = 256 * 1024;
+
+        // CAF linear PCM format flags (see CoreAudioTypes / CAFFile.h). Integer samples are
+        // always written little-endian by the conversion kernels.
+        constexpr uint32_t kCafLinearPcmFormatFlagIsFloat = 1u << 0;
+        constexpr uint32_t kCafLinearPcmFormatFlagIsLittleEndian = 1u << 1;
+
+        // Marks the `data` chunk as extending to the end of the file.
+        constexpr int64_t kCafUnknownDataSize = -1;
+
+        // The `data` chunk starts with a 4-byte edit count before the audio.
+        constexpr int64_t kCafEditCountSize = 4;
+
+        constexpr auto formatFlags(SampleFormat sampleFormat) -> uint32_t
+        {
+            if (sampleFormat != SampleFormat::Float32) {
+                return kCafLinearPcmFormatFlagIsLittleEndian;
+            }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            return kCafLinearPcmFormatFlagIsFloat;
+#else
+            return kCafLinearPcmFormatFlagIsFloat | kCafLinearPcmFormatFlagIsLittleEndian;
+#endif
+        }
+
+        void appendBigEndian(std::vector<uint8_t> &out, uint64_t value, int byteCount)
+        {
+            for (int i = byteCount - 1; i >= 0; --i) {
+                out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+            }
+        }
+
+        void appendFourCC(std::vector<uint8_t> &out, const char *code)
+        {
+            out.insert(out.end(), code, code + 4);
+        }
+
+        void appendFloat64(std::vector<uint8_t> &out, double value)
+        {
+            uint64_t bits = 0;
+            std::memcpy(&bits, &value, sizeof(bits));
+            appendBigEndian(out, bits, 8);
+        }
+    } // namespace
+
+    auto CafFileWriter::open(const std::string &path, const CaptureFormat &format,
+                             const OutputFormat &outputFormat) -> std::unique_ptr<CafFileWriter>
+    {
+        if (!format.isValid()) { return nullptr; }
+
+        std::FILE *file = std::fopen(path.c_str(), "wb");
+        if (!file) { return nullptr; }
+
+        const uint32_t bytesPerSample = audio_tap::bytesPerSample(outputFormat.sampleFormat);
+        const uint32_t bytesPerFrame = format.channelCount * bytesPerSample;
+
+        std::vector<uint8_t> header;
+        appendFourCC(header, "caff");
+        appendBigEndian(header, 1, 2); // mFileVersion
+        appendBigEndian(header, 0, 2); // mFileFlags
+
+        appendFourCC(header, "desc");
+        appendBigEndian(header, 32, 8);
+        appendFloat64(header, format.sampleRate);
+        appendFourCC(header, "lpcm");
+        appendBigEndian(header, formatFlags(outputFormat.sampleFormat), 4);
+        appendBigEndian(header, bytesPerFrame, 4);       // mBytesPerPacket
+        appendBigEndian(header, 1, 4);                   // mFramesPerPacket
+        appendBigEndian(header, format.channelCount, 4); // mChannelsPerFrame
+        appendBigEndian(header, bytesPerSample * 8, 4);  // mBitsPerChannel
+
+        appendFourCC(header, "data");
+        const auto dataSizeOffset = static_cast<int64_t>(header.size());
+        appendBigEndian(header, static_cast<uint64_t>(kCafUnknownDataSize), 8);
+        appendBigEndian(header, 0, 4); // mEditCount
+
+        if (std::fwrite(header.data(), 1, header.size(), file) != header.size()) {
+            std::fclose(file);
+            return nullptr;
+        }
+
+        return std::unique_ptr<CafFileWriter>(
+                new CafFileWriter(file, format, outputFormat, dataSizeOffset));
+    }
+
+    CafFileWriter::CafFileWriter(std::FILE *file, const CaptureFormat &format,
+                                 const OutputFormat &outputFormat, int64_t dataSizeOffset)
+      : file_(file),
+        format_(format),
+        outputFormat_(outputFormat),
+        bytesPerFrame_(format.channelCount * bytesPerSample(outputFormat.sampleFormat)),
+        dataSizeOffset_(dataSizeOffset),
+        chunk_(std::max<size_t>(kChunkSizeInBytes / bytesPerFrame_, 1) * bytesPerFrame_)
+    {
+        const bool needsDither =
+                outputFormat_.dither && outputFormat_.sampleFormat != SampleFormat::Float32;
+        if (needsDither) { noise_.resize(chunk_.size() / bytesPerFrame_ * format_.channelCount); }
+    }
+
+    CafFileWriter::~CafFileWriter()
+    {
+        if (file_) { finalize(); }
+    }
+
+    auto CafFileWriter::write(const float *interleaved, size_t frameCount) -> bool
+    {
+        if (!file_ || failed_) { return false; }
+
+        size_t framesRemaining = frameCount;
+        while (framesRemaining > 0) {
+            const size_t framesToEncode =
+                    std::min(framesRemaining, (chunk_.size() - chunkFill_) / bytesPerFrame_);
+            const size_t sampleCount = framesToEncode * format_.channelCount;
+
+            encode(interleaved, sampleCount, chunk_.data() + chunkFill_);
+            interleaved += sampleCount;
+            framesRemaining -= framesToEncode;
+            chunkFill_ += framesToEncode * bytesPerFrame_;
+
+            if (chunkFill_ == chunk_.size() && !flushChunk()) { return false; }
+        }
+
+        framesWritten_ += frameCount;
+        return true;
+    }
+
+    auto CafFileWriter::finalize() -> bool
+    {
+        if (!file_) { return false; }
+
+        const bool ok = flushChunk() && writeDataSize();
+        const bool closed = std::fclose(file_) == 0;
+        file_ = nullptr;
+        return ok && closed;
+    }
+
+    auto CafFileWriter::checkpoint() -> bool
+    {
+        if (!file_ || failed_) { return false; }
+
+        // Costs one chunk write plus an 8-byte header rewrite, whatever the take length. Audio
+        // written after this stays beyond the recorded size until the next checkpoint;
+        // `recoverCaptureFile` reclaims it after a crash.
+        if (!flushChunk() || !writeDataSize() || fseeko(file_, 0, SEEK_END) != 0 ||
+            std::fflush(file_) != 0) {
+            failed_ = true;
+        }
+        return !failed_;
+    }
+
+    auto CafFileWriter::getBytesWritten() const -> uint64_t
+    {
+        const auto headerBytes = static_cast<uint64_t>(dataSizeOffset_) + 8 + kCafEditCountSize;
+        return headerBytes + framesWritten_ * bytesPerFrame_;
+    }
+
+    auto CafFileWriter::writeDataSize() -> bool
+    {
+        const uint64_t audioBytes = framesWritten_ * bytesPerFrame_;
+        const int64_t dataSize = kCafEditCountSize + static_cast<int64_t>(audioBytes);
+        std::vector<uint8_t> sizeField;
+        appendBigEndian(sizeField, static_cast<uint64_t>(dataSize), 8);
+        return fseeko(file_, dataSizeOffset_, SEEK_SET) == 0 &&
+               std::fwrite(sizeField.data(), 1, sizeField.size(), file_) == sizeField.size();
+    }
+
+    void CafFileWriter::encode(const float *samples, size_t sampleCount, uint8_t *destination)
+    {
+        const float *noise = nullptr;
+        if (!noise_.empty()) {
+            dither_.generate(noise_.data(), sampleCount);
+            noise = noise_.data();
+        }
+
+        switch (outputFormat_.sampleFormat) {
+        case SampleFormat::Float32:
+            std::memcpy(destination, samples, sampleCount * sizeof(float));
+            break;
+        case SampleFormat::Int16:
+            kernels::floatToInt16(samples, noise, sampleCount,
+                                  reinterpret_cast<int16_t *>(destination));
+            break;
+        case SampleFormat::Int24:
+            kernels::floatToInt24(samples, noise, sampleCount, destination);
+            break;
+        }
+    }
+
+    auto CafFileWriter::flushChunk() -> bool
+    {
+        if (chunkFill_ == 0) { return !failed_; }
+
+        if (std::fwrite(chunk_.data(), 1, chunkFill_, file_) != chunkFill_) { failed_ = true; }
+        chunkFill_ = 0;
+        return !failed_;
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "CaptureFormat.h"
+#include "SampleConversion.h"
+#include "SampleSink.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    // Streaming writer for linear PCM Core Audio Format (CAF) files. Audio arrives as float32
+    // and is stored as float32, or quantised to 16/24-bit integers (optionally dithered) as it
+    // is written, on the calling (writer) thread.
+    //
+    // The header is written up front with an open-ended `data` chunk, audio is appended in
+    // fixed-size chunks as it arrives, and `finalize()` only seeks back to patch the chunk size.
+    // Closing a file therefore costs the same regardless of how long the take was.
+    //
+    // Pure C++ with no AudioToolbox dependency.
+    class CafFileWriter : public SampleSink
+    {
+    public:
+        // Creates (or truncates) `path` and writes the CAF header. Returns nullptr on failure.
+        static auto open(const std::string &path, const CaptureFormat &format,
+                         const OutputFormat &outputFormat = {}) -> std::unique_ptr<CafFileWriter>;
+
+        ~CafFileWriter() override;
+
+        auto write(const float *interleaved, size_t frameCount) -> bool override;
+        auto finalize() -> bool override;
+        auto checkpoint() -> bool override;
+
+        auto getFramesWritten() const -> uint64_t { return framesWritten_; }
+        auto getBytesWritten() const -> uint64_t override;
+
+    private:
+        CafFileWriter(std::FILE *file, const CaptureFormat &format,
+                      const OutputFormat &outputFormat, int64_t dataSizeOffset);
+
+        void encode(const float *samples, size_t sampleCount, uint8_t *destination);
+        auto flushChunk() -> bool;
+        auto writeDataSize() -> bool;
+
+        std::FILE *file_{nullptr};
+        CaptureFormat format_;
+        OutputFormat outputFormat_;
+        uint32_t bytesPerFrame_{0};
+        int64_t dataSizeOffset_{0}; // File offset of the `data` chunk's size field.
+        uint64_t framesWritten_{0};
+
+        std::vector<uint8_t> chunk_; // Whole frames only.
+        size_t chunkFill_{0};
+        std::vector<float> noise_;
+        TpdfDither dither_;
+        bool failed_{false};
+    };
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,147 @@
+#include "CaptureBroadcaster.h"
+
+#include <algorithm>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        // Depth of each subscriber's queue, in blocks.
+        constexpr size_t kSubscriberQueueDepth = 64;
+    } // namespace
+
+    auto CaptureBroadcaster::create(uint32_t channelCount, size_t framesPerBlock,
+                                    size_t blockCount) -> std::shared_ptr<CaptureBroadcaster>
+    {
+        return std::shared_ptr<CaptureBroadcaster>(
+                new CaptureBroadcaster(channelCount, framesPerBlock, blockCount));
+    }
+
+    CaptureBroadcaster::CaptureBroadcaster(uint32_t channelCount, size_t framesPerBlock,
+                                           size_t blockCount)
+      : channelCount_(channelCount > 0 ? channelCount : 1),
+        framesPerBlock_(std::max<size_t>(framesPerBlock, 1)),
+        memory_(framesPerBlock_ * channelCount_ * sizeof(float), std::max<size_t>(blockCount, 1),
+                false),
+        blocks_(new PooledBlock[memory_.getBlockCount()]),
+        blockCount_(memory_.getBlockCount())
+    {
+        // The pool is small and touched on every cycle, so fault it all in up front.
+        for (size_t i = 0; i < blockCount_; ++i) {
+            memory_.prefaultBlock(i);
+            blocks_[i].storage = static_cast<float *>(memory_.getBlock(i));
+            blocks_[i].block.samples = blocks_[i].storage;
+        }
+
+        for (auto &slot : slots_) {
+            slot.queue = std::make_unique<SpscRingBuffer<PooledBlock *>>(kSubscriberQueueDepth);
+        }
+    }
+
+    void CaptureBroadcaster::publish(const float *interleaved, size_t sampleCount)
+    {
+        for (auto &slot : slots_) {
+            if (slot.state.load(std::memory_order_acquire) == SlotState::Closing) {
+                reclaimSlot(slot);
+            }
+        }
+
+        size_t framesRemaining = sampleCount / channelCount_;
+        while (framesRemaining > 0) {
+            const size_t frameCount = std::min(framesRemaining, framesPerBlock_);
+            framesRemaining -= frameCount;
+
+            // Decide on the recipients first so the reference count is final before any
+            // subscriber can see (and release) the block.
+            std::array<Slot *, kMaxSubscribers> recipients{};
+            uint32_t recipientCount = 0;
+            for (auto &slot : slots_) {
+                if (slot.state.load(std::memory_order_acquire) != SlotState::Active) { continue; }
+                if (slot.queue->availableToWrite() == 0) {
+                    slot.droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                recipients[recipientCount++] = &slot;
+            }
+
+            const uint64_t firstFrame = framesPublished_;
+            framesPublished_ += frameCount;
+            if (recipientCount == 0) {
+                interleaved += frameCount * channelCount_;
+                continue;
+            }
+
+            PooledBlock *pooled = acquireBlock();
+            if (!pooled) {
+                droppedBlocks_.fetch_add(1, std::memory_order_relaxed);
+                interleaved += frameCount * channelCount_;
+                continue;
+            }
+
+            std::copy(interleaved, interleaved + frameCount * channelCount_, pooled->storage);
+            interleaved += frameCount * channelCount_;
+            pooled->block.frameCount = frameCount;
+            pooled->block.firstFrame = firstFrame;
+            pooled->refCount.store(recipientCount, std::memory_order_release);
+
+            for (uint32_t i = 0; i < recipientCount; ++i) {
+                recipients[i]->queue->tryPush(pooled);
+            }
+        }
+    }
+
+    auto CaptureBroadcaster::subscribe() -> std::unique_ptr<CaptureSubscription>
+    {
+        for (auto &slot : slots_) {
+            auto expected = SlotState::Free;
+            if (slot.state.compare_exchange_strong(expected, SlotState::Active,
+                                                   std::memory_order_acq_rel)) {
+                slot.droppedBlocks.store(0);
+                return std::unique_ptr<CaptureSubscription>(
+                        new CaptureSubscription(shared_from_this(), slot));
+            }
+        }
+        return nullptr;
+    }
+
+    auto CaptureBroadcaster::acquireBlock() -> PooledBlock *
+    {
+        // Round-robin scan for a block nobody references. Bounded by the pool size, and in the
+        // common case the next block in line is already free.
+        for (size_t i = 0; i < blockCount_; ++i) {
+            PooledBlock &candidate = blocks_[nextBlock_];
+            nextBlock_ = (nextBlock_ + 1) % blockCount_;
+            if (candidate.refCount.load(std::memory_order_acquire) == 0) { return &candidate; }
+        }
+        return nullptr;
+    }
+
+    void CaptureBroadcaster::reclaimSlot(Slot &slot)
+    {
+        // The subscriber has stopped reading, so the publisher now owns the consumer side of the
+        // queue and can drop the references left in it.
+        PooledBlock *pooled = nullptr;
+        while (slot.queue->tryPop(pooled)) { release(pooled); }
+        slot.state.store(SlotState::Free, std::memory_order_release);
+    }
+
+    void CaptureBroadcaster::release(PooledBlock *block)
+    {
+        block->refCount.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    // --- CaptureSubscription ---
+
+    CaptureSubscription::CaptureSubscription(std::shared_ptr<CaptureBroadcaster> owner,
+                                             CaptureBroadcaster::Slot &slot)
+      : owner_(std::move(owner)), slot_(slot)
+    {
+    }
+
+    CaptureSubscription::~CaptureSubscription()
+    {
+        slot_.state.store(CaptureBroadcaster::SlotState::Closing, std::memory_order_release);
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "RealtimeMemoryPool.h"
+#include "SpscRingBuffer.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace pg {
+namespace audio_tap {
+
+    class CaptureSubscription;
+
+    // Zero-copy fan-out of captured audio to several consumers (meters, analysis, monitoring).
+    //
+    // The audio thread copies each incoming buffer once into a block from a fixed, prefaulted
+    // pool and publishes a pointer to it to every active subscriber. Blocks are reference
+    // counted and return to the pool when the last subscriber releases them. Each subscriber has
+    // its own bounded queue: one that falls behind only loses its own blocks, and never holds up
+    // the audio thread or the other subscribers.
+    //
+    // This class has no platform dependencies.
+    class CaptureBroadcaster : public std::enable_shared_from_this<CaptureBroadcaster>
+    {
+    public:
+        static constexpr size_t kMaxSubscribers = 8;
+
+        struct Block
+        {
+            const float *samples{nullptr}; // Interleaved.
+            size_t frameCount{0};
+            uint64_t firstFrame{0}; // Position of the first frame in the capture stream.
+        };
+
+        static auto create(uint32_t channelCount, size_t framesPerBlock, size_t blockCount)
+                -> std::shared_ptr<CaptureBroadcaster>;
+
+        CaptureBroadcaster(const CaptureBroadcaster &) = delete;
+        CaptureBroadcaster &operator=(const CaptureBroadcaster &) = delete;
+
+        auto getChannelCount() const -> uint32_t { return channelCount_; }
+
+        // Called from the real-time audio thread. Never blocks or allocates.
+        void publish(const float *interleaved, size_t sampleCount);
+
+        // Registers a new consumer. Returns nullptr if all subscriber slots are taken.
+        // Not real-time safe; may be called while publishing is in progress.
+        auto subscribe() -> std::unique_ptr<CaptureSubscription>;
+
+        // Blocks that could not be published to anyone because the pool was exhausted.
+        auto getDroppedBlockCount() const -> uint64_t { return droppedBlocks_.load(); }
+
+    private:
+        friend class CaptureSubscription;
+
+        struct PooledBlock
+        {
+            Block block;
+            float *storage{nullptr};
+            std::atomic<uint32_t> refCount{0};
+        };
+
+        enum class SlotState : uint8_t
+        {
+            Free,
+            Active,
+            Closing, // The subscriber has left; the publisher still has to release its queue.
+        };
+
+        struct Slot
+        {
+            std::atomic<SlotState> state{SlotState::Free};
+            std::unique_ptr<SpscRingBuffer<PooledBlock *>> queue;
+            std::atomic<uint64_t> droppedBlocks{0};
+        };
+
+        CaptureBroadcaster(uint32_t channelCount, size_t framesPerBlock, size_t blockCount);
+
+        auto acquireBlock() -> PooledBlock *;
+        void reclaimSlot(Slot &slot);
+        static void release(PooledBlock *block);
+
+        const uint32_t channelCount_;
+        const size_t framesPerBlock_;
+        RealtimeMemoryPool memory_;
+        std::unique_ptr<PooledBlock[]> blocks_;
+        const size_t blockCount_;
+        std::array<Slot, kMaxSubscribers> slots_;
+
+        // Publisher-only state.
+        size_t nextBlock_{0};
+        uint64_t framesPublished_{0};
+
+        std::atomic<uint64_t> droppedBlocks_{0};
+    };
+
+    // A consumer's view of a `CaptureBroadcaster`. Owned and read by a single consumer thread;
+    // destroying it unsubscribes.
+    class CaptureSubscription
+    {
+    public:
+        ~CaptureSubscription();
+
+        CaptureSubscription(const CaptureSubscription &) = delete;
+        CaptureSubscription &operator=(const CaptureSubscription &) = delete;
+
+        auto getChannelCount() const -> uint32_t { return owner_->getChannelCount(); }
+
+        // Invokes `visitor(const CaptureBroadcaster::Block &)` for every block published since
+        // the last call, oldest first. Block data is only valid inside the visitor.
+        template <typename Visitor>
+        auto read(Visitor &&visitor) -> size_t
+        {
+            size_t blocksRead = 0;
+            CaptureBroadcaster::PooledBlock *pooled = nullptr;
+            while (slot_.queue->tryPop(pooled)) {
+                visitor(static_cast<const CaptureBroadcaster::Block &>(pooled->block));
+                CaptureBroadcaster::release(pooled);
+                ++blocksRead;
+            }
+            return blocksRead;
+        }
+
+        // Blocks this subscriber missed because its queue was full.
+        auto getDroppedBlockCount() const -> uint64_t { return slot_.droppedBlocks.load(); }
+
+    private:
+        friend class CaptureBroadcaster;
+        CaptureSubscription(std::shared_ptr<CaptureBroadcaster> owner,
+                            CaptureBroadcaster::Slot &slot);
+
+        std::shared_ptr<CaptureBroadcaster> owner_;
+        CaptureBroadcaster::Slot &slot_;
+    };
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,401 @@
+#include "CaptureController.h"
+#include "AudioDataHandler.h"
+#include "AudioHardwareBackend.h"
+#include "CaptureBroadcaster.h"
+#include "CaptureTimeline.h"
+#include "DropoutLog.h"
+#include "FileSinkFactory.h"
+#include "LevelMeter.h"
+#include "MetricsRegistry.h"
+#include "StreamSplicer.h"
+#include "SystemAudioTapper.h"
+#include "TraceRecorder.h"
+#include "WaveformPyramid.h"
+
+#include <chrono>
+#include <cmath>
+#include <utility>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        // Wraps `function` so that the wait on the owner's queue shows up in traces as `name`.
+        template <typename Function>
+        auto traceHop(const char *name, Function function) -> std::function<void()>
+        {
+            if (!TraceRecorder::isEnabled()) { return function; }
+
+            const uint64_t queuedAt = TraceRecorder::now();
+            return [name, queuedAt, function]
+            {
+                auto &trace = TraceRecorder::getInstance();
+                trace.record(name, queuedAt, TraceRecorder::now() - queuedAt);
+                function();
+            };
+        }
+    } // namespace
+
+    CaptureController::CaptureController(Dispatcher dispatcher)
+      : dispatcher_(std::move(dispatcher))
+    {
+    }
+
+    CaptureController::~CaptureController()
+    {
+        lifetime_.reset(); // Drops any stop or reconfiguration still queued.
+
+        auto expectedState = state_.load();
+        if (expectedState == State::Recording || expectedState == State::Starting) {
+            // In the destructor, we must stop synchronously to avoid use-after-free.
+            if (state_.compare_exchange_strong(expectedState, State::Stopping)) {
+                lastStopReason_ = StopReason::UserRequested;
+                performStopLogic();
+            }
+        } else if (expectedState == State::Stopping) {
+            performStopLogic(); // The queued stop was just dropped; finish the take here.
+        }
+    }
+
+    auto CaptureController::startRecording(const std::string &path,
+                                           const OutputFormat &outputFormat) -> bool
+    {
+        if (!canStartRecording()) { return false; }
+        PG_TRACE_SCOPE("CaptureController::startRecording");
+
+        const auto requested = std::chrono::steady_clock::now();
+        state_.store(State::Starting);
+        lastStopReason_ = StopReason::UserRequested;
+
+        if (!setupTappingSession()) {
+            cleanupAfterFailure();
+            return false;
+        }
+
+        if (tappingSession_.getAudioFormat().mSampleRate == 0) { // Check for a valid format
+            cleanupAfterFailure();
+            return false;
+        }
+
+        // Positions are in frames of the file, which may be written at another rate.
+        const double recordingRate = outputFormat.sampleRate > 0.0
+                                             ? outputFormat.sampleRate
+                                             : tappingSession_.getSampleRate();
+
+        // The overview is built on the writer thread from the audio the file stores, after
+        // any rate conversion.
+        waveform_ = std::make_shared<WaveformPyramid>(
+                tappingSession_.getAudioFormat().mChannelsPerFrame, recordingRate);
+        auto sink = utils::createFileSink(tappingSession_.getAudioFormat(), path, outputFormat,
+                                          waveform_);
+        if (!sink) {
+            cleanupAfterFailure();
+            return false;
+        }
+
+        timeline_ = std::make_shared<CaptureTimeline>(
+                recordingRate, getAudioHardwareBackend()->getHostClockFrequency());
+        sink = std::make_unique<TimelineSink>(std::move(sink), timeline_,
+                                              CaptureTimeline::getSidecarPath(path));
+
+        dropouts_ = std::make_shared<DropoutLog>(recordingRate);
+        fillGaps_ = outputFormat.fillGaps;
+        sink = std::make_unique<DropoutLogSink>(std::move(sink), dropouts_,
+                                                DropoutLog::getLogPath(path));
+
+        // If the device changes format mid-take, the new stream is converted back to this one
+        // and spliced on, so the recording keeps its original rate and layout.
+        const CaptureFormat sessionFormat{tappingSession_.getSampleRate(),
+                                          tappingSession_.getChannelCount()};
+        splicer_ = std::make_unique<StreamSplicer>(std::move(sink), sessionFormat,
+                                                   outputFormat.resamplerQuality);
+
+        broadcaster_ = CaptureBroadcaster::create(
+                tappingSession_.getAudioFormat().mChannelsPerFrame, kBroadcastFramesPerBlock,
+                kBroadcastBlockCount);
+
+        audioDataHandler_ = std::make_unique<AudioDataHandler>(
+                tappingSession_.getAudioFormat(), splicer_->beginSegment(sessionFormat),
+                AudioDataHandler::BufferOptions{});
+        meter_ = std::make_shared<LevelMeter>(tappingSession_.getAudioFormat().mChannelsPerFrame,
+                                              tappingSession_.getAudioFormat().mSampleRate);
+
+        callbackTimer_ = std::make_shared<CallbackTimer>();
+
+        audioDataHandler_->setBroadcaster(broadcaster_);
+        audioDataHandler_->setMeter(meter_);
+        audioDataHandler_->setRecordingPosition(0, recordingRate);
+        audioDataHandler_->setTimeline(timeline_);
+        audioDataHandler_->setDropoutLog(dropouts_, fillGaps_);
+        audioDataHandler_->setStartRequestTime(requested);
+        if (!audioDataHandler_->start()) {
+            cleanupAfterFailure();
+            return false;
+        }
+
+        if (!setupIOProc(tappingSession_.getAggregateDeviceID())) {
+            cleanupAfterFailure();
+            return false;
+        }
+
+        state_.store(State::Recording);
+        MetricsRegistry::getDefault()
+                .counter("pg_capture_recordings_started_total", "Recordings started.")
+                .add();
+        tappingSession_.registerPropertyListener([this](auto reason)
+                                                 { handleDevicePropertyChanged(reason); });
+        return true;
+    }
+
+    void CaptureController::stopRecording()
+    {
+        auto expected = State::Recording;
+        if (state_.compare_exchange_strong(expected, State::Stopping)) {
+            // If the state transition succeeds, it means no other stop reason was set.
+            // We can safely set the reason to UserRequested.
+            lastStopReason_ = StopReason::UserRequested;
+            asyncPerformStop();
+        }
+    }
+
+    auto CaptureController::isRecording() const -> bool
+    {
+        auto const currentState = state_.load();
+        return currentState == State::Recording || currentState == State::Stopping;
+    }
+
+    auto CaptureController::hasRecordingFinished() const -> bool
+    {
+        const auto currentState = state_.load();
+        return currentState == State::Succeeded || currentState == State::Failed;
+    }
+
+    auto CaptureController::subscribe() -> std::unique_ptr<CaptureSubscription>
+    {
+        return broadcaster_ ? broadcaster_->subscribe() : nullptr;
+    }
+
+    auto CaptureController::getLevels(LevelSnapshot &levels) -> bool
+    {
+        if (!meter_ || state_.load() != State::Recording) { return false; }
+        meter_->read(levels);
+        return true;
+    }
+
+    auto CaptureController::getCallbackTiming(CallbackTimingSummary &timing) const -> bool
+    {
+        if (!callbackTimer_ || state_.load() != State::Recording) { return false; }
+        timing = callbackTimer_->getSummary();
+        return true;
+    }
+
+    auto CaptureController::getWaveform() const -> std::shared_ptr<const WaveformPyramid>
+    {
+        return waveform_;
+    }
+
+    auto CaptureController::getTimeline() const -> std::shared_ptr<const CaptureTimeline>
+    {
+        return timeline_;
+    }
+
+    auto CaptureController::getDropoutLog() const -> std::shared_ptr<const DropoutLog>
+    {
+        return dropouts_;
+    }
+
+    auto CaptureController::canStartRecording() -> bool
+    {
+        auto const currentState = state_.load();
+        return currentState == State::Idle || currentState == State::Succeeded ||
+               currentState == State::Failed;
+    }
+
+    auto CaptureController::setupTappingSession() -> bool
+    {
+        tappingSession_ = SystemAudioTapper::getInstance().acquireSession();
+        return tappingSession_.isValid();
+    }
+
+    auto CaptureController::setupIOProc(AudioDeviceID aggregateDeviceID) -> bool
+    {
+        // Timing continues across reconfigurations; the IOProc restarts the interval clock.
+        ioProcHandle_.emplace(aggregateDeviceID, *audioDataHandler_, callbackTimer_);
+        return ioProcHandle_->isValid();
+    }
+
+    void CaptureController::cleanupAfterFailure()
+    {
+        state_.store(State::Failed);
+        MetricsRegistry::getDefault()
+                .counter("pg_capture_start_failures_total", "Recordings that failed to start.")
+                .add();
+        tappingSession_ = {}; // Release resources via RAII
+        ioProcHandle_.reset();
+        audioDataHandler_.reset();
+        if (splicer_) { splicer_->finalize(); }
+        splicer_.reset();
+        broadcaster_.reset();
+        meter_.reset();
+        callbackTimer_.reset();
+        waveform_.reset();
+        timeline_.reset();
+        dropouts_.reset();
+    }
+
+    void CaptureController::asyncPerformStop()
+    {
+        // Asynchronously dispatch the synchronous cleanup logic to the owner's thread.
+        callAsync("callAsync: stop", &CaptureController::performStopLogic);
+    }
+
+    void CaptureController::callAsync(const char *name, void (CaptureController::*method)())
+    {
+        dispatcher_(traceHop(name,
+                             [lifetime = std::weak_ptr<CaptureController *>(lifetime_), method]
+                             {
+                                 if (const auto self = lifetime.lock()) { ((*self)->*method)(); }
+                             }));
+    }
+
+    void CaptureController::performStopLogic()
+    {
+        PG_TRACE_SCOPE("CaptureController::performStopLogic");
+        tappingSession_.unregisterPropertyListener();
+
+        // IOProcHandle's destructor will automagically handle stopping and destroying the IOProcID.
+        ioProcHandle_.reset();
+
+        // With the IOProc gone, the writer thread can drain what is left and close the file.
+        if (audioDataHandler_ && !audioDataHandler_->finish()) {
+            lastStopReason_ = StopReason::ExplicitError;
+        }
+        if (splicer_ && !splicer_->finalize()) { lastStopReason_ = StopReason::ExplicitError; }
+
+        // Now that saving is complete, we can reset the session handle and handler.
+        tappingSession_ = {};
+        audioDataHandler_.reset();
+        splicer_.reset();
+        // Existing subscriptions keep the broadcaster alive; they simply stop receiving blocks.
+        broadcaster_.reset();
+        meter_.reset();
+        callbackTimer_.reset();
+
+        countStop();
+
+        // Any stop reason other than an explicit failure should be considered a success. The
+        // reason is counted in the `pg_capture_stops_total` metric and kept for
+        // `getStopReason()`.
+        state_.store(lastStopReason_ == StopReason::ExplicitError ? State::Failed
+                                                                  : State::Succeeded);
+    }
+
+    void CaptureController::countStop()
+    {
+        const char *reason = "user_requested";
+        switch (lastStopReason_.load()) {
+        case StopReason::UserRequested:
+            break;
+        case StopReason::ConfigurationChanged:
+            reason = "configuration_changed";
+            break;
+        case StopReason::DeviceRemoved:
+            reason = "device_removed";
+            break;
+        case StopReason::ExplicitError:
+            reason = "explicit_error";
+            break;
+        }
+        MetricsRegistry::getDefault()
+                .counter("pg_capture_stops_total", "Recordings stopped, by reason.",
+                         {{"reason", reason}})
+                .add();
+    }
+
+    // =================================================================================
+    // MARK: - Device Callbacks & Helpers
+    // =================================================================================
+
+    void CaptureController::handleDevicePropertyChanged(DevicePropertyChangeReason reason)
+    {
+        if (state_.load() != State::Recording) { return; }
+
+        bool shouldStop = false;
+        switch (reason) {
+        case DevicePropertyChangeReason::StreamFormatChanged:
+        case DevicePropertyChangeReason::StreamConfigurationChanged:
+            // One change usually fires both notifications; handle them once.
+            if (!reconfigurePending_.exchange(true)) {
+                callAsync("callAsync: reconfigure", &CaptureController::performReconfigure);
+            }
+            break;
+        case DevicePropertyChangeReason::DeviceIsAliveChanged:
+            lastStopReason_ = StopReason::DeviceRemoved;
+            shouldStop = true;
+            break;
+        }
+
+        if (shouldStop) {
+            auto expected = State::Recording;
+            if (state_.compare_exchange_strong(expected, State::Stopping)) { asyncPerformStop(); }
+        }
+    }
+
+    // Switches the capture over to the device's new format without ending the take: the
+    // current handler drains into the splicer, and a new one feeds it in the new format.
+    void CaptureController::performReconfigure()
+    {
+        reconfigurePending_.store(false);
+        if (state_.load() != State::Recording) { return; }
+        PG_TRACE_SCOPE("CaptureController::performReconfigure");
+        if (!tappingSession_.refreshAudioFormat()) { return; } // Nothing we depend on changed.
+
+        const auto &format = tappingSession_.getAudioFormat();
+        const auto &sessionFormat = splicer_->getOutputFormat();
+
+        ioProcHandle_.reset();
+        bool resumed = audioDataHandler_->finish();
+        if (!resumed) { lastStopReason_ = StopReason::ExplicitError; }
+        audioDataHandler_.reset();
+
+        auto segment = resumed ? splicer_->beginSegment({format.mSampleRate,
+                                                         format.mChannelsPerFrame})
+                               : nullptr;
+        if (segment) {
+            audioDataHandler_ = std::make_unique<AudioDataHandler>(
+                    format, std::move(segment), AudioDataHandler::BufferOptions{});
+            const double recordingRate = timeline_->getSampleRate();
+            const double startFrame = static_cast<double>(splicer_->getSegmentStartFrame()) *
+                                      recordingRate / sessionFormat.sampleRate;
+            audioDataHandler_->setRecordingPosition(
+                    static_cast<uint64_t>(std::llround(startFrame)), recordingRate);
+            audioDataHandler_->setTimeline(timeline_);
+            audioDataHandler_->setDropoutLog(dropouts_, fillGaps_);
+
+            // Subscribers expect blocks in the original format; the meter only needs the
+            // channel layout to match.
+            if (format.mChannelsPerFrame == sessionFormat.channelCount) {
+                audioDataHandler_->setMeter(meter_);
+                if (format.mSampleRate == sessionFormat.sampleRate) {
+                    audioDataHandler_->setBroadcaster(broadcaster_);
+                }
+            }
+            resumed = audioDataHandler_->start() &&
+                      setupIOProc(tappingSession_.getAggregateDeviceID());
+        } else {
+            resumed = false;
+        }
+
+        if (!resumed) {
+            auto expected = State::Recording;
+            if (state_.compare_exchange_strong(expected, State::Stopping)) {
+                if (lastStopReason_ != StopReason::ExplicitError) {
+                    lastStopReason_ = StopReason::ConfigurationChanged;
+                }
+                performStopLogic();
+            }
+        }
+    }
+
+} // namespace audio_tap
+} // namespace pg
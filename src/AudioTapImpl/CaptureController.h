@@ -0,0 +1,131 @@
+#pragma once
+
+#include "CaptureFormat.h"
+#include "IOProcHandle.h"
+#include "TappingSessionHandle.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace pg {
+namespace audio_tap {
+    class AudioDataHandler;
+    class CaptureBroadcaster;
+    class CaptureSubscription;
+    class CaptureTimeline;
+    class DropoutLog;
+    class LevelMeter;
+    class StreamSplicer;
+    class WaveformPyramid;
+    struct LevelSnapshot;
+
+    // Records the system audio tap to a file, one take at a time: the recorder state machine
+    // behind `CoreAudioTapRecorder`, without its JUCE glue.
+    //
+    // A take goes from idle through starting and recording to stopping, and ends as succeeded
+    // or failed. A device format change does not end it: the capture restarts in the new format
+    // and `StreamSplicer` converts it back to the take's. Losing the device ends it.
+    //
+    // Stops and reconfigurations are deferred to the owner's thread through the `Dispatcher`:
+    // the message thread in the app, or a queue a test pumps. Every public function and the
+    // destructor must be called on that thread; tasks still queued when the controller is
+    // destroyed do nothing. The hardware is reached through `getAudioHardwareBackend()`, so with
+    // a `SimulatedAudioBackend` the whole state machine runs without Core Audio. No JUCE
+    // dependency.
+    class CaptureController
+    {
+    public:
+        // Runs `task` later on the owner's thread.
+        using Dispatcher = std::function<void(std::function<void()> task)>;
+
+        enum class StopReason
+        {
+            UserRequested,
+            ConfigurationChanged, // The device changed format and the capture could not resume.
+            DeviceRemoved,
+            ExplicitError // Part of the take could not be written.
+        };
+
+        explicit CaptureController(Dispatcher dispatcher);
+        ~CaptureController();
+
+        CaptureController(const CaptureController &) = delete;
+        CaptureController &operator=(const CaptureController &) = delete;
+
+        // See `CoreAudioTapRecorder` for these.
+        auto startRecording(const std::string &path, const OutputFormat &outputFormat) -> bool;
+        void stopRecording();
+        auto isRecording() const -> bool;
+        auto hasRecordingFinished() const -> bool;
+        auto subscribe() -> std::unique_ptr<CaptureSubscription>;
+        auto getLevels(LevelSnapshot &levels) -> bool;
+        auto getCallbackTiming(CallbackTimingSummary &timing) const -> bool;
+        auto getWaveform() const -> std::shared_ptr<const WaveformPyramid>;
+        auto getTimeline() const -> std::shared_ptr<const CaptureTimeline>;
+        auto getDropoutLog() const -> std::shared_ptr<const DropoutLog>;
+
+        // Why the current or last take ended. Only meaningful once it has finished.
+        auto getStopReason() const -> StopReason { return lastStopReason_.load(); }
+
+    private:
+        enum class State
+        {
+            Idle,      // Not recording, ready to start.
+            Starting,  // `startRecording` called, in the process of setting up.
+            Recording, // Actively capturing audio.
+            Stopping,  // `stopRecording` called, in the process of finalizing.
+            Succeeded, // Recording finished successfully.
+            Failed     // Recording terminated due to an error.
+        };
+
+        auto canStartRecording() -> bool;
+        auto setupTappingSession() -> bool;
+        auto setupIOProc(AudioDeviceID aggregateDeviceID) -> bool;
+        void cleanupAfterFailure();
+        void asyncPerformStop();
+        // Queues `method` on the owner's thread. It is skipped if the controller is destroyed
+        // first.
+        void callAsync(const char *name, void (CaptureController::*method)());
+        void performStopLogic();
+        void countStop();
+        void handleDevicePropertyChanged(DevicePropertyChangeReason reason);
+        void performReconfigure();
+
+        // Fan-out pool for `subscribe()`: ~85 ms blocks at 48 kHz, enough for every subscriber
+        // queue to hold a few seconds.
+        static constexpr size_t kBroadcastFramesPerBlock = 4096;
+        static constexpr size_t kBroadcastBlockCount = 128;
+
+        const Dispatcher dispatcher_;
+
+        // Expires when the controller is destroyed, which happens on the owner's thread like
+        // everything queued there, so a queued call can tell whether it may still run.
+        std::shared_ptr<CaptureController *> lifetime_{
+                std::make_shared<CaptureController *>(this)};
+
+        // State
+        std::atomic<State> state_{State::Idle};
+        // Also set from the device's listener thread when the device disappears.
+        std::atomic<StopReason> lastStopReason_{StopReason::UserRequested};
+
+        TappingSessionHandle tappingSession_;
+        std::shared_ptr<CaptureBroadcaster> broadcaster_;
+        std::shared_ptr<LevelMeter> meter_; // Read from the owner's thread only.
+        std::shared_ptr<CallbackTimer> callbackTimer_;
+        std::shared_ptr<WaveformPyramid> waveform_; // Kept after stopping.
+        std::shared_ptr<CaptureTimeline> timeline_; // Kept after stopping.
+        std::shared_ptr<DropoutLog> dropouts_;      // Kept after stopping.
+        bool fillGaps_{false};
+        // Owns the file sink; declared before the handler, whose current segment feeds it.
+        std::unique_ptr<StreamSplicer> splicer_;
+        std::atomic<bool> reconfigurePending_{false};
+        std::unique_ptr<AudioDataHandler> audioDataHandler_;
+        // Declared after the handler it delivers to, so that it is destroyed first.
+        std::optional<IOProcHandle<AudioDataHandler>> ioProcHandle_;
+    };
+
+} // namespace audio_tap
+} // namespace pg
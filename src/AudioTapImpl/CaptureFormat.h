@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+
+namespace pg {
+namespace audio_tap {
+
+    // Platform-neutral description of the interleaved float stream produced by the capture
+    // pipeline. Components that must build without Core Audio take this instead of an ASBD.
+    struct CaptureFormat
+    {
+        double sampleRate{0.0};
+        uint32_t channelCount{0};
+
+        auto isValid() const -> bool { return sampleRate > 0.0 && channelCount > 0; }
+    };
+
+    // Sample encoding used when writing a recording to disk. Capture itself is always float32.
+    enum class SampleFormat
+    {
+        Float32,
+        Int16,
+        Int24,
+    };
+
+    constexpr auto bytesPerSample(SampleFormat format) -> uint32_t
+    {
+        switch (format) {
+        case SampleFormat::Int16: return 2;
+        case SampleFormat::Int24: return 3;
+        case SampleFormat::Float32: break;
+        }
+        return 4;
+    }
+
+    // Container written by the file sinks.
+    enum class FileType
+    {
+        Caf,  // Uncompressed linear PCM.
+        Flac, // Lossless; integer only, so Float32 is stored as 24-bit.
+    };
+
+    // Splits a recording into consecutive files once either limit is reached. Zero disables a
+    // limit; with both at zero the recording is a single file.
+    struct SegmentOptions
+    {
+        double maxSeconds{0.0};
+        uint64_t maxBytes{0};
+
+        auto isEnabled() const -> bool { return maxSeconds > 0.0 || maxBytes > 0; }
+    };
+
+    // Leaves long stretches of silence out of the file and lists them in a `.silence` index
+    // instead. A stretch starts once every sample has stayed within `threshold` (linear peak)
+    // for `holdSeconds`; shorter pauses are written as usual. The default threshold only
+    // matches digital silence, so expanding the recording restores exactly what was captured.
+    // A hold time of zero disables gating.
+    struct SilenceOptions
+    {
+        float threshold{0.0f};
+        double holdSeconds{0.0};
+
+        auto isEnabled() const -> bool { return holdSeconds > 0.0; }
+    };
+
+    // Trade-off between conversion quality and cost for `Resampler`. Stopband attenuation,
+    // passband edge (as a fraction of the lower Nyquist frequency) and filter delay at 48 kHz:
+    //   Fast       60 dB, 0.75, ~0.3 ms
+    //   Balanced  100 dB, 0.86, ~1 ms
+    //   Best      140 dB, 0.91, ~2 ms
+    enum class ResamplerQuality
+    {
+        Fast,
+        Balanced,
+        Best,
+    };
+
+    // How a recording is encoded on disk.
+    struct OutputFormat
+    {
+        FileType fileType{FileType::Caf};
+        SampleFormat sampleFormat{SampleFormat::Float32};
+        // Add TPDF dither when quantising to an integer format.
+        bool dither{true};
+        SegmentOptions segments;
+        SilenceOptions silence;
+        // Sample rate of the file. Zero keeps the device rate; anything else is converted on the
+        // writer thread.
+        double sampleRate{0.0};
+        ResamplerQuality resamplerQuality{ResamplerQuality::Balanced};
+        // Keep the file sample-accurate across device dropouts: write silence for audio the
+        // device skipped (up to a second per gap, the rest is logged as unfilled) and leave out
+        // audio it delivered twice. Dropouts are logged either way.
+        bool fillGaps{false};
+    };
+
+} // namespace audio_tap
+} // namespace pg
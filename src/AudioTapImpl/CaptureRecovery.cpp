@@ -0,0 +1,438 @@
+#include "CaptureRecovery.h"
+#include "FlacCrc.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <unistd.h>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        using FileHandle = std::unique_ptr<std::FILE, decltype(&std::fclose)>;
+
+        // A complete FLAC frame is well under this (8 channels of 4096 verbatim 32-bit samples is
+        // 128 KiB), so the last whole frame always starts inside the window.
+        constexpr uint64_t kFlacTailWindow = 1024 * 1024;
+
+        auto readBigEndian(const uint8_t *bytes, size_t count) -> uint64_t
+        {
+            uint64_t value = 0;
+            for (size_t i = 0; i < count; ++i) { value = (value << 8) | bytes[i]; }
+            return value;
+        }
+
+        void storeBigEndian(uint8_t *bytes, uint64_t value, size_t count)
+        {
+            for (size_t i = 0; i < count; ++i) {
+                bytes[i] = static_cast<uint8_t>(value >> (8 * (count - 1 - i)));
+            }
+        }
+
+        auto readAt(std::FILE *file, int64_t offset, void *buffer, size_t size) -> bool
+        {
+            return fseeko(file, offset, SEEK_SET) == 0 &&
+                   std::fread(buffer, 1, size, file) == size;
+        }
+
+        auto writeAt(std::FILE *file, int64_t offset, const void *buffer, size_t size) -> bool
+        {
+            return fseeko(file, offset, SEEK_SET) == 0 &&
+                   std::fwrite(buffer, 1, size, file) == size;
+        }
+
+        auto getFileSize(std::FILE *file) -> int64_t
+        {
+            if (fseeko(file, 0, SEEK_END) != 0) { return -1; }
+            return ftello(file);
+        }
+
+        auto truncateTo(std::FILE *file, int64_t size) -> bool
+        {
+            return std::fflush(file) == 0 && ftruncate(fileno(file), size) == 0;
+        }
+
+        // --- CAF ---
+
+        auto recoverCaf(std::FILE *file, int64_t fileSize) -> RecoveryResult
+        {
+            RecoveryResult result;
+
+            // Walk the header chunks up to `data`, which is always last in our files.
+            uint32_t bytesPerPacket = 0;
+            int64_t dataChunk = -1;
+            for (int64_t offset = 8; offset + 12 <= fileSize;) {
+                uint8_t chunkHeader[12];
+                if (!readAt(file, offset, chunkHeader, sizeof(chunkHeader))) { return result; }
+                const auto chunkSize = static_cast<int64_t>(readBigEndian(chunkHeader + 4, 8));
+
+                if (std::memcmp(chunkHeader, "desc", 4) == 0) {
+                    uint8_t desc[32];
+                    if (!readAt(file, offset + 12, desc, sizeof(desc))) { return result; }
+                    bytesPerPacket = static_cast<uint32_t>(readBigEndian(desc + 16, 4));
+                } else if (std::memcmp(chunkHeader, "data", 4) == 0) {
+                    dataChunk = offset;
+                    break;
+                }
+                if (chunkSize < 0) { return result; }
+                offset += 12 + chunkSize;
+            }
+            if (dataChunk < 0 || bytesPerPacket == 0) { return result; }
+
+            // The data chunk payload starts with a 4-byte edit count.
+            const int64_t audioStart = dataChunk + 12 + 4;
+            if (fileSize < audioStart) { return result; }
+
+            const uint64_t frameCount =
+                    static_cast<uint64_t>(fileSize - audioStart) / bytesPerPacket;
+            const int64_t audioEnd = audioStart + static_cast<int64_t>(frameCount * bytesPerPacket);
+            const int64_t dataSize = 4 + (audioEnd - audioStart);
+
+            uint8_t sizeField[8];
+            if (!readAt(file, dataChunk + 4, sizeField, sizeof(sizeField))) { return result; }
+
+            result.frameCount = frameCount;
+            result.discardedBytes = static_cast<uint64_t>(fileSize - audioEnd);
+            result.repaired = static_cast<int64_t>(readBigEndian(sizeField, 8)) != dataSize ||
+                              audioEnd != fileSize;
+            if (result.repaired) {
+                storeBigEndian(sizeField, static_cast<uint64_t>(dataSize), 8);
+                if (!writeAt(file, dataChunk + 4, sizeField, sizeof(sizeField))) { return result; }
+                if (audioEnd != fileSize && !truncateTo(file, audioEnd)) { return result; }
+            }
+            result.ok = true;
+            return result;
+        }
+
+        // --- FLAC ---
+
+        struct FlacFrameHeader
+        {
+            uint64_t number{0}; // Frame number, or first sample for variable block sizes.
+            uint32_t blockSize{0};
+            bool variableBlockSize{false};
+            uint32_t size{0}; // Bytes, including the CRC-8.
+            uint32_t channelCount{0};
+            int sideChannel{-1};       // Carries one extra bit per sample; -1 if none.
+            uint32_t bitsPerSample{0}; // Zero: as in STREAMINFO.
+        };
+
+        // Reads a FLAC frame most significant bit first, to measure it.
+        class FlacBitReader
+        {
+        public:
+            FlacBitReader(const uint8_t *data, size_t size)
+              : data_(data), bitCount_(static_cast<uint64_t>(size) * 8)
+            {
+            }
+
+            auto read(uint32_t bits, uint32_t &value) -> bool
+            {
+                if (bits > 32 || position_ + bits > bitCount_) { return false; }
+                value = 0;
+                for (uint32_t i = 0; i < bits; ++i) { value = (value << 1) | nextBit(); }
+                return true;
+            }
+
+            auto skip(uint64_t bits) -> bool
+            {
+                if (bits > bitCount_ - position_) { return false; }
+                position_ += bits;
+                return true;
+            }
+
+            // Counts the zero bits up to and including the next one bit.
+            auto readUnary(uint32_t &zeros) -> bool
+            {
+                zeros = 0;
+                while (position_ < bitCount_) {
+                    if (position_ % 8 == 0 && position_ + 8 <= bitCount_ &&
+                        data_[position_ / 8] == 0) {
+                        zeros += 8;
+                        position_ += 8;
+                    } else if (nextBit() != 0) {
+                        return true;
+                    } else {
+                        ++zeros;
+                    }
+                }
+                return false;
+            }
+
+            // Bytes consumed, counting a partly read byte as whole.
+            auto getByteCount() const -> size_t { return static_cast<size_t>((position_ + 7) / 8); }
+
+        private:
+            auto nextBit() -> uint32_t
+            {
+                const uint32_t bit = (data_[position_ / 8] >> (7 - position_ % 8)) & 1u;
+                ++position_;
+                return bit;
+            }
+
+            const uint8_t *data_;
+            const uint64_t bitCount_;
+            uint64_t position_{0};
+        };
+
+        // Parses and CRC-checks the frame header at `p`. Returns nothing if `p` is not the start
+        // of a valid header.
+        auto parseFlacFrameHeader(const uint8_t *p, size_t available)
+                -> std::optional<FlacFrameHeader>
+        {
+            if (available < 6 || p[0] != 0xff || (p[1] & 0xfe) != 0xf8) { return std::nullopt; }
+
+            const uint32_t blockSizeCode = p[2] >> 4;
+            const uint32_t sampleRateCode = p[2] & 0x0f;
+            const uint32_t channelCode = p[3] >> 4;
+            const uint32_t sampleSizeCode = (p[3] >> 1) & 0x07;
+            if (blockSizeCode == 0 || sampleRateCode == 15 || channelCode > 10 ||
+                sampleSizeCode == 3 || (p[3] & 1) != 0) {
+                return std::nullopt;
+            }
+
+            constexpr uint32_t kBitsPerSample[] = {0, 8, 12, 0, 16, 20, 24, 32};
+            FlacFrameHeader header;
+            header.variableBlockSize = (p[1] & 1) != 0;
+            header.channelCount = channelCode < 8 ? channelCode + 1 : 2;
+            header.sideChannel = channelCode == 9 ? 0 : channelCode >= 8 ? 1 : -1;
+            header.bitsPerSample = kBitsPerSample[sampleSizeCode];
+
+            size_t pos = 4;
+            // Frame number in FLAC's extended UTF-8 coding (up to 7 bytes).
+            const uint8_t lead = p[pos++];
+            uint32_t leadingOnes = 0;
+            while (leadingOnes < 8 && (lead & (0x80 >> leadingOnes))) { ++leadingOnes; }
+            if (leadingOnes == 1 || leadingOnes == 8) { return std::nullopt; }
+            const uint32_t extraBytes = leadingOnes == 0 ? 0 : leadingOnes - 1;
+            header.number = lead & (0x7f >> leadingOnes);
+            // Room for the continuation bytes, up to four bytes of block size and sample rate,
+            // and the CRC.
+            if (pos + extraBytes + 5 > available) { return std::nullopt; }
+            for (uint32_t i = 0; i < extraBytes; ++i) {
+                const uint8_t byte = p[pos++];
+                if ((byte & 0xc0) != 0x80) { return std::nullopt; }
+                header.number = (header.number << 6) | (byte & 0x3f);
+            }
+
+            if (blockSizeCode == 1) {
+                header.blockSize = 192;
+            } else if (blockSizeCode <= 5) {
+                header.blockSize = 576u << (blockSizeCode - 2);
+            } else if (blockSizeCode == 6) {
+                header.blockSize = p[pos++] + 1u;
+            } else if (blockSizeCode == 7) {
+                header.blockSize = static_cast<uint32_t>(readBigEndian(p + pos, 2)) + 1;
+                pos += 2;
+            } else {
+                header.blockSize = 256u << (blockSizeCode - 8);
+            }
+
+            if (sampleRateCode == 12) {
+                pos += 1;
+            } else if (sampleRateCode == 13 || sampleRateCode == 14) {
+                pos += 2;
+            }
+
+            if (pos >= available || flac::crc8(p, pos) != p[pos]) { return std::nullopt; }
+            header.size = static_cast<uint32_t>(pos + 1);
+            return header;
+        }
+
+        // Skips a partitioned Rice-coded residual of a subframe with `order` warm-up samples.
+        auto skipFlacResidual(FlacBitReader &reader, uint32_t blockSize, uint32_t order) -> bool
+        {
+            uint32_t method = 0;
+            uint32_t partitionOrder = 0;
+            if (!reader.read(2, method) || method > 1 || !reader.read(4, partitionOrder)) {
+                return false;
+            }
+            const uint32_t parameterBits = method == 0 ? 4 : 5;
+            const uint32_t escape = (1u << parameterBits) - 1;
+            const uint32_t samplesPerPartition = blockSize >> partitionOrder;
+            if ((samplesPerPartition << partitionOrder) != blockSize ||
+                samplesPerPartition < order) {
+                return false;
+            }
+
+            for (uint32_t partition = 0; partition < (1u << partitionOrder); ++partition) {
+                const uint32_t count = samplesPerPartition - (partition == 0 ? order : 0);
+                uint32_t parameter = 0;
+                if (!reader.read(parameterBits, parameter)) { return false; }
+                if (parameter == escape) {
+                    uint32_t bits = 0;
+                    if (!reader.read(5, bits) || !reader.skip(uint64_t{bits} * count)) {
+                        return false;
+                    }
+                    continue;
+                }
+                for (uint32_t i = 0; i < count; ++i) {
+                    uint32_t quotient = 0;
+                    if (!reader.readUnary(quotient) || !reader.skip(parameter)) { return false; }
+                }
+            }
+            return true;
+        }
+
+        // Length in bytes of the frame at `p`, found by walking its subframes, or nothing if it
+        // is malformed or does not fit in `available` bytes. The CRC-16 alone cannot tell: a
+        // frame whose CRC ends in a zero byte still passes the check without that byte.
+        auto measureFlacFrame(const uint8_t *p, size_t available, const FlacFrameHeader &header,
+                              uint32_t streamBitsPerSample) -> std::optional<size_t>
+        {
+            FlacBitReader reader(p, available);
+            if (!reader.skip(uint64_t{header.size} * 8)) { return std::nullopt; }
+
+            for (uint32_t ch = 0; ch < header.channelCount; ++ch) {
+                uint32_t bits = header.bitsPerSample != 0 ? header.bitsPerSample
+                                                          : streamBitsPerSample;
+                if (static_cast<int>(ch) == header.sideChannel) { ++bits; }
+
+                uint32_t padding = 0;
+                uint32_t type = 0;
+                uint32_t hasWastedBits = 0;
+                if (!reader.read(1, padding) || padding != 0 || !reader.read(6, type) ||
+                    !reader.read(1, hasWastedBits)) {
+                    return std::nullopt;
+                }
+                if (hasWastedBits) {
+                    uint32_t wasted = 0;
+                    if (!reader.readUnary(wasted) || wasted + 1 >= bits) { return std::nullopt; }
+                    bits -= wasted + 1;
+                }
+
+                bool ok = false;
+                if (type == 0) { // Constant
+                    ok = reader.skip(bits);
+                } else if (type == 1) { // Verbatim
+                    ok = reader.skip(uint64_t{bits} * header.blockSize);
+                } else if ((type & 0x38) == 0x08 && (type & 0x07) <= 4) { // Fixed predictor
+                    const uint32_t order = type & 0x07;
+                    ok = reader.skip(uint64_t{order} * bits) &&
+                         skipFlacResidual(reader, header.blockSize, order);
+                } else if ((type & 0x20) != 0) { // Linear predictor
+                    const uint32_t order = (type & 0x1f) + 1;
+                    uint32_t precision = 0;
+                    ok = reader.skip(uint64_t{order} * bits) && reader.read(4, precision) &&
+                         precision != 15 && reader.skip(5 + uint64_t{order} * (precision + 1)) &&
+                         skipFlacResidual(reader, header.blockSize, order);
+                }
+                if (!ok) { return std::nullopt; }
+            }
+
+            // Zero padding to a whole byte, then the CRC-16.
+            const size_t size = reader.getByteCount() + 2;
+            if (size > available) { return std::nullopt; }
+            return size;
+        }
+
+        auto recoverFlac(std::FILE *file, int64_t fileSize) -> RecoveryResult
+        {
+            RecoveryResult result;
+
+            // STREAMINFO comes first; skip any further metadata blocks to the first frame.
+            uint8_t streamInfo[34];
+            if (!readAt(file, 8, streamInfo, sizeof(streamInfo))) { return result; }
+            const auto streamBlockSize = static_cast<uint32_t>(readBigEndian(streamInfo + 2, 2));
+            const uint32_t streamBitsPerSample =
+                    (((streamInfo[12] & 1u) << 4) | (streamInfo[13] >> 4)) + 1;
+
+            int64_t audioStart = 4;
+            for (bool last = false; !last;) {
+                uint8_t blockHeader[4];
+                if (!readAt(file, audioStart, blockHeader, sizeof(blockHeader))) { return result; }
+                last = (blockHeader[0] & 0x80) != 0;
+                audioStart += 4 + static_cast<int64_t>(readBigEndian(blockHeader + 1, 3));
+            }
+            if (fileSize < audioStart) { return result; }
+
+            // Find the last frame that is complete: a valid header, subframes that end within
+            // the file and a matching CRC-16.
+            const auto windowSize =
+                    static_cast<size_t>(std::min<uint64_t>(fileSize - audioStart, kFlacTailWindow));
+            const int64_t windowStart = fileSize - static_cast<int64_t>(windowSize);
+            std::vector<uint8_t> tail(windowSize);
+            if (windowSize > 0 && !readAt(file, windowStart, tail.data(), windowSize)) {
+                return result;
+            }
+
+            std::vector<size_t> headers;
+            std::vector<FlacFrameHeader> parsed;
+            for (size_t i = 0; i + 1 < windowSize; ++i) {
+                if (auto header = parseFlacFrameHeader(tail.data() + i, windowSize - i)) {
+                    headers.push_back(i);
+                    parsed.push_back(*header);
+                }
+            }
+
+            std::optional<size_t> lastFrame;
+            size_t lastFrameEnd = 0;
+            for (size_t h = headers.size(); h-- > 0 && !lastFrame;) {
+                const size_t begin = headers[h];
+                const auto size = measureFlacFrame(tail.data() + begin, windowSize - begin,
+                                                   parsed[h], streamBitsPerSample);
+                if (!size) { continue; }
+                const size_t end = begin + *size;
+                const uint16_t stored = static_cast<uint16_t>(readBigEndian(&tail[end - 2], 2));
+                if (flac::crc16(&tail[begin], end - 2 - begin) == stored) {
+                    lastFrame = h;
+                    lastFrameEnd = end;
+                }
+            }
+
+            uint64_t frameCount = 0;
+            int64_t audioEnd = audioStart;
+            if (lastFrame) {
+                const FlacFrameHeader &header = parsed[*lastFrame];
+                const uint64_t firstSample = header.variableBlockSize
+                                                     ? header.number
+                                                     : header.number * streamBlockSize;
+                frameCount = firstSample + header.blockSize;
+                audioEnd = windowStart + static_cast<int64_t>(lastFrameEnd);
+            } else if (fileSize - audioStart > static_cast<int64_t>(kFlacTailWindow)) {
+                return result; // Damaged beyond the tail; not a crash we can repair.
+            }
+
+            const uint64_t storedTotal = readBigEndian(streamInfo + 10, 8) & 0xfffffffffull;
+            result.frameCount = frameCount;
+            result.discardedBytes = static_cast<uint64_t>(fileSize - audioEnd);
+            result.repaired = storedTotal != frameCount || audioEnd != fileSize;
+            if (result.repaired) {
+                // Patch the 36-bit total and clear the MD5, which no longer matches.
+                const uint64_t packed = readBigEndian(streamInfo + 10, 8);
+                storeBigEndian(streamInfo + 10, (packed & ~0xfffffffffull) | frameCount, 8);
+                std::fill(streamInfo + 18, streamInfo + 34, 0);
+                if (!writeAt(file, 8, streamInfo, sizeof(streamInfo))) { return result; }
+                if (audioEnd != fileSize && !truncateTo(file, audioEnd)) { return result; }
+            }
+            result.ok = true;
+            return result;
+        }
+    } // namespace
+
+    auto recoverCaptureFile(const std::string &path) -> RecoveryResult
+    {
+        FileHandle file(std::fopen(path.c_str(), "r+b"), &std::fclose);
+        if (!file) { return {}; }
+
+        uint8_t magic[4];
+        const int64_t fileSize = getFileSize(file.get());
+        if (fileSize < 8 || !readAt(file.get(), 0, magic, sizeof(magic))) { return {}; }
+
+        RecoveryResult result;
+        if (std::memcmp(magic, "caff", 4) == 0) {
+            result = recoverCaf(file.get(), fileSize);
+        } else if (std::memcmp(magic, "fLaC", 4) == 0) {
+            result = recoverFlac(file.get(), fileSize);
+        }
+
+        if (std::fclose(file.release()) != 0) { result.ok = false; }
+        return result;
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace pg {
+namespace audio_tap {
+
+    struct RecoveryResult
+    {
+        // The file is now well formed, whether or not it needed repairing.
+        bool ok{false};
+        // The header was rewritten and/or a partial tail removed.
+        bool repaired{false};
+        // Playable frames in the file after recovery.
+        uint64_t frameCount{0};
+        // Bytes of incomplete audio cut from the end of the file.
+        uint64_t discardedBytes{0};
+    };
+
+    // Repairs a CAF or FLAC recording left behind when the process died mid-take: audio written
+    // after the last checkpoint is reclaimed, a partially written frame at the end is cut off
+    // and the header totals are rewritten to match.
+    //
+    // Only the header and the end of the file are read, so the cost depends on the tail, not
+    // on the recording length. For segmented recordings, run it on the last segment listed in
+    // the index; the others were finalized at rotation.
+    //
+    // Must not be called while the file is still being written. No platform dependencies
+    // beyond POSIX.
+    auto recoverCaptureFile(const std::string &path) -> RecoveryResult;
+
+} // namespace audio_tap
+} // namespace pg
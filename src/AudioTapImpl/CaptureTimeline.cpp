@@ -0,0 +1,255 @@
+#include "CaptureTimeline.h"
+#include "FilePaths.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        constexpr char kSidecarMagic[4] = {'P', 'G', 'T', 'L'};
+        constexpr uint32_t kSidecarVersion = 1;
+        constexpr size_t kHeaderSize = 32;
+        constexpr size_t kBytesPerPoint = 8 + 8 + 4;
+
+        // Points moved out of the queue per pass in `collect()`.
+        constexpr size_t kCollectBatch = 256;
+
+        void appendLittleEndian(std::vector<uint8_t> &out, uint64_t value, int byteCount)
+        {
+            for (int i = 0; i < byteCount; ++i) {
+                out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+            }
+        }
+
+        auto readLittleEndian(const uint8_t *bytes, int byteCount) -> uint64_t
+        {
+            uint64_t value = 0;
+            for (int i = byteCount - 1; i >= 0; --i) { value = (value << 8) | bytes[i]; }
+            return value;
+        }
+
+        // Adds a signed tick offset to a host time without wrapping below zero.
+        auto offsetHostTime(uint64_t hostTime, double ticks) -> uint64_t
+        {
+            const double rounded = std::round(ticks);
+            if (rounded >= 0) { return hostTime + static_cast<uint64_t>(rounded); }
+            const auto back = static_cast<uint64_t>(-rounded);
+            return back > hostTime ? 0 : hostTime - back;
+        }
+    } // namespace
+
+    CaptureTimeline::CaptureTimeline(double sampleRate, double hostTicksPerSecond,
+                                     size_t queueCapacity)
+      : sampleRate_(sampleRate), hostTicksPerSecond_(hostTicksPerSecond), queue_(queueCapacity)
+    {
+    }
+
+    auto CaptureTimeline::record(uint64_t frame, uint64_t hostTime, double rateScalar) -> bool
+    {
+        if (queue_.tryPush(Point{frame, hostTime, rateScalar})) { return true; }
+        droppedPoints_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void CaptureTimeline::collect()
+    {
+        Point batch[kCollectBatch];
+        for (size_t count; (count = queue_.pop(batch, kCollectBatch)) > 0;) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t i = 0; i < count; ++i) { append(batch[i]); }
+        }
+    }
+
+    auto CaptureTimeline::append(const Point &point) -> bool
+    {
+        if (!frames_.empty() &&
+            (point.frame < frames_.back() || point.hostTime <= hostTimes_.back())) {
+            return false;
+        }
+        frames_.push_back(point.frame);
+        hostTimes_.push_back(point.hostTime);
+        rateScalars_.push_back(point.rateScalar > 0 ? static_cast<float>(point.rateScalar) : 1.0f);
+        return true;
+    }
+
+    auto CaptureTimeline::getPointCount() const -> size_t
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return frames_.size();
+    }
+
+    auto CaptureTimeline::getTicksPerFrame(size_t index) const -> double
+    {
+        return hostTicksPerSecond_ / (sampleRate_ * static_cast<double>(rateScalars_[index]));
+    }
+
+    auto CaptureTimeline::getHostTime(double frame, uint64_t &hostTime) const -> bool
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (frames_.empty()) { return false; }
+
+        // The last point at or before the frame; after a drop that is the point where the audio
+        // resumed.
+        const auto next = std::upper_bound(frames_.begin(), frames_.end(), frame,
+                                           [](double value, uint64_t pointFrame)
+                                           { return value < static_cast<double>(pointFrame); });
+        const size_t index = next == frames_.begin()
+                                     ? 0
+                                     : static_cast<size_t>(next - frames_.begin()) - 1;
+        const double offset = frame - static_cast<double>(frames_[index]);
+
+        if (next == frames_.begin() || next == frames_.end()) {
+            hostTime = offsetHostTime(hostTimes_[index], offset * getTicksPerFrame(index));
+            return true;
+        }
+
+        const double frameSpan = static_cast<double>(frames_[index + 1] - frames_[index]);
+        const double hostSpan = static_cast<double>(hostTimes_[index + 1] - hostTimes_[index]);
+        hostTime = offsetHostTime(hostTimes_[index], offset * hostSpan / frameSpan);
+        return true;
+    }
+
+    auto CaptureTimeline::getFrame(uint64_t hostTime, double &frame) const -> bool
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (hostTimes_.empty()) { return false; }
+
+        const auto next = std::upper_bound(hostTimes_.begin(), hostTimes_.end(), hostTime);
+        const size_t index = next == hostTimes_.begin()
+                                     ? 0
+                                     : static_cast<size_t>(next - hostTimes_.begin()) - 1;
+        // Signed: the host time may precede the first point.
+        const double ticks = hostTime >= hostTimes_[index]
+                                     ? static_cast<double>(hostTime - hostTimes_[index])
+                                     : -static_cast<double>(hostTimes_[index] - hostTime);
+        const double first = static_cast<double>(frames_[index]);
+
+        if (next == hostTimes_.begin() || next == hostTimes_.end()) {
+            frame = first + ticks / getTicksPerFrame(index);
+            return true;
+        }
+
+        const double frameSpan = static_cast<double>(frames_[index + 1] - frames_[index]);
+        const double hostSpan = static_cast<double>(hostTimes_[index + 1] - hostTimes_[index]);
+        frame = first + ticks * frameSpan / hostSpan;
+        return true;
+    }
+
+    auto CaptureTimeline::save(const std::string &path) const -> bool
+    {
+        std::vector<uint8_t> bytes;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const size_t count = frames_.size();
+            bytes.reserve(kHeaderSize + count * kBytesPerPoint);
+
+            bytes.insert(bytes.end(), kSidecarMagic, kSidecarMagic + 4);
+            appendLittleEndian(bytes, kSidecarVersion, 4);
+            uint64_t bits;
+            std::memcpy(&bits, &sampleRate_, sizeof(bits));
+            appendLittleEndian(bytes, bits, 8);
+            std::memcpy(&bits, &hostTicksPerSecond_, sizeof(bits));
+            appendLittleEndian(bytes, bits, 8);
+            appendLittleEndian(bytes, count, 8);
+
+            // Stored as arrays, like in memory.
+            for (const uint64_t frame : frames_) { appendLittleEndian(bytes, frame, 8); }
+            for (const uint64_t hostTime : hostTimes_) { appendLittleEndian(bytes, hostTime, 8); }
+            for (const float rateScalar : rateScalars_) {
+                uint32_t rateBits;
+                std::memcpy(&rateBits, &rateScalar, sizeof(rateBits));
+                appendLittleEndian(bytes, rateBits, 4);
+            }
+        }
+
+        // Written to a temporary file and renamed into place so readers never see a partial
+        // sidecar.
+        const std::string temporaryPath = path + ".tmp";
+        std::FILE *file = std::fopen(temporaryPath.c_str(), "wb");
+        if (!file) { return false; }
+
+        bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        ok = std::fclose(file) == 0 && ok;
+        if (!ok) {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+        return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+    }
+
+    auto CaptureTimeline::load(const std::string &path) -> std::unique_ptr<CaptureTimeline>
+    {
+        std::FILE *file = std::fopen(path.c_str(), "rb");
+        if (!file) { return nullptr; }
+        std::vector<uint8_t> bytes;
+        uint8_t buffer[65536];
+        for (size_t read; (read = std::fread(buffer, 1, sizeof(buffer), file)) > 0;) {
+            bytes.insert(bytes.end(), buffer, buffer + read);
+        }
+        std::fclose(file);
+
+        if (bytes.size() < kHeaderSize || std::memcmp(bytes.data(), kSidecarMagic, 4) != 0 ||
+            readLittleEndian(&bytes[4], 4) != kSidecarVersion) {
+            return nullptr;
+        }
+
+        double sampleRate, hostTicksPerSecond;
+        uint64_t bits = readLittleEndian(&bytes[8], 8);
+        std::memcpy(&sampleRate, &bits, sizeof(sampleRate));
+        bits = readLittleEndian(&bytes[16], 8);
+        std::memcpy(&hostTicksPerSecond, &bits, sizeof(hostTicksPerSecond));
+        const uint64_t count = readLittleEndian(&bytes[24], 8);
+        if (!(sampleRate > 0) || !(hostTicksPerSecond > 0) ||
+            (bytes.size() - kHeaderSize) / kBytesPerPoint != count) {
+            return nullptr;
+        }
+
+        auto timeline = std::make_unique<CaptureTimeline>(sampleRate, hostTicksPerSecond, 2);
+        const uint8_t *frames = &bytes[kHeaderSize];
+        const uint8_t *hostTimes = frames + count * 8;
+        const uint8_t *rateScalars = hostTimes + count * 8;
+        for (uint64_t i = 0; i < count; ++i) {
+            const auto rateBits = static_cast<uint32_t>(readLittleEndian(rateScalars + i * 4, 4));
+            float rateScalar;
+            std::memcpy(&rateScalar, &rateBits, sizeof(rateScalar));
+            const Point point{readLittleEndian(frames + i * 8, 8),
+                              readLittleEndian(hostTimes + i * 8, 8), rateScalar};
+            if (!timeline->append(point)) { return nullptr; }
+        }
+        return timeline;
+    }
+
+    auto CaptureTimeline::getSidecarPath(const std::string &recordingPath) -> std::string
+    {
+        return paths::getCompanionPath(recordingPath, ".timeline");
+    }
+
+    TimelineSink::TimelineSink(std::unique_ptr<SampleSink> sink,
+                               std::shared_ptr<CaptureTimeline> timeline, std::string sidecarPath)
+      : sink_(std::move(sink)), timeline_(std::move(timeline)), sidecarPath_(std::move(sidecarPath))
+    {
+    }
+
+    auto TimelineSink::write(const float *interleaved, size_t frameCount) -> bool
+    {
+        timeline_->collect();
+        return sink_->write(interleaved, frameCount);
+    }
+
+    auto TimelineSink::finalize() -> bool
+    {
+        const bool ok = sink_->finalize();
+        // Like the waveform overview, the timeline is a companion: failing to save it does not
+        // fail the take.
+        timeline_->collect();
+        timeline_->save(sidecarPath_);
+        return ok;
+    }
+
+} // namespace audio_tap
+} // namespace pg
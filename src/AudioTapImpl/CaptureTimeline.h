@@ -0,0 +1,119 @@
+#pragma once
+
+#include "SampleSink.h"
+#include "SpscRingBuffer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    // Maps frames of a recording to the host clock and back, e.g. to line a take up with
+    // playback from another engine or with video.
+    //
+    // The capture callback records one point per callback: the recording frame its first sample
+    // lands on, the host time the device reported for that sample, and the device's rate scalar
+    // (actual over nominal sample rate). Points travel through a lock-free queue and are moved
+    // into the index by `collect()` on the writer thread. The index is a structure of arrays, so
+    // the binary search in a query only touches the array it searches: about 20 bytes per
+    // callback, ~7 MB for an hour of 512-frame callbacks at 48 kHz.
+    //
+    // Between two points a query interpolates linearly; before the first and after the last it
+    // extrapolates with that point's rate scalar. Points share a frame when the audio of a
+    // callback was dropped, so time spent without audio maps to the frame where it resumes.
+    //
+    // `record()` is real-time safe and called from one thread; `collect()` from one other
+    // thread; queries from any thread. No platform dependencies.
+    class CaptureTimeline
+    {
+    public:
+        static constexpr size_t kDefaultQueueCapacity = 8192;
+
+        // `sampleRate` is the recording's rate; `hostTicksPerSecond` the host clock frequency.
+        CaptureTimeline(double sampleRate, double hostTicksPerSecond,
+                        size_t queueCapacity = kDefaultQueueCapacity);
+
+        CaptureTimeline(const CaptureTimeline &) = delete;
+        CaptureTimeline &operator=(const CaptureTimeline &) = delete;
+
+        // Notes that recording frame `frame` was captured at `hostTime`. Called from the
+        // real-time thread; never blocks or allocates. Returns false, and counts the point as
+        // dropped, if the queue is full.
+        auto record(uint64_t frame, uint64_t hostTime, double rateScalar) -> bool;
+
+        // Moves queued points into the index. Points that go backwards are discarded.
+        void collect();
+
+        auto getSampleRate() const -> double { return sampleRate_; }
+        auto getHostTicksPerSecond() const -> double { return hostTicksPerSecond_; }
+        auto getPointCount() const -> size_t;
+        auto getDroppedPointCount() const -> uint64_t { return droppedPoints_.load(); }
+
+        // Host time at which recording frame `frame` was captured. Returns false if there are
+        // no points yet.
+        auto getHostTime(double frame, uint64_t &hostTime) const -> bool;
+
+        // Recording frame captured at `hostTime`; may be fractional, negative or beyond the
+        // end when extrapolated. Returns false if there are no points yet.
+        auto getFrame(uint64_t hostTime, double &frame) const -> bool;
+
+        // Writes the index to `path`, replacing it atomically.
+        auto save(const std::string &path) const -> bool;
+
+        // Reads an index written by `save()`. Returns nullptr if the file is missing or invalid.
+        static auto load(const std::string &path) -> std::unique_ptr<CaptureTimeline>;
+
+        // Sidecar location for a recording: `take.caf` -> `take.timeline`.
+        static auto getSidecarPath(const std::string &recordingPath) -> std::string;
+
+    private:
+        struct Point
+        {
+            uint64_t frame;
+            uint64_t hostTime;
+            double rateScalar;
+        };
+
+        auto append(const Point &point) -> bool; // Requires `mutex_`.
+        // Host ticks per recording frame at the rate scalar of point `index`.
+        auto getTicksPerFrame(size_t index) const -> double;
+
+        const double sampleRate_;
+        const double hostTicksPerSecond_;
+        SpscRingBuffer<Point> queue_;
+        std::atomic<uint64_t> droppedPoints_{0};
+
+        // Guards the index. Frames and host times never decrease.
+        mutable std::mutex mutex_;
+        std::vector<uint64_t> frames_;
+        std::vector<uint64_t> hostTimes_;
+        std::vector<float> rateScalars_;
+    };
+
+    // Pass-through sink that collects a `CaptureTimeline` on the writer thread and saves it as a
+    // sidecar when the recording is finalized.
+    class TimelineSink : public SampleSink
+    {
+    public:
+        TimelineSink(std::unique_ptr<SampleSink> sink, std::shared_ptr<CaptureTimeline> timeline,
+                     std::string sidecarPath);
+
+        auto write(const float *interleaved, size_t frameCount) -> bool override;
+        auto finalize() -> bool override;
+        auto checkpoint() -> bool override { return sink_->checkpoint(); }
+        auto getBytesWritten() const -> uint64_t override { return sink_->getBytesWritten(); }
+
+    private:
+        std::unique_ptr<SampleSink> sink_;
+        std::shared_ptr<CaptureTimeline> timeline_;
+        const std::string sidecarPath_;
+    };
+
+} // namespace audio_tap
+} // namespace pg
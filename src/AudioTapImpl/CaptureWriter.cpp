@@ -0,0 +1,149 @@
+#include "CaptureWriter.h"
+#include "TraceRecorder.h"
+
+#include <chrono>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        // How long the writer thread sleeps between drains. The store holds several seconds of
+        // audio, so this only needs to be short relative to that.
+        constexpr auto kIdleInterval = std::chrono::milliseconds(10);
+
+        // Frames per store page, and so per write call into the sink.
+        constexpr size_t kFramesPerPage = 4096;
+    } // namespace
+
+    CaptureWriter::CaptureWriter(uint32_t channelCount, const BufferOptions &options,
+                                 std::unique_ptr<SampleSink> sink)
+      : channelCount_(channelCount > 0 ? channelCount : 1),
+        checkpointIntervalSeconds_(options.checkpointIntervalSeconds),
+        store_(kFramesPerPage * channelCount_,
+               (options.capacityInFrames + kFramesPerPage - 1) / kFramesPerPage,
+               (options.prefaultedFrames + kFramesPerPage - 1) / kFramesPerPage,
+               options.lockMemory),
+        sink_(std::move(sink)),
+        bytesWrittenMetric_(MetricsRegistry::getDefault().counter(
+                "pg_capture_bytes_written_total", "Encoded bytes written to recordings.")),
+        lagMetric_(MetricsRegistry::getDefault().gauge(
+                "pg_capture_writer_lag_frames",
+                "Frames captured but not yet written by the current recording.")),
+        highWaterMetric_(MetricsRegistry::getDefault().gauge(
+                "pg_capture_buffer_high_water_frames",
+                "Most frames ever queued between the capture callback and the writer."))
+    {
+    }
+
+    CaptureWriter::~CaptureWriter()
+    {
+        stop();
+    }
+
+    auto CaptureWriter::start() -> bool
+    {
+        if (stopped_ || thread_.joinable() || !sink_ || !store_.isValid()) { return false; }
+
+        running_.store(true);
+        thread_ = std::thread([this] { run(); });
+        return true;
+    }
+
+    auto CaptureWriter::push(const float *samples, size_t sampleCount) -> bool
+    {
+        if (store_.write(samples, sampleCount)) {
+            // Single producer, so a plain load and store does; the writer only reads it.
+            pushedSamples_.store(pushedSamples_.load(std::memory_order_relaxed) + sampleCount,
+                                 std::memory_order_relaxed);
+            return true;
+        }
+
+        droppedSamples_.fetch_add(sampleCount, std::memory_order_relaxed);
+        return false;
+    }
+
+    auto CaptureWriter::stop() -> bool
+    {
+        if (stopped_) { return !writeFailed_; }
+        stopped_ = true;
+        PG_TRACE_SCOPE("CaptureWriter::stop");
+
+        running_.store(false);
+        if (thread_.joinable()) { thread_.join(); }
+
+        if (sink_) {
+            {
+                PG_TRACE_SCOPE("CaptureWriter::drain");
+                store_.readAll([this](const float *samples, size_t count)
+                               { writeToSink(samples, count); });
+            }
+            PG_TRACE_SCOPE("SampleSink::finalize");
+            if (!sink_->finalize()) { writeFailed_ = true; }
+            updateMetrics();
+        }
+        return !writeFailed_;
+    }
+
+    auto CaptureWriter::getPeakBufferedFrames() const -> uint64_t
+    {
+        return store_.getPeakPagesInUse() * kFramesPerPage;
+    }
+
+    auto CaptureWriter::getQueuedFrameCount() const -> uint64_t
+    {
+        const uint64_t pushedFrames = pushedSamples_.load(std::memory_order_relaxed) /
+                                      channelCount_;
+        const uint64_t writtenFrames = writtenFrames_.load(std::memory_order_relaxed);
+        return pushedFrames > writtenFrames ? pushedFrames - writtenFrames : 0;
+    }
+
+    void CaptureWriter::run()
+    {
+        using Clock = std::chrono::steady_clock;
+        const auto checkpointInterval = std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(checkpointIntervalSeconds_));
+        auto nextCheckpoint = Clock::now() + checkpointInterval;
+
+        while (running_.load()) {
+            store_.preparePages();
+            store_.readFullPages([this](const float *samples, size_t count)
+                                 { writeToSink(samples, count); });
+            updateMetrics();
+
+            // Everything but the producer's partially filled page is now on its way to disk.
+            if (checkpointIntervalSeconds_ > 0.0 && Clock::now() >= nextCheckpoint) {
+                PG_TRACE_SCOPE("SampleSink::checkpoint");
+                if (!writeFailed_ && !sink_->checkpoint()) { writeFailed_ = true; }
+                nextCheckpoint = Clock::now() + checkpointInterval;
+            }
+
+            std::this_thread::sleep_for(kIdleInterval);
+        }
+    }
+
+    void CaptureWriter::updateMetrics()
+    {
+        const uint64_t bytes = sink_->getBytesWritten();
+        if (bytes > reportedBytes_) { bytesWrittenMetric_.add(bytes - reportedBytes_); }
+        reportedBytes_ = bytes;
+
+        lagMetric_.set(static_cast<double>(getQueuedFrameCount()));
+        highWaterMetric_.raiseTo(static_cast<double>(getPeakBufferedFrames()));
+    }
+
+    void CaptureWriter::writeToSink(const float *samples, size_t sampleCount)
+    {
+        // Keep consuming after a failure so the producer never sees a permanently full store.
+        if (writeFailed_) { return; }
+        PG_TRACE_SCOPE("SampleSink::write");
+
+        const size_t frames = sampleCount / channelCount_;
+        if (sink_->write(samples, frames)) {
+            writtenFrames_.fetch_add(frames, std::memory_order_relaxed);
+        } else {
+            writeFailed_ = true;
+        }
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "MetricsRegistry.h"
+#include "PagedSampleStore.h"
+#include "SampleSink.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+namespace pg {
+namespace audio_tap {
+
+    // Streams interleaved float audio from a real-time producer to a `SampleSink`.
+    //
+    // The producer appends into a lock-free `PagedSampleStore`; a dedicated writer thread drains
+    // full pages and hands them to the sink. Memory use is bounded by the store capacity, so
+    // recording length is limited only by the sink. If the writer falls behind and the store fills
+    // up, the incoming block is dropped and counted rather than blocking the audio thread.
+    //
+    // Bytes written, the writer's backlog and the buffer high-water mark are also reported to
+    // `MetricsRegistry::getDefault()`.
+    //
+    // This class has no platform dependencies.
+    class CaptureWriter
+    {
+    public:
+        struct BufferOptions
+        {
+            // Frames that may queue up before the producer starts dropping blocks.
+            size_t capacityInFrames{0};
+            // Frames of prefaulted space kept ready for the producer at all times.
+            size_t prefaultedFrames{0};
+            // Also wire the prefaulted pages into RAM with `mlock`.
+            bool lockMemory{false};
+            // How often to call `SampleSink::checkpoint()`; zero never does.
+            double checkpointIntervalSeconds{0.0};
+        };
+
+        CaptureWriter(uint32_t channelCount, const BufferOptions &options,
+                      std::unique_ptr<SampleSink> sink);
+        ~CaptureWriter();
+
+        CaptureWriter(const CaptureWriter &) = delete;
+        CaptureWriter &operator=(const CaptureWriter &) = delete;
+
+        // Starts the writer thread. Returns false if it is already running or has been stopped,
+        // or if the store's memory could not be reserved.
+        auto start() -> bool;
+
+        // Called from the real-time audio thread. Never blocks or allocates.
+        // Returns false (and counts the samples as dropped) if the store has no room.
+        auto push(const float *samples, size_t sampleCount) -> bool;
+
+        // Stops the writer thread, drains everything still queued and finalizes the sink.
+        // Must not be called concurrently with `push()`. Returns false if any write failed.
+        auto stop() -> bool;
+
+        auto getChannelCount() const -> uint32_t { return channelCount_; }
+        auto getDroppedSampleCount() const -> uint64_t { return droppedSamples_.load(); }
+        auto getWrittenFrameCount() const -> uint64_t { return writtenFrames_.load(); }
+        auto getPeakBufferedFrames() const -> uint64_t;
+        // Frames accepted by `push()` that have not reached the sink yet.
+        auto getQueuedFrameCount() const -> uint64_t;
+        auto getResidentBufferBytes() const -> size_t { return store_.getResidentBytes(); }
+
+    private:
+        void run();
+        void writeToSink(const float *samples, size_t sampleCount);
+        void updateMetrics();
+
+        const uint32_t channelCount_;
+        const double checkpointIntervalSeconds_;
+        PagedSampleStore store_;
+        std::unique_ptr<SampleSink> sink_;
+
+        std::thread thread_;
+        std::atomic<bool> running_{false};
+        bool stopped_{false};
+        bool writeFailed_{false}; // Writer-thread only until `stop()` joins.
+
+        std::atomic<uint64_t> droppedSamples_{0};
+        std::atomic<uint64_t> writtenFrames_{0};
+        std::atomic<uint64_t> pushedSamples_{0};
+
+        MetricCounter &bytesWrittenMetric_;
+        MetricGauge &lagMetric_;
+        MetricGauge &highWaterMetric_;
+        uint64_t reportedBytes_{0}; // Writer thread only.
+    };
+
+} // namespace audio_tap
+} // namespace pg
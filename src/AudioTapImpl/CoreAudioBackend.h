@@ -0,0 +1,62 @@
+#pragma once
+
+#include "AudioHardwareBackend.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace pg {
+namespace audio_tap {
+
+    // `AudioHardwareBackend` on the macOS HAL: process taps, a private aggregate device,
+    // property listeners and IOProcs.
+    class CoreAudioBackend : public AudioHardwareBackend
+    {
+    public:
+        CoreAudioBackend() = default;
+        ~CoreAudioBackend() override;
+
+        CoreAudioBackend(const CoreAudioBackend &) = delete;
+        CoreAudioBackend &operator=(const CoreAudioBackend &) = delete;
+
+        auto getDefaultOutputDevice() -> AudioDeviceID override;
+        auto getStreamFormat(AudioDeviceID device, AudioStreamBasicDescription &format)
+                -> bool override;
+        auto createTap(AudioDeviceID outputDevice, AudioObjectID &tapID,
+                       AudioDeviceID &aggregateDeviceID) -> bool override;
+        void destroyTap(AudioObjectID tapID, AudioDeviceID aggregateDeviceID) override;
+        auto addPropertyListener(AudioDeviceID device, PropertyListener listener)
+                -> Token override;
+        void removePropertyListener(Token token) override;
+        auto startIOProc(AudioDeviceID device, IOCallback callback) -> Token override;
+        void stopIOProc(Token token) override;
+        auto getHostClockFrequency() -> double override;
+
+    private:
+        struct Listener;
+        struct IOProc;
+
+        // `tapUID` is the UUID of the tap the aggregate device should expose.
+        static auto findOrCreateAggregateDevice(CFStringRef tapUID) -> AudioDeviceID;
+
+        static OSStatus propertyListenerCallback(AudioObjectID inObjectID,
+                                                 UInt32 inNumberAddresses,
+                                                 const AudioObjectPropertyAddress inAddresses[],
+                                                 void *__nullable inClientData);
+
+        static OSStatus ioprocCallback(AudioObjectID inDevice, const AudioTimeStamp *inNow,
+                                       const AudioBufferList *inInputData,
+                                       const AudioTimeStamp *inInputTime,
+                                       AudioBufferList *outOutputData,
+                                       const AudioTimeStamp *inOutputTime,
+                                       void *__nullable inClientData);
+
+        std::mutex mutex_;
+        Token nextToken_{1};
+        std::map<Token, std::unique_ptr<Listener>> listeners_;
+        std::map<Token, std::unique_ptr<IOProc>> ioProcs_;
+    };
+
+} // namespace audio_tap
+} // namespace pg
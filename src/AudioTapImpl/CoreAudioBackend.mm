@@ -0,0 +1,326 @@
+#include "CoreAudioBackend.h"
+#include "TraceRecorder.h"
+
+#import <AVFoundation/AVFoundation.h>
+#import <CoreAudio/AudioHardwareTapping.h>
+#import <CoreAudio/CATapDescription.h>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        constexpr const char *kAggregateDeviceUID = "PG-Aggregate-Device";
+
+        constexpr AudioObjectPropertyAddress kWatchedProperties[] = {
+                {kAudioDevicePropertyStreamFormat, kAudioObjectPropertyScopeOutput,
+                 kAudioObjectPropertyElementMain},
+                {kAudioDevicePropertyStreamConfiguration, kAudioObjectPropertyScopeOutput,
+                 kAudioObjectPropertyElementMain},
+                {kAudioDevicePropertyDeviceIsAlive, kAudioObjectPropertyScopeOutput,
+                 kAudioObjectPropertyElementMain},
+        };
+    } // namespace
+
+    struct CoreAudioBackend::Listener
+    {
+        AudioDeviceID device{kAudioObjectUnknown};
+        PropertyListener callback;
+    };
+
+    struct CoreAudioBackend::IOProc
+    {
+        AudioDeviceID device{kAudioObjectUnknown};
+        AudioDeviceIOProcID procID{nullptr};
+        IOCallback callback;
+    };
+
+    CoreAudioBackend::~CoreAudioBackend()
+    {
+        for (const auto &entry : ioProcs_) {
+            AudioDeviceStop(entry.second->device, entry.second->procID);
+            AudioDeviceDestroyIOProcID(entry.second->device, entry.second->procID);
+        }
+        for (const auto &entry : listeners_) {
+            for (const auto &address : kWatchedProperties) {
+                AudioObjectRemovePropertyListener(entry.second->device, &address,
+                                                  propertyListenerCallback, entry.second.get());
+            }
+        }
+    }
+
+    auto CoreAudioBackend::getDefaultOutputDevice() -> AudioDeviceID
+    {
+        AudioDeviceID deviceID = kAudioObjectUnknown;
+        UInt32 propertySize = sizeof(deviceID);
+        AudioObjectPropertyAddress propertyAddress = {kAudioHardwarePropertyDefaultOutputDevice,
+                                                      kAudioObjectPropertyScopeGlobal,
+                                                      kAudioObjectPropertyElementMain};
+
+        OSStatus status = AudioObjectGetPropertyData(kAudioObjectSystemObject, &propertyAddress, 0,
+                                                     nullptr, &propertySize, &deviceID);
+        if (status != kAudioHardwareNoError) { return kAudioObjectUnknown; }
+
+        return deviceID;
+    }
+
+    auto CoreAudioBackend::getStreamFormat(AudioDeviceID device,
+                                           AudioStreamBasicDescription &format) -> bool
+    {
+        AudioObjectPropertyAddress propertyAddress = {kAudioDevicePropertyStreamFormat,
+                                                      kAudioObjectPropertyScopeOutput,
+                                                      kAudioObjectPropertyElementMain};
+        UInt32 dataSize = sizeof(format);
+        return AudioObjectGetPropertyData(device, &propertyAddress, 0, nullptr, &dataSize,
+                                          &format) == noErr;
+    }
+
+    // Tap and aggregate device are created in dependency order: the aggregate device lists the
+    // tap by the UUID of its description, before the tap itself exists.
+    auto CoreAudioBackend::createTap(AudioDeviceID outputDevice, AudioObjectID &tapID,
+                                     AudioDeviceID &aggregateDeviceID) -> bool
+    {
+        // Create the CATapDescription, which is needed for BOTH tap creation and agg device
+        // creation
+        CFStringRef deviceUIDRef = nullptr;
+        UInt32 uidSize = sizeof(deviceUIDRef);
+        AudioObjectPropertyAddress uidAddress = {kAudioDevicePropertyDeviceUID,
+                                                 kAudioObjectPropertyScopeGlobal,
+                                                 kAudioObjectPropertyElementMain};
+        OSStatus status = noErr;
+        CATapDescription *tapDescription = nil;
+        {
+            PG_TRACE_SCOPE("createTapDescription");
+            status = AudioObjectGetPropertyData(outputDevice, &uidAddress, 0, nullptr, &uidSize,
+                                                &deviceUIDRef);
+            if (status != noErr || deviceUIDRef == nullptr) { return false; }
+
+            tapDescription =
+                    [[CATapDescription alloc] initWithProcesses:@[]
+                                                   andDeviceUID:(__bridge NSString *)deviceUIDRef
+                                                     withStream:0];
+            CFRelease(deviceUIDRef);
+            if (!tapDescription) { return false; }
+
+            [tapDescription setMuteBehavior:CATapUnmuted];
+            [tapDescription setName:@"BIASAudioTap"];
+            [tapDescription setPrivate:YES];
+            [tapDescription setExclusive:YES];
+        }
+
+        // Second, create or find the aggregate device. It depends on the tap's UUID from the
+        // description.
+        aggregateDeviceID = findOrCreateAggregateDevice(
+                (__bridge CFStringRef)[[tapDescription UUID] UUIDString]);
+        if (aggregateDeviceID == kAudioObjectUnknown) {
+            [tapDescription release];
+            return false;
+        }
+
+        // Third, with the aggregate device ready, create the actual process tap.
+        {
+            PG_TRACE_SCOPE("AudioHardwareCreateProcessTap");
+            status = AudioHardwareCreateProcessTap(tapDescription, &tapID);
+        }
+        [tapDescription release]; // release the description now that it's been used
+
+        if (status != noErr) {
+            AudioHardwareDestroyAggregateDevice(aggregateDeviceID);
+            aggregateDeviceID = kAudioObjectUnknown;
+            tapID = kAudioObjectUnknown;
+            return false;
+        }
+
+        return true;
+    }
+
+    void CoreAudioBackend::destroyTap(AudioObjectID tapID, AudioDeviceID aggregateDeviceID)
+    {
+        if (tapID != kAudioObjectUnknown) { AudioHardwareDestroyProcessTap(tapID); }
+        if (aggregateDeviceID != kAudioDeviceUnknown) {
+            AudioHardwareDestroyAggregateDevice(aggregateDeviceID);
+        }
+    }
+
+    auto CoreAudioBackend::findOrCreateAggregateDevice(CFStringRef tapUID) -> AudioDeviceID
+    {
+        PG_TRACE_SCOPE("CoreAudioBackend::findOrCreateAggregateDevice");
+
+        // Check if the device already exists in the system
+        AudioObjectPropertyAddress propertyAddress = {kAudioHardwarePropertyDevices,
+                                                      kAudioObjectPropertyScopeGlobal,
+                                                      kAudioObjectPropertyElementMain};
+
+        UInt32 dataSize = 0;
+        OSStatus status = AudioObjectGetPropertyDataSize(kAudioObjectSystemObject, &propertyAddress,
+                                                         0, nullptr, &dataSize);
+
+        if (status == noErr && dataSize > 0) {
+            std::vector<AudioDeviceID> devices(dataSize / sizeof(AudioDeviceID));
+            status = AudioObjectGetPropertyData(kAudioObjectSystemObject, &propertyAddress, 0,
+                                                nullptr, &dataSize, devices.data());
+
+            if (status == noErr) {
+                for (AudioDeviceID deviceID : devices) {
+                    CFStringRef deviceUID = nullptr;
+                    UInt32 uidSize = sizeof(deviceUID);
+                    AudioObjectPropertyAddress uidAddress = {kAudioDevicePropertyDeviceUID,
+                                                             kAudioObjectPropertyScopeGlobal,
+                                                             kAudioObjectPropertyElementMain};
+
+                    status = AudioObjectGetPropertyData(deviceID, &uidAddress, 0, nullptr, &uidSize,
+                                                        &deviceUID);
+
+                    if (status == noErr && deviceUID != nullptr) {
+                        NSString *nsUID = (__bridge NSString *)deviceUID;
+                        if ([nsUID isEqualToString:@(kAggregateDeviceUID)]) {
+                            CFRelease(deviceUID);
+                            return deviceID; // Found it
+                        }
+                        CFRelease(deviceUID); // Not a match, release it
+                    }
+                }
+            }
+        }
+
+        // --- Create a new one if not found ---
+
+        NSArray<NSDictionary *> *taps = @[ @{
+            @kAudioSubTapUIDKey : (__bridge NSString *)tapUID,
+            @kAudioSubTapDriftCompensationKey : @YES,
+        } ];
+
+        NSDictionary *aggregateDeviceProperties = @{
+            @kAudioAggregateDeviceNameKey : @"BIASAggregateDevice",
+            @kAudioAggregateDeviceUIDKey : @(kAggregateDeviceUID),
+
+            @kAudioAggregateDeviceTapListKey : taps,
+            @kAudioAggregateDeviceTapAutoStartKey : @NO,
+            @kAudioAggregateDeviceIsPrivateKey : @YES,
+        };
+
+        PG_TRACE_SCOPE("AudioHardwareCreateAggregateDevice");
+        AudioDeviceID newDeviceID = kAudioObjectUnknown;
+        status = AudioHardwareCreateAggregateDevice(
+                (__bridge CFDictionaryRef)aggregateDeviceProperties, &newDeviceID);
+
+        return (status == noErr) ? newDeviceID : kAudioObjectUnknown;
+    }
+
+    auto CoreAudioBackend::addPropertyListener(AudioDeviceID device, PropertyListener listener)
+            -> Token
+    {
+        if (device == kAudioObjectUnknown || !listener) { return 0; }
+
+        auto entry = std::make_unique<Listener>();
+        entry->device = device;
+        entry->callback = std::move(listener);
+        for (const auto &address : kWatchedProperties) {
+            AudioObjectAddPropertyListener(device, &address, propertyListenerCallback,
+                                           entry.get());
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Token token = nextToken_++;
+        listeners_[token] = std::move(entry);
+        return token;
+    }
+
+    void CoreAudioBackend::removePropertyListener(Token token)
+    {
+        std::unique_ptr<Listener> entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto it = listeners_.find(token);
+            if (it == listeners_.end()) { return; }
+            entry = std::move(it->second);
+            listeners_.erase(it);
+        }
+
+        for (const auto &address : kWatchedProperties) {
+            AudioObjectRemovePropertyListener(entry->device, &address, propertyListenerCallback,
+                                              entry.get());
+        }
+    }
+
+    auto CoreAudioBackend::startIOProc(AudioDeviceID device, IOCallback callback) -> Token
+    {
+        if (device == kAudioObjectUnknown || !callback) { return 0; }
+
+        auto ioProc = std::make_unique<IOProc>();
+        ioProc->device = device;
+        ioProc->callback = std::move(callback);
+
+        OSStatus status =
+                AudioDeviceCreateIOProcID(device, ioprocCallback, ioProc.get(), &ioProc->procID);
+        if (status != noErr) { return 0; }
+
+        {
+            PG_TRACE_SCOPE("AudioDeviceStart");
+            status = AudioDeviceStart(device, ioProc->procID);
+        }
+        if (status != noErr) {
+            AudioDeviceDestroyIOProcID(device, ioProc->procID);
+            return 0;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Token token = nextToken_++;
+        ioProcs_[token] = std::move(ioProc);
+        return token;
+    }
+
+    void CoreAudioBackend::stopIOProc(Token token)
+    {
+        std::unique_ptr<IOProc> ioProc;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto it = ioProcs_.find(token);
+            if (it == ioProcs_.end()) { return; }
+            ioProc = std::move(it->second);
+            ioProcs_.erase(it);
+        }
+
+        AudioDeviceStop(ioProc->device, ioProc->procID);
+        AudioDeviceDestroyIOProcID(ioProc->device, ioProc->procID);
+    }
+
+    auto CoreAudioBackend::getHostClockFrequency() -> double
+    {
+        return AudioGetHostClockFrequency();
+    }
+
+    OSStatus CoreAudioBackend::propertyListenerCallback(
+            AudioObjectID, UInt32 inNumberAddresses,
+            const AudioObjectPropertyAddress inAddresses[], void *__nullable inClientData)
+    {
+        auto *listener = static_cast<Listener *>(inClientData);
+        if (!listener || !listener->callback) { return noErr; }
+
+        for (UInt32 i = 0; i < inNumberAddresses; ++i) {
+            const auto &address = inAddresses[i];
+            if (address.mSelector == kAudioDevicePropertyStreamFormat) {
+                listener->callback(DevicePropertyChangeReason::StreamFormatChanged);
+            } else if (address.mSelector == kAudioDevicePropertyStreamConfiguration) {
+                listener->callback(DevicePropertyChangeReason::StreamConfigurationChanged);
+            } else if (address.mSelector == kAudioDevicePropertyDeviceIsAlive) {
+                listener->callback(DevicePropertyChangeReason::DeviceIsAliveChanged);
+            }
+        }
+
+        return noErr;
+    }
+
+    OSStatus CoreAudioBackend::ioprocCallback(AudioObjectID, const AudioTimeStamp *,
+                                              const AudioBufferList *inInputData,
+                                              const AudioTimeStamp *inInputTime,
+                                              AudioBufferList *, const AudioTimeStamp *,
+                                              void *__nullable inClientData)
+    {
+        auto *ioProc = static_cast<IOProc *>(inClientData);
+        if (ioProc) { ioProc->callback(inInputData, inInputTime); }
+        return noErr;
+    }
+
+} // namespace audio_tap
+} // namespace pg
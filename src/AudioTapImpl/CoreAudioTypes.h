@@ -0,0 +1,115 @@
+#pragma once
+
+// The Core Audio data types the capture pipeline passes around. On Apple platforms this is the
+// system header; elsewhere (the simulated backend on Linux) it is a layout-compatible subset of
+// the declarations, with no functions.
+
+#if defined(__APPLE__)
+
+#include <CoreAudio/CoreAudio.h>
+
+#else
+
+#include <cstdint>
+
+typedef uint8_t UInt8;
+typedef int16_t SInt16;
+typedef uint32_t UInt32;
+typedef int32_t SInt32;
+typedef uint64_t UInt64;
+typedef double Float64;
+typedef SInt32 OSStatus;
+
+typedef UInt32 AudioObjectID;
+typedef AudioObjectID AudioDeviceID;
+typedef UInt32 AudioFormatID;
+typedef UInt32 AudioFormatFlags;
+
+enum : OSStatus
+{
+    noErr = 0,
+    kAudioHardwareNoError = 0,
+};
+
+enum : AudioObjectID
+{
+    kAudioObjectUnknown = 0,
+    kAudioDeviceUnknown = kAudioObjectUnknown,
+};
+
+enum : AudioFormatID
+{
+    kAudioFormatLinearPCM = 0x6C70636D, // 'lpcm'
+};
+
+enum : AudioFormatFlags
+{
+    kAudioFormatFlagIsFloat = 1u << 0,
+    kAudioFormatFlagIsBigEndian = 1u << 1,
+    kAudioFormatFlagIsSignedInteger = 1u << 2,
+    kAudioFormatFlagIsPacked = 1u << 3,
+    kAudioFormatFlagIsNonInterleaved = 1u << 5,
+    kAudioFormatFlagsNativeFloatPacked = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked,
+};
+
+enum : UInt32
+{
+    kAudioTimeStampSampleTimeValid = 1u << 0,
+    kAudioTimeStampHostTimeValid = 1u << 1,
+    kAudioTimeStampRateScalarValid = 1u << 2,
+    kAudioTimeStampWordClockTimeValid = 1u << 3,
+    kAudioTimeStampSMPTETimeValid = 1u << 4,
+};
+
+struct AudioStreamBasicDescription
+{
+    Float64 mSampleRate;
+    AudioFormatID mFormatID;
+    AudioFormatFlags mFormatFlags;
+    UInt32 mBytesPerPacket;
+    UInt32 mFramesPerPacket;
+    UInt32 mBytesPerFrame;
+    UInt32 mChannelsPerFrame;
+    UInt32 mBitsPerChannel;
+    UInt32 mReserved;
+};
+
+struct AudioBuffer
+{
+    UInt32 mNumberChannels;
+    UInt32 mDataByteSize;
+    void *mData;
+};
+
+// Variable length: allocate room for `mNumberBuffers` entries.
+struct AudioBufferList
+{
+    UInt32 mNumberBuffers;
+    AudioBuffer mBuffers[1];
+};
+
+struct SMPTETime
+{
+    SInt16 mSubframes;
+    SInt16 mSubframeDivisor;
+    UInt32 mCounter;
+    UInt32 mType;
+    UInt32 mFlags;
+    SInt16 mHours;
+    SInt16 mMinutes;
+    SInt16 mSeconds;
+    SInt16 mFrames;
+};
+
+struct AudioTimeStamp
+{
+    Float64 mSampleTime;
+    UInt64 mHostTime;
+    Float64 mRateScalar;
+    UInt64 mWordClockTime;
+    SMPTETime mSMPTETime;
+    UInt32 mFlags;
+    UInt32 mReserved;
+};
+
+#endif
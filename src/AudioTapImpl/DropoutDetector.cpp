@@ -0,0 +1,34 @@
+#include "DropoutDetector.h"
+
+#include <cmath>
+
+namespace pg {
+namespace audio_tap {
+
+    DropoutDetector::DropoutDetector(double toleranceFrames)
+      : toleranceFrames_(std::fabs(toleranceFrames))
+    {
+    }
+
+    auto DropoutDetector::process(double sampleTime, uint32_t frameCount) -> int64_t
+    {
+        const double jump = sampleTime - expectedSampleTime_;
+        const bool continuous = !hasPrevious_ || std::fabs(jump) <= toleranceFrames_;
+
+        hasPrevious_ = true;
+        expectedSampleTime_ = sampleTime + frameCount;
+        if (continuous) { return 0; }
+
+        const auto frames = static_cast<int64_t>(std::llround(jump));
+        if (frames > 0) {
+            gapCount_.fetch_add(1, std::memory_order_relaxed);
+            missingFrames_.fetch_add(static_cast<uint64_t>(frames), std::memory_order_relaxed);
+        } else if (frames < 0) {
+            overlapCount_.fetch_add(1, std::memory_order_relaxed);
+            repeatedFrames_.fetch_add(static_cast<uint64_t>(-frames), std::memory_order_relaxed);
+        }
+        return frames;
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace pg {
+namespace audio_tap {
+
+    // Finds discontinuities in a capture stream from the sample times the device reports.
+    //
+    // Each callback should start where the previous one ended: at its sample time plus its
+    // frame count. A later start means the device skipped audio (a gap, typically an overload
+    // or a late wake-up); an earlier one means audio is delivered twice (an overlap). Jumps
+    // within `toleranceFrames` are rounding and ignored.
+    //
+    // `process()` is real-time safe; the counters may be read from any thread. No platform
+    // dependencies.
+    class DropoutDetector
+    {
+    public:
+        explicit DropoutDetector(double toleranceFrames = 0.5);
+
+        // Checks a callback starting at `sampleTime` with `frameCount` frames against the end
+        // of the previous one. Returns the frames missing before it (positive), repeated at its
+        // start (negative), or zero if the stream is continuous. The first callback after
+        // construction or `reset()` is never a discontinuity.
+        auto process(double sampleTime, uint32_t frameCount) -> int64_t;
+
+        // Forgets the previous callback, e.g. when the device restarts its clock.
+        void reset() { hasPrevious_ = false; }
+
+        auto getGapCount() const -> uint64_t { return gapCount_.load(); }
+        auto getOverlapCount() const -> uint64_t { return overlapCount_.load(); }
+        auto getMissingFrameCount() const -> uint64_t { return missingFrames_.load(); }
+        auto getRepeatedFrameCount() const -> uint64_t { return repeatedFrames_.load(); }
+
+    private:
+        const double toleranceFrames_;
+        double expectedSampleTime_{0.0};
+        bool hasPrevious_{false};
+
+        std::atomic<uint64_t> gapCount_{0};
+        std::atomic<uint64_t> overlapCount_{0};
+        std::atomic<uint64_t> missingFrames_{0};
+        std::atomic<uint64_t> repeatedFrames_{0};
+    };
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,189 @@
+#include "DropoutLog.h"
+#include "FilePaths.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        constexpr const char *kHeader = "# audio capture dropout log v2";
+        // Without the unfilled frame count.
+        constexpr const char *kHeaderV1 = "# audio capture dropout log v1";
+
+        // Dropouts moved out of the queue per pass in `collect()`.
+        constexpr size_t kCollectBatch = 64;
+
+        constexpr const char *kKindNames[Dropout::kKindCount] = {"gap", "overlap", "overflow"};
+
+        auto indexOf(Dropout::Kind kind) -> size_t { return static_cast<size_t>(kind); }
+    } // namespace
+
+    DropoutLog::DropoutLog(double sampleRate, size_t queueCapacity)
+      : sampleRate_(sampleRate), queue_(queueCapacity)
+    {
+    }
+
+    auto DropoutLog::report(const Dropout &dropout) -> bool
+    {
+        counts_[indexOf(dropout.kind)].fetch_add(1, std::memory_order_relaxed);
+        frameCounts_[indexOf(dropout.kind)].fetch_add(dropout.frameCount,
+                                                      std::memory_order_relaxed);
+        return queue_.tryPush(dropout);
+    }
+
+    void DropoutLog::collect()
+    {
+        Dropout batch[kCollectBatch];
+        for (size_t count; (count = queue_.pop(batch, kCollectBatch)) > 0;) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t i = 0; i < count; ++i) { append(batch[i]); }
+        }
+    }
+
+    void DropoutLog::append(const Dropout &dropout)
+    {
+        // An overflow is reported per dropped block; the recording does not advance in between.
+        if (dropout.kind == Dropout::Kind::Overflow && !dropouts_.empty() &&
+            dropouts_.back().kind == Dropout::Kind::Overflow &&
+            dropouts_.back().frame == dropout.frame) {
+            dropouts_.back().frameCount += dropout.frameCount;
+            return;
+        }
+        dropouts_.push_back(dropout);
+    }
+
+    auto DropoutLog::getCount(Dropout::Kind kind) const -> uint64_t
+    {
+        return counts_[indexOf(kind)].load();
+    }
+
+    auto DropoutLog::getFrameCount(Dropout::Kind kind) const -> uint64_t
+    {
+        return frameCounts_[indexOf(kind)].load();
+    }
+
+    auto DropoutLog::getDropouts() const -> std::vector<Dropout>
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return dropouts_;
+    }
+
+    auto DropoutLog::getDropoutCount() const -> size_t
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return dropouts_.size();
+    }
+
+    auto DropoutLog::save(const std::string &path) const -> bool
+    {
+        const std::vector<Dropout> dropouts = getDropouts();
+
+        // Written to a temporary file and renamed into place so readers never see a partial
+        // log.
+        const std::string temporaryPath = path + ".tmp";
+        std::FILE *file = std::fopen(temporaryPath.c_str(), "w");
+        if (!file) { return false; }
+
+        std::fprintf(file, "%s\n", kHeader);
+        std::fprintf(file, "sample_rate %.17g\n", sampleRate_);
+        std::fprintf(file, "dropouts %zu\n", dropouts.size());
+        for (const auto &dropout : dropouts) {
+            std::fprintf(file, "%s %" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+                         kKindNames[indexOf(dropout.kind)], dropout.frame, dropout.frameCount,
+                         dropout.unfilledFrameCount);
+        }
+
+        const bool written = std::ferror(file) == 0;
+        if (std::fclose(file) != 0 || !written) { return false; }
+        return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+    }
+
+    auto DropoutLog::load(const std::string &path) -> std::unique_ptr<DropoutLog>
+    {
+        std::FILE *file = std::fopen(path.c_str(), "r");
+        if (!file) { return nullptr; }
+
+        double sampleRate = 0.0;
+        size_t dropoutCount = 0;
+        char comment[64] = {};
+        const bool hasHeader = std::fgets(comment, sizeof(comment), file) != nullptr;
+        const auto startsWith = [&](const char *header)
+        { return hasHeader && std::strncmp(comment, header, std::strlen(header)) == 0; };
+        const bool isV1 = startsWith(kHeaderV1);
+        const bool headerOk = (isV1 || startsWith(kHeader)) &&
+                              std::fscanf(file, " sample_rate %lf", &sampleRate) == 1 &&
+                              std::fscanf(file, " dropouts %zu", &dropoutCount) == 1;
+
+        auto log = std::make_unique<DropoutLog>(sampleRate, 2);
+        bool ok = headerOk && sampleRate > 0.0;
+        for (size_t i = 0; ok && i < dropoutCount; ++i) {
+            char kindName[16] = {};
+            Dropout dropout;
+            ok = std::fscanf(file, " %15s %" SCNu64 " %" SCNu64, kindName, &dropout.frame,
+                             &dropout.frameCount) == 3;
+            if (ok && isV1) {
+                // Gaps were never filled before the count was logged.
+                dropout.unfilledFrameCount =
+                        std::strcmp(kindName, kKindNames[0]) == 0 ? dropout.frameCount : 0;
+            } else if (ok) {
+                ok = std::fscanf(file, " %" SCNu64, &dropout.unfilledFrameCount) == 1;
+            }
+
+            size_t kind = 0;
+            while (kind < Dropout::kKindCount && std::strcmp(kindName, kKindNames[kind]) != 0) {
+                ++kind;
+            }
+            ok = ok && kind < Dropout::kKindCount;
+            if (ok) {
+                dropout.kind = static_cast<Dropout::Kind>(kind);
+                log->counts_[kind].fetch_add(1);
+                log->frameCounts_[kind].fetch_add(dropout.frameCount);
+                log->dropouts_.push_back(dropout);
+            }
+        }
+        std::fclose(file);
+        return ok ? std::move(log) : nullptr;
+    }
+
+    auto DropoutLog::getLogPath(const std::string &recordingPath) -> std::string
+    {
+        return paths::getCompanionPath(recordingPath, ".dropouts");
+    }
+
+    DropoutLogSink::DropoutLogSink(std::unique_ptr<SampleSink> sink,
+                                   std::shared_ptr<DropoutLog> log, std::string logPath)
+      : sink_(std::move(sink)), log_(std::move(log)), logPath_(std::move(logPath))
+    {
+    }
+
+    auto DropoutLogSink::write(const float *interleaved, size_t frameCount) -> bool
+    {
+        log_->collect();
+        return sink_->write(interleaved, frameCount);
+    }
+
+    auto DropoutLogSink::checkpoint() -> bool
+    {
+        const bool ok = sink_->checkpoint();
+        // Dropouts are rare, so the log is only rewritten when it has grown.
+        log_->collect();
+        const size_t count = log_->getDropoutCount();
+        if (count != savedCount_ && log_->save(logPath_)) { savedCount_ = count; }
+        return ok;
+    }
+
+    auto DropoutLogSink::finalize() -> bool
+    {
+        const bool ok = sink_->finalize();
+        // Metadata only: a take whose log could not be written is still a good take.
+        log_->collect();
+        log_->save(logPath_);
+        return ok;
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "SampleSink.h"
+#include "SpscRingBuffer.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    // One place where a recording is not a continuous copy of what the device played.
+    struct Dropout
+    {
+        enum class Kind
+        {
+            Gap,      // The device skipped audio; silence or nothing stands in for it.
+            Overlap,  // The device delivered audio twice.
+            Overflow, // The writer fell behind and a block was dropped.
+        };
+        static constexpr size_t kKindCount = 3;
+
+        Kind kind{Kind::Gap};
+        uint64_t frame{0};      // Position in the recording.
+        uint64_t frameCount{0}; // Frames missing, repeated or dropped.
+        // Gaps only: missing frames that were not written as silence, so the recording runs
+        // this much behind the device from here on. All of them unless gaps are filled.
+        uint64_t unfilledFrameCount{0};
+    };
+
+    // The dropouts of one take, kept as metadata next to the recording (`take.caf` ->
+    // `take.dropouts`, one text line per dropout) so clicks in a file can be traced back to
+    // their cause. Logs written before unfilled gap frames were recorded still load, with
+    // every gap frame counted as unfilled.
+    //
+    // The capture callback reports dropouts through a lock-free queue; `collect()` moves them
+    // into the log on the writer thread, merging consecutive reports of one overflow. Counts
+    // are kept at report time, so they stay exact even if the queue overflows.
+    //
+    // `report()` is real-time safe and called from one thread; `collect()` from one other
+    // thread; the getters from any thread. No platform dependencies.
+    class DropoutLog
+    {
+    public:
+        static constexpr size_t kDefaultQueueCapacity = 1024;
+
+        // `sampleRate` is the recording's rate, stored for reference.
+        explicit DropoutLog(double sampleRate, size_t queueCapacity = kDefaultQueueCapacity);
+
+        DropoutLog(const DropoutLog &) = delete;
+        DropoutLog &operator=(const DropoutLog &) = delete;
+
+        // Called from the real-time thread; never blocks or allocates. Returns false if the
+        // queue is full, in which case only the counters see the dropout.
+        auto report(const Dropout &dropout) -> bool;
+
+        // Moves reported dropouts into the log.
+        void collect();
+
+        auto getSampleRate() const -> double { return sampleRate_; }
+        auto getCount(Dropout::Kind kind) const -> uint64_t;
+        // Frames missing, repeated or dropped over all dropouts of `kind`.
+        auto getFrameCount(Dropout::Kind kind) const -> uint64_t;
+        auto getDropouts() const -> std::vector<Dropout>;
+        // Dropouts collected so far; merged overflow reports count once.
+        auto getDropoutCount() const -> size_t;
+
+        // Writes the log to `path`, replacing it atomically.
+        auto save(const std::string &path) const -> bool;
+
+        // Reads a log written by `save()`. Returns nullptr if the file is missing or malformed.
+        static auto load(const std::string &path) -> std::unique_ptr<DropoutLog>;
+
+        // Log location for a recording: `take.caf` -> `take.dropouts`.
+        static auto getLogPath(const std::string &recordingPath) -> std::string;
+
+    private:
+        void append(const Dropout &dropout); // Requires `mutex_`.
+
+        const double sampleRate_;
+        SpscRingBuffer<Dropout> queue_;
+        std::array<std::atomic<uint64_t>, Dropout::kKindCount> counts_{};
+        std::array<std::atomic<uint64_t>, Dropout::kKindCount> frameCounts_{};
+
+        mutable std::mutex mutex_;
+        std::vector<Dropout> dropouts_;
+    };
+
+    // Pass-through sink that collects a `DropoutLog` on the writer thread and saves it next to
+    // the recording when the recording is finalized, and at checkpoints if it has grown.
+    class DropoutLogSink : public SampleSink
+    {
+    public:
+        DropoutLogSink(std::unique_ptr<SampleSink> sink, std::shared_ptr<DropoutLog> log,
+                       std::string logPath);
+
+        auto write(const float *interleaved, size_t frameCount) -> bool override;
+        auto finalize() -> bool override;
+        auto checkpoint() -> bool override;
+        auto getBytesWritten() const -> uint64_t override { return sink_->getBytesWritten(); }
+
+    private:
+        std::unique_ptr<SampleSink> sink_;
+        std::shared_ptr<DropoutLog> log_;
+        const std::string logPath_;
+        size_t savedCount_{0}; // Dropouts in the file on disk.
+    };
+
+} // namespace audio_tap
+} // namespace pg
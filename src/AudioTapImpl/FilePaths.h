@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <utility>
+
+namespace pg {
+namespace audio_tap {
+    namespace paths {
+
+        // Splits "dir/take.caf" into "dir/take" and ".caf". The extension is empty if the file
+        // name has none.
+        inline auto splitExtension(const std::string &path) -> std::pair<std::string, std::string>
+        {
+            const size_t slash = path.find_last_of('/');
+            const size_t dot = path.find_last_of('.');
+            if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+                return {path, {}};
+            }
+            return {path.substr(0, dot), path.substr(dot)};
+        }
+
+        // Path of a file that accompanies a recording: ("dir/take.caf", ".peaks") ->
+        // "dir/take.peaks".
+        inline auto getCompanionPath(const std::string &recordingPath, const char *extension)
+                -> std::string
+        {
+            return splitExtension(recordingPath).first + extension;
+        }
+
+        inline auto fileName(const std::string &path) -> std::string
+        {
+            const size_t slash = path.find_last_of('/');
+            return slash == std::string::npos ? path : path.substr(slash + 1);
+        }
+
+    } // namespace paths
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,76 @@
+#include "FileSinkFactory.h"
+#include "CafFileWriter.h"
+#include "FlacFileWriter.h"
+#include "Resampler.h"
+#include "SegmentedFileSink.h"
+#include "SilenceGatingSink.h"
+#include "SilenceIndex.h"
+#include "WaveformPyramid.h"
+
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+namespace pg {
+namespace audio_tap {
+    namespace utils {
+
+        auto createFileSink(const AudioStreamBasicDescription &format, const std::string &path,
+                            const OutputFormat &outputFormat,
+                            std::shared_ptr<WaveformPyramid> waveform)
+                -> std::unique_ptr<SampleSink>
+        {
+            const CaptureFormat captureFormat{format.mSampleRate, format.mChannelsPerFrame};
+            const bool resample = outputFormat.sampleRate > 0.0 &&
+                                  std::llround(outputFormat.sampleRate) !=
+                                          std::llround(captureFormat.sampleRate);
+            // Everything behind the resampler, files and indexes included, runs at file rate.
+            const CaptureFormat fileFormat{resample ? outputFormat.sampleRate
+                                                    : captureFormat.sampleRate,
+                                           captureFormat.channelCount};
+            auto openFile = [fileFormat, outputFormat](const std::string &filePath)
+                    -> std::unique_ptr<SampleSink>
+            {
+                switch (outputFormat.fileType) {
+                case FileType::Flac:
+                    return FlacFileWriter::open(filePath, fileFormat, outputFormat);
+                case FileType::Caf:
+                    break;
+                }
+                return CafFileWriter::open(filePath, fileFormat, outputFormat);
+            };
+
+            std::unique_ptr<SampleSink> sink;
+            if (outputFormat.segments.isEnabled()) {
+                sink = SegmentedFileSink::create(path, fileFormat, outputFormat.segments,
+                                                 openFile);
+            } else {
+                sink = openFile(path);
+            }
+
+            // Gating sits in front of segmentation, so segment limits apply to stored audio.
+            const auto indexPath = SilenceIndex::getIndexPath(path);
+            if (sink && outputFormat.silence.isEnabled()) {
+                sink = SilenceGatingSink::create(std::move(sink), fileFormat, outputFormat.silence,
+                                                 indexPath);
+            } else {
+                std::remove(indexPath.c_str()); // Never leave a stale index next to a new take.
+            }
+
+            // The overview covers the whole take at file rate, gated silence included.
+            if (sink && waveform) {
+                sink = std::make_unique<WaveformSink>(std::move(sink), std::move(waveform),
+                                                      WaveformPyramid::getSidecarPath(path));
+            }
+
+            if (sink && resample) {
+                sink = std::make_unique<ResamplingSink>(std::move(sink), captureFormat,
+                                                        fileFormat.sampleRate,
+                                                        outputFormat.resamplerQuality);
+            }
+            return sink;
+        }
+
+    } // namespace utils
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "CaptureFormat.h"
+#include "SampleSink.h"
+
+#include "CoreAudioTypes.h"
+#include <memory>
+#include <string>
+
+namespace pg {
+namespace audio_tap {
+    class WaveformPyramid;
+
+    namespace utils {
+
+        /**
+         * @brief Opens a CAF or FLAC file at `path` for incremental writing of captured audio.
+         *
+         * The chain behind `utils::createFileSink(format, juce::File, ...)`, which documents the
+         * parameters; this overload takes a plain path and has no JUCE dependency.
+         * @return A sink that appends to the file on every write, or nullptr if the file could
+         * not be created.
+         */
+        auto createFileSink(const AudioStreamBasicDescription &format, const std::string &path,
+                            const OutputFormat &outputFormat = {},
+                            std::shared_ptr<WaveformPyramid> waveform = nullptr)
+                -> std::unique_ptr<SampleSink>;
+
+    } // namespace utils
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace pg {
+namespace audio_tap {
+    namespace flac {
+
+        // FLAC frame checksums: CRC-8 (poly 0x07) over the frame header and CRC-16 (poly 0x8005)
+        // over the whole frame, both MSB-first with a zero initial value.
+
+        struct CrcTables
+        {
+            std::array<uint8_t, 256> crc8{};
+            std::array<uint16_t, 256> crc16{};
+
+            CrcTables()
+            {
+                for (uint32_t i = 0; i < 256; ++i) {
+                    uint32_t c8 = i;
+                    uint32_t c16 = i << 8;
+                    for (int bit = 0; bit < 8; ++bit) {
+                        c8 = (c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1;
+                        c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : c16 << 1;
+                    }
+                    crc8[i] = static_cast<uint8_t>(c8);
+                    crc16[i] = static_cast<uint16_t>(c16);
+                }
+            }
+        };
+
+        inline auto getCrcTables() -> const CrcTables &
+        {
+            static const CrcTables tables;
+            return tables;
+        }
+
+        inline auto crc8(const uint8_t *data, size_t size) -> uint8_t
+        {
+            const auto &table = getCrcTables().crc8;
+            uint8_t crc = 0;
+            for (size_t i = 0; i < size; ++i) { crc = table[crc ^ data[i]]; }
+            return crc;
+        }
+
+        inline auto crc16(const uint8_t *data, size_t size) -> uint16_t
+        {
+            const auto &table = getCrcTables().crc16;
+            uint16_t crc = 0;
+            for (size_t i = 0; i < size; ++i) {
+                crc = static_cast<uint16_t>((crc << 8) ^ table[(crc >> 8) ^ data[i]]);
+            }
+            return crc;
+        }
+
+    } // namespace flac
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,511 @@
+#include "FlacFileWriter.h"
+#include "FlacCrc.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        // Frames per FLAC frame; the format's usual choice at 44.1/48 kHz.
+        constexpr size_t kBlockSize = 4096;
+        constexpr uint32_t kBlockSizeCode = 12; // 256 * 2^(12 - 8) = 4096
+
+        // Encoded frames are batched into a single fwrite once this much has accumulated.
+        constexpr size_t kOutputFlushBytes = 256 * 1024;
+
+        constexpr uint32_t kMaxChannels = 8;
+        constexpr uint32_t kMaxFixedOrder = 4;
+        constexpr uint32_t kMaxPartitionOrder = 8;
+        constexpr uint32_t kStreamInfoSize = 34;
+        constexpr long kStreamInfoOffset = 8; // After "fLaC" and the metadata block header.
+
+        enum ChannelAssignment : uint32_t
+        {
+            kLeftSide = 8,
+            kRightSide = 9,
+            kMidSide = 10,
+        };
+
+        // MSB-first bit packer appending whole bytes to a vector.
+        class BitWriter
+        {
+        public:
+            explicit BitWriter(std::vector<uint8_t> &out) : out_(out) {}
+
+            // `bitCount` <= 32.
+            void write(uint64_t value, uint32_t bitCount)
+            {
+                accumulator_ = (accumulator_ << bitCount) | (value & ((1ull << bitCount) - 1));
+                pendingBits_ += bitCount;
+                while (pendingBits_ >= 8) {
+                    pendingBits_ -= 8;
+                    out_.push_back(static_cast<uint8_t>(accumulator_ >> pendingBits_));
+                }
+            }
+
+            void writeSigned(int64_t value, uint32_t bitCount)
+            {
+                write(static_cast<uint64_t>(value), bitCount);
+            }
+
+            void writeRice(uint32_t value, uint32_t parameter)
+            {
+                uint32_t quotient = value >> parameter;
+                if (quotient + 1 + parameter <= 32) {
+                    const uint32_t remainder = value & ((1u << parameter) - 1);
+                    write((1ull << parameter) | remainder, quotient + 1 + parameter);
+                    return;
+                }
+                for (; quotient >= 32; quotient -= 32) { write(0, 32); }
+                write(1, quotient + 1);
+                write(value, parameter);
+            }
+
+            void alignToByte()
+            {
+                if (pendingBits_ > 0) { write(0, 8 - pendingBits_); }
+            }
+
+        private:
+            std::vector<uint8_t> &out_;
+            uint64_t accumulator_{0};
+            uint32_t pendingBits_{0};
+        };
+
+        // FLAC's "UTF-8" coding of the frame number.
+        void writeUtf8(BitWriter &writer, uint64_t value)
+        {
+            if (value < 0x80) {
+                writer.write(value, 8);
+                return;
+            }
+            uint32_t extraBytes = value < 0x800        ? 1
+                                  : value < 0x10000    ? 2
+                                  : value < 0x200000   ? 3
+                                  : value < 0x4000000  ? 4
+                                  : value < 0x80000000 ? 5
+                                                       : 6;
+            const uint32_t leadBits = 6 - extraBytes; // Payload bits in the first byte.
+            const uint64_t lead = (0xff00u >> (extraBytes + 1)) & 0xff;
+            writer.write(lead | ((value >> (6 * extraBytes)) & ((1u << leadBits) - 1)), 8);
+            while (extraBytes-- > 0) {
+                writer.write(0x80 | ((value >> (6 * extraBytes)) & 0x3f), 8);
+            }
+        }
+
+        auto zigzag(int32_t value) -> uint32_t
+        {
+            return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+        }
+
+        // Picks the fixed predictor order (0-4) with the smallest absolute residual sum. Returns
+        // the order and writes that sum to `cost`, used to compare stereo decorrelation modes.
+        auto chooseFixedOrder(const int32_t *x, size_t count, uint64_t &cost) -> uint32_t
+        {
+            std::array<uint64_t, kMaxFixedOrder + 1> sums{};
+            if (count > kMaxFixedOrder) {
+                int64_t last0 = x[3];
+                int64_t last1 = last0 - x[2];
+                int64_t last2 = last1 - (x[2] - x[1]);
+                int64_t last3 = last2 - (x[2] - 2 * int64_t(x[1]) + x[0]);
+                for (size_t i = kMaxFixedOrder; i < count; ++i) {
+                    const int64_t e0 = x[i];
+                    const int64_t e1 = e0 - last0;
+                    const int64_t e2 = e1 - last1;
+                    const int64_t e3 = e2 - last2;
+                    const int64_t e4 = e3 - last3;
+                    sums[0] += static_cast<uint64_t>(std::llabs(e0));
+                    sums[1] += static_cast<uint64_t>(std::llabs(e1));
+                    sums[2] += static_cast<uint64_t>(std::llabs(e2));
+                    sums[3] += static_cast<uint64_t>(std::llabs(e3));
+                    sums[4] += static_cast<uint64_t>(std::llabs(e4));
+                    last0 = e0;
+                    last1 = e1;
+                    last2 = e2;
+                    last3 = e3;
+                }
+            }
+            const auto best = std::min_element(sums.begin(), sums.end());
+            cost = *best;
+            return static_cast<uint32_t>(best - sums.begin());
+        }
+
+        void computeFixedResidual(const int32_t *x, size_t count, uint32_t order,
+                                  int32_t *residual)
+        {
+            switch (order) {
+            case 0:
+                std::copy(x, x + count, residual);
+                break;
+            case 1:
+                for (size_t i = 1; i < count; ++i) { residual[i - 1] = x[i] - x[i - 1]; }
+                break;
+            case 2:
+                for (size_t i = 2; i < count; ++i) {
+                    residual[i - 2] = x[i] - 2 * x[i - 1] + x[i - 2];
+                }
+                break;
+            case 3:
+                for (size_t i = 3; i < count; ++i) {
+                    residual[i - 3] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+                }
+                break;
+            default:
+                for (size_t i = 4; i < count; ++i) {
+                    residual[i - 4] = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+                }
+                break;
+            }
+        }
+
+        auto riceParameterFor(uint64_t sum, size_t count) -> uint32_t
+        {
+            uint32_t parameter = 0;
+            while (parameter < 30 && (static_cast<uint64_t>(count) << (parameter + 1)) < sum) {
+                ++parameter;
+            }
+            return parameter;
+        }
+
+        auto estimateRiceBits(uint64_t sum, size_t count, uint32_t parameter) -> uint64_t
+        {
+            return count * (parameter + 1) + (sum >> parameter);
+        }
+
+        struct ResidualCoding
+        {
+            uint32_t partitionOrder{0};
+            std::array<uint32_t, 1u << kMaxPartitionOrder> parameters{};
+            bool wideParameters{false}; // RICE2: 5-bit parameters.
+            uint64_t bits{0};
+        };
+
+        // Chooses the partition order and per-partition Rice parameters that minimise the
+        // estimated size. `sums` is scratch for 2^kMaxPartitionOrder entries.
+        auto planResidual(const int32_t *residual, size_t blockSize, uint32_t predictorOrder,
+                          uint64_t *sums) -> ResidualCoding
+        {
+            uint32_t maxOrder = kMaxPartitionOrder;
+            while (maxOrder > 0 && ((blockSize & ((size_t(1) << maxOrder) - 1)) != 0 ||
+                                    (blockSize >> maxOrder) <= predictorOrder)) {
+                --maxOrder;
+            }
+
+            // Per-partition zigzag sums at the finest order, merged pairwise for coarser ones.
+            const size_t partitions = size_t(1) << maxOrder;
+            const size_t partitionSize = blockSize >> maxOrder;
+            const int32_t *r = residual;
+            for (size_t p = 0; p < partitions; ++p) {
+                const size_t count = partitionSize - (p == 0 ? predictorOrder : 0);
+                uint64_t sum = 0;
+                for (size_t i = 0; i < count; ++i) { sum += zigzag(r[i]); }
+                sums[p] = sum;
+                r += count;
+            }
+
+            ResidualCoding best;
+            best.bits = UINT64_MAX;
+            for (uint32_t order = maxOrder + 1; order-- > 0;) {
+                const size_t count = size_t(1) << order;
+                if (order < maxOrder) {
+                    for (size_t p = 0; p < count; ++p) { sums[p] = sums[2 * p] + sums[2 * p + 1]; }
+                }
+
+                ResidualCoding candidate;
+                candidate.partitionOrder = order;
+                candidate.bits = 2 + 4;
+                for (size_t p = 0; p < count; ++p) {
+                    const size_t samples = (blockSize >> order) - (p == 0 ? predictorOrder : 0);
+                    const uint32_t parameter = riceParameterFor(sums[p], samples);
+                    candidate.parameters[p] = parameter;
+                    candidate.wideParameters |= parameter > 14;
+                    candidate.bits += estimateRiceBits(sums[p], samples, parameter);
+                }
+                candidate.bits += count * (candidate.wideParameters ? 5 : 4);
+
+                if (candidate.bits < best.bits) { best = candidate; }
+            }
+            return best;
+        }
+
+        void writeResidual(BitWriter &writer, const int32_t *residual, size_t blockSize,
+                           uint32_t predictorOrder, const ResidualCoding &coding)
+        {
+            writer.write(coding.wideParameters ? 1 : 0, 2);
+            writer.write(coding.partitionOrder, 4);
+
+            const size_t partitions = size_t(1) << coding.partitionOrder;
+            const uint32_t parameterBits = coding.wideParameters ? 5 : 4;
+            for (size_t p = 0; p < partitions; ++p) {
+                const size_t count =
+                        (blockSize >> coding.partitionOrder) - (p == 0 ? predictorOrder : 0);
+                const uint32_t parameter = coding.parameters[p];
+                writer.write(parameter, parameterBits);
+                for (size_t i = 0; i < count; ++i) {
+                    writer.writeRice(zigzag(residual[i]), parameter);
+                }
+                residual += count;
+            }
+        }
+
+        // Encodes one channel as CONSTANT, FIXED or VERBATIM, whichever is smallest.
+        void writeSubframe(BitWriter &writer, const int32_t *samples, size_t count,
+                           uint32_t bitsPerSample, int32_t *residual, uint64_t *sums)
+        {
+            if (std::all_of(samples + 1, samples + count,
+                            [first = samples[0]](int32_t s) { return s == first; })) {
+                writer.write(0x00, 8); // CONSTANT
+                writer.writeSigned(samples[0], bitsPerSample);
+                return;
+            }
+
+            const uint64_t verbatimBits = static_cast<uint64_t>(count) * bitsPerSample;
+            if (count > kMaxFixedOrder) {
+                uint64_t cost = 0;
+                const uint32_t order = chooseFixedOrder(samples, count, cost);
+                computeFixedResidual(samples, count, order, residual);
+                const ResidualCoding coding = planResidual(residual, count, order, sums);
+
+                if (order * bitsPerSample + coding.bits < verbatimBits) {
+                    writer.write(0x10 | (order << 1), 8); // FIXED, order in the low type bits
+                    for (uint32_t i = 0; i < order; ++i) {
+                        writer.writeSigned(samples[i], bitsPerSample);
+                    }
+                    writeResidual(writer, residual, count, order, coding);
+                    return;
+                }
+            }
+
+            writer.write(0x02, 8); // VERBATIM
+            for (size_t i = 0; i < count; ++i) { writer.writeSigned(samples[i], bitsPerSample); }
+        }
+    } // namespace
+
+    auto FlacFileWriter::open(const std::string &path, const CaptureFormat &format,
+                              const OutputFormat &outputFormat) -> std::unique_ptr<FlacFileWriter>
+    {
+        if (!format.isValid() || format.channelCount > kMaxChannels) { return nullptr; }
+
+        const auto sampleRate = static_cast<uint32_t>(std::lround(format.sampleRate));
+        if (sampleRate == 0 || sampleRate >= (1u << 20)) { return nullptr; }
+
+        const uint32_t bitsPerSample = outputFormat.sampleFormat == SampleFormat::Int16 ? 16 : 24;
+
+        std::FILE *file = std::fopen(path.c_str(), "wb");
+        if (!file) { return nullptr; }
+
+        auto writer = std::unique_ptr<FlacFileWriter>(new FlacFileWriter(
+                file, format, sampleRate, bitsPerSample, outputFormat.dither));
+
+        // "fLaC", then STREAMINFO as the only (and therefore last) metadata block.
+        std::vector<uint8_t> header = {'f', 'L', 'a', 'C', 0x80, 0, 0, kStreamInfoSize};
+        writer->appendStreamInfo(header);
+        if (std::fwrite(header.data(), 1, header.size(), file) != header.size()) {
+            return nullptr;
+        }
+        writer->bytesWritten_ = header.size();
+        return writer;
+    }
+
+    FlacFileWriter::FlacFileWriter(std::FILE *file, const CaptureFormat &format,
+                                   uint32_t sampleRate, uint32_t bitsPerSample, bool dither)
+      : file_(file),
+        format_(format),
+        sampleRate_(sampleRate),
+        bitsPerSample_(bitsPerSample),
+        pending_(kBlockSize * format.channelCount),
+        noise_(dither ? kBlockSize * format.channelCount : 0),
+        quantized_(kBlockSize * format.channelCount),
+        planes_(kBlockSize * format.channelCount),
+        mid_(kBlockSize),
+        side_(kBlockSize),
+        residual_(kBlockSize),
+        partitionSums_(size_t(1) << kMaxPartitionOrder)
+    {
+        output_.reserve(kOutputFlushBytes + kBlockSize * format.channelCount * 4);
+    }
+
+    FlacFileWriter::~FlacFileWriter()
+    {
+        if (file_) { finalize(); }
+    }
+
+    auto FlacFileWriter::write(const float *interleaved, size_t frameCount) -> bool
+    {
+        if (!file_ || failed_) { return false; }
+
+        const uint32_t channels = format_.channelCount;
+        size_t framesRemaining = frameCount;
+        while (framesRemaining > 0) {
+            const size_t framesToCopy = std::min(framesRemaining, kBlockSize - pendingFrames_);
+            std::copy(interleaved, interleaved + framesToCopy * channels,
+                      pending_.data() + pendingFrames_ * channels);
+            interleaved += framesToCopy * channels;
+            framesRemaining -= framesToCopy;
+            pendingFrames_ += framesToCopy;
+
+            if (pendingFrames_ == kBlockSize && !encodeBlock()) { return false; }
+        }
+        return true;
+    }
+
+    auto FlacFileWriter::finalize() -> bool
+    {
+        if (!file_) { return false; }
+
+        const bool ok = !failed_ && (pendingFrames_ == 0 || encodeBlock()) && flushOutput() &&
+                        writeStreamInfo();
+        const bool closed = std::fclose(file_) == 0;
+        file_ = nullptr;
+        return ok && closed;
+    }
+
+    auto FlacFileWriter::checkpoint() -> bool
+    {
+        if (!file_ || failed_) { return false; }
+
+        // Only whole FLAC frames are flushed; the block being filled waits for the next one.
+        if (!flushOutput() || !writeStreamInfo() || std::fseek(file_, 0, SEEK_END) != 0 ||
+            std::fflush(file_) != 0) {
+            failed_ = true;
+        }
+        return !failed_;
+    }
+
+    auto FlacFileWriter::encodeBlock() -> bool
+    {
+        const size_t sampleCount = pendingFrames_ * format_.channelCount;
+        const float *noise = nullptr;
+        if (!noise_.empty()) {
+            dither_.generate(noise_.data(), sampleCount);
+            noise = noise_.data();
+        }
+        kernels::floatToInt32(pending_.data(), noise, sampleCount, bitsPerSample_,
+                              quantized_.data());
+
+        encodeFrame(pendingFrames_);
+        framesWritten_ += pendingFrames_;
+        pendingFrames_ = 0;
+
+        return output_.size() < kOutputFlushBytes || flushOutput();
+    }
+
+    void FlacFileWriter::encodeFrame(size_t frameCount)
+    {
+        const uint32_t channels = format_.channelCount;
+        for (uint32_t ch = 0; ch < channels; ++ch) {
+            int32_t *plane = planes_.data() + ch * kBlockSize;
+            for (size_t i = 0; i < frameCount; ++i) { plane[i] = quantized_[i * channels + ch]; }
+        }
+
+        // For stereo, pick the cheapest of independent, left/side, right/side and mid/side,
+        // judged by the best fixed predictor's residual on each candidate channel.
+        uint32_t assignment = channels - 1;
+        const int32_t *left = planes_.data();
+        const int32_t *right = planes_.data() + kBlockSize;
+        if (channels == 2 && frameCount > kMaxFixedOrder) {
+            for (size_t i = 0; i < frameCount; ++i) {
+                side_[i] = left[i] - right[i];
+                mid_[i] = (left[i] + right[i]) >> 1;
+            }
+            uint64_t leftCost = 0, rightCost = 0, sideCost = 0, midCost = 0;
+            chooseFixedOrder(left, frameCount, leftCost);
+            chooseFixedOrder(right, frameCount, rightCost);
+            chooseFixedOrder(side_.data(), frameCount, sideCost);
+            chooseFixedOrder(mid_.data(), frameCount, midCost);
+
+            const std::array<uint64_t, 4> costs = {leftCost + rightCost, leftCost + sideCost,
+                                                   sideCost + rightCost, midCost + sideCost};
+            const std::array<uint32_t, 4> assignments = {1, kLeftSide, kRightSide, kMidSide};
+            assignment = assignments[std::min_element(costs.begin(), costs.end()) - costs.begin()];
+        }
+
+        const size_t frameStart = output_.size();
+        BitWriter writer(output_);
+
+        const bool fullBlock = frameCount == kBlockSize;
+        writer.write(0xfff8, 16); // Sync code, fixed block size
+        writer.write(fullBlock ? kBlockSizeCode : 7, 4);
+        writer.write(0, 4); // Sample rate: from STREAMINFO
+        writer.write(assignment, 4);
+        writer.write(bitsPerSample_ == 16 ? 4 : 6, 3);
+        writer.write(0, 1);
+        writeUtf8(writer, frameNumber_++);
+        if (!fullBlock) { writer.write(frameCount - 1, 16); }
+        writer.write(flac::crc8(output_.data() + frameStart, output_.size() - frameStart), 8);
+
+        auto subframe = [&](const int32_t *samples, uint32_t bitsPerSample)
+        {
+            writeSubframe(writer, samples, frameCount, bitsPerSample, residual_.data(),
+                          partitionSums_.data());
+        };
+        switch (assignment) {
+        case kLeftSide:
+            subframe(left, bitsPerSample_);
+            subframe(side_.data(), bitsPerSample_ + 1);
+            break;
+        case kRightSide:
+            subframe(side_.data(), bitsPerSample_ + 1);
+            subframe(right, bitsPerSample_);
+            break;
+        case kMidSide:
+            subframe(mid_.data(), bitsPerSample_);
+            subframe(side_.data(), bitsPerSample_ + 1);
+            break;
+        default:
+            for (uint32_t ch = 0; ch < channels; ++ch) {
+                subframe(planes_.data() + ch * kBlockSize, bitsPerSample_);
+            }
+            break;
+        }
+
+        writer.alignToByte();
+        const uint16_t crc = flac::crc16(output_.data() + frameStart, output_.size() - frameStart);
+        writer.write(crc, 16);
+
+        const auto frameBytes = static_cast<uint32_t>(output_.size() - frameStart);
+        minFrameBytes_ = minFrameBytes_ == 0 ? frameBytes : std::min(minFrameBytes_, frameBytes);
+        maxFrameBytes_ = std::max(maxFrameBytes_, frameBytes);
+    }
+
+    void FlacFileWriter::appendStreamInfo(std::vector<uint8_t> &out) const
+    {
+        BitWriter writer(out);
+        writer.write(kBlockSize, 16); // Minimum block size
+        writer.write(kBlockSize, 16); // Maximum block size
+        writer.write(minFrameBytes_, 24);
+        writer.write(maxFrameBytes_, 24);
+        writer.write(sampleRate_, 20);
+        writer.write(format_.channelCount - 1, 3);
+        writer.write(bitsPerSample_ - 1, 5);
+        writer.write(framesWritten_ >> 32, 4);
+        writer.write(framesWritten_ & 0xffffffffu, 32);
+        for (int i = 0; i < 4; ++i) { writer.write(0, 32); } // MD5: not computed
+    }
+
+    auto FlacFileWriter::writeStreamInfo() -> bool
+    {
+        std::vector<uint8_t> streamInfo;
+        appendStreamInfo(streamInfo);
+        return std::fseek(file_, kStreamInfoOffset, SEEK_SET) == 0 &&
+               std::fwrite(streamInfo.data(), 1, streamInfo.size(), file_) == streamInfo.size();
+    }
+
+    auto FlacFileWriter::flushOutput() -> bool
+    {
+        if (output_.empty()) { return !failed_; }
+
+        if (std::fwrite(output_.data(), 1, output_.size(), file_) != output_.size()) {
+            failed_ = true;
+        }
+        bytesWritten_ += output_.size();
+        output_.clear();
+        return !failed_;
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "CaptureFormat.h"
+#include "SampleConversion.h"
+#include "SampleSink.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    // Streaming FLAC encoder. Audio is quantised to 16 or 24 bits (Float32 output is stored as
+    // 24-bit), cut into fixed 4096-frame blocks and encoded with FLAC's fixed polynomial
+    // predictors, stereo decorrelation and partitioned Rice coding. Each frame is appended to the
+    // file as soon as its block is complete; `finalize()` encodes the final short block and
+    // patches the STREAMINFO totals. A writer destroyed without `finalize()` finalizes itself.
+    //
+    // Runs on the calling (writer) thread. Pure C++ with no codec library dependency; the MD5
+    // signature is left unset, which FLAC decoders treat as "not computed".
+    class FlacFileWriter : public SampleSink
+    {
+    public:
+        // Creates (or truncates) `path` and writes the stream header. Returns nullptr on failure
+        // or if the format cannot be represented in FLAC (more than 8 channels).
+        static auto open(const std::string &path, const CaptureFormat &format,
+                         const OutputFormat &outputFormat = {}) -> std::unique_ptr<FlacFileWriter>;
+
+        ~FlacFileWriter() override;
+
+        auto write(const float *interleaved, size_t frameCount) -> bool override;
+        auto finalize() -> bool override;
+        auto checkpoint() -> bool override;
+
+        auto getFramesWritten() const -> uint64_t { return framesWritten_; }
+        auto getBytesWritten() const -> uint64_t override { return bytesWritten_ + output_.size(); }
+
+    private:
+        FlacFileWriter(std::FILE *file, const CaptureFormat &format, uint32_t sampleRate,
+                       uint32_t bitsPerSample, bool dither);
+
+        auto encodeBlock() -> bool;
+        void encodeFrame(size_t frameCount);
+        void appendStreamInfo(std::vector<uint8_t> &out) const;
+        auto writeStreamInfo() -> bool;
+        auto flushOutput() -> bool;
+
+        std::FILE *file_{nullptr};
+        CaptureFormat format_;
+        uint32_t sampleRate_{0};
+        uint32_t bitsPerSample_{0};
+
+        // Current block, interleaved float until it fills, then quantised and split per channel.
+        std::vector<float> pending_;
+        size_t pendingFrames_{0};
+        std::vector<float> noise_;
+        std::vector<int32_t> quantized_;
+        std::vector<int32_t> planes_; // channelCount * kBlockSize
+        std::vector<int32_t> mid_;
+        std::vector<int32_t> side_;
+        std::vector<int32_t> residual_;
+        std::vector<uint64_t> partitionSums_;
+        TpdfDither dither_;
+
+        std::vector<uint8_t> output_; // Encoded frames not yet written to the file.
+        uint64_t frameNumber_{0};
+        uint64_t framesWritten_{0};
+        uint64_t bytesWritten_{0};
+        uint32_t minFrameBytes_{0};
+        uint32_t maxFrameBytes_{0};
+        bool failed_{false};
+    };
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,402 @@
+#include "InterleaveKernels.h"
+
+#include <algorithm>
+#include <array>
+
+#if defined(PG_KERNELS_PORTABLE)
+// Portable loops only.
+#elif defined(__x86_64__) || defined(__i386__)
+#define PG_KERNELS_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define PG_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace pg {
+namespace audio_tap {
+    namespace kernels {
+
+        namespace {
+            using InterleaveStereoFn = void (*)(const float *, const float *, size_t, float *);
+            using DeinterleaveStereoFn = void (*)(const float *, size_t, float *, float *);
+
+            // --- Portable fallbacks, also used for the tails of the SIMD loops ---
+
+            void interleaveStereoScalar(const float *left, const float *right, size_t frameCount,
+                                        float *destination)
+            {
+                for (size_t i = 0; i < frameCount; ++i) {
+                    destination[2 * i] = left[i];
+                    destination[2 * i + 1] = right[i];
+                }
+            }
+
+            void deinterleaveStereoScalar(const float *source, size_t frameCount, float *left,
+                                          float *right)
+            {
+                for (size_t i = 0; i < frameCount; ++i) {
+                    left[i] = source[2 * i];
+                    right[i] = source[2 * i + 1];
+                }
+            }
+
+#if PG_KERNELS_X86
+            void interleaveStereoSse2(const float *left, const float *right, size_t frameCount,
+                                      float *destination)
+            {
+                size_t i = 0;
+                for (; i + 4 <= frameCount; i += 4) {
+                    const __m128 l = _mm_loadu_ps(left + i);
+                    const __m128 r = _mm_loadu_ps(right + i);
+                    _mm_storeu_ps(destination + 2 * i, _mm_unpacklo_ps(l, r));
+                    _mm_storeu_ps(destination + 2 * i + 4, _mm_unpackhi_ps(l, r));
+                }
+                interleaveStereoScalar(left + i, right + i, frameCount - i, destination + 2 * i);
+            }
+
+            void deinterleaveStereoSse2(const float *source, size_t frameCount, float *left,
+                                        float *right)
+            {
+                size_t i = 0;
+                for (; i + 4 <= frameCount; i += 4) {
+                    const __m128 a = _mm_loadu_ps(source + 2 * i);
+                    const __m128 b = _mm_loadu_ps(source + 2 * i + 4);
+                    _mm_storeu_ps(left + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+                    _mm_storeu_ps(right + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+                }
+                deinterleaveStereoScalar(source + 2 * i, frameCount - i, left + i, right + i);
+            }
+
+            __attribute__((target("avx2"))) void interleaveStereoAvx2(const float *left,
+                                                                      const float *right,
+                                                                      size_t frameCount,
+                                                                      float *destination)
+            {
+                size_t i = 0;
+                for (; i + 8 <= frameCount; i += 8) {
+                    const __m256 l = _mm256_loadu_ps(left + i);
+                    const __m256 r = _mm256_loadu_ps(right + i);
+                    const __m256 lo = _mm256_unpacklo_ps(l, r); // l0 r0 l1 r1 | l4 r4 l5 r5
+                    const __m256 hi = _mm256_unpackhi_ps(l, r); // l2 r2 l3 r3 | l6 r6 l7 r7
+                    _mm256_storeu_ps(destination + 2 * i, _mm256_permute2f128_ps(lo, hi, 0x20));
+                    _mm256_storeu_ps(destination + 2 * i + 8,
+                                     _mm256_permute2f128_ps(lo, hi, 0x31));
+                }
+                // GCC may tail-call the SSE kernel without clearing the upper halves, which costs
+                // an AVX-to-SSE transition penalty on every call.
+                _mm256_zeroupper();
+                interleaveStereoSse2(left + i, right + i, frameCount - i, destination + 2 * i);
+            }
+
+            __attribute__((target("avx2"))) void deinterleaveStereoAvx2(const float *source,
+                                                                        size_t frameCount,
+                                                                        float *left, float *right)
+            {
+                size_t i = 0;
+                for (; i + 8 <= frameCount; i += 8) {
+                    const __m256 a = _mm256_loadu_ps(source + 2 * i);
+                    const __m256 b = _mm256_loadu_ps(source + 2 * i + 8);
+                    const __m256 lo = _mm256_permute2f128_ps(a, b, 0x20);
+                    const __m256 hi = _mm256_permute2f128_ps(a, b, 0x31);
+                    _mm256_storeu_ps(left + i, _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+                    _mm256_storeu_ps(right + i,
+                                     _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+                }
+                _mm256_zeroupper();
+                deinterleaveStereoSse2(source + 2 * i, frameCount - i, left + i, right + i);
+            }
+
+            auto hasAvx2() -> bool
+            {
+#if defined(PG_KERNELS_NO_AVX2)
+                static const bool supported = false;
+#else
+                static const bool supported = __builtin_cpu_supports("avx2");
+#endif
+                return supported;
+            }
+#endif
+
+#if PG_KERNELS_NEON
+            void interleaveStereoNeon(const float *left, const float *right, size_t frameCount,
+                                      float *destination)
+            {
+                size_t i = 0;
+                for (; i + 4 <= frameCount; i += 4) {
+                    float32x4x2_t pair;
+                    pair.val[0] = vld1q_f32(left + i);
+                    pair.val[1] = vld1q_f32(right + i);
+                    vst2q_f32(destination + 2 * i, pair);
+                }
+                interleaveStereoScalar(left + i, right + i, frameCount - i, destination + 2 * i);
+            }
+
+            void deinterleaveStereoNeon(const float *source, size_t frameCount, float *left,
+                                        float *right)
+            {
+                size_t i = 0;
+                for (; i + 4 <= frameCount; i += 4) {
+                    const float32x4x2_t pair = vld2q_f32(source + 2 * i);
+                    vst1q_f32(left + i, pair.val[0]);
+                    vst1q_f32(right + i, pair.val[1]);
+                }
+                deinterleaveStereoScalar(source + 2 * i, frameCount - i, left + i, right + i);
+            }
+#endif
+
+            auto selectInterleaveStereo() -> InterleaveStereoFn
+            {
+#if PG_KERNELS_X86
+                return hasAvx2() ? interleaveStereoAvx2 : interleaveStereoSse2;
+#elif PG_KERNELS_NEON
+                return interleaveStereoNeon;
+#else
+                return interleaveStereoScalar;
+#endif
+            }
+
+            auto selectDeinterleaveStereo() -> DeinterleaveStereoFn
+            {
+#if PG_KERNELS_X86
+                return hasAvx2() ? deinterleaveStereoAvx2 : deinterleaveStereoSse2;
+#elif PG_KERNELS_NEON
+                return deinterleaveStereoNeon;
+#else
+                return deinterleaveStereoScalar;
+#endif
+            }
+
+            const InterleaveStereoFn interleaveStereo = selectInterleaveStereo();
+            const DeinterleaveStereoFn deinterleaveStereo = selectDeinterleaveStereo();
+
+            // --- Kernels for a fixed channel count ---
+
+            void interleaveMono(const float *const *planes, uint32_t, size_t frameCount,
+                                float *destination)
+            {
+                std::copy(planes[0], planes[0] + frameCount, destination);
+            }
+
+            void deinterleaveMono(const float *source, uint32_t, size_t frameCount,
+                                  float *const *planes)
+            {
+                std::copy(source, source + frameCount, planes[0]);
+            }
+
+            void interleaveStereoPlanes(const float *const *planes, uint32_t, size_t frameCount,
+                                        float *destination)
+            {
+                interleaveStereo(planes[0], planes[1], frameCount, destination);
+            }
+
+            void deinterleaveStereoPlanes(const float *source, uint32_t, size_t frameCount,
+                                          float *const *planes)
+            {
+                deinterleaveStereo(source, frameCount, planes[0], planes[1]);
+            }
+
+            // Frame by frame with the channel loop unrolled, so the interleaved side is
+            // accessed sequentially and every plane advances by one sample per frame.
+            template <uint32_t kChannels>
+            void interleaveFixed(const float *const *planes, uint32_t, size_t frameCount,
+                                 float *destination)
+            {
+                std::array<const float *, kChannels> in{};
+                std::copy(planes, planes + kChannels, in.begin());
+                for (size_t i = 0; i < frameCount; ++i) {
+                    for (uint32_t ch = 0; ch < kChannels; ++ch) {
+                        destination[i * kChannels + ch] = in[ch][i];
+                    }
+                }
+            }
+
+            template <uint32_t kChannels>
+            void deinterleaveFixed(const float *source, uint32_t, size_t frameCount,
+                                   float *const *planes)
+            {
+                std::array<float *, kChannels> out{};
+                std::copy(planes, planes + kChannels, out.begin());
+                for (size_t i = 0; i < frameCount; ++i) {
+                    for (uint32_t ch = 0; ch < kChannels; ++ch) {
+                        out[ch][i] = source[i * kChannels + ch];
+                    }
+                }
+            }
+
+            void interleaveAny(const float *const *planes, uint32_t channelCount,
+                               size_t frameCount, float *destination)
+            {
+                for (uint32_t ch = 0; ch < channelCount; ++ch) {
+                    const float *plane = planes[ch];
+                    float *out = destination + ch;
+                    for (size_t i = 0; i < frameCount; ++i) { out[i * channelCount] = plane[i]; }
+                }
+            }
+
+            void deinterleaveAny(const float *source, uint32_t channelCount, size_t frameCount,
+                                 float *const *planes)
+            {
+                for (uint32_t ch = 0; ch < channelCount; ++ch) {
+                    const float *in = source + ch;
+                    float *plane = planes[ch];
+                    for (size_t i = 0; i < frameCount; ++i) { plane[i] = in[i * channelCount]; }
+                }
+            }
+
+#if PG_KERNELS_X86
+            // Four frames at a time: one vector per plane in, then each group of four channels
+            // is transposed 4x4 and a trailing pair of channels is zipped, giving one row per
+            // frame.
+            template <uint32_t kChannels>
+            void interleaveBlocksSse2(const float *const *planes, uint32_t, size_t frameCount,
+                                      float *destination)
+            {
+                static_assert(kChannels % 2 == 0, "Channels are transposed in fours and pairs");
+                constexpr uint32_t kQuadChannels = kChannels / 4 * 4;
+                size_t i = 0;
+                for (; i + 4 <= frameCount; i += 4) {
+                    float *out = destination + i * kChannels;
+                    for (uint32_t ch = 0; ch < kQuadChannels; ch += 4) {
+                        __m128 a = _mm_loadu_ps(planes[ch] + i);
+                        __m128 b = _mm_loadu_ps(planes[ch + 1] + i);
+                        __m128 c = _mm_loadu_ps(planes[ch + 2] + i);
+                        __m128 d = _mm_loadu_ps(planes[ch + 3] + i);
+                        _MM_TRANSPOSE4_PS(a, b, c, d);
+                        _mm_storeu_ps(out + ch, a);
+                        _mm_storeu_ps(out + kChannels + ch, b);
+                        _mm_storeu_ps(out + 2 * kChannels + ch, c);
+                        _mm_storeu_ps(out + 3 * kChannels + ch, d);
+                    }
+                    if (kQuadChannels < kChannels) {
+                        const __m128 l = _mm_loadu_ps(planes[kQuadChannels] + i);
+                        const __m128 r = _mm_loadu_ps(planes[kQuadChannels + 1] + i);
+                        const __m128 lo = _mm_unpacklo_ps(l, r);
+                        const __m128 hi = _mm_unpackhi_ps(l, r);
+                        _mm_storel_pi(reinterpret_cast<__m64 *>(out + kQuadChannels), lo);
+                        _mm_storeh_pi(reinterpret_cast<__m64 *>(out + kChannels + kQuadChannels),
+                                      lo);
+                        _mm_storel_pi(
+                                reinterpret_cast<__m64 *>(out + 2 * kChannels + kQuadChannels),
+                                hi);
+                        _mm_storeh_pi(
+                                reinterpret_cast<__m64 *>(out + 3 * kChannels + kQuadChannels),
+                                hi);
+                    }
+                }
+
+                std::array<const float *, kChannels> rest{};
+                for (uint32_t ch = 0; ch < kChannels; ++ch) { rest[ch] = planes[ch] + i; }
+                interleaveFixed<kChannels>(rest.data(), kChannels, frameCount - i,
+                                           destination + i * kChannels);
+            }
+
+            template <uint32_t kChannels>
+            void deinterleaveBlocksSse2(const float *source, uint32_t, size_t frameCount,
+                                        float *const *planes)
+            {
+                static_assert(kChannels % 2 == 0, "Channels are transposed in fours and pairs");
+                constexpr uint32_t kQuadChannels = kChannels / 4 * 4;
+                size_t i = 0;
+                for (; i + 4 <= frameCount; i += 4) {
+                    const float *in = source + i * kChannels;
+                    for (uint32_t ch = 0; ch < kQuadChannels; ch += 4) {
+                        __m128 a = _mm_loadu_ps(in + ch);
+                        __m128 b = _mm_loadu_ps(in + kChannels + ch);
+                        __m128 c = _mm_loadu_ps(in + 2 * kChannels + ch);
+                        __m128 d = _mm_loadu_ps(in + 3 * kChannels + ch);
+                        _MM_TRANSPOSE4_PS(a, b, c, d);
+                        _mm_storeu_ps(planes[ch] + i, a);
+                        _mm_storeu_ps(planes[ch + 1] + i, b);
+                        _mm_storeu_ps(planes[ch + 2] + i, c);
+                        _mm_storeu_ps(planes[ch + 3] + i, d);
+                    }
+                    if (kQuadChannels < kChannels) {
+                        // Frames 0 and 1, then 2 and 3, of the trailing pair.
+                        const __m128 a = _mm_loadh_pi(
+                                _mm_loadl_pi(_mm_setzero_ps(),
+                                             reinterpret_cast<const __m64 *>(in + kQuadChannels)),
+                                reinterpret_cast<const __m64 *>(in + kChannels + kQuadChannels));
+                        const __m128 b = _mm_loadh_pi(
+                                _mm_loadl_pi(_mm_setzero_ps(),
+                                             reinterpret_cast<const __m64 *>(
+                                                     in + 2 * kChannels + kQuadChannels)),
+                                reinterpret_cast<const __m64 *>(in + 3 * kChannels +
+                                                                kQuadChannels));
+                        _mm_storeu_ps(planes[kQuadChannels] + i,
+                                      _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+                        _mm_storeu_ps(planes[kQuadChannels + 1] + i,
+                                      _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+                    }
+                }
+
+                std::array<float *, kChannels> rest{};
+                for (uint32_t ch = 0; ch < kChannels; ++ch) { rest[ch] = planes[ch] + i; }
+                deinterleaveFixed<kChannels>(source + i * kChannels, kChannels, frameCount - i,
+                                             rest.data());
+            }
+#endif
+        } // namespace
+
+        auto selectInterleave(uint32_t channelCount) -> InterleaveFn
+        {
+            switch (channelCount) {
+            case 1: return interleaveMono;
+            case 2: return interleaveStereoPlanes;
+#if PG_KERNELS_X86
+            case 4: return interleaveBlocksSse2<4>;
+            case 6: return interleaveBlocksSse2<6>;
+            case 8: return interleaveBlocksSse2<8>;
+#else
+            case 4: return interleaveFixed<4>;
+            case 6: return interleaveFixed<6>;
+            case 8: return interleaveFixed<8>;
+#endif
+            default: return interleaveAny;
+            }
+        }
+
+        auto selectDeinterleave(uint32_t channelCount) -> DeinterleaveFn
+        {
+            switch (channelCount) {
+            case 1: return deinterleaveMono;
+            case 2: return deinterleaveStereoPlanes;
+#if PG_KERNELS_X86
+            case 4: return deinterleaveBlocksSse2<4>;
+            case 6: return deinterleaveBlocksSse2<6>;
+            case 8: return deinterleaveBlocksSse2<8>;
+#else
+            case 4: return deinterleaveFixed<4>;
+            case 6: return deinterleaveFixed<6>;
+            case 8: return deinterleaveFixed<8>;
+#endif
+            default: return deinterleaveAny;
+            }
+        }
+
+        void interleave(const float *const *planes, uint32_t channelCount, size_t frameCount,
+                        float *destination)
+        {
+            selectInterleave(channelCount)(planes, channelCount, frameCount, destination);
+        }
+
+        void deinterleave(const float *source, uint32_t channelCount, size_t frameCount,
+                          float *const *planes)
+        {
+            selectDeinterleave(channelCount)(source, channelCount, frameCount, planes);
+        }
+
+        auto getActiveInstructionSet() -> const char *
+        {
+#if PG_KERNELS_X86
+            return hasAvx2() ? "AVX2" : "SSE2";
+#elif PG_KERNELS_NEON
+            return "NEON";
+#else
+            return "scalar";
+#endif
+        }
+
+    } // namespace kernels
+} // namespace audio_tap
+} // namespace pg
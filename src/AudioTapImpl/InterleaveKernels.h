@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pg {
+namespace audio_tap {
+    namespace kernels {
+
+        // Converts between planar (one buffer per channel) and interleaved float audio.
+        //
+        // Common layouts have kernels specialised for their channel count. Stereo, the common
+        // case for system audio, uses SIMD: SSE2 or AVX2 (selected at run time) on x86 and
+        // NEON on ARM. Four, six and eight channels transpose blocks of four frames with SSE2
+        // on x86 and use a loop unrolled over the channels elsewhere; mono is a plain copy.
+        // Other channel counts use a portable strided loop. All variants are real-time safe and
+        // have no platform dependencies beyond the instruction set.
+        //
+        // Building with `PG_KERNELS_NO_AVX2` stops at SSE2 on x86, and `PG_KERNELS_PORTABLE`
+        // uses the portable loops everywhere, so each instruction set can be benchmarked.
+
+        void interleave(const float *const *planes, uint32_t channelCount, size_t frameCount,
+                        float *destination);
+
+        void deinterleave(const float *source, uint32_t channelCount, size_t frameCount,
+                          float *const *planes);
+
+        using InterleaveFn = void (*)(const float *const *planes, uint32_t channelCount,
+                                      size_t frameCount, float *destination);
+        using DeinterleaveFn = void (*)(const float *source, uint32_t channelCount,
+                                        size_t frameCount, float *const *planes);
+
+        // The kernels `interleave()` and `deinterleave()` use for `channelCount`. Callers with a
+        // fixed layout select once and call the result, which skips the dispatch per call;
+        // it must be called with the same `channelCount`.
+        auto selectInterleave(uint32_t channelCount) -> InterleaveFn;
+        auto selectDeinterleave(uint32_t channelCount) -> DeinterleaveFn;
+
+        // Name of the instruction set the stereo kernels dispatch to on this machine, for
+        // diagnostics and benchmarks.
+        auto getActiveInstructionSet() -> const char *;
+
+    } // namespace kernels
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,53 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    auto LatencyHistogram::getBucketUpperBound(size_t index) -> uint64_t
+    {
+        constexpr size_t kSubBuckets = size_t{1} << kSubBucketBits;
+        if (index < kSubBuckets) { return index; }
+
+        const size_t shift = index / kSubBuckets - 1;
+        const uint64_t top = index - shift * kSubBuckets;
+        return ((top + 1) << shift) - 1;
+    }
+
+    auto LatencyHistogram::getSummary() const -> LatencySummary
+    {
+        // Work from one copy of the buckets so every percentile comes from the same counts.
+        std::vector<uint64_t> buckets(kBucketCount);
+        uint64_t total = 0;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+            total += buckets[i];
+        }
+
+        LatencySummary summary;
+        if (total == 0) { return summary; }
+
+        summary.count = total;
+        summary.minimum = minimum_.load(std::memory_order_relaxed);
+        summary.maximum = maximum_.load(std::memory_order_relaxed);
+        summary.mean = static_cast<double>(sum_.load(std::memory_order_relaxed)) /
+                       static_cast<double>(std::max<uint64_t>(count_.load(), 1));
+
+        const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+        uint64_t *const results[] = {&summary.p50, &summary.p90, &summary.p99, &summary.p999};
+        size_t bucket = 0;
+        uint64_t seen = 0;
+        for (size_t q = 0; q < 4; ++q) {
+            const auto rank = std::max<uint64_t>(
+                    1, static_cast<uint64_t>(std::ceil(quantiles[q] * static_cast<double>(total))));
+            while (seen + buckets[bucket] < rank) { seen += buckets[bucket++]; }
+            *results[q] = std::min(getBucketUpperBound(bucket), summary.maximum);
+        }
+        return summary;
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace pg {
+namespace audio_tap {
+
+    // Distribution of a latency, in nanoseconds. Percentiles are bucket upper bounds, so they
+    // err on the slow side by at most ~3%.
+    struct LatencySummary
+    {
+        uint64_t count{0};
+        uint64_t minimum{0};
+        uint64_t maximum{0};
+        double mean{0.0};
+        uint64_t p50{0};
+        uint64_t p90{0};
+        uint64_t p99{0};
+        uint64_t p999{0};
+    };
+
+    // Fixed-memory histogram of latencies with logarithmic buckets, after HdrHistogram: values
+    // below 32 ns have their own bucket, above that every power of two is split into 32 linear
+    // buckets, so the resolution stays within ~3% from nanoseconds up to the ~18 minute
+    // ceiling. 1152 buckets, 9 KB.
+    //
+    // `record()` is real-time safe and wait-free. It must only be called from one thread, which
+    // lets every counter be a plain relaxed load and store instead of an atomic increment.
+    // `getSummary()` may be called from any other thread; it sees each counter whole but not
+    // necessarily all of them from the same instant. No platform dependencies.
+    class LatencyHistogram
+    {
+    public:
+        static constexpr uint32_t kSubBucketBits = 5;
+        static constexpr uint32_t kMaxValueBits = 40;
+        static constexpr size_t kBucketCount =
+                (size_t{1} << kSubBucketBits) * (kMaxValueBits - kSubBucketBits + 1);
+
+        LatencyHistogram() = default;
+
+        LatencyHistogram(const LatencyHistogram &) = delete;
+        LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+        // Adds one value. Values beyond the ceiling land in the last bucket.
+        void record(uint64_t nanoseconds)
+        {
+            bump(buckets_[getBucketIndex(nanoseconds)], 1);
+            bump(count_, 1);
+            bump(sum_, nanoseconds);
+            if (nanoseconds > maximum_.load(std::memory_order_relaxed)) {
+                maximum_.store(nanoseconds, std::memory_order_relaxed);
+            }
+            if (nanoseconds < minimum_.load(std::memory_order_relaxed)) {
+                minimum_.store(nanoseconds, std::memory_order_relaxed);
+            }
+        }
+
+        auto getSummary() const -> LatencySummary;
+
+        static auto getBucketIndex(uint64_t value) -> size_t
+        {
+            constexpr uint64_t kSubBuckets = uint64_t{1} << kSubBucketBits;
+            if (value < kSubBuckets) { return static_cast<size_t>(value); }
+
+            const auto magnitude = static_cast<uint32_t>(63 - __builtin_clzll(value));
+            if (magnitude >= kMaxValueBits) { return kBucketCount - 1; }
+            const uint32_t shift = magnitude - kSubBucketBits;
+            return static_cast<size_t>(shift * kSubBuckets + (value >> shift));
+        }
+
+        // Largest value that maps to bucket `index`.
+        static auto getBucketUpperBound(size_t index) -> uint64_t;
+
+    private:
+        static void bump(std::atomic<uint64_t> &counter, uint64_t amount)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + amount,
+                          std::memory_order_relaxed);
+        }
+
+        std::array<std::atomic<uint64_t>, kBucketCount> buckets_{};
+        std::atomic<uint64_t> count_{0};
+        std::atomic<uint64_t> sum_{0};
+        std::atomic<uint64_t> minimum_{UINT64_MAX};
+        std::atomic<uint64_t> maximum_{0};
+    };
+
+    // Timing of a periodic real-time callback: how long each call takes and how long passes
+    // between the starts of consecutive calls.
+    struct CallbackTimingSummary
+    {
+        LatencySummary duration;
+        LatencySummary interval;
+    };
+
+    // Feeds two `LatencyHistogram`s from the start and end times of a real-time callback.
+    // `begin()` and `end()` are called from the callback with a monotonic clock in nanoseconds;
+    // everything else from any other thread. No platform dependencies.
+    class CallbackTimer
+    {
+    public:
+        void begin(uint64_t nowNanoseconds)
+        {
+            if (lastBegin_ != 0) { interval_.record(nowNanoseconds - lastBegin_); }
+            lastBegin_ = nowNanoseconds;
+        }
+
+        void end(uint64_t nowNanoseconds) { duration_.record(nowNanoseconds - lastBegin_); }
+
+        // Forgets the previous call, so that the pause does not count as an interval when the
+        // callback is stopped and started again. Only call while the callback is not running.
+        void restart() { lastBegin_ = 0; }
+
+        auto getSummary() const -> CallbackTimingSummary
+        {
+            return {duration_.getSummary(), interval_.getSummary()};
+        }
+
+    private:
+        LatencyHistogram duration_;
+        LatencyHistogram interval_;
+        uint64_t lastBegin_{0}; // Callback thread only.
+    };
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,326 @@
+#include "LevelMeter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(PG_KERNELS_PORTABLE)
+// Portable loops only.
+#elif defined(__x86_64__) || defined(__i386__)
+#define PG_KERNELS_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define PG_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        // Reductions over one buffer. Float accumulators are fine at callback sizes; the meter
+        // folds them into doubles for the window.
+        struct Sums
+        {
+            float peak[2]{};
+            float sumSquares[2]{};
+            float sumProduct{0.0f}; // Stereo only: sum of left * right.
+        };
+
+        using ReduceFn = void (*)(const float *, size_t, Sums &);
+
+        // --- Portable fallbacks, also used for the tails of the SIMD loops ---
+
+        void reduceMonoScalar(const float *samples, size_t frameCount, Sums &sums)
+        {
+            for (size_t i = 0; i < frameCount; ++i) {
+                const float s = samples[i];
+                sums.peak[0] = std::max(sums.peak[0], std::fabs(s));
+                sums.sumSquares[0] += s * s;
+            }
+        }
+
+        void reduceStereoScalar(const float *samples, size_t frameCount, Sums &sums)
+        {
+            for (size_t i = 0; i < frameCount; ++i) {
+                const float l = samples[2 * i];
+                const float r = samples[2 * i + 1];
+                sums.peak[0] = std::max(sums.peak[0], std::fabs(l));
+                sums.peak[1] = std::max(sums.peak[1], std::fabs(r));
+                sums.sumSquares[0] += l * l;
+                sums.sumSquares[1] += r * r;
+                sums.sumProduct += l * r;
+            }
+        }
+
+#if PG_KERNELS_X86
+        // Lanes hold L R L R; even lanes belong to the left channel, odd lanes to the right.
+        void foldStereoLanes(const float *peak, const float *squares, const float *products,
+                             size_t laneCount, Sums &sums)
+        {
+            for (size_t lane = 0; lane < laneCount; ++lane) {
+                const size_t ch = lane & 1;
+                sums.peak[ch] = std::max(sums.peak[ch], peak[lane]);
+                sums.sumSquares[ch] += squares[lane];
+            }
+            // Products appear twice (L*R in even lanes, R*L in odd lanes); take the even ones.
+            for (size_t lane = 0; lane < laneCount; lane += 2) {
+                sums.sumProduct += products[lane];
+            }
+        }
+
+        void reduceMonoSse2(const float *samples, size_t frameCount, Sums &sums)
+        {
+            const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+            __m128 peak = _mm_setzero_ps();
+            __m128 squares = _mm_setzero_ps();
+
+            size_t i = 0;
+            for (; i + 4 <= frameCount; i += 4) {
+                const __m128 v = _mm_loadu_ps(samples + i);
+                peak = _mm_max_ps(peak, _mm_and_ps(v, absMask));
+                squares = _mm_add_ps(squares, _mm_mul_ps(v, v));
+            }
+
+            alignas(16) float p[4], s[4];
+            _mm_store_ps(p, peak);
+            _mm_store_ps(s, squares);
+            for (int lane = 0; lane < 4; ++lane) {
+                sums.peak[0] = std::max(sums.peak[0], p[lane]);
+                sums.sumSquares[0] += s[lane];
+            }
+            reduceMonoScalar(samples + i, frameCount - i, sums);
+        }
+
+        void reduceStereoSse2(const float *samples, size_t frameCount, Sums &sums)
+        {
+            const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+            __m128 peak = _mm_setzero_ps();
+            __m128 squares = _mm_setzero_ps();
+            __m128 products = _mm_setzero_ps();
+
+            size_t i = 0;
+            for (; i + 2 <= frameCount; i += 2) {
+                const __m128 v = _mm_loadu_ps(samples + 2 * i);
+                const __m128 swapped = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+                peak = _mm_max_ps(peak, _mm_and_ps(v, absMask));
+                squares = _mm_add_ps(squares, _mm_mul_ps(v, v));
+                products = _mm_add_ps(products, _mm_mul_ps(v, swapped));
+            }
+
+            alignas(16) float p[4], s[4], x[4];
+            _mm_store_ps(p, peak);
+            _mm_store_ps(s, squares);
+            _mm_store_ps(x, products);
+            foldStereoLanes(p, s, x, 4, sums);
+            reduceStereoScalar(samples + 2 * i, frameCount - i, sums);
+        }
+
+        __attribute__((target("avx2,fma"))) void reduceMonoAvx2(const float *samples,
+                                                                size_t frameCount, Sums &sums)
+        {
+            const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+            __m256 peak = _mm256_setzero_ps();
+            __m256 squares = _mm256_setzero_ps();
+
+            size_t i = 0;
+            for (; i + 8 <= frameCount; i += 8) {
+                const __m256 v = _mm256_loadu_ps(samples + i);
+                peak = _mm256_max_ps(peak, _mm256_and_ps(v, absMask));
+                squares = _mm256_fmadd_ps(v, v, squares);
+            }
+
+            alignas(32) float p[8], s[8];
+            _mm256_store_ps(p, peak);
+            _mm256_store_ps(s, squares);
+            for (int lane = 0; lane < 8; ++lane) {
+                sums.peak[0] = std::max(sums.peak[0], p[lane]);
+                sums.sumSquares[0] += s[lane];
+            }
+            // GCC may tail-call the SSE kernel without clearing the upper halves, which costs an
+            // AVX-to-SSE transition penalty on every call.
+            _mm256_zeroupper();
+            reduceMonoSse2(samples + i, frameCount - i, sums);
+        }
+
+        __attribute__((target("avx2,fma"))) void reduceStereoAvx2(const float *samples,
+                                                                  size_t frameCount, Sums &sums)
+        {
+            const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+            __m256 peak = _mm256_setzero_ps();
+            __m256 squares = _mm256_setzero_ps();
+            __m256 products = _mm256_setzero_ps();
+
+            size_t i = 0;
+            for (; i + 4 <= frameCount; i += 4) {
+                const __m256 v = _mm256_loadu_ps(samples + 2 * i);
+                const __m256 swapped = _mm256_permute_ps(v, _MM_SHUFFLE(2, 3, 0, 1));
+                peak = _mm256_max_ps(peak, _mm256_and_ps(v, absMask));
+                squares = _mm256_fmadd_ps(v, v, squares);
+                products = _mm256_fmadd_ps(v, swapped, products);
+            }
+
+            alignas(32) float p[8], s[8], x[8];
+            _mm256_store_ps(p, peak);
+            _mm256_store_ps(s, squares);
+            _mm256_store_ps(x, products);
+            foldStereoLanes(p, s, x, 8, sums);
+            _mm256_zeroupper();
+            reduceStereoSse2(samples + 2 * i, frameCount - i, sums);
+        }
+
+        auto hasAvx2() -> bool
+        {
+#if defined(PG_KERNELS_NO_AVX2)
+            static const bool supported = false;
+#else
+            static const bool supported =
+                    __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+            return supported;
+        }
+#endif
+
+#if PG_KERNELS_NEON
+        void reduceMonoNeon(const float *samples, size_t frameCount, Sums &sums)
+        {
+            float32x4_t peak = vdupq_n_f32(0.0f);
+            float32x4_t squares = vdupq_n_f32(0.0f);
+
+            size_t i = 0;
+            for (; i + 4 <= frameCount; i += 4) {
+                const float32x4_t v = vld1q_f32(samples + i);
+                peak = vmaxq_f32(peak, vabsq_f32(v));
+                squares = vmlaq_f32(squares, v, v);
+            }
+
+            sums.peak[0] = std::max(sums.peak[0], vmaxvq_f32(peak));
+            sums.sumSquares[0] += vaddvq_f32(squares);
+            reduceMonoScalar(samples + i, frameCount - i, sums);
+        }
+
+        void reduceStereoNeon(const float *samples, size_t frameCount, Sums &sums)
+        {
+            float32x4_t peakL = vdupq_n_f32(0.0f), peakR = vdupq_n_f32(0.0f);
+            float32x4_t squaresL = vdupq_n_f32(0.0f), squaresR = vdupq_n_f32(0.0f);
+            float32x4_t products = vdupq_n_f32(0.0f);
+
+            size_t i = 0;
+            for (; i + 4 <= frameCount; i += 4) {
+                const float32x4x2_t lr = vld2q_f32(samples + 2 * i);
+                peakL = vmaxq_f32(peakL, vabsq_f32(lr.val[0]));
+                peakR = vmaxq_f32(peakR, vabsq_f32(lr.val[1]));
+                squaresL = vmlaq_f32(squaresL, lr.val[0], lr.val[0]);
+                squaresR = vmlaq_f32(squaresR, lr.val[1], lr.val[1]);
+                products = vmlaq_f32(products, lr.val[0], lr.val[1]);
+            }
+
+            sums.peak[0] = std::max(sums.peak[0], vmaxvq_f32(peakL));
+            sums.peak[1] = std::max(sums.peak[1], vmaxvq_f32(peakR));
+            sums.sumSquares[0] += vaddvq_f32(squaresL);
+            sums.sumSquares[1] += vaddvq_f32(squaresR);
+            sums.sumProduct += vaddvq_f32(products);
+            reduceStereoScalar(samples + 2 * i, frameCount - i, sums);
+        }
+#endif
+
+        auto selectReduceMono() -> ReduceFn
+        {
+#if PG_KERNELS_X86
+            return hasAvx2() ? reduceMonoAvx2 : reduceMonoSse2;
+#elif PG_KERNELS_NEON
+            return reduceMonoNeon;
+#else
+            return reduceMonoScalar;
+#endif
+        }
+
+        auto selectReduceStereo() -> ReduceFn
+        {
+#if PG_KERNELS_X86
+            return hasAvx2() ? reduceStereoAvx2 : reduceStereoSse2;
+#elif PG_KERNELS_NEON
+            return reduceStereoNeon;
+#else
+            return reduceStereoScalar;
+#endif
+        }
+
+        const ReduceFn reduceMono = selectReduceMono();
+        const ReduceFn reduceStereo = selectReduceStereo();
+    } // namespace
+
+    LevelMeter::LevelMeter(uint32_t channelCount, double sampleRate, double windowSeconds)
+      : channelCount_(std::max<uint32_t>(channelCount, 1)),
+        meteredChannels_(std::min(channelCount_, LevelSnapshot::kMaxChannels)),
+        windowFrames_(std::max<uint64_t>(1, static_cast<uint64_t>(sampleRate * windowSeconds)))
+    {
+    }
+
+    void LevelMeter::process(const float *interleaved, size_t sampleCount)
+    {
+        const size_t frameCount = sampleCount / channelCount_;
+        if (frameCount == 0) { return; }
+
+        if (channelCount_ <= 2) {
+            Sums sums;
+            (channelCount_ == 1 ? reduceMono : reduceStereo)(interleaved, frameCount, sums);
+            for (uint32_t ch = 0; ch < channelCount_; ++ch) {
+                peak_[ch] = std::max(peak_[ch], sums.peak[ch]);
+                sumSquares_[ch] += sums.sumSquares[ch];
+            }
+            sumProduct_ += sums.sumProduct;
+        } else {
+            for (uint32_t ch = 0; ch < meteredChannels_; ++ch) {
+                float peak = 0.0f, squares = 0.0f;
+                for (size_t i = 0; i < frameCount; ++i) {
+                    const float s = interleaved[i * channelCount_ + ch];
+                    peak = std::max(peak, std::fabs(s));
+                    squares += s * s;
+                }
+                peak_[ch] = std::max(peak_[ch], peak);
+                sumSquares_[ch] += squares;
+            }
+            float products = 0.0f;
+            for (size_t i = 0; i < frameCount; ++i) {
+                products += interleaved[i * channelCount_] * interleaved[i * channelCount_ + 1];
+            }
+            sumProduct_ += products;
+        }
+
+        framePosition_ += frameCount;
+        windowFill_ += frameCount;
+        if (windowFill_ >= windowFrames_) { publish(); }
+    }
+
+    auto LevelMeter::read(LevelSnapshot &levels) -> bool
+    {
+        const bool isNew = snapshots_.update();
+        levels = snapshots_.getReadBuffer();
+        return isNew;
+    }
+
+    void LevelMeter::publish()
+    {
+        LevelSnapshot &snapshot = snapshots_.getWriteBuffer();
+        snapshot.channelCount = meteredChannels_;
+        for (uint32_t ch = 0; ch < meteredChannels_; ++ch) {
+            snapshot.peak[ch] = peak_[ch];
+            snapshot.rms[ch] = static_cast<float>(std::sqrt(sumSquares_[ch] / windowFill_));
+        }
+
+        const double energy = sumSquares_[0] * sumSquares_[1];
+        snapshot.correlation =
+                meteredChannels_ >= 2 && energy > 0.0
+                        ? static_cast<float>(std::clamp(sumProduct_ / std::sqrt(energy), -1.0, 1.0))
+                        : 0.0f;
+        snapshot.framePosition = framePosition_;
+        snapshots_.publish();
+
+        peak_.fill(0.0f);
+        sumSquares_.fill(0.0);
+        sumProduct_ = 0.0;
+        windowFill_ = 0;
+    }
+
+} // namespace audio_tap
+} // namespace pg
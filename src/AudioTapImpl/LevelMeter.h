@@ -0,0 +1,70 @@
+#pragma once
+
+#include "TripleBuffer.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace pg {
+namespace audio_tap {
+
+    // Levels over one metering window. Linear amplitudes; convert to dB for display.
+    struct LevelSnapshot
+    {
+        static constexpr uint32_t kMaxChannels = 16;
+
+        uint32_t channelCount{0}; // Metered channels, at most kMaxChannels.
+        std::array<float, kMaxChannels> peak{};
+        std::array<float, kMaxChannels> rms{};
+        // Phase correlation of the first two channels in [-1, 1]; 0 for mono or silence.
+        float correlation{0.0f};
+        // Frames metered since the start of capture, up to the end of this window.
+        uint64_t framePosition{0};
+    };
+
+    // Real-time level meter: per-channel peak and RMS plus stereo phase correlation.
+    //
+    // `process()` runs on the audio thread and reduces each buffer with SIMD (SSE2 or AVX2
+    // selected at run time on x86, NEON on ARM, capped by the same build knobs as the
+    // interleave kernels) for mono and stereo; other layouts use a scalar loop. Once a window's
+    // worth of frames has been seen, the result is published through a triple buffer that one
+    // consumer, typically a UI timer, polls with `read()`.
+    //
+    // Channels beyond LevelSnapshot::kMaxChannels are not metered. No platform dependencies.
+    class LevelMeter
+    {
+    public:
+        // `windowSeconds` sets the integration time and so the publishing rate. The default
+        // of 20 ms gives a UI polling at 60 Hz a fresh value every frame.
+        LevelMeter(uint32_t channelCount, double sampleRate, double windowSeconds = 0.02);
+
+        LevelMeter(const LevelMeter &) = delete;
+        LevelMeter &operator=(const LevelMeter &) = delete;
+
+        // Called from the real-time audio thread. Never blocks or allocates.
+        void process(const float *interleaved, size_t sampleCount);
+
+        // Called from a single consumer thread. Copies the latest levels into `levels` and
+        // returns true if they are newer than those returned by the previous call.
+        auto read(LevelSnapshot &levels) -> bool;
+
+    private:
+        void publish();
+
+        const uint32_t channelCount_;
+        const uint32_t meteredChannels_;
+        const uint64_t windowFrames_;
+
+        // Audio thread only.
+        std::array<float, LevelSnapshot::kMaxChannels> peak_{};
+        std::array<double, LevelSnapshot::kMaxChannels> sumSquares_{};
+        double sumProduct_{0.0};
+        uint64_t windowFill_{0};
+        uint64_t framePosition_{0};
+
+        TripleBuffer<LevelSnapshot> snapshots_;
+    };
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,150 @@
+#include "MetricsExporter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        // How long the thread waits for a connection before checking the file deadline and
+        // whether it should stop.
+        constexpr int kPollIntervalMilliseconds = 100;
+
+        // A scraper that stops reading is cut off after this long.
+        constexpr int kSendTimeoutSeconds = 1;
+
+#ifdef MSG_NOSIGNAL
+        constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+        constexpr int kSendFlags = 0; // SO_NOSIGPIPE is set on the socket instead.
+#endif
+    } // namespace
+
+    MetricsExporter::MetricsExporter(const MetricsRegistry &registry, Options options)
+      : registry_(registry), options_(std::move(options))
+    {
+    }
+
+    MetricsExporter::~MetricsExporter()
+    {
+        stop();
+    }
+
+    auto MetricsExporter::start() -> bool
+    {
+        if (thread_.joinable()) { return false; }
+
+        if (!options_.socketPath.empty()) {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            if (options_.socketPath.size() >= sizeof(address.sun_path)) { return false; }
+            std::memcpy(address.sun_path, options_.socketPath.c_str(),
+                        options_.socketPath.size() + 1);
+
+            listenSocket_ = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (listenSocket_ < 0) { return false; }
+
+            ::unlink(options_.socketPath.c_str()); // Left behind by a previous run.
+            if (bind(listenSocket_, reinterpret_cast<const sockaddr *>(&address),
+                     sizeof(address)) != 0 ||
+                listen(listenSocket_, 8) != 0) {
+                ::close(listenSocket_);
+                listenSocket_ = -1;
+                return false;
+            }
+        }
+
+        running_.store(true);
+        thread_ = std::thread([this] { run(); });
+        return true;
+    }
+
+    void MetricsExporter::stop()
+    {
+        running_.store(false);
+        if (thread_.joinable()) { thread_.join(); }
+
+        if (listenSocket_ >= 0) {
+            ::close(listenSocket_);
+            listenSocket_ = -1;
+            ::unlink(options_.socketPath.c_str());
+        }
+    }
+
+    auto MetricsExporter::writeFile(const MetricsRegistry &registry, const std::string &path)
+            -> bool
+    {
+        const std::string text = registry.renderPrometheus();
+
+        // Collectors read the file at any moment, so it is replaced, never rewritten in place.
+        const std::string temporaryPath = path + ".tmp";
+        std::FILE *file = std::fopen(temporaryPath.c_str(), "w");
+        if (!file) { return false; }
+
+        const bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+        if (std::fclose(file) != 0 || !written) { return false; }
+        return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+    }
+
+    void MetricsExporter::run()
+    {
+        using Clock = std::chrono::steady_clock;
+        const bool writesFile = !options_.filePath.empty();
+        const auto fileInterval = std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(options_.fileIntervalSeconds));
+        auto nextFileWrite = Clock::now();
+
+        while (running_.load()) {
+            if (writesFile && Clock::now() >= nextFileWrite) {
+                writeFile(registry_, options_.filePath);
+                nextFileWrite = Clock::now() + fileInterval;
+            }
+
+            if (listenSocket_ < 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(kPollIntervalMilliseconds));
+                continue;
+            }
+
+            pollfd listener{listenSocket_, POLLIN, 0};
+            if (poll(&listener, 1, kPollIntervalMilliseconds) > 0 &&
+                (listener.revents & POLLIN) != 0) {
+                const int connection = accept(listenSocket_, nullptr, nullptr);
+                if (connection >= 0) {
+                    serveConnection(connection);
+                    ::close(connection);
+                }
+            }
+        }
+
+        if (writesFile) { writeFile(registry_, options_.filePath); }
+    }
+
+    void MetricsExporter::serveConnection(int connection) const
+    {
+        timeval timeout{kSendTimeoutSeconds, 0};
+        setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+        const int noSignal = 1;
+        setsockopt(connection, SOL_SOCKET, SO_NOSIGPIPE, &noSignal, sizeof(noSignal));
+#endif
+
+        const std::string text = registry_.renderPrometheus();
+        size_t offset = 0;
+        while (offset < text.size()) {
+            const ssize_t sent =
+                    send(connection, text.data() + offset, text.size() - offset, kSendFlags);
+            if (sent <= 0) { return; }
+            offset += static_cast<size_t>(sent);
+        }
+    }
+
+} // namespace audio_tap
+} // namespace pg
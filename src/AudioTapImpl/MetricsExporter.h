@@ -0,0 +1,58 @@
+#pragma once
+
+#include "MetricsRegistry.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+namespace pg {
+namespace audio_tap {
+
+    // Publishes a `MetricsRegistry` for a local collector, in the Prometheus text format:
+    //  - as a file rewritten at a fixed interval, for node_exporter's textfile collector, and/or
+    //  - on a Unix domain socket that answers every connection with the current metrics and
+    //    closes it, for a sidecar that scrapes and forwards them.
+    //
+    // Everything runs on one background thread. POSIX only; no Core Audio dependency.
+    class MetricsExporter
+    {
+    public:
+        struct Options
+        {
+            // File to keep up to date; empty disables it.
+            std::string filePath;
+            double fileIntervalSeconds{10.0};
+            // Socket to listen on; empty disables it. A stale socket file is replaced.
+            std::string socketPath;
+        };
+
+        MetricsExporter(const MetricsRegistry &registry, Options options);
+        ~MetricsExporter();
+
+        MetricsExporter(const MetricsExporter &) = delete;
+        MetricsExporter &operator=(const MetricsExporter &) = delete;
+
+        // Opens the socket and starts the thread. Returns false if the socket cannot be opened
+        // or the exporter is already running.
+        auto start() -> bool;
+
+        // Writes the file one last time, then closes and removes the socket.
+        void stop();
+
+        // Writes the metrics to `path`, replacing it atomically.
+        static auto writeFile(const MetricsRegistry &registry, const std::string &path) -> bool;
+
+    private:
+        void run();
+        void serveConnection(int connection) const;
+
+        const MetricsRegistry &registry_;
+        const Options options_;
+        int listenSocket_{-1};
+        std::thread thread_;
+        std::atomic<bool> running_{false};
+    };
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,131 @@
+#include "MetricsRegistry.h"
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        // Escapes `\` and newlines, plus `"` in label values, as the text format requires.
+        auto escape(const std::string &text, bool isLabelValue) -> std::string
+        {
+            std::string escaped;
+            escaped.reserve(text.size());
+            for (const char c : text) {
+                if (c == '\\') {
+                    escaped += "\\\\";
+                } else if (c == '\n') {
+                    escaped += "\\n";
+                } else if (c == '"' && isLabelValue) {
+                    escaped += "\\\"";
+                } else {
+                    escaped += c;
+                }
+            }
+            return escaped;
+        }
+
+        auto renderLabels(const MetricsRegistry::Labels &labels) -> std::string
+        {
+            if (labels.empty()) { return {}; }
+
+            std::string rendered = "{";
+            for (size_t i = 0; i < labels.size(); ++i) {
+                if (i > 0) { rendered += ','; }
+                rendered += labels[i].first + "=\"" + escape(labels[i].second, true) + '"';
+            }
+            return rendered + '}';
+        }
+
+        auto formatValue(double value) -> std::string
+        {
+            if (std::isnan(value)) { return "NaN"; }
+            if (std::isinf(value)) { return value > 0.0 ? "+Inf" : "-Inf"; }
+
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.15g", value);
+            return buffer;
+        }
+
+        auto formatValue(uint64_t value) -> std::string
+        {
+            char buffer[24];
+            std::snprintf(buffer, sizeof(buffer), "%" PRIu64, value);
+            return buffer;
+        }
+    } // namespace
+
+    auto MetricsRegistry::getDefault() -> MetricsRegistry &
+    {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    auto MetricsRegistry::counter(const std::string &name, const std::string &help,
+                                  const Labels &labels) -> MetricCounter &
+    {
+        return getSeries(Kind::Counter, name, help, labels).counter;
+    }
+
+    auto MetricsRegistry::gauge(const std::string &name, const std::string &help,
+                                const Labels &labels) -> MetricGauge &
+    {
+        return getSeries(Kind::Gauge, name, help, labels).gauge;
+    }
+
+    auto MetricsRegistry::getSeries(Kind kind, const std::string &name, const std::string &help,
+                                    const Labels &labels) -> Series &
+    {
+        const std::string renderedLabels = renderLabels(labels);
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        Family *family = nullptr;
+        for (const auto &candidate : families_) {
+            if (candidate->name == name) {
+                family = candidate.get();
+                break;
+            }
+        }
+        if (family && family->kind != kind) {
+            detached_.push_back(std::make_unique<Series>());
+            return *detached_.back();
+        }
+        if (!family) {
+            families_.push_back(std::make_unique<Family>());
+            family = families_.back().get();
+            family->name = name;
+            family->help = help;
+            family->kind = kind;
+        }
+
+        for (const auto &series : family->series) {
+            if (series->labels == renderedLabels) { return *series; }
+        }
+        family->series.push_back(std::make_unique<Series>());
+        family->series.back()->labels = renderedLabels;
+        return *family->series.back();
+    }
+
+    auto MetricsRegistry::renderPrometheus() const -> std::string
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::string text;
+        for (const auto &family : families_) {
+            const bool isCounter = family->kind == Kind::Counter;
+            text += "# HELP " + family->name + ' ' + escape(family->help, false) + '\n';
+            text += "# TYPE " + family->name + (isCounter ? " counter\n" : " gauge\n");
+            for (const auto &series : family->series) {
+                text += family->name + series->labels + ' ' +
+                        (isCounter ? formatValue(series->counter.get())
+                                   : formatValue(series->gauge.get())) +
+                        '\n';
+            }
+        }
+        return text;
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    // Monotonically increasing count. `add()` is a single relaxed atomic increment, so it is
+    // safe from the real-time thread and from several threads at once.
+    class MetricCounter
+    {
+    public:
+        void add(uint64_t amount = 1) { value_.fetch_add(amount, std::memory_order_relaxed); }
+        auto get() const -> uint64_t { return value_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> value_{0};
+    };
+
+    // Value that goes up and down. `set()` is a relaxed store and real-time safe; `raiseTo()`
+    // keeps the largest value seen, for high-water marks.
+    class MetricGauge
+    {
+    public:
+        void set(double value) { value_.store(value, std::memory_order_relaxed); }
+
+        void raiseTo(double value)
+        {
+            double current = value_.load(std::memory_order_relaxed);
+            while (value > current &&
+                   !value_.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+            }
+        }
+
+        auto get() const -> double { return value_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<double> value_{0.0};
+    };
+
+    // Named counters and gauges describing the capture pipeline, rendered in the Prometheus
+    // text exposition format for dashboards.
+    //
+    // Components look their metrics up once, when they are created, and keep the returned
+    // reference; it stays valid for the life of the registry. Updates are then plain relaxed
+    // atomics with no lookup or locking. Registration and `renderPrometheus()` take a mutex and
+    // may be called from any non-real-time thread. No platform dependencies.
+    class MetricsRegistry
+    {
+    public:
+        using Labels = std::vector<std::pair<std::string, std::string>>;
+
+        MetricsRegistry() = default;
+
+        MetricsRegistry(const MetricsRegistry &) = delete;
+        MetricsRegistry &operator=(const MetricsRegistry &) = delete;
+
+        // The registry every component of the capture pipeline reports to.
+        static auto getDefault() -> MetricsRegistry &;
+
+        // Returns the metric `name` with `labels`, creating it on first use. `name` should
+        // follow Prometheus conventions (`pg_capture_frames_total`, base units, `_total` for
+        // counters). A name registered as the other kind before gets a metric that is kept out
+        // of the export.
+        auto counter(const std::string &name, const std::string &help, const Labels &labels = {})
+                -> MetricCounter &;
+        auto gauge(const std::string &name, const std::string &help, const Labels &labels = {})
+                -> MetricGauge &;
+
+        // Every metric in the text exposition format, in registration order.
+        auto renderPrometheus() const -> std::string;
+
+    private:
+        enum class Kind
+        {
+            Counter,
+            Gauge,
+        };
+
+        struct Series
+        {
+            std::string labels; // Already rendered: `{reason="device_removed"}` or empty.
+            MetricCounter counter;
+            MetricGauge gauge;
+        };
+
+        struct Family
+        {
+            std::string name;
+            std::string help;
+            Kind kind{Kind::Counter};
+            std::vector<std::unique_ptr<Series>> series;
+        };
+
+        auto getSeries(Kind kind, const std::string &name, const std::string &help,
+                       const Labels &labels) -> Series &;
+
+        mutable std::mutex mutex_;
+        std::vector<std::unique_ptr<Family>> families_;
+        std::vector<std::unique_ptr<Series>> detached_; // Kind mismatches.
+    };
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,90 @@
+#include "PagedSampleStore.h"
+
+#include <algorithm>
+
+namespace pg {
+namespace audio_tap {
+
+    PagedSampleStore::PagedSampleStore(size_t samplesPerPage, size_t pageCount, size_t pagesAhead,
+                                       bool lockMemory)
+      : samplesPerPage_(std::max<size_t>(samplesPerPage, 1)),
+        pagesAhead_(std::max<size_t>(pagesAhead, 1)),
+        pool_(samplesPerPage_ * sizeof(float), std::max<size_t>(pageCount, 1), lockMemory),
+        filledPages_(std::max<size_t>(pageCount, 1)),
+        recycledPages_(std::max<size_t>(pageCount, 1))
+    {
+        if (!pool_.isValid()) { return; }
+        freePages_.reserve(pool_.getBlockCount());
+
+        // Hand the producer its initial reserve directly; nothing is running yet.
+        const size_t initialPages = std::min(pagesAhead_, pool_.getBlockCount());
+        for (; nextFreshPage_ < initialPages; ++nextFreshPage_) {
+            pool_.prefaultBlock(nextFreshPage_);
+        }
+        for (size_t i = initialPages; i > 0; --i) { freePages_.push_back(pageAt(i - 1)); }
+    }
+
+    auto PagedSampleStore::preparePages() -> bool
+    {
+        if (!pool_.isValid()) { return false; }
+        bool ok = true;
+
+        // Every page handed out so far is either free on the producer side, being filled, or
+        // queued as full. Estimate the first from the other two and top it up.
+        for (;;) {
+            const size_t pagesNotFree = filledPages_.availableToRead() + 1;
+            const size_t freeWithProducer =
+                    nextFreshPage_ > pagesNotFree ? nextFreshPage_ - pagesNotFree : 0;
+            if (freeWithProducer >= pagesAhead_ || nextFreshPage_ >= pool_.getBlockCount()) {
+                return ok;
+            }
+
+            if (!pool_.prefaultBlock(nextFreshPage_)) { ok = false; }
+            recycledPages_.tryPush(pageAt(nextFreshPage_));
+            ++nextFreshPage_;
+        }
+    }
+
+    auto PagedSampleStore::write(const float *samples, size_t count) -> bool
+    {
+        reclaimRecycledPages();
+
+        const size_t roomInCurrentPage = currentPage_ ? samplesPerPage_ - currentFill_ : 0;
+        if (roomInCurrentPage + freePages_.size() * samplesPerPage_ < count) { return false; }
+
+        while (count > 0) {
+            if (!currentPage_) {
+                currentPage_ = freePages_.back();
+                freePages_.pop_back();
+                currentFill_ = 0;
+
+                const size_t pagesInUse = filledPages_.availableToRead() + 1;
+                if (pagesInUse > peakPagesInUse_.load(std::memory_order_relaxed)) {
+                    peakPagesInUse_.store(pagesInUse, std::memory_order_relaxed);
+                }
+            }
+
+            const size_t toCopy = std::min(count, samplesPerPage_ - currentFill_);
+            std::copy(samples, samples + toCopy, currentPage_ + currentFill_);
+            samples += toCopy;
+            count -= toCopy;
+            currentFill_ += toCopy;
+
+            if (currentFill_ == samplesPerPage_) {
+                // Cannot fail: the queue has room for every page.
+                filledPages_.tryPush(currentPage_);
+                currentPage_ = nullptr;
+                currentFill_ = 0;
+            }
+        }
+        return true;
+    }
+
+    void PagedSampleStore::reclaimRecycledPages()
+    {
+        float *page = nullptr;
+        while (recycledPages_.tryPop(page)) { freePages_.push_back(page); }
+    }
+
+} // namespace audio_tap
+} // namespace pg
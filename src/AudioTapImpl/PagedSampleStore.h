@@ -0,0 +1,115 @@
+#pragma once
+
+#include "RealtimeMemoryPool.h"
+#include "SpscRingBuffer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    // Queue of captured samples built from fixed-size pages.
+    //
+    // Every page is reserved up front from a `RealtimeMemoryPool` but only committed when the
+    // producer first needs it. The producer draws pages from a private LIFO free list and hands
+    // full pages to the consumer; the consumer hands them back once read. Because the most
+    // recently returned page is reused first, the resident set tracks the deepest backlog the
+    // writer has actually seen rather than the configured capacity, and start-up does not pay for
+    // memory that may never be used.
+    //
+    // Fresh pages are prefaulted (and optionally locked) by the consumer before the producer ever
+    // sees them: the producer starts with `pagesAhead` of them, and `preparePages()` tops its free
+    // list back up as the backlog grows, so the audio thread never takes a first-touch fault.
+    //
+    // Single producer, single consumer. The producer side never allocates or blocks.
+    class PagedSampleStore
+    {
+    public:
+        PagedSampleStore(size_t samplesPerPage, size_t pageCount, size_t pagesAhead,
+                         bool lockMemory);
+
+        PagedSampleStore(const PagedSampleStore &) = delete;
+        PagedSampleStore &operator=(const PagedSampleStore &) = delete;
+
+        // False if the pool could not be reserved, in which case every write fails.
+        auto isValid() const -> bool { return pool_.isValid(); }
+        auto getSamplesPerPage() const -> size_t { return samplesPerPage_; }
+        auto getPageCount() const -> size_t { return pool_.getBlockCount(); }
+        auto getResidentBytes() const -> size_t { return pool_.getResidentBytes(); }
+
+        // Highest number of pages that have been queued or in progress at once, i.e. the deepest
+        // backlog the consumer has let build up.
+        auto getPeakPagesInUse() const -> size_t { return peakPagesInUse_.load(); }
+
+        // --- Producer side ---
+
+        // Appends all `count` samples or none of them. Returns false if the store is full.
+        auto write(const float *samples, size_t count) -> bool;
+
+        // --- Consumer side ---
+
+        // Prefaults fresh pages and passes them to the producer until it again holds at least
+        // `pagesAhead` free pages, or the pool is exhausted. Not real-time safe. Returns false if
+        // the store is not valid, or if memory locking was requested and failed for any page.
+        auto preparePages() -> bool;
+
+        // Invokes `visitor(const float *samples, size_t count)` for every full page, oldest
+        // first, and recycles each page afterwards. Returns the number of samples visited.
+        template <typename Visitor>
+        auto readFullPages(Visitor &&visitor) -> size_t
+        {
+            size_t samplesRead = 0;
+            float *page = nullptr;
+            while (filledPages_.tryPop(page)) {
+                visitor(static_cast<const float *>(page), samplesPerPage_);
+                recycledPages_.tryPush(page);
+                samplesRead += samplesPerPage_;
+                preparePages();
+            }
+            return samplesRead;
+        }
+
+        // Like `readFullPages()`, but also flushes the partially filled page the producer is
+        // working on. Only valid once the producer has stopped for good.
+        template <typename Visitor>
+        auto readAll(Visitor &&visitor) -> size_t
+        {
+            size_t samplesRead = readFullPages(visitor);
+            if (currentPage_ && currentFill_ > 0) {
+                visitor(static_cast<const float *>(currentPage_), currentFill_);
+                samplesRead += currentFill_;
+                currentFill_ = 0;
+            }
+            return samplesRead;
+        }
+
+    private:
+        void reclaimRecycledPages();
+
+        auto pageAt(size_t index) const -> float *
+        {
+            return static_cast<float *>(pool_.getBlock(index));
+        }
+
+        const size_t samplesPerPage_;
+        const size_t pagesAhead_;
+        RealtimeMemoryPool pool_;
+
+        // Consumer-only state: index of the next pool block that has never been handed out.
+        size_t nextFreshPage_{0};
+
+        SpscRingBuffer<float *> filledPages_;   // Producer -> consumer.
+        SpscRingBuffer<float *> recycledPages_; // Consumer -> producer.
+
+        // Producer-only state. `freePages_` is reserved for every page so it never reallocates.
+        std::vector<float *> freePages_;
+        float *currentPage_{nullptr};
+        size_t currentFill_{0};
+
+        std::atomic<size_t> peakPagesInUse_{0};
+    };
+
+} // namespace audio_tap
+} // namespace pg
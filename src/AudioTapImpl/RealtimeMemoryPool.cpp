@@ -0,0 +1,117 @@
+#include "RealtimeMemoryPool.h"
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    RealtimeMemoryPool::RealtimeMemoryPool(size_t blockSizeInBytes, size_t blockCount,
+                                           bool lockMemory)
+      : lockMemory_(lockMemory)
+    {
+        if (blockSizeInBytes == 0 || blockCount == 0) { return; }
+
+        // Round each block up to whole OS pages so that prefaulting and locking one block never
+        // touches its neighbours.
+        const size_t pageSize = getSystemPageSize();
+        blockStride_ = (blockSizeInBytes + pageSize - 1) / pageSize * pageSize;
+        mappedBytes_ = blockStride_ * blockCount;
+
+        void *memory = mmap(nullptr, mappedBytes_, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (memory == MAP_FAILED) {
+            blockStride_ = 0;
+            mappedBytes_ = 0;
+            return;
+        }
+
+        base_ = memory;
+        blockCount_ = blockCount;
+    }
+
+    RealtimeMemoryPool::~RealtimeMemoryPool()
+    {
+        if (!base_) { return; }
+
+        if (lockedBytes_ > 0) { munlock(base_, mappedBytes_); }
+        munmap(base_, mappedBytes_);
+    }
+
+    auto RealtimeMemoryPool::prefaultBlock(size_t index) -> bool
+    {
+        if (!base_ || index >= blockCount_) { return false; }
+
+        auto *block = static_cast<volatile uint8_t *>(getBlock(index));
+        const size_t pageSize = getSystemPageSize();
+        for (size_t offset = 0; offset < blockStride_; offset += pageSize) { block[offset] = 0; }
+
+        if (!lockMemory_) { return true; }
+        if (mlock(getBlock(index), blockStride_) != 0) { return false; }
+
+        lockedBytes_ += blockStride_;
+        return true;
+    }
+
+    auto RealtimeMemoryPool::getResidentBytes() const -> size_t
+    {
+        if (!base_) { return 0; }
+
+        const size_t pageSize = getSystemPageSize();
+        const size_t pageCount = (mappedBytes_ + pageSize - 1) / pageSize;
+
+        // The element type of mincore's vector differs between Linux and Darwin.
+#if defined(__APPLE__)
+        std::vector<char> residency(pageCount);
+#else
+        std::vector<unsigned char> residency(pageCount);
+#endif
+        if (mincore(base_, mappedBytes_, residency.data()) != 0) { return 0; }
+
+        size_t residentPages = 0;
+        for (auto flags : residency) {
+            if (flags & 1) { ++residentPages; }
+        }
+        return residentPages * pageSize;
+    }
+
+    auto RealtimeMemoryPool::getSystemPageSize() -> size_t
+    {
+        static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return pageSize;
+    }
+
+    // --- PageFaultCounter ---
+
+    void PageFaultCounter::begin()
+    {
+        measuring_ = isEnabled();
+        if (measuring_) { startFaults_ = readFaults(); }
+    }
+
+    void PageFaultCounter::end()
+    {
+        if (!measuring_) { return; }
+
+        const uint64_t now = readFaults();
+        if (now > startFaults_) {
+            faults_.fetch_add(now - startFaults_, std::memory_order_relaxed);
+        }
+        measuring_ = false;
+    }
+
+    auto PageFaultCounter::readFaults() -> uint64_t
+    {
+        rusage usage{};
+#if defined(RUSAGE_THREAD)
+        getrusage(RUSAGE_THREAD, &usage);
+#else
+        getrusage(RUSAGE_SELF, &usage);
+#endif
+        return static_cast<uint64_t>(usage.ru_minflt) + static_cast<uint64_t>(usage.ru_majflt);
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace pg {
+namespace audio_tap {
+
+    // Fixed set of equally sized memory blocks for buffers that are written on the real-time
+    // thread.
+    //
+    // The whole pool is reserved with a single anonymous mapping, so untouched blocks cost
+    // address space but no resident memory. Before a block is handed to the audio thread it
+    // should be passed through `prefaultBlock()` on a non-real-time thread: that touches every OS
+    // page in it (and optionally wires it with `mlock`) so the first real-time write does not
+    // take a page fault.
+    //
+    // POSIX only; no Core Audio dependency.
+    class RealtimeMemoryPool
+    {
+    public:
+        RealtimeMemoryPool(size_t blockSizeInBytes, size_t blockCount, bool lockMemory);
+        ~RealtimeMemoryPool();
+
+        RealtimeMemoryPool(const RealtimeMemoryPool &) = delete;
+        RealtimeMemoryPool &operator=(const RealtimeMemoryPool &) = delete;
+
+        auto isValid() const -> bool { return base_ != nullptr; }
+        auto getBlockCount() const -> size_t { return blockCount_; }
+        auto getBlockStride() const -> size_t { return blockStride_; }
+
+        auto getBlock(size_t index) const -> void *
+        {
+            return static_cast<uint8_t *>(base_) + index * blockStride_;
+        }
+
+        // Touches every page of the block and, if requested, locks it into RAM. Not real-time
+        // safe. Returns false if locking was requested but failed; the block is still usable.
+        auto prefaultBlock(size_t index) -> bool;
+
+        // Number of bytes of the pool currently resident in physical memory, via `mincore`.
+        // Intended for diagnostics and tests.
+        auto getResidentBytes() const -> size_t;
+
+        static auto getSystemPageSize() -> size_t;
+
+    private:
+        void *base_{nullptr};
+        size_t blockStride_{0};
+        size_t blockCount_{0};
+        size_t mappedBytes_{0};
+        bool lockMemory_{false};
+        size_t lockedBytes_{0};
+    };
+
+    // Counts page faults taken by the thread that calls `begin()` / `end()`.
+    //
+    // Bracket a real-time callback with it to find out whether buffers were touched for the first
+    // time on the audio thread. Uses per-thread `getrusage` where the platform offers it and
+    // falls back to process-wide counts otherwise (macOS), which over-reports but never misses a
+    // fault. Disabled by default because each bracket costs two system calls.
+    class PageFaultCounter
+    {
+    public:
+        void setEnabled(bool shouldBeEnabled) { enabled_.store(shouldBeEnabled); }
+        auto isEnabled() const -> bool { return enabled_.load(std::memory_order_relaxed); }
+
+        void begin();
+        void end();
+
+        auto getFaultCount() const -> uint64_t { return faults_.load(); }
+
+    private:
+        static auto readFaults() -> uint64_t;
+
+        std::atomic<bool> enabled_{false};
+        bool measuring_{false}; // Only touched by the measured thread.
+        uint64_t startFaults_{0};
+        std::atomic<uint64_t> faults_{0};
+    };
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,107 @@
+#include "ReplayHistoryBuffer.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        // Frames copied per sink write when taking a snapshot.
+        constexpr size_t kSnapshotChunkFrames = 16384;
+    } // namespace
+
+    ReplayHistoryBuffer::ReplayHistoryBuffer(uint32_t channelCount, size_t capacityInFrames)
+      : channelCount_(channelCount > 0 ? channelCount : 1),
+        capacityInFrames_(std::max<size_t>(capacityInFrames, 1)),
+        samples_(new float[capacityInFrames_ * channelCount_])
+    {
+    }
+
+    void ReplayHistoryBuffer::write(const float *interleaved, size_t sampleCount)
+    {
+        size_t frameCount = sampleCount / channelCount_;
+        uint64_t first = publishedFrames_.load(std::memory_order_relaxed);
+
+        // Only the newest `capacityInFrames_` frames of an oversized block can survive anyway.
+        if (frameCount > capacityInFrames_) {
+            const size_t skippedFrames = frameCount - capacityInFrames_;
+            interleaved += skippedFrames * channelCount_;
+            first += skippedFrames;
+            frameCount = capacityInFrames_;
+        }
+
+        reservedFrames_.store(first + frameCount, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        const size_t offset = static_cast<size_t>(first % capacityInFrames_);
+        const size_t firstPart = std::min(frameCount, capacityInFrames_ - offset);
+
+        std::copy(interleaved, interleaved + firstPart * channelCount_,
+                  samples_.get() + offset * channelCount_);
+        std::copy(interleaved + firstPart * channelCount_, interleaved + frameCount * channelCount_,
+                  samples_.get());
+
+        publishedFrames_.store(first + frameCount, std::memory_order_release);
+    }
+
+    auto ReplayHistoryBuffer::getTotalFramesWritten() const -> uint64_t
+    {
+        return publishedFrames_.load(std::memory_order_acquire);
+    }
+
+    auto ReplayHistoryBuffer::read(uint64_t firstFrame, float *destination,
+                                   size_t frameCount) const -> bool
+    {
+        if (frameCount == 0) { return true; }
+        if (frameCount > capacityInFrames_) { return false; }
+
+        const uint64_t published = publishedFrames_.load(std::memory_order_acquire);
+        if (firstFrame + frameCount > published) { return false; }
+
+        copyOut(firstFrame, destination, frameCount);
+
+        // Anything the writer has reserved since could have overwritten the slots just read.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t reserved = reservedFrames_.load(std::memory_order_relaxed);
+        return reserved <= capacityInFrames_ || firstFrame >= reserved - capacityInFrames_;
+    }
+
+    auto ReplayHistoryBuffer::writeLatestTo(SampleSink &sink, size_t maxFrames) const -> size_t
+    {
+        const uint64_t end = getTotalFramesWritten();
+        const uint64_t available = std::min<uint64_t>(end, capacityInFrames_);
+        uint64_t frame = end - std::min<uint64_t>(available, maxFrames);
+
+        std::vector<float> chunk(std::min(kSnapshotChunkFrames, capacityInFrames_) *
+                                 channelCount_);
+        size_t framesWritten = 0;
+
+        while (frame < end) {
+            const size_t chunkFrames = chunk.size() / channelCount_;
+            const auto framesToCopy =
+                    static_cast<size_t>(std::min<uint64_t>(end - frame, chunkFrames));
+            if (!read(frame, chunk.data(), framesToCopy)) { break; }
+            if (!sink.write(chunk.data(), framesToCopy)) { break; }
+
+            frame += framesToCopy;
+            framesWritten += framesToCopy;
+        }
+        return framesWritten;
+    }
+
+    void ReplayHistoryBuffer::copyOut(uint64_t firstFrame, float *destination,
+                                      size_t frameCount) const
+    {
+        const size_t offset = static_cast<size_t>(firstFrame % capacityInFrames_);
+        const size_t firstPart = std::min(frameCount, capacityInFrames_ - offset);
+        const float *source = samples_.get();
+
+        std::copy(source + offset * channelCount_, source + (offset + firstPart) * channelCount_,
+                  destination);
+        std::copy(source, source + (frameCount - firstPart) * channelCount_,
+                  destination + firstPart * channelCount_);
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "SampleSink.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace pg {
+namespace audio_tap {
+
+    // Fixed-size circular history of the most recent captured audio, for instant replay.
+    //
+    // A single real-time writer overwrites the oldest frames without ever waiting. Readers copy
+    // out of the history concurrently and detect, seqlock-style, whether the writer lapped them
+    // while they were copying, so neither side takes a lock. Memory use is constant: the capacity
+    // is allocated once and not initialised, so it only becomes resident as it fills.
+    //
+    // This class has no platform dependencies.
+    class ReplayHistoryBuffer
+    {
+    public:
+        ReplayHistoryBuffer(uint32_t channelCount, size_t capacityInFrames);
+
+        ReplayHistoryBuffer(const ReplayHistoryBuffer &) = delete;
+        ReplayHistoryBuffer &operator=(const ReplayHistoryBuffer &) = delete;
+
+        auto getChannelCount() const -> uint32_t { return channelCount_; }
+        auto getCapacityInFrames() const -> size_t { return capacityInFrames_; }
+
+        // --- Writer side (real-time) ---
+
+        // Appends interleaved samples, overwriting the oldest history. Never blocks or allocates.
+        void write(const float *interleaved, size_t sampleCount);
+
+        // --- Reader side ---
+
+        // Total number of frames ever written; frame indices below are absolute.
+        auto getTotalFramesWritten() const -> uint64_t;
+
+        // Copies frames [firstFrame, firstFrame + frameCount) into `destination`. Returns false
+        // if any of them were no longer (or not yet) in the history by the end of the copy.
+        auto read(uint64_t firstFrame, float *destination, size_t frameCount) const -> bool;
+
+        // Streams up to the last `maxFrames` frames, oldest first, into `sink` without
+        // finalizing it. Capture continues throughout; the snapshot ends at the frame that was
+        // newest when the call started. Returns the number of frames written, which is short if
+        // the writer overtook the snapshot or the sink failed.
+        auto writeLatestTo(SampleSink &sink, size_t maxFrames) const -> size_t;
+
+    private:
+        void copyOut(uint64_t firstFrame, float *destination, size_t frameCount) const;
+
+        const uint32_t channelCount_;
+        const size_t capacityInFrames_;
+        std::unique_ptr<float[]> samples_;
+
+        // `reservedFrames_` is advanced before the writer touches the storage and
+        // `publishedFrames_` after, so a reader can tell which frames may have been overwritten
+        // while it was copying.
+        std::atomic<uint64_t> reservedFrames_{0};
+        std::atomic<uint64_t> publishedFrames_{0};
+    };
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,428 @@
+#include "Resampler.h"
+#include "InterleaveKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#if defined(PG_KERNELS_PORTABLE)
+// Portable loops only.
+#elif defined(__x86_64__) || defined(__i386__)
+#define PG_KERNELS_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define PG_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        // Above this many phases the coefficient table would get large, so phases are
+        // interpolated from a table of this size instead.
+        constexpr uint64_t kMaxExactPhases = 1024;
+
+        // Filter lengths are rounded up to this so the SIMD loops need no tail.
+        constexpr size_t kTapAlignment = 8;
+
+        constexpr double kPi = 3.14159265358979323846;
+
+        struct FilterDesign
+        {
+            double attenuationDb;
+            double passband; // Passband edge as a fraction of the lower Nyquist frequency.
+        };
+
+        auto getDesign(ResamplerQuality quality) -> FilterDesign
+        {
+            switch (quality) {
+            case ResamplerQuality::Fast: return {60.0, 0.75};
+            case ResamplerQuality::Best: return {140.0, 0.91};
+            case ResamplerQuality::Balanced: break;
+            }
+            return {100.0, 0.86};
+        }
+
+        // Zeroth-order modified Bessel function of the first kind, for the Kaiser window.
+        auto besselI0(double x) -> double
+        {
+            double sum = 1.0;
+            double term = 1.0;
+            for (int k = 1; k < 64 && term > sum * 1e-17; ++k) {
+                const double half = x / (2.0 * k);
+                term *= half * half;
+                sum += term;
+            }
+            return sum;
+        }
+
+        using DotFn = float (*)(const float *, const float *, size_t);
+        // Two channels against the same coefficients, loading each coefficient once.
+        using DotStereoFn = void (*)(const float *, const float *, const float *, size_t,
+                                     float *);
+
+        // `count` is always a multiple of kTapAlignment, so no kernel needs a scalar tail.
+
+#if !PG_KERNELS_X86 && !PG_KERNELS_NEON
+        auto dotScalar(const float *a, const float *b, size_t count) -> float
+        {
+            float sums[4] = {};
+            for (size_t i = 0; i < count; i += 4) {
+                for (size_t lane = 0; lane < 4; ++lane) { sums[lane] += a[i + lane] * b[i + lane]; }
+            }
+            return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+        }
+
+        void dotStereoScalar(const float *coefficients, const float *left, const float *right,
+                             size_t count, float *result)
+        {
+            result[0] = dotScalar(coefficients, left, count);
+            result[1] = dotScalar(coefficients, right, count);
+        }
+#endif
+
+#if PG_KERNELS_X86
+        auto horizontalSum(__m128 sum) -> float
+        {
+            sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+            sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+            return _mm_cvtss_f32(sum);
+        }
+
+        auto dotSse2(const float *a, const float *b, size_t count) -> float
+        {
+            __m128 sum0 = _mm_setzero_ps();
+            __m128 sum1 = _mm_setzero_ps();
+            for (size_t i = 0; i < count; i += 8) {
+                sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+                sum1 = _mm_add_ps(sum1,
+                                  _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+            }
+            return horizontalSum(_mm_add_ps(sum0, sum1));
+        }
+
+        void dotStereoSse2(const float *coefficients, const float *left, const float *right,
+                           size_t count, float *result)
+        {
+            __m128 sumL0 = _mm_setzero_ps(), sumL1 = _mm_setzero_ps();
+            __m128 sumR0 = _mm_setzero_ps(), sumR1 = _mm_setzero_ps();
+            for (size_t i = 0; i < count; i += 8) {
+                const __m128 c0 = _mm_loadu_ps(coefficients + i);
+                const __m128 c1 = _mm_loadu_ps(coefficients + i + 4);
+                sumL0 = _mm_add_ps(sumL0, _mm_mul_ps(c0, _mm_loadu_ps(left + i)));
+                sumL1 = _mm_add_ps(sumL1, _mm_mul_ps(c1, _mm_loadu_ps(left + i + 4)));
+                sumR0 = _mm_add_ps(sumR0, _mm_mul_ps(c0, _mm_loadu_ps(right + i)));
+                sumR1 = _mm_add_ps(sumR1, _mm_mul_ps(c1, _mm_loadu_ps(right + i + 4)));
+            }
+            result[0] = horizontalSum(_mm_add_ps(sumL0, sumL1));
+            result[1] = horizontalSum(_mm_add_ps(sumR0, sumR1));
+        }
+
+        __attribute__((target("avx2,fma"))) auto dotAvx2(const float *a, const float *b,
+                                                         size_t count) -> float
+        {
+            __m256 sum0 = _mm256_setzero_ps();
+            __m256 sum1 = _mm256_setzero_ps();
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16) {
+                sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+                sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8),
+                                       sum1);
+            }
+            if (i < count) {
+                sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+            }
+            const __m256 sum = _mm256_add_ps(sum0, sum1);
+            alignas(32) float lanes[8];
+            _mm256_store_ps(lanes, sum);
+            return ((lanes[0] + lanes[4]) + (lanes[1] + lanes[5])) +
+                   ((lanes[2] + lanes[6]) + (lanes[3] + lanes[7]));
+        }
+
+        __attribute__((target("avx2,fma"))) void dotStereoAvx2(const float *coefficients,
+                                                               const float *left,
+                                                               const float *right, size_t count,
+                                                               float *result)
+        {
+            __m256 sumL0 = _mm256_setzero_ps(), sumL1 = _mm256_setzero_ps();
+            __m256 sumR0 = _mm256_setzero_ps(), sumR1 = _mm256_setzero_ps();
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16) {
+                const __m256 c0 = _mm256_loadu_ps(coefficients + i);
+                const __m256 c1 = _mm256_loadu_ps(coefficients + i + 8);
+                sumL0 = _mm256_fmadd_ps(c0, _mm256_loadu_ps(left + i), sumL0);
+                sumL1 = _mm256_fmadd_ps(c1, _mm256_loadu_ps(left + i + 8), sumL1);
+                sumR0 = _mm256_fmadd_ps(c0, _mm256_loadu_ps(right + i), sumR0);
+                sumR1 = _mm256_fmadd_ps(c1, _mm256_loadu_ps(right + i + 8), sumR1);
+            }
+            if (i < count) {
+                const __m256 c0 = _mm256_loadu_ps(coefficients + i);
+                sumL0 = _mm256_fmadd_ps(c0, _mm256_loadu_ps(left + i), sumL0);
+                sumR0 = _mm256_fmadd_ps(c0, _mm256_loadu_ps(right + i), sumR0);
+            }
+            const __m256 sumL = _mm256_add_ps(sumL0, sumL1);
+            const __m256 sumR = _mm256_add_ps(sumR0, sumR1);
+            // Fold both channels at once: lanes 0-3 end up holding L, lanes 4-7 R.
+            const __m256 folded = _mm256_add_ps(_mm256_permute2f128_ps(sumL, sumR, 0x20),
+                                                _mm256_permute2f128_ps(sumL, sumR, 0x31));
+            alignas(32) float lanes[8];
+            _mm256_store_ps(lanes, folded);
+            result[0] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+            result[1] = (lanes[4] + lanes[5]) + (lanes[6] + lanes[7]);
+        }
+
+        auto hasAvx2() -> bool
+        {
+#if defined(PG_KERNELS_NO_AVX2)
+            static const bool supported = false;
+#else
+            static const bool supported =
+                    __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+            return supported;
+        }
+#endif
+
+#if PG_KERNELS_NEON
+        auto dotNeon(const float *a, const float *b, size_t count) -> float
+        {
+            float32x4_t sum0 = vdupq_n_f32(0.0f);
+            float32x4_t sum1 = vdupq_n_f32(0.0f);
+            for (size_t i = 0; i < count; i += 8) {
+                sum0 = vfmaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+                sum1 = vfmaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+            }
+            return vaddvq_f32(vaddq_f32(sum0, sum1));
+        }
+
+        void dotStereoNeon(const float *coefficients, const float *left, const float *right,
+                           size_t count, float *result)
+        {
+            float32x4_t sumL0 = vdupq_n_f32(0.0f), sumL1 = vdupq_n_f32(0.0f);
+            float32x4_t sumR0 = vdupq_n_f32(0.0f), sumR1 = vdupq_n_f32(0.0f);
+            for (size_t i = 0; i < count; i += 8) {
+                const float32x4_t c0 = vld1q_f32(coefficients + i);
+                const float32x4_t c1 = vld1q_f32(coefficients + i + 4);
+                sumL0 = vfmaq_f32(sumL0, c0, vld1q_f32(left + i));
+                sumL1 = vfmaq_f32(sumL1, c1, vld1q_f32(left + i + 4));
+                sumR0 = vfmaq_f32(sumR0, c0, vld1q_f32(right + i));
+                sumR1 = vfmaq_f32(sumR1, c1, vld1q_f32(right + i + 4));
+            }
+            result[0] = vaddvq_f32(vaddq_f32(sumL0, sumL1));
+            result[1] = vaddvq_f32(vaddq_f32(sumR0, sumR1));
+        }
+#endif
+
+        auto selectDotProduct() -> DotFn
+        {
+#if PG_KERNELS_X86
+            return hasAvx2() ? dotAvx2 : dotSse2;
+#elif PG_KERNELS_NEON
+            return dotNeon;
+#else
+            return dotScalar;
+#endif
+        }
+
+        auto selectDotProductStereo() -> DotStereoFn
+        {
+#if PG_KERNELS_X86
+            return hasAvx2() ? dotStereoAvx2 : dotStereoSse2;
+#elif PG_KERNELS_NEON
+            return dotStereoNeon;
+#else
+            return dotStereoScalar;
+#endif
+        }
+
+        const DotFn dotProduct = selectDotProduct();
+        const DotStereoFn dotProductStereo = selectDotProductStereo();
+    } // namespace
+
+    Resampler::Resampler(uint32_t channelCount, double inputRate, double outputRate,
+                         ResamplerQuality quality)
+      : channelCount_(std::max<uint32_t>(channelCount, 1)),
+        history_(channelCount_),
+        planes_(channelCount_)
+    {
+        const auto inRate = static_cast<uint64_t>(std::max<long long>(1, std::llround(inputRate)));
+        const auto outRate =
+                static_cast<uint64_t>(std::max<long long>(1, std::llround(outputRate)));
+        const uint64_t divisor = std::gcd(inRate, outRate);
+        up_ = outRate / divisor;
+        down_ = inRate / divisor;
+        if (up_ == down_) { return; } // Nothing to convert; `process()` copies.
+
+        // Kaiser design in input-frame units. The stopband starts at the lower Nyquist
+        // frequency and the cutoff sits in the middle of the transition band.
+        const FilterDesign design = getDesign(quality);
+        const double nyquist =
+                0.5 * std::min(1.0, static_cast<double>(outRate) / static_cast<double>(inRate));
+        const double transition = nyquist * (1.0 - design.passband);
+        const double cutoff = nyquist * (1.0 + design.passband) * 0.5;
+        const double beta = 0.1102 * (design.attenuationDb - 8.7);
+        const auto length = static_cast<size_t>(
+                std::ceil((design.attenuationDb - 7.95) / (14.36 * transition))) + 1;
+        tapCount_ = (length + kTapAlignment - 1) / kTapAlignment * kTapAlignment;
+
+        interpolate_ = up_ > kMaxExactPhases;
+        const uint64_t phaseCount = interpolate_ ? kMaxExactPhases : up_;
+        rowCount_ = static_cast<size_t>(phaseCount) + (interpolate_ ? 1 : 0);
+        rows_.resize(rowCount_ * tapCount_);
+
+        // Row r computes an output at fraction r / phaseCount past input frame n; tap j
+        // multiplies frame n - (half - 1) + j, which lies t frames before the output.
+        const double half = static_cast<double>(tapCount_ / 2);
+        const double windowScale = 1.0 / besselI0(beta);
+        for (size_t r = 0; r < rowCount_; ++r) {
+            const double fraction = static_cast<double>(r) / static_cast<double>(phaseCount);
+            float *row = &rows_[r * tapCount_];
+            double sum = 0.0;
+            for (size_t j = 0; j < tapCount_; ++j) {
+                const double t = fraction + half - 1.0 - static_cast<double>(j);
+                const double x = t / half;
+                double value = 0.0;
+                if (std::fabs(x) < 1.0) {
+                    const double arg = 2.0 * kPi * cutoff * t;
+                    const double sinc = t == 0.0 ? 1.0 : std::sin(arg) / arg;
+                    value = 2.0 * cutoff * sinc * besselI0(beta * std::sqrt(1.0 - x * x)) *
+                            windowScale;
+                }
+                row[j] = static_cast<float>(value);
+                sum += value;
+            }
+            // Unity gain at DC for every phase, so no phase-dependent ripple.
+            for (size_t j = 0; j < tapCount_; ++j) { row[j] = static_cast<float>(row[j] / sum); }
+        }
+
+        // Centre the filter on frame zero with zeros standing in for the past.
+        const size_t priming = tapCount_ / 2 - 1;
+        for (auto &channel : history_) { channel.assign(priming, 0.0f); }
+        historyStart_ = -static_cast<int64_t>(priming);
+    }
+
+    auto Resampler::process(const float *interleaved, size_t frameCount,
+                            std::vector<float> &output) -> size_t
+    {
+        if (flushed_ || frameCount == 0) { return 0; }
+        inputFrames_ += frameCount;
+
+        if (tapCount_ == 0) {
+            output.insert(output.end(), interleaved, interleaved + frameCount * channelCount_);
+            outputFrames_ += frameCount;
+            return frameCount;
+        }
+
+        const size_t previous = history_[0].size();
+        for (uint32_t ch = 0; ch < channelCount_; ++ch) {
+            history_[ch].resize(previous + frameCount);
+            planes_[ch] = history_[ch].data() + previous;
+        }
+        kernels::deinterleave(interleaved, channelCount_, frameCount, planes_.data());
+
+        const uint64_t before = outputFrames_;
+        generate(output, UINT64_MAX);
+        return static_cast<size_t>(outputFrames_ - before);
+    }
+
+    auto Resampler::flush(std::vector<float> &output) -> size_t
+    {
+        if (flushed_) { return 0; }
+        flushed_ = true;
+        if (tapCount_ == 0) { return 0; }
+
+        // Zeros stand in for the future, so the last frames see a full filter.
+        for (auto &channel : history_) { channel.resize(channel.size() + tapCount_ / 2, 0.0f); }
+
+        const uint64_t before = outputFrames_;
+        generate(output, (inputFrames_ * up_ + down_ / 2) / down_);
+        return static_cast<size_t>(outputFrames_ - before);
+    }
+
+    void Resampler::filter(const float *row, size_t first, std::vector<float> &output) const
+    {
+        if (channelCount_ == 2) {
+            float frame[2];
+            dotProductStereo(row, history_[0].data() + first, history_[1].data() + first,
+                             tapCount_, frame);
+            output.insert(output.end(), frame, frame + 2);
+            return;
+        }
+        for (uint32_t ch = 0; ch < channelCount_; ++ch) {
+            output.push_back(dotProduct(row, history_[ch].data() + first, tapCount_));
+        }
+    }
+
+    void Resampler::generate(std::vector<float> &output, uint64_t frameLimit)
+    {
+        const auto lookBehind = static_cast<int64_t>(tapCount_ / 2 - 1);
+        const size_t available = history_[0].size();
+
+        while (outputFrames_ < frameLimit) {
+            const auto first = static_cast<size_t>(inputFrame_ - lookBehind - historyStart_);
+            if (first + tapCount_ > available) { break; }
+
+            if (!interpolate_) {
+                filter(getRow(static_cast<size_t>(phase_)), first, output);
+            } else {
+                const double position = static_cast<double>(phase_) *
+                                        static_cast<double>(rowCount_ - 1) /
+                                        static_cast<double>(up_);
+                const auto index = static_cast<size_t>(position);
+                const auto fraction = static_cast<float>(position - static_cast<double>(index));
+                const size_t begin = output.size();
+                filter(getRow(index), first, output);
+                filter(getRow(index + 1), first, output);
+                for (uint32_t ch = 0; ch < channelCount_; ++ch) {
+                    const float a = output[begin + ch];
+                    const float b = output[begin + channelCount_ + ch];
+                    output[begin + ch] = a + fraction * (b - a);
+                }
+                output.resize(begin + channelCount_);
+            }
+
+            ++outputFrames_;
+            phase_ += down_;
+            inputFrame_ += static_cast<int64_t>(phase_ / up_);
+            phase_ %= up_;
+        }
+
+        // Drop input no future output can reach, once there is enough of it to be worth a move.
+        const auto consumed = static_cast<size_t>(
+                std::max<int64_t>(0, inputFrame_ - lookBehind - historyStart_));
+        if (consumed > 8192 && consumed * 2 > available) {
+            for (auto &channel : history_) {
+                channel.erase(channel.begin(),
+                              channel.begin() + static_cast<std::ptrdiff_t>(
+                                                        std::min(consumed, channel.size())));
+            }
+            historyStart_ += static_cast<int64_t>(consumed);
+        }
+    }
+
+    ResamplingSink::ResamplingSink(std::unique_ptr<SampleSink> sink,
+                                   const CaptureFormat &inputFormat, double outputRate,
+                                   ResamplerQuality quality)
+      : sink_(std::move(sink)),
+        resampler_(inputFormat.channelCount, inputFormat.sampleRate, outputRate, quality)
+    {
+    }
+
+    auto ResamplingSink::write(const float *interleaved, size_t frameCount) -> bool
+    {
+        converted_.clear();
+        const size_t frames = resampler_.process(interleaved, frameCount, converted_);
+        return frames == 0 || sink_->write(converted_.data(), frames);
+    }
+
+    auto ResamplingSink::finalize() -> bool
+    {
+        converted_.clear();
+        const size_t frames = resampler_.flush(converted_);
+        const bool written = frames == 0 || sink_->write(converted_.data(), frames);
+        return sink_->finalize() && written;
+    }
+
+} // namespace audio_tap
+} // namespace pg
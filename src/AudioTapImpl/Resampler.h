@@ -0,0 +1,101 @@
+#pragma once
+
+#include "CaptureFormat.h"
+#include "SampleSink.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    // Streaming sample-rate converter for interleaved float audio.
+    //
+    // A polyphase windowed-sinc (Kaiser) filter, designed for the lower of the two Nyquist
+    // frequencies so downsampling does not alias. Integer rate pairs with a small ratio (e.g.
+    // 48000 -> 44100 is 147/160) use one exact coefficient set per phase; other ratios
+    // interpolate between 1024 precomputed phases. The inner dot products use SSE2 or AVX2/FMA
+    // (selected at run time, capped by the interleave kernels' build knobs) on x86 and NEON on
+    // ARM.
+    //
+    // Output is time-aligned with the input: the filter delay is compensated, so the first
+    // output frame lines up with the first input frame, and after `flush()` the stream holds
+    // exactly round(inputFrames * outputRate / inputRate) frames.
+    //
+    // Not real-time safe (buffers grow as needed); meant for the writer thread or offline use.
+    // No platform dependencies.
+    class Resampler
+    {
+    public:
+        Resampler(uint32_t channelCount, double inputRate, double outputRate,
+                  ResamplerQuality quality = ResamplerQuality::Balanced);
+
+        Resampler(const Resampler &) = delete;
+        Resampler &operator=(const Resampler &) = delete;
+
+        // Converts `frameCount` interleaved frames, appending whatever output is ready to
+        // `output`. Returns the number of frames appended.
+        auto process(const float *interleaved, size_t frameCount, std::vector<float> &output)
+                -> size_t;
+
+        // Ends the stream: pushes the remaining input through the filter and appends the final
+        // frames to `output`. Returns the number of frames appended.
+        auto flush(std::vector<float> &output) -> size_t;
+
+        auto getChannelCount() const -> uint32_t { return channelCount_; }
+        // Filter length in input frames; the delay hidden by the alignment is half of it.
+        auto getTapCount() const -> size_t { return tapCount_; }
+
+    private:
+        void generate(std::vector<float> &output, uint64_t frameLimit);
+        // Appends one output frame computed with `row` from history starting at `first`.
+        void filter(const float *row, size_t first, std::vector<float> &output) const;
+        auto getRow(size_t index) const -> const float * { return &rows_[index * tapCount_]; }
+
+        const uint32_t channelCount_;
+        uint64_t up_{1};   // Output rate / gcd.
+        uint64_t down_{1}; // Input rate / gcd.
+        size_t tapCount_{0};
+        size_t rowCount_{0};         // Phases in `rows_`, plus one when interpolating.
+        bool interpolate_{false};    // Phases are looked up fractionally.
+        std::vector<float> rows_;    // One coefficient set per phase, `tapCount_` each.
+
+        // Input per channel, starting at absolute frame `historyStart_` (negative at first:
+        // the zeros that centre the filter on frame zero).
+        std::vector<std::vector<float>> history_;
+        std::vector<float *> planes_;
+        int64_t historyStart_{0};
+
+        // Position of the next output frame in the input: `inputFrame_ + phase_ / up_`.
+        int64_t inputFrame_{0};
+        uint64_t phase_{0};
+
+        uint64_t inputFrames_{0};
+        uint64_t outputFrames_{0};
+        bool flushed_{false};
+    };
+
+    // Pass-through sink that converts the capture stream to another sample rate before handing
+    // it on, e.g. to write every recording at a fixed 48 kHz whatever the device runs at.
+    class ResamplingSink : public SampleSink
+    {
+    public:
+        // `sink` receives audio at `outputRate`.
+        ResamplingSink(std::unique_ptr<SampleSink> sink, const CaptureFormat &inputFormat,
+                       double outputRate, ResamplerQuality quality);
+
+        auto write(const float *interleaved, size_t frameCount) -> bool override;
+        auto finalize() -> bool override;
+        auto checkpoint() -> bool override { return sink_->checkpoint(); }
+        auto getBytesWritten() const -> uint64_t override { return sink_->getBytesWritten(); }
+
+    private:
+        std::unique_ptr<SampleSink> sink_;
+        Resampler resampler_;
+        std::vector<float> converted_;
+    };
+
+} // namespace audio_tap
+} // namespace pg
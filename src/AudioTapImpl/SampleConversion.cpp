@@ -0,0 +1,207 @@
+#include "SampleConversion.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(PG_KERNELS_PORTABLE)
+// Portable loops only.
+#elif defined(__x86_64__) || defined(__i386__)
+#define PG_KERNELS_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define PG_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace pg {
+namespace audio_tap {
+    namespace kernels {
+
+        namespace {
+            // Samples quantised per pass; small enough for the int32 staging block to stay in L1.
+            constexpr size_t kBlockSize = 256;
+
+            constexpr float kInt16Scale = 32767.0f;
+            constexpr float kInt24Scale = 8388607.0f;
+
+            using QuantizeFn = void (*)(const float *, const float *, size_t, float, float, float,
+                                        int32_t *);
+
+            void quantizeScalar(const float *source, const float *noise, size_t count,
+                                float scale, float minimum, float maximum, int32_t *destination)
+            {
+                for (size_t i = 0; i < count; ++i) {
+                    float value = source[i] * scale + (noise ? noise[i] : 0.0f);
+                    value = std::min(std::max(value, minimum), maximum);
+                    destination[i] = static_cast<int32_t>(std::lrintf(value));
+                }
+            }
+
+#if PG_KERNELS_X86
+            void quantizeSse2(const float *source, const float *noise, size_t count, float scale,
+                              float minimum, float maximum, int32_t *destination)
+            {
+                const __m128 vScale = _mm_set1_ps(scale);
+                const __m128 vMin = _mm_set1_ps(minimum);
+                const __m128 vMax = _mm_set1_ps(maximum);
+
+                size_t i = 0;
+                for (; i + 4 <= count; i += 4) {
+                    __m128 value = _mm_mul_ps(_mm_loadu_ps(source + i), vScale);
+                    if (noise) { value = _mm_add_ps(value, _mm_loadu_ps(noise + i)); }
+                    value = _mm_min_ps(_mm_max_ps(value, vMin), vMax);
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i),
+                                     _mm_cvtps_epi32(value));
+                }
+                quantizeScalar(source + i, noise ? noise + i : nullptr, count - i, scale, minimum,
+                               maximum, destination + i);
+            }
+
+            __attribute__((target("avx2"))) void quantizeAvx2(const float *source,
+                                                              const float *noise, size_t count,
+                                                              float scale, float minimum,
+                                                              float maximum, int32_t *destination)
+            {
+                const __m256 vScale = _mm256_set1_ps(scale);
+                const __m256 vMin = _mm256_set1_ps(minimum);
+                const __m256 vMax = _mm256_set1_ps(maximum);
+
+                size_t i = 0;
+                for (; i + 8 <= count; i += 8) {
+                    __m256 value = _mm256_mul_ps(_mm256_loadu_ps(source + i), vScale);
+                    if (noise) { value = _mm256_add_ps(value, _mm256_loadu_ps(noise + i)); }
+                    value = _mm256_min_ps(_mm256_max_ps(value, vMin), vMax);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(destination + i),
+                                        _mm256_cvtps_epi32(value));
+                }
+                // GCC may tail-call the SSE kernel without clearing the upper halves, which costs
+                // an AVX-to-SSE transition penalty on every call.
+                _mm256_zeroupper();
+                quantizeSse2(source + i, noise ? noise + i : nullptr, count - i, scale, minimum,
+                             maximum, destination + i);
+            }
+
+            auto hasAvx2() -> bool
+            {
+#if defined(PG_KERNELS_NO_AVX2)
+                static const bool supported = false;
+#else
+                static const bool supported = __builtin_cpu_supports("avx2");
+#endif
+                return supported;
+            }
+#endif
+
+#if PG_KERNELS_NEON
+            void quantizeNeon(const float *source, const float *noise, size_t count, float scale,
+                              float minimum, float maximum, int32_t *destination)
+            {
+                const float32x4_t vMin = vdupq_n_f32(minimum);
+                const float32x4_t vMax = vdupq_n_f32(maximum);
+
+                size_t i = 0;
+                for (; i + 4 <= count; i += 4) {
+                    float32x4_t value = vmulq_n_f32(vld1q_f32(source + i), scale);
+                    if (noise) { value = vaddq_f32(value, vld1q_f32(noise + i)); }
+                    value = vminq_f32(vmaxq_f32(value, vMin), vMax);
+                    vst1q_s32(destination + i, vcvtnq_s32_f32(value));
+                }
+                quantizeScalar(source + i, noise ? noise + i : nullptr, count - i, scale, minimum,
+                               maximum, destination + i);
+            }
+#endif
+
+            auto selectQuantize() -> QuantizeFn
+            {
+#if PG_KERNELS_X86
+                return hasAvx2() ? quantizeAvx2 : quantizeSse2;
+#elif PG_KERNELS_NEON
+                return quantizeNeon;
+#else
+                return quantizeScalar;
+#endif
+            }
+
+            const QuantizeFn quantize = selectQuantize();
+        } // namespace
+
+        void floatToInt16(const float *source, const float *noise, size_t count,
+                          int16_t *destination)
+        {
+            int32_t block[kBlockSize];
+            for (size_t offset = 0; offset < count; offset += kBlockSize) {
+                const size_t n = std::min(kBlockSize, count - offset);
+                quantize(source + offset, noise ? noise + offset : nullptr, n, kInt16Scale,
+                         -32768.0f, 32767.0f, block);
+                for (size_t i = 0; i < n; ++i) {
+                    destination[offset + i] = static_cast<int16_t>(block[i]);
+                }
+            }
+        }
+
+        void floatToInt24(const float *source, const float *noise, size_t count,
+                          uint8_t *destination)
+        {
+            int32_t block[kBlockSize];
+            for (size_t offset = 0; offset < count; offset += kBlockSize) {
+                const size_t n = std::min(kBlockSize, count - offset);
+                quantize(source + offset, noise ? noise + offset : nullptr, n, kInt24Scale,
+                         -8388608.0f, 8388607.0f, block);
+                uint8_t *out = destination + offset * 3;
+                for (size_t i = 0; i < n; ++i) {
+                    const auto value = static_cast<uint32_t>(block[i]);
+                    out[3 * i] = static_cast<uint8_t>(value);
+                    out[3 * i + 1] = static_cast<uint8_t>(value >> 8);
+                    out[3 * i + 2] = static_cast<uint8_t>(value >> 16);
+                }
+            }
+        }
+
+        void floatToInt32(const float *source, const float *noise, size_t count,
+                          uint32_t bitsPerSample, int32_t *destination)
+        {
+            const auto fullScale = static_cast<float>(1u << (bitsPerSample - 1));
+            quantize(source, noise, count, fullScale - 1.0f, -fullScale, fullScale - 1.0f,
+                     destination);
+        }
+
+    } // namespace kernels
+
+    TpdfDither::TpdfDither(uint32_t seed)
+    {
+        // Spread the seed over the lanes; xorshift must never be seeded with zero.
+        for (size_t lane = 0; lane < kLanes; ++lane) {
+            uint32_t value = seed ^ (0x85ebca6bu * static_cast<uint32_t>(lane + 1));
+            state_[lane] = value != 0 ? value : 0x6a09e667u;
+        }
+    }
+
+    void TpdfDither::generate(float *noise, size_t count)
+    {
+        constexpr float kToUnit = 1.0f / 16777216.0f; // 2^-24: top 24 bits -> [0, 1)
+
+        auto next = [](uint32_t &x)
+        {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            return static_cast<float>(x >> 8) * kToUnit;
+        };
+
+        size_t i = 0;
+        for (; i + kLanes <= count; i += kLanes) {
+            for (size_t lane = 0; lane < kLanes; ++lane) {
+                const float a = next(state_[lane]);
+                const float b = next(state_[lane]);
+                noise[i + lane] = a - b;
+            }
+        }
+        for (size_t lane = 0; i < count; ++i, ++lane) {
+            const float a = next(state_[lane]);
+            const float b = next(state_[lane]);
+            noise[i] = a - b;
+        }
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace pg {
+namespace audio_tap {
+    namespace kernels {
+
+        // Quantise float samples in [-1, 1] to signed integer PCM with clamping and
+        // round-to-nearest. `noise`, if not null, holds one dither value per sample in LSBs of
+        // the target format and is added before rounding.
+        //
+        // The scale/clamp/round stage uses SSE2 or AVX2 (selected at run time) on x86 and NEON
+        // on ARM, capped by the same build knobs as the interleave kernels. Output is
+        // little-endian; 24-bit samples are packed into 3 bytes.
+
+        void floatToInt16(const float *source, const float *noise, size_t count,
+                          int16_t *destination);
+
+        void floatToInt24(const float *source, const float *noise, size_t count,
+                          uint8_t *destination);
+
+        // Same, for encoders that work on whole words: each sample is quantised to
+        // `bitsPerSample` (8-24) bits and stored sign-extended in an int32.
+        void floatToInt32(const float *source, const float *noise, size_t count,
+                          uint32_t bitsPerSample, int32_t *destination);
+
+    } // namespace kernels
+
+    // Generates triangular-PDF dither in the range (-1, 1) LSB from eight independent xorshift
+    // generators, so the loop vectorises and stays cheap enough for the writer thread.
+    class TpdfDither
+    {
+    public:
+        explicit TpdfDither(uint32_t seed = 0x9e3779b9u);
+
+        void generate(float *noise, size_t count);
+
+    private:
+        static constexpr size_t kLanes = 8;
+        std::array<uint32_t, kLanes> state_{};
+    };
+
+} // namespace audio_tap
+} // namespace pg
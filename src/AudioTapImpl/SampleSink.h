@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pg {
+namespace audio_tap {
+
+    // Destination for captured audio. Implementations are driven exclusively from the
+    // `CaptureWriter` thread, so they are free to block, allocate and perform file I/O.
+    class SampleSink
+    {
+    public:
+        virtual ~SampleSink() = default;
+
+        // Appends `frameCount` interleaved float frames. Returns false on an unrecoverable error.
+        virtual auto write(const float *interleaved, size_t frameCount) -> bool = 0;
+
+        // Flushes any pending data and closes the destination. Called exactly once.
+        virtual auto finalize() -> bool = 0;
+
+        // Makes everything written so far durable against a crash of this process: flushes
+        // buffered data and updates the header so the file is readable as it stands. Called
+        // periodically by `CaptureWriter`; must be cheap and independent of the recording length.
+        virtual auto checkpoint() -> bool { return true; }
+
+        // Size of the encoded output so far, including anything still buffered. Zero if the
+        // sink cannot tell.
+        virtual auto getBytesWritten() const -> uint64_t { return 0; }
+    };
+
+} // namespace audio_tap
+} // namespace pg
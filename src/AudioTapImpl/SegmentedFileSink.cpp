@@ -0,0 +1,173 @@
+#include "SegmentedFileSink.h"
+#include "FilePaths.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+namespace pg {
+namespace audio_tap {
+
+    auto SegmentedFileSink::create(const std::string &basePath, const CaptureFormat &format,
+                                   const SegmentOptions &options, SinkFactory openSegment)
+            -> std::unique_ptr<SegmentedFileSink>
+    {
+        if (!options.isEnabled() || !format.isValid() || !openSegment) { return nullptr; }
+
+        auto sink = std::unique_ptr<SegmentedFileSink>(
+                new SegmentedFileSink(basePath, format, options, std::move(openSegment)));
+        sink->openNext();
+        if (!sink->rotate()) { return nullptr; }
+        return sink;
+    }
+
+    SegmentedFileSink::SegmentedFileSink(const std::string &basePath, const CaptureFormat &format,
+                                         const SegmentOptions &options, SinkFactory openSegment)
+      : basePath_(basePath),
+        indexPath_(paths::getCompanionPath(basePath, ".segments")),
+        format_(format),
+        maxFramesPerSegment_(options.maxSeconds > 0.0
+                                     ? static_cast<uint64_t>(std::max<long long>(
+                                               1, std::llround(options.maxSeconds *
+                                                               format.sampleRate)))
+                                     : 0),
+        maxBytesPerSegment_(options.maxBytes),
+        openSegment_(std::move(openSegment))
+    {
+    }
+
+    SegmentedFileSink::~SegmentedFileSink()
+    {
+        if (next_) {
+            next_.reset();
+            std::remove(nextPath_.c_str());
+        }
+    }
+
+    auto SegmentedFileSink::getSegmentPath(const std::string &basePath, size_t index)
+            -> std::string
+    {
+        const auto [stem, extension] = paths::splitExtension(basePath);
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), "_%04zu", index + 1);
+        return stem + suffix + extension;
+    }
+
+    auto SegmentedFileSink::write(const float *interleaved, size_t frameCount) -> bool
+    {
+        if (failed_ || !current_) { return false; }
+
+        while (frameCount > 0) {
+            // Rotate lazily, so the last segment is never left empty.
+            const Segment &segment = segments_.back();
+            const bool full =
+                    (maxFramesPerSegment_ > 0 && segment.frameCount >= maxFramesPerSegment_) ||
+                    (maxBytesPerSegment_ > 0 && segment.frameCount > 0 &&
+                     current_->getBytesWritten() >= maxBytesPerSegment_);
+            if (full && !rotate()) { return false; }
+
+            size_t framesToWrite = frameCount;
+            if (maxFramesPerSegment_ > 0) {
+                const uint64_t room = maxFramesPerSegment_ - segments_.back().frameCount;
+                if (room < framesToWrite) { framesToWrite = static_cast<size_t>(room); }
+            }
+
+            if (!current_->write(interleaved, framesToWrite)) {
+                failed_ = true;
+                return false;
+            }
+            segments_.back().frameCount += framesToWrite;
+            interleaved += framesToWrite * format_.channelCount;
+            frameCount -= framesToWrite;
+        }
+        return true;
+    }
+
+    auto SegmentedFileSink::finalize() -> bool
+    {
+        bool ok = !failed_;
+
+        if (next_) {
+            next_.reset();
+            std::remove(nextPath_.c_str());
+        }
+        if (current_) {
+            ok = current_->finalize() && ok;
+            finishedBytes_ += current_->getBytesWritten();
+            current_.reset();
+        }
+        return writeIndex() && ok;
+    }
+
+    auto SegmentedFileSink::checkpoint() -> bool
+    {
+        if (failed_ || !current_) { return false; }
+
+        // Earlier segments were finalized at rotation; only the open one and the index, which
+        // now also records its current length, need refreshing.
+        if (!current_->checkpoint() || !writeIndex()) { failed_ = true; }
+        return !failed_;
+    }
+
+    auto SegmentedFileSink::getBytesWritten() const -> uint64_t
+    {
+        return finishedBytes_ + (current_ ? current_->getBytesWritten() : 0);
+    }
+
+    void SegmentedFileSink::openNext()
+    {
+        nextPath_ = getSegmentPath(basePath_, segments_.size());
+        next_ = openSegment_(nextPath_);
+    }
+
+    auto SegmentedFileSink::rotate() -> bool
+    {
+        // Normally pre-opened; retry here in case that failed transiently.
+        if (!next_) { openNext(); }
+        if (!next_) {
+            failed_ = true;
+            return false;
+        }
+
+        auto finished = std::move(current_);
+        current_ = std::move(next_);
+        const uint64_t firstFrame =
+                segments_.empty() ? 0 : segments_.back().firstFrame + segments_.back().frameCount;
+        segments_.push_back({nextPath_, firstFrame, 0});
+
+        if (finished) {
+            if (!finished->finalize()) { failed_ = true; }
+            finishedBytes_ += finished->getBytesWritten();
+        }
+
+        openNext();
+        if (!writeIndex()) { failed_ = true; }
+        return !failed_;
+    }
+
+    auto SegmentedFileSink::writeIndex() -> bool
+    {
+        // Written to a temporary file and renamed into place so readers never see a partial
+        // index. The last segment is the one in progress until `finalize()`.
+        const std::string temporaryPath = indexPath_ + ".tmp";
+        std::FILE *file = std::fopen(temporaryPath.c_str(), "w");
+        if (!file) { return false; }
+
+        std::fprintf(file, "# audio capture segment index v1\n");
+        std::fprintf(file, "sample_rate %.17g\n", format_.sampleRate);
+        std::fprintf(file, "channels %u\n", format_.channelCount);
+        std::fprintf(file, "segments %zu\n", segments_.size());
+        for (const auto &segment : segments_) {
+            std::fprintf(file, "%" PRIu64 " %" PRIu64 " %s\n", segment.firstFrame,
+                         segment.frameCount, paths::fileName(segment.path).c_str());
+        }
+
+        const bool written = std::ferror(file) == 0;
+        if (std::fclose(file) != 0 || !written) { return false; }
+        return std::rename(temporaryPath.c_str(), indexPath_.c_str()) == 0;
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "CaptureFormat.h"
+#include "SampleSink.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    // Splits a recording into consecutive segment files, e.g. `take.caf` becomes
+    // `take_0001.caf`, `take_0002.caf`, ... plus a `take.segments` index describing them.
+    //
+    // The next segment is always opened ahead of time, so a rotation is a pointer swap followed
+    // by finalizing the old file; every frame lands in exactly one segment. The duration limit
+    // is sample-exact. The size limit is checked after each write, so a segment may overshoot
+    // it by one write (a store page, ~85 ms at 48 kHz).
+    //
+    // Driven from the `CaptureWriter` thread like any other sink. No platform dependencies.
+    class SegmentedFileSink : public SampleSink
+    {
+    public:
+        using SinkFactory = std::function<std::unique_ptr<SampleSink>(const std::string &path)>;
+
+        // Opens the first two segments and writes the initial index. Returns nullptr if
+        // segmentation is disabled in `options` or the first segment cannot be created.
+        static auto create(const std::string &basePath, const CaptureFormat &format,
+                           const SegmentOptions &options, SinkFactory openSegment)
+                -> std::unique_ptr<SegmentedFileSink>;
+
+        ~SegmentedFileSink() override;
+
+        auto write(const float *interleaved, size_t frameCount) -> bool override;
+        auto finalize() -> bool override;
+        auto checkpoint() -> bool override;
+        auto getBytesWritten() const -> uint64_t override;
+
+        auto getSegmentCount() const -> size_t { return segments_.size(); }
+        auto getIndexPath() const -> const std::string & { return indexPath_; }
+
+        // Path of segment `index` (zero-based) for a recording at `basePath`.
+        static auto getSegmentPath(const std::string &basePath, size_t index) -> std::string;
+
+    private:
+        struct Segment
+        {
+            std::string path;
+            uint64_t firstFrame{0};
+            uint64_t frameCount{0};
+        };
+
+        SegmentedFileSink(const std::string &basePath, const CaptureFormat &format,
+                          const SegmentOptions &options, SinkFactory openSegment);
+
+        void openNext();
+        auto rotate() -> bool;
+        auto writeIndex() -> bool;
+
+        const std::string basePath_;
+        const std::string indexPath_;
+        const CaptureFormat format_;
+        const uint64_t maxFramesPerSegment_; // 0 = unlimited
+        const uint64_t maxBytesPerSegment_;  // 0 = unlimited
+        const SinkFactory openSegment_;
+
+        std::unique_ptr<SampleSink> current_;
+        std::unique_ptr<SampleSink> next_; // Pre-opened; becomes `current_` at the boundary.
+        std::string nextPath_;
+        std::vector<Segment> segments_; // Last entry is `current_`.
+        uint64_t finishedBytes_{0};     // Bytes in already finalized segments.
+        bool failed_{false};
+    };
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,148 @@
+#include "SilenceGatingSink.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace pg {
+namespace audio_tap {
+
+    auto SilenceGatingSink::create(std::unique_ptr<SampleSink> sink, const CaptureFormat &format,
+                                   const SilenceOptions &options, const std::string &indexPath)
+            -> std::unique_ptr<SilenceGatingSink>
+    {
+        if (!options.isEnabled() || !format.isValid() || !sink) { return nullptr; }
+        return std::unique_ptr<SilenceGatingSink>(
+                new SilenceGatingSink(std::move(sink), format, options, indexPath));
+    }
+
+    SilenceGatingSink::SilenceGatingSink(std::unique_ptr<SampleSink> sink,
+                                         const CaptureFormat &format,
+                                         const SilenceOptions &options,
+                                         const std::string &indexPath)
+      : sink_(std::move(sink)),
+        channelCount_(format.channelCount),
+        threshold_(std::max(options.threshold, 0.0f)),
+        holdFrames_(std::max<uint64_t>(
+                1, static_cast<uint64_t>(std::llround(options.holdSeconds * format.sampleRate)))),
+        indexPath_(indexPath),
+        index_(format)
+    {
+        heldBack_.reserve(static_cast<size_t>(holdFrames_) * channelCount_);
+    }
+
+    auto SilenceGatingSink::isQuiet(const float *frame) const -> bool
+    {
+        for (uint32_t ch = 0; ch < channelCount_; ++ch) {
+            if (!(std::fabs(frame[ch]) <= threshold_)) { return false; } // NaN counts as signal.
+        }
+        return true;
+    }
+
+    auto SilenceGatingSink::write(const float *interleaved, size_t frameCount) -> bool
+    {
+        if (failed_) { return false; }
+
+        const uint64_t firstFrame = timelineFrames_;
+        size_t writeFrom = 0; // First frame of this block not yet written or skipped.
+
+        for (size_t frame = 0; frame < frameCount; ++frame) {
+            const bool quiet = isQuiet(interleaved + frame * channelCount_);
+
+            if (inSilence_) {
+                if (quiet) {
+                    ++quietRun_;
+                    continue;
+                }
+                index_.addSpan(firstFrame + frame - quietRun_, quietRun_);
+                inSilence_ = false;
+                quietRun_ = 0;
+                writeFrom = frame;
+                continue;
+            }
+
+            if (!quiet) {
+                // The held-back pause turned out to be short; it precedes this block.
+                if (!heldBack_.empty()) {
+                    if (!forward(heldBack_.data(), heldBack_.size() / channelCount_)) {
+                        return false;
+                    }
+                    heldBack_.clear();
+                }
+                quietRun_ = 0;
+                continue;
+            }
+
+            if (++quietRun_ < holdFrames_) { continue; }
+
+            // Long enough: write what came before the quiet run and drop the run itself.
+            const size_t runStart = quietRun_ > frame + 1 ? 0 : frame + 1 - quietRun_;
+            if (runStart > writeFrom &&
+                !forward(interleaved + writeFrom * channelCount_, runStart - writeFrom)) {
+                return false;
+            }
+            heldBack_.clear();
+            inSilence_ = true;
+            writeFrom = frameCount;
+        }
+
+        if (!inSilence_) {
+            // Write up to the trailing quiet run, which waits for the next block to decide.
+            const size_t runStart = quietRun_ > frameCount ? 0 : frameCount - quietRun_;
+            const size_t tailStart = std::max(runStart, writeFrom);
+            if (tailStart > writeFrom &&
+                !forward(interleaved + writeFrom * channelCount_, tailStart - writeFrom)) {
+                return false;
+            }
+            heldBack_.insert(heldBack_.end(), interleaved + tailStart * channelCount_,
+                             interleaved + frameCount * channelCount_);
+        }
+
+        timelineFrames_ += frameCount;
+        return true;
+    }
+
+    auto SilenceGatingSink::finalize() -> bool
+    {
+        bool ok = !failed_;
+        if (inSilence_) {
+            index_.addSpan(timelineFrames_ - quietRun_, quietRun_);
+            inSilence_ = false;
+            quietRun_ = 0;
+        } else if (ok && !heldBack_.empty()) {
+            ok = forward(heldBack_.data(), heldBack_.size() / channelCount_);
+        }
+        heldBack_.clear();
+
+        ok = sink_->finalize() && ok;
+        return saveIndex() && ok;
+    }
+
+    auto SilenceGatingSink::checkpoint() -> bool
+    {
+        if (failed_) { return false; }
+        if (!sink_->checkpoint() || !saveIndex()) { failed_ = true; }
+        return !failed_;
+    }
+
+    auto SilenceGatingSink::forward(const float *interleaved, size_t frameCount) -> bool
+    {
+        if (!sink_->write(interleaved, frameCount)) {
+            failed_ = true;
+            return false;
+        }
+        storedFrames_ += frameCount;
+        return true;
+    }
+
+    auto SilenceGatingSink::saveIndex() -> bool
+    {
+        if (!inSilence_) { return index_.save(indexPath_, timelineFrames_); }
+
+        // Include the span still in progress so a crash keeps the timeline intact.
+        SilenceIndex snapshot = index_;
+        snapshot.addSpan(timelineFrames_ - quietRun_, quietRun_);
+        return snapshot.save(indexPath_, timelineFrames_);
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "CaptureFormat.h"
+#include "SampleSink.h"
+#include "SilenceIndex.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    // Keeps long silences out of a recording. Audio passes through to the wrapped sink until
+    // every channel has stayed within the threshold for the hold time; from there on nothing is
+    // written until the signal returns, and the skipped span goes into a `SilenceIndex` saved
+    // next to the recording. Quiet stretches shorter than the hold time are held back and
+    // then written unchanged, so short pauses and fades survive intact.
+    //
+    // At most the hold time of audio is held back at once. It is not yet in the file at a
+    // checkpoint, but by definition it is quiet.
+    //
+    // Driven from the `CaptureWriter` thread like any other sink. No platform dependencies.
+    class SilenceGatingSink : public SampleSink
+    {
+    public:
+        // Returns nullptr if gating is disabled in `options` or `sink` is null.
+        static auto create(std::unique_ptr<SampleSink> sink, const CaptureFormat &format,
+                           const SilenceOptions &options, const std::string &indexPath)
+                -> std::unique_ptr<SilenceGatingSink>;
+
+        auto write(const float *interleaved, size_t frameCount) -> bool override;
+        auto finalize() -> bool override;
+        auto checkpoint() -> bool override;
+        auto getBytesWritten() const -> uint64_t override { return sink_->getBytesWritten(); }
+
+        auto getTimelineFrameCount() const -> uint64_t { return timelineFrames_; }
+        auto getStoredFrameCount() const -> uint64_t { return storedFrames_; }
+
+    private:
+        SilenceGatingSink(std::unique_ptr<SampleSink> sink, const CaptureFormat &format,
+                          const SilenceOptions &options, const std::string &indexPath);
+
+        auto isQuiet(const float *frame) const -> bool;
+        auto forward(const float *interleaved, size_t frameCount) -> bool;
+        auto saveIndex() -> bool;
+
+        std::unique_ptr<SampleSink> sink_;
+        const uint32_t channelCount_;
+        const float threshold_;
+        const uint64_t holdFrames_;
+        const std::string indexPath_;
+
+        SilenceIndex index_;
+        std::vector<float> heldBack_; // Quiet frames carried over from earlier writes.
+        uint64_t quietRun_{0};        // Length of the current quiet run, held back or not.
+        bool inSilence_{false};       // The run has reached the hold time and is being skipped.
+        uint64_t timelineFrames_{0};
+        uint64_t storedFrames_{0};
+        bool failed_{false};
+    };
+
+} // namespace audio_tap
+} // namespace pg
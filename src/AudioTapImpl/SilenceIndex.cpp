@@ -0,0 +1,124 @@
+#include "SilenceIndex.h"
+#include "FilePaths.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+namespace pg {
+namespace audio_tap {
+
+    SilenceIndex::SilenceIndex(const CaptureFormat &format) : format_(format) {}
+
+    void SilenceIndex::addSpan(uint64_t timelineFrame, uint64_t frameCount)
+    {
+        if (frameCount == 0) { return; }
+        silentBefore_.push_back(getSilentFrameCount());
+        spans_.push_back({timelineFrame, frameCount});
+    }
+
+    auto SilenceIndex::getSilentFrameCount() const -> uint64_t
+    {
+        return spans_.empty() ? 0 : silentBefore_.back() + spans_.back().frameCount;
+    }
+
+    auto SilenceIndex::getRun(uint64_t timelineFrame) const -> Run
+    {
+        // The last span starting at or before the frame, if any.
+        const auto next = std::upper_bound(spans_.begin(), spans_.end(), timelineFrame,
+                                           [](uint64_t frame, const Span &span)
+                                           { return frame < span.timelineFrame; });
+        const size_t nextIndex = static_cast<size_t>(next - spans_.begin());
+
+        Run run;
+        uint64_t silentSoFar = 0;
+        if (nextIndex > 0) {
+            const Span &span = spans_[nextIndex - 1];
+            const uint64_t spanEnd = span.timelineFrame + span.frameCount;
+            if (timelineFrame < spanEnd) {
+                run.silent = true;
+                run.frameCount = spanEnd - timelineFrame;
+                return run;
+            }
+            silentSoFar = silentBefore_[nextIndex - 1] + span.frameCount;
+        }
+
+        run.storedFrame = timelineFrame - silentSoFar;
+        run.frameCount = next == spans_.end() ? UINT64_MAX : next->timelineFrame - timelineFrame;
+        return run;
+    }
+
+    auto SilenceIndex::forEachRun(uint64_t timelineFrame, uint64_t frameCount,
+                                  const RunVisitor &visit) const -> bool
+    {
+        for (uint64_t done = 0; done < frameCount;) {
+            const Run run = getRun(timelineFrame + done);
+            const uint64_t count = std::min(run.frameCount, frameCount - done);
+            if (!visit(run, done, count)) { return false; }
+            done += count;
+        }
+        return true;
+    }
+
+    auto SilenceIndex::save(const std::string &path, uint64_t timelineFrameCount) const -> bool
+    {
+        // Written to a temporary file and renamed into place so readers never see a partial
+        // index.
+        const std::string temporaryPath = path + ".tmp";
+        std::FILE *file = std::fopen(temporaryPath.c_str(), "w");
+        if (!file) { return false; }
+
+        std::fprintf(file, "# audio capture silence index v1\n");
+        std::fprintf(file, "sample_rate %.17g\n", format_.sampleRate);
+        std::fprintf(file, "channels %u\n", format_.channelCount);
+        std::fprintf(file, "timeline_frames %" PRIu64 "\n", timelineFrameCount);
+        std::fprintf(file, "spans %zu\n", spans_.size());
+        for (const auto &span : spans_) {
+            std::fprintf(file, "%" PRIu64 " %" PRIu64 "\n", span.timelineFrame, span.frameCount);
+        }
+
+        const bool written = std::ferror(file) == 0;
+        if (std::fclose(file) != 0 || !written) { return false; }
+        return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+    }
+
+    auto SilenceIndex::load(const std::string &path) -> std::unique_ptr<SilenceIndex>
+    {
+        std::FILE *file = std::fopen(path.c_str(), "r");
+        if (!file) { return nullptr; }
+
+        CaptureFormat format;
+        uint64_t timelineFrames = 0;
+        size_t spanCount = 0;
+        char comment[64] = {};
+        const bool headerOk =
+                std::fgets(comment, sizeof(comment), file) &&
+                std::strncmp(comment, "# audio capture silence index v1", 32) == 0 &&
+                std::fscanf(file, " sample_rate %lf", &format.sampleRate) == 1 &&
+                std::fscanf(file, " channels %u", &format.channelCount) == 1 &&
+                std::fscanf(file, " timeline_frames %" SCNu64, &timelineFrames) == 1 &&
+                std::fscanf(file, " spans %zu", &spanCount) == 1;
+
+        auto index = std::make_unique<SilenceIndex>(format);
+        bool ok = headerOk && format.isValid();
+        uint64_t previousEnd = 0;
+        for (size_t i = 0; ok && i < spanCount; ++i) {
+            Span span;
+            ok = std::fscanf(file, " %" SCNu64 " %" SCNu64, &span.timelineFrame,
+                             &span.frameCount) == 2 &&
+                 span.timelineFrame >= previousEnd;
+            previousEnd = span.timelineFrame + span.frameCount;
+            if (ok) { index->addSpan(span.timelineFrame, span.frameCount); }
+        }
+        std::fclose(file);
+        return ok ? std::move(index) : nullptr;
+    }
+
+    auto SilenceIndex::getIndexPath(const std::string &recordingPath) -> std::string
+    {
+        return paths::getCompanionPath(recordingPath, ".silence");
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "CaptureFormat.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    // Maps the timeline of a silence-gated recording onto the frames actually stored in its
+    // file. The timeline is the audio as captured; the file holds it minus the silent spans
+    // listed here, which read back as zeros.
+    //
+    // Stored as a small text file next to the recording (`take.caf` -> `take.silence`), one
+    // line per span. No platform dependencies.
+    class SilenceIndex
+    {
+    public:
+        struct Span
+        {
+            uint64_t timelineFrame{0}; // First silent frame.
+            uint64_t frameCount{0};
+        };
+
+        // A stretch of the timeline that is either all silence or all stored audio.
+        struct Run
+        {
+            bool silent{false};
+            // Frames from the queried position to the end of the run. Unbounded (UINT64_MAX)
+            // for stored audio after the last span.
+            uint64_t frameCount{0};
+            // Position in the file of the queried frame, if the run is stored audio.
+            uint64_t storedFrame{0};
+        };
+
+        explicit SilenceIndex(const CaptureFormat &format);
+
+        // Appends a span. Spans must be added in timeline order and must not overlap.
+        void addSpan(uint64_t timelineFrame, uint64_t frameCount);
+
+        auto getFormat() const -> const CaptureFormat & { return format_; }
+        auto getSpans() const -> const std::vector<Span> & { return spans_; }
+        auto getSilentFrameCount() const -> uint64_t;
+
+        // The run containing `timelineFrame`. O(log spans).
+        auto getRun(uint64_t timelineFrame) const -> Run;
+
+        // Expands `frameCount` timeline frames from `timelineFrame`: calls `visit(run, offset,
+        // count)` for each run in the range, in order, where `offset` counts the frames visited
+        // before it and `count` is its share of the range. Readers zero silent runs and read
+        // `count` stored frames from `run.storedFrame` for the others. Stops and returns false
+        // as soon as `visit` does.
+        using RunVisitor = std::function<bool(const Run &run, uint64_t offset, uint64_t count)>;
+        auto forEachRun(uint64_t timelineFrame, uint64_t frameCount,
+                        const RunVisitor &visit) const -> bool;
+
+        // Writes the index to `path`, replacing it atomically. `timelineFrameCount` is recorded
+        // for reference; readers derive the length from the audio file plus the spans.
+        auto save(const std::string &path, uint64_t timelineFrameCount) const -> bool;
+
+        // Reads an index written by `save()`. Returns nullptr if the file is missing or
+        // malformed.
+        static auto load(const std::string &path) -> std::unique_ptr<SilenceIndex>;
+
+        // Index location for a recording: `take.caf` -> `take.silence`.
+        static auto getIndexPath(const std::string &recordingPath) -> std::string;
+
+    private:
+        CaptureFormat format_;
+        std::vector<Span> spans_;
+        // Silent frames before each span, so a timeline position maps to the file in one
+        // binary search.
+        std::vector<uint64_t> silentBefore_;
+    };
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,299 @@
+#include "SimulatedAudioBackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <utility>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        // How often an idle clock (dead device) checks whether it should stop.
+        constexpr auto kIdleInterval = std::chrono::milliseconds(10);
+
+        constexpr double kTwoPi = 6.283185307179586;
+    } // namespace
+
+    SimulatedAudioBackend::SimulatedAudioBackend(const Options &options)
+      : options_(options),
+        sampleRate_(options.sampleRate > 0.0 ? options.sampleRate : 48000.0),
+        channelCount_(options.channelCount > 0 ? options.channelCount : 1)
+    {
+    }
+
+    SimulatedAudioBackend::~SimulatedAudioBackend()
+    {
+        std::lock_guard<std::mutex> control(controlMutex_);
+        stopClock();
+    }
+
+    auto SimulatedAudioBackend::getDefaultOutputDevice() -> AudioDeviceID
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return alive_ ? kOutputDeviceID : kAudioObjectUnknown;
+    }
+
+    auto SimulatedAudioBackend::getStreamFormat(AudioDeviceID device,
+                                                AudioStreamBasicDescription &format) -> bool
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!alive_) { return false; }
+
+        bool known = device == kOutputDeviceID;
+        for (const auto &tap : taps_) { known = known || tap.second == device; }
+        if (!known) { return false; }
+
+        format = makeFormat();
+        return true;
+    }
+
+    auto SimulatedAudioBackend::createTap(AudioDeviceID outputDevice, AudioObjectID &tapID,
+                                          AudioDeviceID &aggregateDeviceID) -> bool
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!alive_ || outputDevice != kOutputDeviceID || options_.failTapCreation) {
+            return false;
+        }
+
+        tapID = nextObjectID_++;
+        aggregateDeviceID = nextObjectID_++;
+        taps_[tapID] = aggregateDeviceID;
+        return true;
+    }
+
+    void SimulatedAudioBackend::destroyTap(AudioObjectID tapID, AudioDeviceID)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        taps_.erase(tapID);
+    }
+
+    auto SimulatedAudioBackend::getTapCount() const -> size_t
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return taps_.size();
+    }
+
+    auto SimulatedAudioBackend::addPropertyListener(AudioDeviceID device,
+                                                    PropertyListener listener) -> Token
+    {
+        if (device != kOutputDeviceID || !listener) { return 0; }
+
+        Token token = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            token = nextToken_++;
+        }
+        std::lock_guard<std::mutex> lock(listenerMutex_);
+        listeners_[token] = {device, std::move(listener)};
+        return token;
+    }
+
+    void SimulatedAudioBackend::removePropertyListener(Token token)
+    {
+        std::lock_guard<std::mutex> lock(listenerMutex_);
+        listeners_.erase(token);
+    }
+
+    auto SimulatedAudioBackend::startIOProc(AudioDeviceID device, IOCallback callback) -> Token
+    {
+        if (!callback) { return 0; }
+
+        std::lock_guard<std::mutex> control(controlMutex_);
+        Token token = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            bool isAggregateDevice = false;
+            for (const auto &tap : taps_) { isAggregateDevice |= tap.second == device; }
+            if (!alive_ || !isAggregateDevice) { return 0; }
+            token = nextToken_++;
+        }
+
+        bool isFirst = false;
+        {
+            std::lock_guard<std::mutex> lock(ioMutex_);
+            isFirst = ioProcs_.empty();
+            ioProcs_[token] = std::move(callback);
+        }
+        if (isFirst) { startClock(); }
+        return token;
+    }
+
+    void SimulatedAudioBackend::stopIOProc(Token token)
+    {
+        std::lock_guard<std::mutex> control(controlMutex_);
+        bool isLast = false;
+        {
+            std::lock_guard<std::mutex> lock(ioMutex_);
+            if (ioProcs_.erase(token) == 0) { return; }
+            isLast = ioProcs_.empty();
+        }
+        if (isLast) { stopClock(); }
+    }
+
+    void SimulatedAudioBackend::changeFormat(double sampleRate, uint32_t channelCount)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (sampleRate > 0.0) { sampleRate_ = sampleRate; }
+            if (channelCount > 0) { channelCount_ = channelCount; }
+        }
+        notify(DevicePropertyChangeReason::StreamFormatChanged);
+    }
+
+    void SimulatedAudioBackend::injectDropout(uint64_t frameCount)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pendingDropoutFrames_ += frameCount;
+    }
+
+    void SimulatedAudioBackend::removeDevice()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            alive_ = false;
+        }
+        notify(DevicePropertyChangeReason::DeviceIsAliveChanged);
+    }
+
+    void SimulatedAudioBackend::notify(DevicePropertyChangeReason reason)
+    {
+        std::lock_guard<std::mutex> lock(listenerMutex_);
+        for (const auto &listener : listeners_) { listener.second.callback(reason); }
+    }
+
+    void SimulatedAudioBackend::startClock()
+    {
+        {
+            std::lock_guard<std::mutex> lock(clockMutex_);
+            clockRunning_ = true;
+        }
+        clock_ = std::thread([this] { run(); });
+    }
+
+    void SimulatedAudioBackend::stopClock()
+    {
+        {
+            std::lock_guard<std::mutex> lock(clockMutex_);
+            clockRunning_ = false;
+        }
+        clockWakeUp_.notify_all();
+        if (clock_.joinable()) { clock_.join(); }
+    }
+
+    auto SimulatedAudioBackend::makeFormat() const -> AudioStreamBasicDescription
+    {
+        AudioStreamBasicDescription format{};
+        format.mSampleRate = sampleRate_;
+        format.mFormatID = kAudioFormatLinearPCM;
+        format.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked;
+        if (options_.nonInterleaved) { format.mFormatFlags |= kAudioFormatFlagIsNonInterleaved; }
+        format.mChannelsPerFrame = channelCount_;
+        format.mBitsPerChannel = 32;
+        format.mFramesPerPacket = 1;
+        format.mBytesPerFrame = options_.nonInterleaved ? 4 : 4 * channelCount_;
+        format.mBytesPerPacket = format.mBytesPerFrame;
+        return format;
+    }
+
+    void SimulatedAudioBackend::run()
+    {
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point origin = Clock::now();
+        const auto originNanoseconds = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(origin.time_since_epoch())
+                        .count());
+
+        std::minstd_rand random(options_.seed);
+        std::uniform_real_distribution<double> jitter(0.0, std::max(options_.maxJitterSeconds,
+                                                                     0.0));
+
+        const uint32_t frameCount = std::max<uint32_t>(options_.framesPerBuffer, 1);
+        double sampleTime = 0.0;
+        double deviceSeconds = 0.0; // When the next buffer starts, from `origin`.
+        double phase = 0.0;
+
+        std::vector<float> samples;
+        std::vector<unsigned char> bufferListStorage;
+
+        for (;;) {
+            double sampleRate = 0.0;
+            uint32_t channelCount = 0;
+            bool alive = false;
+            uint64_t skippedFrames = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                sampleRate = sampleRate_;
+                channelCount = channelCount_;
+                alive = alive_;
+                skippedFrames = std::exchange(pendingDropoutFrames_, 0);
+            }
+
+            std::unique_lock<std::mutex> clockLock(clockMutex_);
+            if (!clockRunning_) { break; }
+            if (!alive) {
+                clockWakeUp_.wait_for(clockLock, kIdleInterval);
+                continue;
+            }
+
+            sampleTime += static_cast<double>(skippedFrames);
+            deviceSeconds += static_cast<double>(skippedFrames) / sampleRate;
+            const double bufferStart = deviceSeconds;
+            deviceSeconds += frameCount / sampleRate;
+
+            // A buffer is delivered once its last frame has been captured.
+            if (options_.realTime) {
+                const auto due = origin + std::chrono::duration_cast<Clock::duration>(
+                                                  std::chrono::duration<double>(
+                                                          deviceSeconds + jitter(random)));
+                if (clockWakeUp_.wait_until(clockLock, due, [this] { return !clockRunning_; })) {
+                    break;
+                }
+            }
+            clockLock.unlock();
+
+            const size_t sampleCount = static_cast<size_t>(frameCount) * channelCount;
+            samples.resize(sampleCount);
+            const double phaseIncrement = kTwoPi * options_.toneFrequency / sampleRate;
+            for (uint32_t frame = 0; frame < frameCount; ++frame) {
+                const float value = options_.toneLevel * static_cast<float>(std::sin(phase));
+                phase = std::fmod(phase + phaseIncrement, kTwoPi);
+                for (uint32_t ch = 0; ch < channelCount; ++ch) {
+                    // Planar layout keeps each channel contiguous.
+                    samples[options_.nonInterleaved ? ch * frameCount + frame
+                                                    : frame * channelCount + ch] = value;
+                }
+            }
+
+            const UInt32 bufferCount = options_.nonInterleaved ? channelCount : 1;
+            const size_t samplesPerBuffer = sampleCount / bufferCount;
+            bufferListStorage.resize(sizeof(AudioBufferList) +
+                                     bufferCount * sizeof(AudioBuffer));
+            auto *bufferList = reinterpret_cast<AudioBufferList *>(bufferListStorage.data());
+            bufferList->mNumberBuffers = bufferCount;
+            for (UInt32 i = 0; i < bufferCount; ++i) {
+                AudioBuffer &buffer = bufferList->mBuffers[i];
+                buffer.mNumberChannels = options_.nonInterleaved ? 1 : channelCount;
+                buffer.mDataByteSize = static_cast<UInt32>(samplesPerBuffer * sizeof(float));
+                buffer.mData = samples.data() + i * samplesPerBuffer;
+            }
+
+            AudioTimeStamp inputTime{};
+            inputTime.mSampleTime = sampleTime;
+            inputTime.mHostTime = originNanoseconds + static_cast<uint64_t>(bufferStart * 1e9);
+            inputTime.mRateScalar = 1.0;
+            inputTime.mFlags = kAudioTimeStampSampleTimeValid | kAudioTimeStampHostTimeValid |
+                               kAudioTimeStampRateScalarValid;
+
+            {
+                std::lock_guard<std::mutex> lock(ioMutex_);
+                for (const auto &ioProc : ioProcs_) { ioProc.second(bufferList, &inputTime); }
+            }
+            callbackCount_.fetch_add(1, std::memory_order_relaxed);
+            sampleTime += frameCount;
+        }
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "AudioHardwareBackend.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    // `AudioHardwareBackend` that plays a virtual output device, so the recorder's state
+    // machine and pipeline can be driven and profiled without audio hardware.
+    //
+    // The device plays a sine tone. While any IOProc runs, a clock thread delivers it in
+    // buffers of `framesPerBuffer` at the device rate, with well-formed sample and host time
+    // stamps (host time is in nanoseconds). Wake-up jitter is drawn from a seeded generator,
+    // so a run with the same settings and script makes the same calls with the same data.
+    // Format changes, dropouts and device removal are injected from any thread while running.
+    //
+    // Listeners are called on the thread that injects the change and must not add or remove
+    // listeners themselves. No Core Audio dependency.
+    class SimulatedAudioBackend : public AudioHardwareBackend
+    {
+    public:
+        struct Options
+        {
+            double sampleRate{48000.0};
+            uint32_t channelCount{2};
+            bool nonInterleaved{false};
+            uint32_t framesPerBuffer{512};
+            // Each callback is late by a random amount up to this; the sample times are not.
+            double maxJitterSeconds{0.0};
+            uint32_t seed{1};
+            // Pace callbacks to the device rate; otherwise deliver them back to back.
+            bool realTime{true};
+            double toneFrequency{440.0};
+            float toneLevel{0.25f};
+            // Makes `createTap()` fail, as it does without the audio capture permission.
+            bool failTapCreation{false};
+        };
+
+        static constexpr AudioDeviceID kOutputDeviceID = 1;
+
+        SimulatedAudioBackend() : SimulatedAudioBackend(Options{}) {}
+        explicit SimulatedAudioBackend(const Options &options);
+        ~SimulatedAudioBackend() override;
+
+        SimulatedAudioBackend(const SimulatedAudioBackend &) = delete;
+        SimulatedAudioBackend &operator=(const SimulatedAudioBackend &) = delete;
+
+        auto getDefaultOutputDevice() -> AudioDeviceID override;
+        auto getStreamFormat(AudioDeviceID device, AudioStreamBasicDescription &format)
+                -> bool override;
+        auto createTap(AudioDeviceID outputDevice, AudioObjectID &tapID,
+                       AudioDeviceID &aggregateDeviceID) -> bool override;
+        void destroyTap(AudioObjectID tapID, AudioDeviceID aggregateDeviceID) override;
+        auto addPropertyListener(AudioDeviceID device, PropertyListener listener)
+                -> Token override;
+        void removePropertyListener(Token token) override;
+        auto startIOProc(AudioDeviceID device, IOCallback callback) -> Token override;
+        void stopIOProc(Token token) override;
+        auto getHostClockFrequency() -> double override { return 1e9; }
+
+        // Switches the device to a new format from the next buffer on and notifies listeners
+        // of a format change, as the HAL does when the user picks another rate in Audio MIDI
+        // Setup.
+        void changeFormat(double sampleRate, uint32_t channelCount);
+
+        // Skips `frameCount` frames before the next buffer, as an overloaded device does.
+        void injectDropout(uint64_t frameCount);
+
+        // Stops all callbacks and notifies listeners that the device is gone. The device does
+        // not come back.
+        void removeDevice();
+
+        auto getCallbackCount() const -> uint64_t { return callbackCount_.load(); }
+        auto getTapCount() const -> size_t;
+
+    private:
+        struct Listener
+        {
+            AudioDeviceID device{kAudioObjectUnknown};
+            PropertyListener callback;
+        };
+
+        void notify(DevicePropertyChangeReason reason);
+        void startClock();
+        void stopClock();
+        void run();
+        auto makeFormat() const -> AudioStreamBasicDescription; // Requires `mutex_`.
+
+        const Options options_;
+
+        // Device state.
+        mutable std::mutex mutex_;
+        double sampleRate_;
+        uint32_t channelCount_;
+        bool alive_{true};
+        uint64_t pendingDropoutFrames_{0};
+        std::map<AudioObjectID, AudioDeviceID> taps_; // Tap -> its aggregate device.
+        AudioObjectID nextObjectID_{100};
+        Token nextToken_{1};
+
+        // Held while listeners run, so removing one waits for a notification in progress.
+        std::mutex listenerMutex_;
+        std::map<Token, Listener> listeners_;
+
+        // Held while IOProcs run, so stopping one waits for the callback in progress.
+        std::mutex ioMutex_;
+        std::map<Token, IOCallback> ioProcs_;
+
+        // Serializes starting and stopping IOProcs, and with them the clock thread.
+        std::mutex controlMutex_;
+        std::thread clock_;
+        std::mutex clockMutex_;
+        std::condition_variable clockWakeUp_;
+        bool clockRunning_{false}; // Guarded by `clockMutex_`.
+        std::atomic<uint64_t> callbackCount_{0};
+    };
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace pg {
+namespace audio_tap {
+
+    // Bounded lock-free single-producer/single-consumer FIFO.
+    //
+    // The producer (typically the IOProc) only touches `writeIndex_` and the consumer only
+    // touches `readIndex_`, so neither side ever blocks or allocates once constructed.
+    // Indices run freely and are reduced modulo the capacity, which is rounded up to a power of
+    // two so that the wrap is a mask.
+    template <typename T>
+    class SpscRingBuffer
+    {
+    public:
+        explicit SpscRingBuffer(size_t minimumCapacity)
+          : capacity_(roundUpToPowerOfTwo(std::max<size_t>(minimumCapacity, 2))),
+            mask_(capacity_ - 1),
+            storage_(new T[capacity_])
+        {
+        }
+
+        SpscRingBuffer(const SpscRingBuffer &) = delete;
+        SpscRingBuffer &operator=(const SpscRingBuffer &) = delete;
+
+        auto capacity() const -> size_t { return capacity_; }
+
+        // --- Producer side ---
+
+        auto availableToWrite() const -> size_t
+        {
+            const size_t write = writeIndex_.load(std::memory_order_relaxed);
+            const size_t read = readIndex_.load(std::memory_order_acquire);
+            return capacity_ - (write - read);
+        }
+
+        // Pushes all `count` items or none of them. Returns false if there is not enough room.
+        auto tryPush(const T *items, size_t count) -> bool
+        {
+            const size_t write = writeIndex_.load(std::memory_order_relaxed);
+            const size_t read = readIndex_.load(std::memory_order_acquire);
+            if (capacity_ - (write - read) < count) { return false; }
+
+            const size_t offset = write & mask_;
+            const size_t firstPart = std::min(count, capacity_ - offset);
+            std::copy(items, items + firstPart, storage_.get() + offset);
+            std::copy(items + firstPart, items + count, storage_.get());
+
+            writeIndex_.store(write + count, std::memory_order_release);
+            return true;
+        }
+
+        auto tryPush(const T &item) -> bool { return tryPush(&item, 1); }
+
+        // --- Consumer side ---
+
+        auto availableToRead() const -> size_t
+        {
+            const size_t read = readIndex_.load(std::memory_order_relaxed);
+            const size_t write = writeIndex_.load(std::memory_order_acquire);
+            return write - read;
+        }
+
+        // Pops up to `maxCount` items into `destination` and returns how many were popped.
+        auto pop(T *destination, size_t maxCount) -> size_t
+        {
+            const size_t read = readIndex_.load(std::memory_order_relaxed);
+            const size_t write = writeIndex_.load(std::memory_order_acquire);
+            const size_t count = std::min(maxCount, write - read);
+
+            const size_t offset = read & mask_;
+            const size_t firstPart = std::min(count, capacity_ - offset);
+            std::copy(storage_.get() + offset, storage_.get() + offset + firstPart, destination);
+            std::copy(storage_.get(), storage_.get() + (count - firstPart),
+                      destination + firstPart);
+
+            readIndex_.store(read + count, std::memory_order_release);
+            return count;
+        }
+
+        auto tryPop(T &item) -> bool { return pop(&item, 1) == 1; }
+
+    private:
+        static auto roundUpToPowerOfTwo(size_t value) -> size_t
+        {
+            size_t result = 1;
+            while (result < value) { result <<= 1; }
+            return result;
+        }
+
+        static constexpr size_t kCacheLineSize = 64;
+
+        const size_t capacity_;
+        const size_t mask_;
+        std::unique_ptr<T[]> storage_;
+
+        // Keep the two indices on separate cache lines to avoid false sharing between the
+        // producer and consumer threads.
+        alignas(kCacheLineSize) std::atomic<size_t> writeIndex_{0};
+        alignas(kCacheLineSize) std::atomic<size_t> readIndex_{0};
+    };
+
+} // namespace audio_tap
+} // namespace pg
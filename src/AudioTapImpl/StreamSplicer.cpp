@@ -0,0 +1,251 @@
+#include "StreamSplicer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        constexpr double kHalfPi = 1.57079632679489661923;
+
+        // Maps `frameCount` frames from `inputChannels` to `outputChannels`, replacing `output`.
+        void mapChannels(const float *input, uint32_t inputChannels, size_t frameCount,
+                         uint32_t outputChannels, std::vector<float> &output)
+        {
+            output.assign(frameCount * outputChannels, 0.0f);
+            float *out = output.data();
+
+            if (inputChannels == 1) {
+                for (size_t frame = 0; frame < frameCount; ++frame) {
+                    std::fill_n(out + frame * outputChannels, outputChannels, input[frame]);
+                }
+                return;
+            }
+
+            if (inputChannels < outputChannels) {
+                for (size_t frame = 0; frame < frameCount; ++frame) {
+                    std::copy_n(input + frame * inputChannels, inputChannels,
+                                out + frame * outputChannels);
+                }
+                return;
+            }
+
+            // Fold channel `ch` into `ch % outputChannels`, averaging what lands together.
+            std::vector<float> weights(outputChannels, 0.0f);
+            for (uint32_t ch = 0; ch < inputChannels; ++ch) { weights[ch % outputChannels] += 1; }
+            for (auto &weight : weights) { weight = 1.0f / weight; }
+
+            for (size_t frame = 0; frame < frameCount; ++frame) {
+                const float *in = input + frame * inputChannels;
+                float *mixed = out + frame * outputChannels;
+                for (uint32_t ch = 0; ch < inputChannels; ++ch) {
+                    mixed[ch % outputChannels] += in[ch];
+                }
+                for (uint32_t ch = 0; ch < outputChannels; ++ch) { mixed[ch] *= weights[ch]; }
+            }
+        }
+    } // namespace
+
+    // The sink handed to a segment's `CaptureWriter`; everything goes back to the splicer.
+    class StreamSplicer::SegmentSink : public SampleSink
+    {
+    public:
+        explicit SegmentSink(StreamSplicer &splicer) : splicer_(splicer) {}
+
+        auto write(const float *interleaved, size_t frameCount) -> bool override
+        {
+            return splicer_.write(interleaved, frameCount);
+        }
+        auto finalize() -> bool override { return splicer_.endSegment(); }
+        auto checkpoint() -> bool override { return splicer_.checkpoint(); }
+        auto getBytesWritten() const -> uint64_t override { return splicer_.getBytesWritten(); }
+
+    private:
+        StreamSplicer &splicer_;
+    };
+
+    StreamSplicer::StreamSplicer(std::unique_ptr<SampleSink> sink,
+                                 const CaptureFormat &outputFormat, ResamplerQuality quality,
+                                 double crossfadeSeconds)
+      : sink_(std::move(sink)),
+        outputFormat_(outputFormat),
+        quality_(quality),
+        crossfadeFrames_(static_cast<size_t>(
+                std::llround(std::max(crossfadeSeconds, 0.0) * outputFormat.sampleRate)))
+    {
+    }
+
+    auto StreamSplicer::beginSegment(const CaptureFormat &inputFormat)
+            -> std::unique_ptr<SampleSink>
+    {
+        if (!inputFormat.isValid() || !outputFormat_.isValid() || segmentOpen_) {
+            return nullptr;
+        }
+
+        inputFormat_ = inputFormat;
+        resampler_.reset();
+        if (inputFormat.sampleRate != outputFormat_.sampleRate) {
+            // Resample whichever side of the channel mapping has fewer channels.
+            resampler_ = std::make_unique<Resampler>(
+                    std::min(inputFormat.channelCount, outputFormat_.channelCount),
+                    inputFormat.sampleRate, outputFormat_.sampleRate, quality_);
+        }
+
+        segmentOpen_ = true;
+        ++segmentCount_;
+        // The held-back end of the previous segment overlaps this one's start.
+        segmentStartFrame_ = writtenFrames_;
+        return std::make_unique<SegmentSink>(*this);
+    }
+
+    auto StreamSplicer::write(const float *interleaved, size_t frameCount) -> bool
+    {
+        if (failed_) { return false; }
+
+        const uint32_t inputChannels = inputFormat_.channelCount;
+        const uint32_t outputChannels = outputFormat_.channelCount;
+        const float *samples = interleaved;
+
+        if (inputChannels > outputChannels) {
+            mapChannels(samples, inputChannels, frameCount, outputChannels, mapped_);
+            samples = mapped_.data();
+        }
+        if (resampler_) {
+            converted_.clear();
+            frameCount = resampler_->process(samples, frameCount, converted_);
+            samples = converted_.data();
+        }
+        if (inputChannels < outputChannels) {
+            mapChannels(samples, inputChannels, frameCount, outputChannels, mapped_);
+            samples = mapped_.data();
+        }
+
+        return emit(samples, frameCount);
+    }
+
+    auto StreamSplicer::endSegment() -> bool
+    {
+        if (!segmentOpen_) { return !failed_; }
+        segmentOpen_ = false;
+
+        if (resampler_ && !failed_) {
+            converted_.clear();
+            const size_t frames = resampler_->flush(converted_);
+            const float *samples = converted_.data();
+            if (inputFormat_.channelCount < outputFormat_.channelCount) {
+                mapChannels(samples, inputFormat_.channelCount, frames,
+                            outputFormat_.channelCount, mapped_);
+                samples = mapped_.data();
+            }
+            emit(samples, frames);
+        }
+        resampler_.reset();
+
+        const uint32_t channels = outputFormat_.channelCount;
+        const size_t fadeFrames = fadeOut_.size() / channels;
+        if (fadePosition_ < fadeFrames) {
+            // The segment was shorter than the crossfade: let the rest of the previous one fade
+            // out on its own.
+            for (size_t frame = fadePosition_; frame < fadeFrames; ++frame) {
+                const float gain = fadeGains_[fadeFrames - 1 - frame];
+                for (uint32_t ch = 0; ch < channels; ++ch) {
+                    pending_.push_back(fadeOut_[frame * channels + ch] * gain);
+                }
+            }
+        }
+
+        // What is held back becomes the fade-out for the next segment.
+        fadeOut_.swap(pending_);
+        pending_.clear();
+        fadePosition_ = 0;
+
+        const size_t length = fadeOut_.size() / channels;
+        fadeGains_.resize(length);
+        for (size_t frame = 0; frame < length; ++frame) {
+            fadeGains_[frame] = static_cast<float>(
+                    std::sin(kHalfPi * (static_cast<double>(frame) + 0.5) /
+                             static_cast<double>(length)));
+        }
+        return !failed_;
+    }
+
+    auto StreamSplicer::finalize() -> bool
+    {
+        endSegment();
+
+        // No segment followed, so the last one ends as it was recorded.
+        bool ok = !failed_;
+        if (ok && !fadeOut_.empty()) {
+            ok = forward(fadeOut_.data(), fadeOut_.size() / outputFormat_.channelCount);
+        }
+        fadeOut_.clear();
+        fadeGains_.clear();
+
+        return sink_->finalize() && ok;
+    }
+
+    auto StreamSplicer::checkpoint() -> bool
+    {
+        if (failed_) { return false; }
+        if (!sink_->checkpoint()) { failed_ = true; }
+        return !failed_;
+    }
+
+    auto StreamSplicer::emit(const float *interleaved, size_t frameCount) -> bool
+    {
+        if (failed_) { return false; }
+
+        const uint32_t channels = outputFormat_.channelCount;
+        size_t frame = 0;
+
+        const size_t fadeFrames = fadeOut_.size() / channels;
+        for (; fadePosition_ < fadeFrames && frame < frameCount; ++fadePosition_, ++frame) {
+            const float *oldFrame = fadeOut_.data() + fadePosition_ * channels;
+            const float *newFrame = interleaved + frame * channels;
+            const float fadeIn = fadeGains_[fadePosition_];
+            const float fadeOut = fadeGains_[fadeFrames - 1 - fadePosition_];
+            for (uint32_t ch = 0; ch < channels; ++ch) {
+                pending_.push_back(oldFrame[ch] * fadeOut + newFrame[ch] * fadeIn);
+            }
+        }
+        if (fadeFrames > 0 && fadePosition_ == fadeFrames) {
+            fadeOut_.clear();
+            fadePosition_ = 0;
+        }
+
+        // Write everything except the last `crossfadeFrames_`, taking the oldest from
+        // `pending_` and the rest straight from the block.
+        const size_t pendingFrames = pending_.size() / channels;
+        const size_t blockFrames = frameCount - frame;
+        const size_t totalFrames = pendingFrames + blockFrames;
+        if (totalFrames > crossfadeFrames_) {
+            const size_t toWrite = totalFrames - crossfadeFrames_;
+            const size_t fromPending = std::min(pendingFrames, toWrite);
+            const size_t fromBlock = toWrite - fromPending;
+
+            if (fromPending > 0 && !forward(pending_.data(), fromPending)) { return false; }
+            if (fromBlock > 0 && !forward(interleaved + frame * channels, fromBlock)) {
+                return false;
+            }
+            pending_.erase(pending_.begin(),
+                           pending_.begin() + static_cast<std::ptrdiff_t>(fromPending * channels));
+            frame += fromBlock;
+        }
+        pending_.insert(pending_.end(), interleaved + frame * channels,
+                        interleaved + frameCount * channels);
+        return true;
+    }
+
+    auto StreamSplicer::forward(const float *interleaved, size_t frameCount) -> bool
+    {
+        if (!sink_->write(interleaved, frameCount)) {
+            failed_ = true;
+            return false;
+        }
+        writtenFrames_ += frameCount;
+        return true;
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "CaptureFormat.h"
+#include "Resampler.h"
+#include "SampleSink.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    // Joins consecutive capture streams of differing formats into one recording in a fixed
+    // output format, so a take survives the device changing its sample rate or channel count.
+    //
+    // Each stretch of input is a segment with its own format, fed through the sink returned by
+    // `beginSegment()`. Its channels are mapped onto the output layout (mono is spread to every
+    // channel, anything going to mono is averaged, other downmixes fold channel `i` into
+    // `i % outputChannels`, extra output channels stay silent) and it is resampled to the output
+    // rate. Consecutive segments are joined with an equal-power crossfade of `crossfadeSeconds`:
+    // the end of the old segment overlaps the start of the new one, so each splice shortens the
+    // timeline by the crossfade length. A segment in the output format passes straight through.
+    //
+    // The last crossfade length of output is held back until the next segment or `finalize()`,
+    // so it is not yet in the file at a checkpoint.
+    //
+    // Segments run one after another, each driven from its own `CaptureWriter` thread; a
+    // segment's sink must be finalized before the next one begins. No platform dependencies.
+    class StreamSplicer
+    {
+    public:
+        static constexpr double kDefaultCrossfadeSeconds = 0.01;
+
+        // `sink` receives audio in `outputFormat`.
+        StreamSplicer(std::unique_ptr<SampleSink> sink, const CaptureFormat &outputFormat,
+                      ResamplerQuality quality = ResamplerQuality::Balanced,
+                      double crossfadeSeconds = kDefaultCrossfadeSeconds);
+
+        StreamSplicer(const StreamSplicer &) = delete;
+        StreamSplicer &operator=(const StreamSplicer &) = delete;
+
+        // Starts the next segment and returns the sink that feeds it. Finalizing that sink ends
+        // the segment without finalizing the recording. The splicer must outlive it. Returns
+        // nullptr if `inputFormat` is invalid or the previous segment is still open.
+        auto beginSegment(const CaptureFormat &inputFormat) -> std::unique_ptr<SampleSink>;
+
+        // Writes out the held-back end of the last segment and finalizes the wrapped sink.
+        // Returns false if any write failed.
+        auto finalize() -> bool;
+
+        auto getOutputFormat() const -> const CaptureFormat & { return outputFormat_; }
+        auto getSegmentCount() const -> size_t { return segmentCount_; }
+        // Output frame on which the first frame of the open segment lands.
+        auto getSegmentStartFrame() const -> uint64_t { return segmentStartFrame_; }
+        // Output frames handed to the wrapped sink so far.
+        auto getWrittenFrameCount() const -> uint64_t { return writtenFrames_; }
+
+    private:
+        class SegmentSink;
+
+        auto write(const float *interleaved, size_t frameCount) -> bool;
+        auto endSegment() -> bool;
+        auto checkpoint() -> bool;
+        auto getBytesWritten() const -> uint64_t { return sink_->getBytesWritten(); }
+
+        // Appends resampled output to `pending_`, blending it into the previous segment's
+        // tail first, and writes everything but the held-back end.
+        auto emit(const float *interleaved, size_t frameCount) -> bool;
+        auto forward(const float *interleaved, size_t frameCount) -> bool;
+
+        std::unique_ptr<SampleSink> sink_;
+        const CaptureFormat outputFormat_;
+        const ResamplerQuality quality_;
+        const size_t crossfadeFrames_;
+
+        // The open segment.
+        CaptureFormat inputFormat_;
+        std::unique_ptr<Resampler> resampler_; // Null when the rate already matches.
+        std::vector<float> mapped_;            // Input in the output channel layout.
+        std::vector<float> converted_;         // Resampler output.
+        bool segmentOpen_{false};
+
+        std::vector<float> pending_;   // Output not yet written; ends with the held-back frames.
+        std::vector<float> fadeOut_;   // End of the previous segment, crossfaded into this one.
+        size_t fadePosition_{0};       // Frames of `fadeOut_` already blended.
+        std::vector<float> fadeGains_; // Fade-in gain per frame; reversed, the fade-out gain.
+
+        size_t segmentCount_{0};
+        uint64_t segmentStartFrame_{0};
+        uint64_t writtenFrames_{0};
+        bool failed_{false};
+    };
+
+} // namespace audio_tap
+} // namespace pg
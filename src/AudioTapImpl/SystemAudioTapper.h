@@ -1,12 +1,10 @@
 #pragma once
 
+#include "AudioHardwareBackend.h"
 #include "TappingSessionHandle.h"
-#include <CoreAudio/CoreAudio.h>
 #include <memory>
 #include <mutex>
 
-@class CATapDescription;
-
 namespace pg {
 namespace audio_tap {
 
@@ -32,17 +30,13 @@ namespace audio_tap {
 
         // --- Private Helper Methods ---
         bool setupTapAndAggregateDevice();
-        AudioDeviceID findDefaultOutputDevice();
-        AudioDeviceID findOrCreateAggregateDevice(CATapDescription *tapDescription);
-
-        // --- Class Constants ---
-        static constexpr const char *kAggregateDeviceUID = "PG-Aggregate-Device";
 
         // --- Member Variables ---
         std::mutex sessionMutex_;
         int activeSessions_{0};
         AudioDeviceID aggregateDeviceID_{kAudioDeviceUnknown};
         AudioObjectID tapSessionID_{kAudioObjectUnknown};
+        std::shared_ptr<AudioHardwareBackend> backend_; // Set while sessions are active.
     };
 
 } // namespace audio_tap
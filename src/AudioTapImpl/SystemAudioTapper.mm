@@ -1,14 +1,27 @@
 #include "SystemAudioTapper.h"
-#include "AudioDeviceUtils.h"
-
-#import <AVFoundation/AVFoundation.h>
-#import <CoreAudio/AudioHardwareTapping.h>
-#import <CoreAudio/CATapDescription.h>
-#include <vector>
+#include "MetricsRegistry.h"
+#include "TraceRecorder.h"
 
 namespace pg {
 namespace audio_tap {
 
+    namespace {
+        auto activeSessionsMetric() -> MetricGauge &
+        {
+            static MetricGauge &gauge = MetricsRegistry::getDefault().gauge(
+                    "pg_capture_active_sessions", "Tapping sessions currently held.");
+            return gauge;
+        }
+
+        auto tapSetupFailuresMetric() -> MetricCounter &
+        {
+            static MetricCounter &counter = MetricsRegistry::getDefault().counter(
+                    "pg_capture_tap_setup_failures_total",
+                    "Failures to create the process tap or its aggregate device.");
+            return counter;
+        }
+    } // namespace
+
     // --- Singleton Implementation ---
 
     SystemAudioTapper &SystemAudioTapper::getInstance()
@@ -19,36 +32,28 @@ namespace audio_tap {
 
     SystemAudioTapper::~SystemAudioTapper()
     {
-        if (tapSessionID_ != kAudioObjectUnknown) { AudioHardwareDestroyProcessTap(tapSessionID_); }
-        if (aggregateDeviceID_ != kAudioDeviceUnknown) {
-            AudioHardwareDestroyAggregateDevice(aggregateDeviceID_);
-        }
+        if (backend_) { backend_->destroyTap(tapSessionID_, aggregateDeviceID_); }
     }
 
     // --- Public API ---
 
     TappingSessionHandle SystemAudioTapper::acquireSession()
     {
+        PG_TRACE_SCOPE("SystemAudioTapper::acquireSession");
         std::lock_guard<std::mutex> lock(sessionMutex_);
 
         if (activeSessions_ == 0) {
             if (!setupTapAndAggregateDevice()) {
+                tapSetupFailuresMetric().add();
                 // PGLOG_LOGGER(logger).error("Failed to setup tap and aggregate device.");
-                // Ensure cleanup happens if partial setup failed.
-                if (tapSessionID_ != kAudioObjectUnknown) {
-                    AudioHardwareDestroyProcessTap(tapSessionID_);
-                    tapSessionID_ = kAudioObjectUnknown;
-                }
-                if (aggregateDeviceID_ != kAudioDeviceUnknown) {
-                    AudioHardwareDestroyAggregateDevice(aggregateDeviceID_);
-                    aggregateDeviceID_ = kAudioDeviceUnknown;
-                }
+                backend_.reset();
                 return {}; // Return invalid handle
             }
         }
 
         activeSessions_++;
-        return TappingSessionHandle(tapSessionID_, aggregateDeviceID_, this);
+        activeSessionsMetric().set(activeSessions_);
+        return TappingSessionHandle(tapSessionID_, aggregateDeviceID_, this, backend_);
     }
 
     // --- Private Methods ---
@@ -56,138 +61,39 @@ namespace audio_tap {
     void SystemAudioTapper::releaseSession(AudioObjectID /*tapID*/,
                                            AudioDeviceID /*aggregateDeviceID*/)
     {
+        PG_TRACE_SCOPE("SystemAudioTapper::releaseSession");
         std::lock_guard<std::mutex> lock(sessionMutex_);
 
         if (activeSessions_ > 0) { activeSessions_--; }
+        activeSessionsMetric().set(activeSessions_);
 
-        if (activeSessions_ == 0) {
-            if (tapSessionID_ != kAudioObjectUnknown) {
-                AudioHardwareDestroyProcessTap(tapSessionID_);
-                tapSessionID_ = kAudioObjectUnknown;
-            }
-            if (aggregateDeviceID_ != kAudioDeviceUnknown) {
-                AudioHardwareDestroyAggregateDevice(aggregateDeviceID_);
-                aggregateDeviceID_ = kAudioDeviceUnknown;
-            }
+        if (activeSessions_ == 0 && backend_) {
+            backend_->destroyTap(tapSessionID_, aggregateDeviceID_);
+            tapSessionID_ = kAudioObjectUnknown;
+            aggregateDeviceID_ = kAudioDeviceUnknown;
+            backend_.reset();
         }
     }
 
-    // This now combines the logic of tap and aggregate device creation
-    // to follow the correct dependency order from CoreAudioTapRecorder.mm.
+    // The backend is picked up here, so a backend set between sessions takes effect with the
+    // next one.
     bool SystemAudioTapper::setupTapAndAggregateDevice()
     {
-        // First, find the default output device to tap
-        AudioDeviceID mainDeviceID = utils::getDefaultOutputDevice();
-        if (mainDeviceID == kAudioDeviceUnknown) { return false; }
+        PG_TRACE_SCOPE("SystemAudioTapper::setupTapAndAggregateDevice");
 
-        // Create the CATapDescription, which is needed for BOTH tap creation and agg device
-        // creation
-        CFStringRef deviceUIDRef = nullptr;
-        UInt32 uidSize = sizeof(deviceUIDRef);
-        AudioObjectPropertyAddress uidAddress = {kAudioDevicePropertyDeviceUID,
-                                                 kAudioObjectPropertyScopeGlobal,
-                                                 kAudioObjectPropertyElementMain};
-        OSStatus status = AudioObjectGetPropertyData(mainDeviceID, &uidAddress, 0, nullptr,
-                                                     &uidSize, &deviceUIDRef);
-
-        if (status != noErr || deviceUIDRef == nullptr) { return false; }
-
-        CATapDescription *tapDescription =
-                [[CATapDescription alloc] initWithProcesses:@[]
-                                               andDeviceUID:(__bridge NSString *)deviceUIDRef
-                                                 withStream:0];
-        CFRelease(deviceUIDRef);
-        if (!tapDescription) { return false; }
-
-        [tapDescription setMuteBehavior:CATapUnmuted];
-        [tapDescription setName:@"BIASAudioTap"];
-        [tapDescription setPrivate:YES];
-        [tapDescription setExclusive:YES];
-
-        // Second, create or find the aggregate device. It depends on the tap's UUID from the
-        // description.
-        aggregateDeviceID_ = findOrCreateAggregateDevice(tapDescription);
-        if (aggregateDeviceID_ == kAudioObjectUnknown) {
-            [tapDescription release];
-            return false;
-        }
-
-        // Third, with the aggregate device ready, create the actual process tap.
-        status = AudioHardwareCreateProcessTap(tapDescription, &tapSessionID_);
-        [tapDescription release]; // release the description now that it's been used
+        backend_ = getAudioHardwareBackend();
+        if (!backend_) { return false; }
 
-        if (status != noErr) {
-            // If tap creation fails, the calling function `acquireSession` will handle cleanup
-            // of the aggregate device we might have just found/created.
-            return false;
-        }
-
-        return true;
-    }
-
-    AudioDeviceID SystemAudioTapper::findOrCreateAggregateDevice(CATapDescription *tapDescription)
-    {
-        // Check if the device already exists in the system
-        AudioObjectPropertyAddress propertyAddress = {kAudioHardwarePropertyDevices,
-                                                      kAudioObjectPropertyScopeGlobal,
-                                                      kAudioObjectPropertyElementMain};
-
-        UInt32 dataSize = 0;
-        OSStatus status = AudioObjectGetPropertyDataSize(kAudioObjectSystemObject, &propertyAddress,
-                                                         0, nullptr, &dataSize);
-
-        if (status == noErr && dataSize > 0) {
-            std::vector<AudioDeviceID> devices(dataSize / sizeof(AudioDeviceID));
-            status = AudioObjectGetPropertyData(kAudioObjectSystemObject, &propertyAddress, 0,
-                                                nullptr, &dataSize, devices.data());
-
-            if (status == noErr) {
-                for (AudioDeviceID deviceID : devices) {
-                    CFStringRef deviceUID = nullptr;
-                    UInt32 uidSize = sizeof(deviceUID);
-                    AudioObjectPropertyAddress uidAddress = {kAudioDevicePropertyDeviceUID,
-                                                             kAudioObjectPropertyScopeGlobal,
-                                                             kAudioObjectPropertyElementMain};
-
-                    status = AudioObjectGetPropertyData(deviceID, &uidAddress, 0, nullptr, &uidSize,
-                                                        &deviceUID);
-
-                    if (status == noErr && deviceUID != nullptr) {
-                        NSString *nsUID = (__bridge NSString *)deviceUID;
-                        if ([nsUID isEqualToString:@(kAggregateDeviceUID)]) {
-                            CFRelease(deviceUID);
-                            return deviceID; // Found it
-                        }
-                        CFRelease(deviceUID); // Not a match, release it
-                    }
-                }
-            }
+        // First, find the default output device to tap
+        AudioDeviceID mainDeviceID = kAudioDeviceUnknown;
+        {
+            PG_TRACE_SCOPE("getDefaultOutputDevice");
+            mainDeviceID = backend_->getDefaultOutputDevice();
         }
+        if (mainDeviceID == kAudioDeviceUnknown) { return false; }
 
-        // --- Create a new one if not found ---
-
-        // Get the UUID string from the tap description provided.
-        NSString *tapUID = [[tapDescription UUID] UUIDString];
-
-        NSArray<NSDictionary *> *taps = @[ @{
-            @kAudioSubTapUIDKey : tapUID,
-            @kAudioSubTapDriftCompensationKey : @YES,
-        } ];
-
-        NSDictionary *aggregateDeviceProperties = @{
-            @kAudioAggregateDeviceNameKey : @"BIASAggregateDevice",
-            @kAudioAggregateDeviceUIDKey : @(SystemAudioTapper::kAggregateDeviceUID),
-
-            @kAudioAggregateDeviceTapListKey : taps,
-            @kAudioAggregateDeviceTapAutoStartKey : @NO,
-            @kAudioAggregateDeviceIsPrivateKey : @YES,
-        };
-
-        AudioDeviceID newDeviceID = kAudioObjectUnknown;
-        status = AudioHardwareCreateAggregateDevice(
-                (__bridge CFDictionaryRef)aggregateDeviceProperties, &newDeviceID);
-
-        return (status == noErr) ? newDeviceID : kAudioObjectUnknown;
+        // Then the tap on it, and the aggregate device that captures from the tap.
+        return backend_->createTap(mainDeviceID, tapSessionID_, aggregateDeviceID_);
     }
 
 } // namespace audio_tap
@@ -1,20 +1,15 @@
 #pragma once
 
-#include <CoreAudio/CoreAudio.h>
+#include "AudioHardwareBackend.h"
+#include "CoreAudioTypes.h"
 #include <functional>
+#include <memory>
 
 namespace pg {
 namespace audio_tap {
 
     class SystemAudioTapper;
 
-    enum class DevicePropertyChangeReason
-    {
-        StreamFormatChanged,
-        StreamConfigurationChanged,
-        DeviceIsAliveChanged,
-    };
-
     using PropertyChangeCallback = std::function<void(DevicePropertyChangeReason)>;
 
     class TappingSessionHandle
@@ -35,31 +30,32 @@ namespace audio_tap {
         auto getChannelCount() const -> uint32_t;
         bool isValid() const;
 
+        // Re-reads the device format after a format or configuration change. Returns true if it
+        // differs from the one reported before.
+        auto refreshAudioFormat() -> bool;
+
         void registerPropertyListener(PropertyChangeCallback callback);
         void unregisterPropertyListener();
 
     private:
         // Only SystemAudioTapper can create instances of this handle.
         friend class SystemAudioTapper;
-        TappingSessionHandle(AudioObjectID tapID, AudioDeviceID aggID, SystemAudioTapper *manager);
+        TappingSessionHandle(AudioObjectID tapID, AudioDeviceID aggID, SystemAudioTapper *manager,
+                             std::shared_ptr<AudioHardwareBackend> backend);
 
         void release();
 
         void queryDefaultDeviceFormat();
 
-        static OSStatus
-        staticPropertyListenerCallback(AudioObjectID inObjectID, UInt32 inNumberAddresses,
-                                       const AudioObjectPropertyAddress inAddresses[],
-                                       void *__nullable inClientData);
-
         AudioObjectID tapSessionID_{kAudioObjectUnknown};
         AudioDeviceID aggregateDeviceID_{kAudioDeviceUnknown};
         SystemAudioTapper *manager_{nullptr};
+        std::shared_ptr<AudioHardwareBackend> backend_;
         AudioStreamBasicDescription audioFormat_{};
 
         // Listener-related members
         AudioDeviceID defaultDeviceID_{kAudioObjectUnknown};
-        PropertyChangeCallback propertyChangeCallback_{nullptr};
+        AudioHardwareBackend::Token listenerToken_{0};
     };
 
 } // namespace audio_tap
@@ -1,9 +1,7 @@
 #include "TappingSessionHandle.h"
-#include "AudioDeviceUtils.h"
+#include "MetricsRegistry.h"
 #include "SystemAudioTapper.h"
 
-#include "JuceHeader.h"
-
 #include <utility>
 
 namespace pg {
@@ -12,9 +10,10 @@ namespace audio_tap {
       : tapSessionID_(std::exchange(other.tapSessionID_, kAudioObjectUnknown)),
         aggregateDeviceID_(std::exchange(other.aggregateDeviceID_, kAudioObjectUnknown)),
         manager_(std::exchange(other.manager_, nullptr)),
+        backend_(std::move(other.backend_)),
         audioFormat_(std::exchange(other.audioFormat_, {})),
         defaultDeviceID_(std::exchange(other.defaultDeviceID_, kAudioObjectUnknown)),
-        propertyChangeCallback_(std::move(other.propertyChangeCallback_))
+        listenerToken_(std::exchange(other.listenerToken_, 0))
     {
     }
 
@@ -25,9 +24,10 @@ namespace audio_tap {
             tapSessionID_ = std::exchange(other.tapSessionID_, kAudioObjectUnknown);
             aggregateDeviceID_ = std::exchange(other.aggregateDeviceID_, kAudioObjectUnknown);
             manager_ = std::exchange(other.manager_, nullptr);
+            backend_ = std::move(other.backend_);
             audioFormat_ = std::exchange(other.audioFormat_, {});
             defaultDeviceID_ = std::exchange(other.defaultDeviceID_, kAudioObjectUnknown);
-            propertyChangeCallback_ = std::move(other.propertyChangeCallback_);
+            listenerToken_ = std::exchange(other.listenerToken_, 0);
         }
         return *this;
     }
@@ -38,11 +38,13 @@ namespace audio_tap {
     }
 
     TappingSessionHandle::TappingSessionHandle(AudioObjectID tapID, AudioDeviceID aggID,
-                                               SystemAudioTapper *manager)
+                                               SystemAudioTapper *manager,
+                                               std::shared_ptr<AudioHardwareBackend> backend)
       : tapSessionID_(tapID),
         aggregateDeviceID_(aggID),
         manager_(manager),
-        defaultDeviceID_(utils::getDefaultOutputDevice())
+        backend_(std::move(backend)),
+        defaultDeviceID_(backend_ ? backend_->getDefaultOutputDevice() : kAudioObjectUnknown)
     {
         queryDefaultDeviceFormat();
     }
@@ -76,102 +78,57 @@ namespace audio_tap {
         return tapSessionID_ != kAudioObjectUnknown;
     }
 
-    void TappingSessionHandle::registerPropertyListener(PropertyChangeCallback callback)
+    auto TappingSessionHandle::refreshAudioFormat() -> bool
     {
-        if (!isValid() || defaultDeviceID_ == kAudioObjectUnknown) { return; }
+        static MetricCounter &formatChanges = MetricsRegistry::getDefault().counter(
+                "pg_capture_device_format_changes_total",
+                "Changes of the tapped device's sample rate, channel count or layout.");
 
-        propertyChangeCallback_ = std::move(callback);
+        const AudioStreamBasicDescription previous = audioFormat_;
+        queryDefaultDeviceFormat();
+        const bool changed = audioFormat_.mSampleRate != previous.mSampleRate ||
+                             audioFormat_.mChannelsPerFrame != previous.mChannelsPerFrame ||
+                             audioFormat_.mFormatFlags != previous.mFormatFlags;
+        if (changed) { formatChanges.add(); }
+        return changed;
+    }
 
-        constexpr AudioObjectPropertyAddress addresses[] = {
-                {kAudioDevicePropertyStreamFormat, kAudioObjectPropertyScopeOutput,
-                 kAudioObjectPropertyElementMain},
-                {kAudioDevicePropertyStreamConfiguration, kAudioObjectPropertyScopeOutput,
-                 kAudioObjectPropertyElementMain},
-                {kAudioDevicePropertyDeviceIsAlive, kAudioObjectPropertyScopeOutput,
-                 kAudioObjectPropertyElementMain},
-        };
+    void TappingSessionHandle::registerPropertyListener(PropertyChangeCallback callback)
+    {
+        if (!isValid() || defaultDeviceID_ == kAudioObjectUnknown) { return; }
 
-        for (const auto &address : addresses) {
-            AudioObjectAddPropertyListener(defaultDeviceID_, &address,
-                                           staticPropertyListenerCallback, this);
-        }
+        if (listenerToken_ != 0) { backend_->removePropertyListener(listenerToken_); }
+        listenerToken_ = backend_->addPropertyListener(defaultDeviceID_, std::move(callback));
     }
 
     void TappingSessionHandle::unregisterPropertyListener()
     {
-        if (defaultDeviceID_ == kAudioObjectUnknown) { return; }
-
-        constexpr AudioObjectPropertyAddress addresses[] = {
-                {kAudioDevicePropertyStreamFormat, kAudioObjectPropertyScopeOutput,
-                 kAudioObjectPropertyElementMain},
-                {kAudioDevicePropertyStreamConfiguration, kAudioObjectPropertyScopeOutput,
-                 kAudioObjectPropertyElementMain},
-                {kAudioDevicePropertyDeviceIsAlive, kAudioObjectPropertyScopeOutput,
-                 kAudioObjectPropertyElementMain},
-        };
-
-        for (const auto &address : addresses) {
-            AudioObjectRemovePropertyListener(defaultDeviceID_, &address,
-                                              staticPropertyListenerCallback, this);
-        }
-
-        propertyChangeCallback_ = nullptr;
+        if (listenerToken_ != 0) { backend_->removePropertyListener(listenerToken_); }
+        listenerToken_ = 0;
         defaultDeviceID_ = kAudioObjectUnknown;
     }
 
-
     void TappingSessionHandle::release()
     {
+        // The listener may capture whoever owns this handle, so it must not outlive it.
+        if (listenerToken_ != 0 && backend_) { backend_->removePropertyListener(listenerToken_); }
+        listenerToken_ = 0;
+
         if (manager_ && tapSessionID_ != kAudioObjectUnknown) {
             manager_->releaseSession(tapSessionID_, aggregateDeviceID_);
         }
         tapSessionID_ = kAudioObjectUnknown;
         aggregateDeviceID_ = kAudioObjectUnknown;
         manager_ = nullptr;
+        backend_.reset();
     }
 
     void TappingSessionHandle::queryDefaultDeviceFormat()
     {
-        if (defaultDeviceID_ == kAudioObjectUnknown) {
-            DBG("TappingSessionHandle: Cannot query format, default output device is unknown.");
-            return;
-        }
-
-        AudioObjectPropertyAddress propertyAddress = {kAudioDevicePropertyStreamFormat,
-                                                      kAudioObjectPropertyScopeOutput,
-                                                      kAudioObjectPropertyElementMain};
-        UInt32 dataSize = sizeof(audioFormat_);
-        OSStatus status = AudioObjectGetPropertyData(defaultDeviceID_, &propertyAddress, 0, nullptr,
-                                                     &dataSize, &audioFormat_);
-
-        if (status != noErr) {
-            DBG("TappingSessionHandle: Warning - Could not query device format, using defaults. "
-                "Error: "
-                << status);
-            memset(&audioFormat_, 0, sizeof(audioFormat_));
-        }
-    }
-
-    OSStatus TappingSessionHandle::staticPropertyListenerCallback(
-            AudioObjectID inObjectID, UInt32 inNumberAddresses,
-            const AudioObjectPropertyAddress inAddresses[], void *__nullable inClientData)
-    {
-        auto *self = static_cast<TappingSessionHandle *>(inClientData);
-        if (!self || !self->propertyChangeCallback_) { return noErr; }
-
-        for (UInt32 i = 0; i < inNumberAddresses; ++i) {
-            const auto &address = inAddresses[i];
-            if (address.mSelector == kAudioDevicePropertyStreamFormat) {
-                self->propertyChangeCallback_(DevicePropertyChangeReason::StreamFormatChanged);
-            } else if (address.mSelector == kAudioDevicePropertyStreamConfiguration) {
-                self->propertyChangeCallback_(
-                        DevicePropertyChangeReason::StreamConfigurationChanged);
-            } else if (address.mSelector == kAudioDevicePropertyDeviceIsAlive) {
-                self->propertyChangeCallback_(DevicePropertyChangeReason::DeviceIsAliveChanged);
-            }
-        }
-
-        return noErr;
+        // Without a device or a readable format, the format stays empty (zero sample rate),
+        // which callers check for.
+        if (defaultDeviceID_ == kAudioObjectUnknown) { return; }
+        if (!backend_->getStreamFormat(defaultDeviceID_, audioFormat_)) { audioFormat_ = {}; }
     }
 } // namespace audio_tap
 } // namespace pg
@@ -0,0 +1,241 @@
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <pthread.h>
+#include <unistd.h>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        // Slots are atomics so that a ring can be read while its thread overwrites it; the
+        // reader drops whatever was overwritten during the copy.
+        struct Event
+        {
+            std::atomic<const char *> name{nullptr};
+            std::atomic<uint64_t> start{0};
+            std::atomic<uint64_t> duration{0};
+            std::atomic<uint64_t> threadId{0};
+        };
+
+        struct EventCopy
+        {
+            const char *name;
+            uint64_t start;
+            uint64_t duration;
+            uint64_t threadId;
+        };
+
+        pthread_key_t ringKey;
+        std::atomic<uint64_t> nextThreadId{1};
+
+        void appendJsonString(std::string &json, const char *text)
+        {
+            json += '"';
+            for (const char *c = text; *c != '\0'; ++c) {
+                const auto byte = static_cast<unsigned char>(*c);
+                if (byte == '"' || byte == '\\') {
+                    json += '\\';
+                    json += *c;
+                } else if (byte < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", byte);
+                    json += escaped;
+                } else {
+                    json += *c;
+                }
+            }
+            json += '"';
+        }
+    } // namespace
+
+    struct TraceRecorder::Ring
+    {
+        std::unique_ptr<Event[]> events;
+        size_t capacity{0};
+        std::atomic<uint64_t> written{0};
+        std::atomic<bool> inUse{false};
+        // Set by the owning thread when it claims the ring.
+        std::atomic<uint64_t> threadId{0};
+        char threadName[64]{};
+    };
+
+    std::atomic<bool> TraceRecorder::enabled_{false};
+
+    auto TraceRecorder::getInstance() -> TraceRecorder &
+    {
+        static TraceRecorder recorder;
+        return recorder;
+    }
+
+    TraceRecorder::TraceRecorder()
+    {
+        // A thread's ring goes back to the pool when it exits; its events stay until reused.
+        pthread_key_create(&ringKey, [](void *ring)
+                           { static_cast<Ring *>(ring)->inUse.store(false); });
+    }
+
+    TraceRecorder::~TraceRecorder()
+    {
+        enabled_.store(false);
+    }
+
+    void TraceRecorder::enable(size_t eventsPerThread)
+    {
+        std::lock_guard<std::mutex> lock(enableMutex_);
+        if (!rings_) {
+            const size_t capacity = std::max<size_t>(eventsPerThread, 1);
+            rings_ = std::make_unique<Ring[]>(kMaxThreads);
+            for (size_t i = 0; i < kMaxThreads; ++i) {
+                rings_[i].events = std::make_unique<Event[]>(capacity);
+                rings_[i].capacity = capacity;
+            }
+            ringsBase_.store(rings_.get(), std::memory_order_release);
+        }
+        enabled_.store(true);
+    }
+
+    void TraceRecorder::disable()
+    {
+        enabled_.store(false);
+    }
+
+    auto TraceRecorder::now() -> uint64_t
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                             std::chrono::steady_clock::now().time_since_epoch())
+                                             .count());
+    }
+
+    auto TraceRecorder::getThreadRing() -> Ring *
+    {
+        if (auto *ring = static_cast<Ring *>(pthread_getspecific(ringKey))) { return ring; }
+
+        Ring *rings = ringsBase_.load(std::memory_order_acquire);
+        if (!rings) { return nullptr; }
+
+        for (size_t i = 0; i < kMaxThreads; ++i) {
+            bool expected = false;
+            if (rings[i].inUse.compare_exchange_strong(expected, true)) {
+                Ring *ring = &rings[i];
+                if (pthread_getname_np(pthread_self(), ring->threadName,
+                                       sizeof(ring->threadName)) != 0) {
+                    ring->threadName[0] = '\0';
+                }
+                ring->threadId.store(nextThreadId.fetch_add(1));
+                pthread_setspecific(ringKey, ring);
+                return ring;
+            }
+        }
+        return nullptr;
+    }
+
+    void TraceRecorder::record(const char *name, uint64_t startNanoseconds,
+                               uint64_t durationNanoseconds)
+    {
+        Ring *ring = getThreadRing();
+        if (!ring) { return; }
+
+        const uint64_t index = ring->written.load(std::memory_order_relaxed);
+        Event &event = ring->events[index % ring->capacity];
+        event.name.store(name, std::memory_order_relaxed);
+        event.start.store(startNanoseconds, std::memory_order_relaxed);
+        event.duration.store(durationNanoseconds, std::memory_order_relaxed);
+        event.threadId.store(ring->threadId.load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+        ring->written.store(index + 1, std::memory_order_release);
+    }
+
+    auto TraceRecorder::exportChromeTrace() const -> std::string
+    {
+        std::vector<EventCopy> events;
+        std::vector<std::pair<uint64_t, std::string>> threadNames;
+
+        const Ring *rings = ringsBase_.load(std::memory_order_acquire);
+        for (size_t r = 0; rings && r < kMaxThreads; ++r) {
+            const Ring &ring = rings[r];
+            const uint64_t end = ring.written.load(std::memory_order_acquire);
+            if (end == 0) { continue; }
+            const uint64_t begin = end > ring.capacity ? end - ring.capacity : 0;
+
+            const size_t firstCopied = events.size();
+            for (uint64_t i = begin; i < end; ++i) {
+                const Event &event = ring.events[i % ring.capacity];
+                events.push_back({event.name.load(std::memory_order_relaxed),
+                                  event.start.load(std::memory_order_relaxed),
+                                  event.duration.load(std::memory_order_relaxed),
+                                  event.threadId.load(std::memory_order_relaxed)});
+            }
+
+            // Slots the thread reused while they were copied hold a mix of two events.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t endAfterCopy = ring.written.load(std::memory_order_relaxed);
+            const uint64_t firstIntact =
+                    endAfterCopy > ring.capacity ? endAfterCopy - ring.capacity : 0;
+            if (firstIntact > begin) {
+                const auto overwritten = static_cast<size_t>(
+                        std::min<uint64_t>(firstIntact - begin, end - begin));
+                events.erase(events.begin() + static_cast<std::ptrdiff_t>(firstCopied),
+                             events.begin() + static_cast<std::ptrdiff_t>(firstCopied +
+                                                                          overwritten));
+            }
+
+            if (ring.threadName[0] != '\0') {
+                threadNames.emplace_back(ring.threadId.load(), ring.threadName);
+            }
+        }
+
+        std::sort(events.begin(), events.end(),
+                  [](const EventCopy &a, const EventCopy &b) { return a.start < b.start; });
+
+        const long processId = static_cast<long>(getpid());
+        std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        char buffer[160];
+        bool first = true;
+        for (const auto &thread : threadNames) {
+            std::snprintf(buffer, sizeof(buffer),
+                          "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%ld,"
+                          "\"tid\":%" PRIu64 ",\"args\":{\"name\":",
+                          first ? "" : ",", processId, thread.first);
+            json += buffer;
+            appendJsonString(json, thread.second.c_str());
+            json += "}}";
+            first = false;
+        }
+        for (const auto &event : events) {
+            if (!event.name) { continue; }
+            std::snprintf(buffer, sizeof(buffer), "%s{\"ph\":\"X\",\"name\":", first ? "" : ",");
+            json += buffer;
+            appendJsonString(json, event.name);
+            // Chrome traces count in microseconds.
+            std::snprintf(buffer, sizeof(buffer),
+                          ",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%" PRIu64 "}",
+                          static_cast<double>(event.start) / 1000.0,
+                          static_cast<double>(event.duration) / 1000.0, processId,
+                          event.threadId);
+            json += buffer;
+            first = false;
+        }
+        json += "]}\n";
+        return json;
+    }
+
+    auto TraceRecorder::writeChromeTrace(const std::string &path) const -> bool
+    {
+        const std::string json = exportChromeTrace();
+
+        const std::string temporaryPath = path + ".tmp";
+        std::FILE *file = std::fopen(temporaryPath.c_str(), "w");
+        if (!file) { return false; }
+
+        const bool written = std::fwrite(json.data(), 1, json.size(), file) == json.size();
+        if (std::fclose(file) != 0 || !written) { return false; }
+        return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+    }
+
+} // namespace audio_tap
+} // namespace pg
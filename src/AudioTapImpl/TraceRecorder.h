@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace pg {
+namespace audio_tap {
+
+    // Records timed spans ("tap setup took 80 ms, of which the aggregate device 60 ms") from
+    // any thread, including the IOProc, and exports them as Chrome trace JSON for
+    // chrome://tracing or Perfetto.
+    //
+    // Every thread writes into its own ring of the most recent events, claimed from a pool
+    // allocated by `enable()`, so recording never locks or allocates. While disabled, a
+    // `PG_TRACE_SCOPE` costs one relaxed load and a branch.
+    //
+    // `enable()`, `disable()` and the exports may be called from any non-real-time thread.
+    // POSIX only; no Core Audio dependency.
+    class TraceRecorder
+    {
+    public:
+        static constexpr size_t kDefaultEventsPerThread = 4096;
+        static constexpr size_t kMaxThreads = 64;
+
+        static auto getInstance() -> TraceRecorder &;
+
+        TraceRecorder(const TraceRecorder &) = delete;
+        TraceRecorder &operator=(const TraceRecorder &) = delete;
+
+        // Starts recording. The rings are allocated on the first call and kept, with their
+        // events, for the life of the process; `eventsPerThread` only applies to that call.
+        void enable(size_t eventsPerThread = kDefaultEventsPerThread);
+        void disable();
+        static auto isEnabled() -> bool { return enabled_.load(std::memory_order_relaxed); }
+
+        // Monotonic time in nanoseconds, the time base of all events.
+        static auto now() -> uint64_t;
+
+        // Adds a span that started at `startNanoseconds`. `name` must be a string literal or
+        // otherwise outlive the recorder. Real-time safe. Threads beyond `kMaxThreads` are not
+        // recorded.
+        void record(const char *name, uint64_t startNanoseconds, uint64_t durationNanoseconds);
+
+        // Every event still in the rings, as a Chrome trace JSON document.
+        auto exportChromeTrace() const -> std::string;
+
+        // Writes `exportChromeTrace()` to `path`, replacing it atomically.
+        auto writeChromeTrace(const std::string &path) const -> bool;
+
+    private:
+        struct Ring;
+
+        TraceRecorder();
+        ~TraceRecorder();
+
+        auto getThreadRing() -> Ring *;
+
+        static std::atomic<bool> enabled_;
+
+        std::mutex enableMutex_;
+        std::unique_ptr<Ring[]> rings_;
+        std::atomic<Ring *> ringsBase_{nullptr};
+        std::atomic<size_t> claimedRings_{0};
+    };
+
+    // Records the span from its construction to its destruction. Use `PG_TRACE_SCOPE`.
+    class TraceScope
+    {
+    public:
+        explicit TraceScope(const char *name)
+          : name_(TraceRecorder::isEnabled() ? name : nullptr)
+        {
+            if (name_) { start_ = TraceRecorder::now(); }
+        }
+
+        ~TraceScope()
+        {
+            if (name_) {
+                TraceRecorder::getInstance().record(name_, start_, TraceRecorder::now() - start_);
+            }
+        }
+
+        TraceScope(const TraceScope &) = delete;
+        TraceScope &operator=(const TraceScope &) = delete;
+
+    private:
+        const char *name_;
+        uint64_t start_{0};
+    };
+
+} // namespace audio_tap
+} // namespace pg
+
+#define PG_TRACE_CONCAT_INNER(a, b) a##b
+#define PG_TRACE_CONCAT(a, b) PG_TRACE_CONCAT_INNER(a, b)
+
+// Traces the rest of the enclosing block as a span called `name` (a string literal).
+#define PG_TRACE_SCOPE(name)                                                                  \
+    ::pg::audio_tap::TraceScope PG_TRACE_CONCAT(pgTraceScope, __LINE__)(name)
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace pg {
+namespace audio_tap {
+
+    // Lock-free single-producer/single-consumer "latest value" mailbox.
+    //
+    // The producer fills a private back buffer and publishes it by swapping it with the shared
+    // middle buffer; the consumer swaps the middle buffer with its private front buffer when a
+    // new value is available. Both sides are wait-free, never copy more than one `T` and never
+    // see a torn value. Intermediate values are skipped if the consumer polls less often than
+    // the producer publishes, which is exactly what a UI meter wants.
+    template <typename T>
+    class TripleBuffer
+    {
+    public:
+        TripleBuffer() = default;
+
+        TripleBuffer(const TripleBuffer &) = delete;
+        TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+        // --- Producer side ---
+
+        auto getWriteBuffer() -> T & { return slots_[backIndex_].value; }
+
+        // Makes the write buffer visible to the consumer and hands the producer a fresh one.
+        void publish()
+        {
+            const uint8_t previous =
+                    middle_.exchange(backIndex_ | kDirtyBit, std::memory_order_acq_rel);
+            backIndex_ = previous & kIndexMask;
+        }
+
+        // --- Consumer side ---
+
+        // Picks up the most recently published value, if there is one newer than the current
+        // read buffer. Returns true if the read buffer changed.
+        auto update() -> bool
+        {
+            if ((middle_.load(std::memory_order_relaxed) & kDirtyBit) == 0) { return false; }
+
+            const uint8_t previous = middle_.exchange(frontIndex_, std::memory_order_acq_rel);
+            frontIndex_ = previous & kIndexMask;
+            return true;
+        }
+
+        auto getReadBuffer() const -> const T & { return slots_[frontIndex_].value; }
+
+    private:
+        static constexpr uint8_t kIndexMask = 0x03;
+        static constexpr uint8_t kDirtyBit = 0x04;
+
+        // One cache line per slot so the producer writing its buffer never disturbs the consumer
+        // reading its own.
+        struct alignas(64) Slot
+        {
+            T value{};
+        };
+
+        std::array<Slot, 3> slots_{};
+        alignas(64) std::atomic<uint8_t> middle_{1};
+        alignas(64) uint8_t backIndex_{0}; // Producer only.
+        alignas(64) uint8_t frontIndex_{2}; // Consumer only.
+    };
+
+} // namespace audio_tap
+} // namespace pg
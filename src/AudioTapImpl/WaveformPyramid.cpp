@@ -0,0 +1,332 @@
+#include "WaveformPyramid.h"
+#include "FilePaths.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace pg {
+namespace audio_tap {
+
+    namespace {
+        constexpr char kSidecarMagic[4] = {'P', 'G', 'W', 'F'};
+        constexpr uint32_t kSidecarVersion = 1;
+        constexpr float kFullScale = 32767.0f;
+
+        // Rounded outwards so a quantized bin always contains the samples it summarizes.
+        auto quantizeMinimum(float value) -> int16_t
+        {
+            const float scaled = std::floor(std::max(-1.0f, std::min(value, 1.0f)) * kFullScale);
+            return static_cast<int16_t>(scaled);
+        }
+
+        auto quantizeMaximum(float value) -> int16_t
+        {
+            const float scaled = std::ceil(std::max(-1.0f, std::min(value, 1.0f)) * kFullScale);
+            return static_cast<int16_t>(scaled);
+        }
+
+        void appendLittleEndian(std::vector<uint8_t> &out, uint64_t value, int byteCount)
+        {
+            for (int i = 0; i < byteCount; ++i) {
+                out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+            }
+        }
+
+        auto readLittleEndian(const uint8_t *bytes, int byteCount) -> uint64_t
+        {
+            uint64_t value = 0;
+            for (int i = byteCount - 1; i >= 0; --i) { value = (value << 8) | bytes[i]; }
+            return value;
+        }
+    } // namespace
+
+    WaveformPyramid::WaveformPyramid(uint32_t channelCount, double sampleRate)
+      : channelCount_(channelCount > 0 ? channelCount : 1), sampleRate_(sampleRate)
+    {
+        for (auto &level : levels_) { resetPending(level); }
+    }
+
+    void WaveformPyramid::append(const float *interleaved, size_t frameCount)
+    {
+        // Reduce the block to one min/max pair per channel and per stretch up to the next
+        // 256-frame boundary without holding the lock; only the merge is done under it.
+        // Pending counts only change on this thread, so they can be read without the lock.
+        const uint32_t finestBin = kFramesPerBin[0];
+        uint32_t pending = levels_[0].pendingFrames;
+
+        const size_t maxStretches = frameCount / finestBin + 2;
+        blockMin_.resize(maxStretches * channelCount_);
+        blockMax_.resize(maxStretches * channelCount_);
+        stretchFrames_.clear();
+
+        for (size_t frame = 0; frame < frameCount;) {
+            const auto frames = static_cast<uint32_t>(
+                    std::min<size_t>(finestBin - pending, frameCount - frame));
+            float *mins = blockMin_.data() + stretchFrames_.size() * channelCount_;
+            float *maxs = blockMax_.data() + stretchFrames_.size() * channelCount_;
+            std::fill(mins, mins + channelCount_, std::numeric_limits<float>::infinity());
+            std::fill(maxs, maxs + channelCount_, -std::numeric_limits<float>::infinity());
+
+            const float *samples = interleaved + frame * channelCount_;
+            for (uint32_t i = 0; i < frames; ++i) {
+                for (uint32_t ch = 0; ch < channelCount_; ++ch) {
+                    const float sample = *samples++;
+                    mins[ch] = std::min(mins[ch], sample);
+                    maxs[ch] = std::max(maxs[ch], sample);
+                }
+            }
+
+            stretchFrames_.push_back(frames);
+            frame += frames;
+            pending = (pending + frames) % finestBin;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < stretchFrames_.size(); ++i) {
+            mergeInto(0, blockMin_.data() + i * channelCount_,
+                      blockMax_.data() + i * channelCount_, stretchFrames_[i]);
+        }
+        frameCount_ += frameCount;
+    }
+
+    void WaveformPyramid::resetPending(Level &level)
+    {
+        level.pendingMin.assign(channelCount_, std::numeric_limits<float>::infinity());
+        level.pendingMax.assign(channelCount_, -std::numeric_limits<float>::infinity());
+        level.pendingFrames = 0;
+    }
+
+    void WaveformPyramid::mergeInto(size_t levelIndex, const float *minimums,
+                                    const float *maximums, uint32_t frames)
+    {
+        Level &level = levels_[levelIndex];
+        for (uint32_t ch = 0; ch < channelCount_; ++ch) {
+            level.pendingMin[ch] = std::min(level.pendingMin[ch], minimums[ch]);
+            level.pendingMax[ch] = std::max(level.pendingMax[ch], maximums[ch]);
+        }
+        level.pendingFrames += frames;
+        if (level.pendingFrames >= kFramesPerBin[levelIndex]) { closeBin(levelIndex); }
+    }
+
+    void WaveformPyramid::closeBin(size_t levelIndex)
+    {
+        Level &level = levels_[levelIndex];
+        for (uint32_t ch = 0; ch < channelCount_; ++ch) {
+            level.bins.push_back(quantizeMinimum(level.pendingMin[ch]));
+            level.bins.push_back(quantizeMaximum(level.pendingMax[ch]));
+        }
+        if (levelIndex + 1 < kLevelCount) {
+            mergeInto(levelIndex + 1, level.pendingMin.data(), level.pendingMax.data(),
+                      level.pendingFrames);
+        }
+        resetPending(level);
+    }
+
+    void WaveformPyramid::getPendingExtremes(size_t levelIndex, uint32_t channel, float &minimum,
+                                             float &maximum) const
+    {
+        // The unfinished bin at the end is spread over this level's pending extremes and those
+        // of every finer level, which have not been folded in yet.
+        minimum = std::numeric_limits<float>::infinity();
+        maximum = -std::numeric_limits<float>::infinity();
+        for (size_t i = 0; i <= levelIndex; ++i) {
+            minimum = std::min(minimum, levels_[i].pendingMin[channel]);
+            maximum = std::max(maximum, levels_[i].pendingMax[channel]);
+        }
+    }
+
+    auto WaveformPyramid::getFrameCount() const -> uint64_t
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return frameCount_;
+    }
+
+    auto WaveformPyramid::getPeaks(uint32_t channel, uint64_t startFrame, uint64_t frameCount,
+                                   size_t columnCount, float *minimums, float *maximums) const
+            -> bool
+    {
+        if (channel >= channelCount_) { return false; }
+        if (columnCount == 0) { return true; }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        size_t levelIndex = 0;
+        while (levelIndex + 1 < kLevelCount &&
+               kFramesPerBin[levelIndex + 1] * static_cast<double>(columnCount) <= frameCount) {
+            ++levelIndex;
+        }
+        const Level &level = levels_[levelIndex];
+        const uint64_t framesPerBin = kFramesPerBin[levelIndex];
+        const uint64_t finishedBins = level.bins.size() / (2 * channelCount_);
+
+        float tailMin, tailMax;
+        getPendingExtremes(levelIndex, channel, tailMin, tailMax);
+
+        for (size_t column = 0; column < columnCount; ++column) {
+            const uint64_t begin = startFrame + column * frameCount / columnCount;
+            const uint64_t end = std::max(begin + 1,
+                                          startFrame + (column + 1) * frameCount / columnCount);
+            if (begin >= frameCount_) {
+                minimums[column] = 0.0f;
+                maximums[column] = 0.0f;
+                continue;
+            }
+
+            float lo = std::numeric_limits<float>::infinity();
+            float hi = -std::numeric_limits<float>::infinity();
+            const uint64_t lastBin = (std::min(end, frameCount_) - 1) / framesPerBin;
+            for (uint64_t bin = begin / framesPerBin; bin <= lastBin; ++bin) {
+                if (bin < finishedBins) {
+                    const int16_t *pair = &level.bins[(bin * channelCount_ + channel) * 2];
+                    lo = std::min(lo, pair[0] / kFullScale);
+                    hi = std::max(hi, pair[1] / kFullScale);
+                } else {
+                    lo = std::min(lo, tailMin);
+                    hi = std::max(hi, tailMax);
+                }
+            }
+            minimums[column] = lo;
+            maximums[column] = hi;
+        }
+        return true;
+    }
+
+    auto WaveformPyramid::save(const std::string &path) const -> bool
+    {
+        std::vector<uint8_t> header;
+        std::array<std::vector<int16_t>, kLevelCount> levelBins;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            header.insert(header.end(), kSidecarMagic, kSidecarMagic + 4);
+            appendLittleEndian(header, kSidecarVersion, 4);
+            appendLittleEndian(header, channelCount_, 4);
+            appendLittleEndian(header, kLevelCount, 4);
+            uint64_t sampleRateBits;
+            std::memcpy(&sampleRateBits, &sampleRate_, sizeof(sampleRateBits));
+            appendLittleEndian(header, sampleRateBits, 8);
+            appendLittleEndian(header, frameCount_, 8);
+
+            // Unfinished bins are stored as complete ones; the frame count says where the audio
+            // really ends.
+            for (size_t l = 0; l < kLevelCount; ++l) {
+                levelBins[l] = levels_[l].bins;
+                if (frameCount_ % kFramesPerBin[l] != 0) {
+                    for (uint32_t ch = 0; ch < channelCount_; ++ch) {
+                        float lo, hi;
+                        getPendingExtremes(l, ch, lo, hi);
+                        levelBins[l].push_back(quantizeMinimum(lo));
+                        levelBins[l].push_back(quantizeMaximum(hi));
+                    }
+                }
+                appendLittleEndian(header, kFramesPerBin[l], 4);
+                appendLittleEndian(header, levelBins[l].size() / (2 * channelCount_), 8);
+            }
+        }
+
+        // Written to a temporary file and renamed into place so readers never see a partial
+        // sidecar.
+        const std::string temporaryPath = path + ".tmp";
+        std::FILE *file = std::fopen(temporaryPath.c_str(), "wb");
+        if (!file) { return false; }
+
+        bool ok = std::fwrite(header.data(), 1, header.size(), file) == header.size();
+        std::vector<uint8_t> bytes;
+        for (const auto &bins : levelBins) {
+            bytes.clear();
+            bytes.reserve(bins.size() * 2);
+            for (const int16_t value : bins) {
+                appendLittleEndian(bytes, static_cast<uint16_t>(value), 2);
+            }
+            ok = ok && std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        }
+        ok = std::fclose(file) == 0 && ok;
+        if (!ok) {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+        return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+    }
+
+    auto WaveformPyramid::load(const std::string &path) -> std::unique_ptr<WaveformPyramid>
+    {
+        std::FILE *file = std::fopen(path.c_str(), "rb");
+        if (!file) { return nullptr; }
+        std::vector<uint8_t> bytes;
+        uint8_t buffer[65536];
+        for (size_t read; (read = std::fread(buffer, 1, sizeof(buffer), file)) > 0;) {
+            bytes.insert(bytes.end(), buffer, buffer + read);
+        }
+        std::fclose(file);
+
+        constexpr size_t kFixedHeader = 32;
+        constexpr size_t kLevelHeader = 12;
+        if (bytes.size() < kFixedHeader + kLevelCount * kLevelHeader ||
+            std::memcmp(bytes.data(), kSidecarMagic, 4) != 0 ||
+            readLittleEndian(&bytes[4], 4) != kSidecarVersion ||
+            readLittleEndian(&bytes[12], 4) != kLevelCount) {
+            return nullptr;
+        }
+
+        const auto channelCount = static_cast<uint32_t>(readLittleEndian(&bytes[8], 4));
+        const uint64_t sampleRateBits = readLittleEndian(&bytes[16], 8);
+        double sampleRate;
+        std::memcpy(&sampleRate, &sampleRateBits, sizeof(sampleRate));
+        const uint64_t frameCount = readLittleEndian(&bytes[24], 8);
+        if (channelCount == 0 || channelCount > 1024) { return nullptr; }
+
+        auto pyramid = std::make_unique<WaveformPyramid>(channelCount, sampleRate);
+        size_t offset = kFixedHeader + kLevelCount * kLevelHeader;
+        for (size_t l = 0; l < kLevelCount; ++l) {
+            const uint8_t *levelHeader = &bytes[kFixedHeader + l * kLevelHeader];
+            const uint64_t binCount = readLittleEndian(levelHeader + 4, 8);
+            const uint64_t expectedBins = (frameCount + kFramesPerBin[l] - 1) / kFramesPerBin[l];
+            if (readLittleEndian(levelHeader, 4) != kFramesPerBin[l] || binCount != expectedBins) {
+                return nullptr;
+            }
+
+            const uint64_t valueCount = binCount * channelCount * 2;
+            if ((bytes.size() - offset) / 2 < valueCount) { return nullptr; }
+            auto &bins = pyramid->levels_[l].bins;
+            bins.resize(valueCount);
+            for (uint64_t i = 0; i < valueCount; ++i, offset += 2) {
+                bins[i] = static_cast<int16_t>(readLittleEndian(&bytes[offset], 2));
+            }
+        }
+        pyramid->frameCount_ = frameCount;
+        return pyramid;
+    }
+
+    auto WaveformPyramid::getSidecarPath(const std::string &recordingPath) -> std::string
+    {
+        return paths::getCompanionPath(recordingPath, ".peaks");
+    }
+
+    WaveformSink::WaveformSink(std::unique_ptr<SampleSink> sink,
+                               std::shared_ptr<WaveformPyramid> pyramid, std::string sidecarPath)
+      : sink_(std::move(sink)), pyramid_(std::move(pyramid)), sidecarPath_(std::move(sidecarPath))
+    {
+    }
+
+    auto WaveformSink::write(const float *interleaved, size_t frameCount) -> bool
+    {
+        if (!sink_->write(interleaved, frameCount)) { return false; }
+        pyramid_->append(interleaved, frameCount);
+        return true;
+    }
+
+    auto WaveformSink::finalize() -> bool
+    {
+        const bool ok = sink_->finalize();
+        // The overview is a convenience: a take whose sidecar could not be written is still a
+        // good take, and readers fall back to scanning the audio.
+        pyramid_->save(sidecarPath_);
+        return ok;
+    }
+
+} // namespace audio_tap
+} // namespace pg
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "SampleSink.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pg {
+namespace audio_tap {
+
+    // Multi-resolution min/max overview of a recording, for drawing waveforms.
+    //
+    // Each level stores, per channel, the minimum and maximum sample of consecutive bins of
+    // 256, 4096 and 65536 frames, quantized outwards to 16 bits so the envelope never shrinks.
+    // The pyramid is built incrementally as audio is appended, so a take can be drawn while it
+    // is still being recorded, and any zoom level is answered from the closest level without
+    // touching the audio. Saved as a compact sidecar next to the recording (about 8 bytes per
+    // stereo bin, ~2.8 MB for 30 minutes at 48 kHz), it lets a take be reopened without
+    // rescanning the file.
+    //
+    // `append()` is called from one thread (normally the writer thread through `WaveformSink`);
+    // the query functions may be called concurrently from any other. No platform dependencies.
+    class WaveformPyramid
+    {
+    public:
+        static constexpr size_t kLevelCount = 3;
+        static constexpr std::array<uint32_t, kLevelCount> kFramesPerBin{256, 4096, 65536};
+
+        WaveformPyramid(uint32_t channelCount, double sampleRate);
+
+        WaveformPyramid(const WaveformPyramid &) = delete;
+        WaveformPyramid &operator=(const WaveformPyramid &) = delete;
+
+        // Adds `frameCount` interleaved frames to the end of the overview.
+        void append(const float *interleaved, size_t frameCount);
+
+        auto getChannelCount() const -> uint32_t { return channelCount_; }
+        auto getSampleRate() const -> double { return sampleRate_; }
+        auto getFrameCount() const -> uint64_t;
+
+        // Fills `minimums` and `maximums` with one value per column for `channel`, splitting
+        // frames [startFrame, startFrame + frameCount) evenly over `columnCount` columns. Uses
+        // the coarsest level whose bins are no wider than a column; below 256 frames per column
+        // the 256-frame bins are used and neighbouring columns repeat. Columns past the end of
+        // the audio read as zero. Returns false if `channel` is out of range.
+        auto getPeaks(uint32_t channel, uint64_t startFrame, uint64_t frameCount,
+                      size_t columnCount, float *minimums, float *maximums) const -> bool;
+
+        // Writes the overview to `path`, replacing it atomically.
+        auto save(const std::string &path) const -> bool;
+
+        // Reads an overview written by `save()`. Returns nullptr if the file is missing or not a
+        // valid sidecar. Compare `getFrameCount()` with the audio to detect a stale one.
+        static auto load(const std::string &path) -> std::unique_ptr<WaveformPyramid>;
+
+        // Sidecar location for a recording: `take.caf` -> `take.peaks`.
+        static auto getSidecarPath(const std::string &recordingPath) -> std::string;
+
+    private:
+        struct Level
+        {
+            // Finished bins, channel-interleaved (min, max) pairs.
+            std::vector<int16_t> bins;
+            // Running extremes of the bin being filled, per channel.
+            std::vector<float> pendingMin;
+            std::vector<float> pendingMax;
+            uint32_t pendingFrames{0};
+        };
+
+        void resetPending(Level &level);
+        void closeBin(size_t levelIndex);
+        void mergeInto(size_t levelIndex, const float *minimums, const float *maximums,
+                       uint32_t frames);
+        // Extremes of the unfinished bin at the end of `levelIndex`. Requires `mutex_`.
+        void getPendingExtremes(size_t levelIndex, uint32_t channel, float &minimum,
+                                float &maximum) const;
+
+        const uint32_t channelCount_;
+        const double sampleRate_;
+
+        // Appending thread only. Pending frame counts in `levels_` are also only written by it.
+        std::vector<float> blockMin_;
+        std::vector<float> blockMax_;
+        std::vector<uint32_t> stretchFrames_;
+
+        // Guards everything below. Held by `append()` only while publishing finished bins.
+        mutable std::mutex mutex_;
+        std::array<Level, kLevelCount> levels_;
+        uint64_t frameCount_{0};
+    };
+
+    // Pass-through sink that feeds a `WaveformPyramid` from the writer thread and saves it as a
+    // sidecar when the recording is finalized.
+    class WaveformSink : public SampleSink
+    {
+    public:
+        WaveformSink(std::unique_ptr<SampleSink> sink, std::shared_ptr<WaveformPyramid> pyramid,
+                     std::string sidecarPath);
+
+        auto write(const float *interleaved, size_t frameCount) -> bool override;
+        auto finalize() -> bool override;
+        auto checkpoint() -> bool override { return sink_->checkpoint(); }
+        auto getBytesWritten() const -> uint64_t override { return sink_->getBytesWritten(); }
+
+    private:
+        std::unique_ptr<SampleSink> sink_;
+        std::shared_ptr<WaveformPyramid> pyramid_;
+        const std::string sidecarPath_;
+    };
+
+} // namespace audio_tap
+} // namespace pg
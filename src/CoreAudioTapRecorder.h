@@ -1,20 +1,95 @@
 #pragma once
 
-#include <CoreAudio/AudioHardwareBase.h>
+#include "AudioTapImpl/CaptureFormat.h"
+#include "AudioTapImpl/CoreAudioTypes.h"
 #include <JuceHeader.h>
 
 namespace pg {
+namespace audio_tap {
+    class CaptureSubscription;
+    class CaptureTimeline;
+    class DropoutLog;
+    class MetricsRegistry;
+    class WaveformPyramid;
+    struct CallbackTimingSummary;
+    struct LevelSnapshot;
+}
+
 class CoreAudioTapRecorder
 {
 public:
     CoreAudioTapRecorder();
     ~CoreAudioTapRecorder();
 
-    auto startRecording(const juce::File &outputFile) -> bool;
+    // `outputFormat` selects the container (CAF or FLAC) and sample format stored in the file;
+    // the default is float32 CAF.
+    auto startRecording(const juce::File &outputFile,
+                        const audio_tap::OutputFormat &outputFormat = {}) -> bool;
     auto stopRecording() -> void;
     auto isRecording() const -> bool;
     auto hasRecordingFinished() const -> bool;
 
+    // Live feed of the audio being recorded, for meters, analysis or monitoring. Only available
+    // while recording; returns nullptr otherwise or if every subscriber slot is taken.
+    auto subscribe() -> std::unique_ptr<audio_tap::CaptureSubscription>;
+
+    // Latest input levels, for meters polled from the message thread (e.g. a 60 Hz timer).
+    // Returns false, leaving `levels` untouched, when not recording.
+    auto getLevels(audio_tap::LevelSnapshot &levels) -> bool;
+
+    // How long the capture callback takes and how regularly it is called during the current
+    // take, as percentiles in nanoseconds, for diagnosing glitches. Returns false, leaving
+    // `timing` untouched, when not recording.
+    auto getCallbackTiming(audio_tap::CallbackTimingSummary &timing) const -> bool;
+
+    // Process-wide counters and gauges of every recorder: frames captured, bytes written,
+    // dropped blocks, writer lag, stop reasons and so on. Publish them for dashboards with an
+    // `audio_tap::MetricsExporter` (Prometheus text format, to a file or a Unix socket).
+    static auto getMetrics() -> audio_tap::MetricsRegistry &;
+
+    // Traces the steps of starting and stopping (tap and aggregate device setup, device start,
+    // writer drain, message-thread hops) and every capture callback, for finding out which one
+    // is slow. Off by default; enabling reserves a few megabytes once.
+    static void setTracingEnabled(bool shouldBeEnabled);
+
+    // Writes the most recent traced events as Chrome trace JSON, for chrome://tracing or
+    // Perfetto. Returns false if the file could not be written.
+    static auto writeTrace(const juce::File &file) -> bool;
+
+    // Min/max overview of the current (or last) take, growing while recording, for drawing
+    // its waveform at any zoom level. Saved next to the recording as a `.peaks` sidecar when
+    // the take ends. Returns nullptr before the first recording.
+    auto getWaveform() const -> std::shared_ptr<const audio_tap::WaveformPyramid>;
+
+    // Loads the overview saved with a finished recording. Returns nullptr if there is none or
+    // the recording has been modified since, in which case the audio has to be scanned.
+    static auto loadWaveform(const juce::File &recording)
+            -> std::shared_ptr<const audio_tap::WaveformPyramid>;
+
+    // Host time of every capture callback of the current (or last) take, for converting between
+    // positions in the recording and host time, e.g. to align it with playback or video. Saved
+    // next to the recording as a `.timeline` sidecar when the take ends. Returns nullptr before
+    // the first recording.
+    auto getTimeline() const -> std::shared_ptr<const audio_tap::CaptureTimeline>;
+
+    // Loads the timeline saved with a finished recording. Returns nullptr if there is none.
+    static auto loadTimeline(const juce::File &recording)
+            -> std::shared_ptr<const audio_tap::CaptureTimeline>;
+
+    // Gaps and overlaps in the device stream, and blocks dropped because the writer fell behind,
+    // during the current (or last) take, with their positions in the recording. Saved next to
+    // the recording as a `.dropouts` log. Returns nullptr before the first recording.
+    auto getDropoutLog() const -> std::shared_ptr<const audio_tap::DropoutLog>;
+
+    // Loads the dropout log saved with a finished recording. Returns nullptr if there is none.
+    static auto loadDropoutLog(const juce::File &recording)
+            -> std::shared_ptr<const audio_tap::DropoutLog>;
+
+    // Makes a recording interrupted by a crash or force-quit playable again, keeping everything
+    // up to the last checkpoint and usually more. Call at launch, before recording to the same
+    // file. Returns false if the file is not a recording or could not be repaired.
+    static auto recoverInterruptedRecording(const juce::File &file) -> bool;
+
 private:
     class Impl;
     std::unique_ptr<Impl> pImpl_;
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "AudioTapImpl/CaptureFormat.h"
+#include <JuceHeader.h>
+
+namespace pg {
+
+// Keeps a rolling history of the last few minutes of system audio so that a take can be saved
+// after the fact. Runs on its own tapping session, so it can be active alongside a
+// `CoreAudioTapRecorder`.
+class InstantReplayRecorder
+{
+public:
+    InstantReplayRecorder();
+    ~InstantReplayRecorder();
+
+    // Starts capturing into a history of `historySeconds` (clamped to 1-600 s). Memory use is
+    // fixed for as long as capture runs.
+    auto start(int historySeconds) -> bool;
+    auto stop() -> void;
+    auto isRunning() const -> bool;
+
+    // Writes up to the last `seconds` of captured audio to `outputFile` as CAF, without
+    // interrupting capture. Blocks while the file is written, so call it off the message thread
+    // for long snapshots. Returns false if nothing could be saved.
+    auto saveLastSeconds(const juce::File &outputFile, int seconds,
+                         const audio_tap::OutputFormat &outputFormat = {}) -> bool;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> pImpl_;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(InstantReplayRecorder)
+};
+
+} // namespace pg
@@ -0,0 +1,228 @@
+#include "InstantReplayRecorder.h"
+
+#include "AudioTapImpl/AudioDeviceUtils.h"
+#include "AudioTapImpl/IOProcHandle.h"
+#include "AudioTapImpl/InterleaveKernels.h"
+#include "AudioTapImpl/ReplayHistoryBuffer.h"
+#include "AudioTapImpl/SystemAudioTapper.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace pg {
+
+class InstantReplayRecorder::Impl
+{
+public:
+    Impl() = default;
+
+    ~Impl()
+    {
+        lifetime_.reset(); // Drops any stop still queued on the message thread.
+        stop();
+    }
+
+    auto start(int historySeconds) -> bool
+    {
+        std::lock_guard<std::mutex> lock(controlMutex_);
+        if (history_) { return false; }
+
+        tappingSession_ = audio_tap::SystemAudioTapper::getInstance().acquireSession();
+        if (!tappingSession_.isValid()) { return false; }
+
+        format_ = tappingSession_.getAudioFormat();
+        if (format_.mSampleRate == 0 || format_.mChannelsPerFrame == 0) {
+            DBG("InstantReplayRecorder: Error - Invalid audio format received from session "
+                "handle.");
+            tappingSession_ = {};
+            return false;
+        }
+        if (format_.mFormatID != kAudioFormatLinearPCM ||
+            (format_.mFormatFlags & kAudioFormatFlagIsFloat) == 0 ||
+            format_.mBitsPerChannel != 32) {
+            DBG("InstantReplayRecorder: Error - Only 32-bit float capture is supported.");
+            tappingSession_ = {};
+            return false;
+        }
+
+        // Extra room so that a snapshot of the full history is not overtaken by the live
+        // capture while it is being written.
+        const int seconds = juce::jlimit(kMinHistorySeconds, kMaxHistorySeconds, historySeconds);
+        const auto capacityInFrames =
+                static_cast<size_t>(format_.mSampleRate * (seconds + kSnapshotHeadroomSeconds));
+        history_ = std::make_shared<audio_tap::ReplayHistoryBuffer>(format_.mChannelsPerFrame,
+                                                                    capacityInFrames);
+        historySeconds_ = seconds;
+
+        historySink_.prepare(history_.get(), format_);
+        ioProcHandle_.emplace(tappingSession_.getAggregateDeviceID(), historySink_);
+        if (!ioProcHandle_->isValid()) {
+            ioProcHandle_.reset();
+            history_.reset();
+            tappingSession_ = {};
+            return false;
+        }
+
+        tappingSession_.registerPropertyListener(
+                [lifetime = std::weak_ptr<Impl *>(lifetime_)](auto)
+                {
+                    // Any format change or device loss invalidates the history's layout. The
+                    // stop runs later, so it must not touch a recorder destroyed meanwhile.
+                    juce::MessageManager::callAsync(
+                            [lifetime]
+                            {
+                                if (const auto self = lifetime.lock()) { (*self)->stop(); }
+                            });
+                });
+        return true;
+    }
+
+    auto stop() -> void
+    {
+        std::lock_guard<std::mutex> lock(controlMutex_);
+
+        tappingSession_.unregisterPropertyListener();
+        ioProcHandle_.reset();
+        tappingSession_ = {};
+
+        // A snapshot in progress keeps its own reference to the history.
+        history_.reset();
+    }
+
+    auto isRunning() const -> bool
+    {
+        std::lock_guard<std::mutex> lock(controlMutex_);
+        return history_ != nullptr;
+    }
+
+    auto saveLastSeconds(const juce::File &outputFile, int seconds,
+                         const audio_tap::OutputFormat &outputFormat) -> bool
+    {
+        std::shared_ptr<audio_tap::ReplayHistoryBuffer> history;
+        AudioStreamBasicDescription format{};
+        size_t maxFrames = 0;
+        {
+            std::lock_guard<std::mutex> lock(controlMutex_);
+            if (!history_ || seconds <= 0) { return false; }
+
+            history = history_;
+            format = format_;
+            maxFrames = static_cast<size_t>(format.mSampleRate *
+                                            juce::jmin(seconds, historySeconds_));
+        }
+
+        auto sink = audio_tap::utils::createFileSink(format, outputFile, outputFormat);
+        if (!sink) { return false; }
+
+        const size_t framesWritten = history->writeLatestTo(*sink, maxFrames);
+        return sink->finalize() && framesWritten > 0;
+    }
+
+private:
+    static constexpr int kMinHistorySeconds = 1;
+    static constexpr int kMaxHistorySeconds = 600;
+    static constexpr int kSnapshotHeadroomSeconds = 5;
+
+    // Expires when the recorder is destroyed, which happens on the message thread like
+    // everything queued there, so a queued call can check it is still safe to run.
+    std::shared_ptr<Impl *> lifetime_{std::make_shared<Impl *>(this)};
+
+    mutable std::mutex controlMutex_;
+    int historySeconds_{0};
+    AudioStreamBasicDescription format_{};
+
+    audio_tap::TappingSessionHandle tappingSession_;
+    // Copies each input buffer into the history, on the IOProc's thread. Planar buffer lists
+    // are interleaved first, as `AudioDataHandler` does, since the history is interleaved.
+    class HistorySink
+    {
+    public:
+        // Called before the IOProc starts; allocates everything `process()` needs.
+        void prepare(audio_tap::ReplayHistoryBuffer *history,
+                     const AudioStreamBasicDescription &format)
+        {
+            history_ = history;
+            channelCount_ = format.mChannelsPerFrame;
+            isNonInterleaved_ = (format.mFormatFlags & kAudioFormatFlagIsNonInterleaved) != 0;
+            interleave_ = audio_tap::kernels::selectInterleave(channelCount_);
+            scratch_.assign(isNonInterleaved_ ? kChunkFrames * channelCount_ : 0, 0.0f);
+        }
+
+        void process(const AudioBufferList *buffer, const AudioTimeStamp *)
+        {
+            if (!isNonInterleaved_) {
+                for (UInt32 i = 0; i < buffer->mNumberBuffers; ++i) {
+                    history_->write(static_cast<const float *>(buffer->mBuffers[i].mData),
+                                    buffer->mBuffers[i].mDataByteSize / sizeof(float));
+                }
+                return;
+            }
+
+            if (buffer->mNumberBuffers != channelCount_ || channelCount_ > kMaxPlanarChannels) {
+                return; // Does not match the session format; nothing sensible to keep.
+            }
+
+            size_t frameCount = SIZE_MAX;
+            for (UInt32 ch = 0; ch < channelCount_; ++ch) {
+                frameCount = std::min<size_t>(frameCount,
+                                              buffer->mBuffers[ch].mDataByteSize / sizeof(float));
+            }
+
+            std::array<const float *, kMaxPlanarChannels> planes{};
+            for (size_t offset = 0; offset < frameCount; offset += kChunkFrames) {
+                const size_t chunkFrames = std::min(kChunkFrames, frameCount - offset);
+                for (UInt32 ch = 0; ch < channelCount_; ++ch) {
+                    planes[ch] = static_cast<const float *>(buffer->mBuffers[ch].mData) + offset;
+                }
+                interleave_(planes.data(), channelCount_, chunkFrames, scratch_.data());
+                history_->write(scratch_.data(), chunkFrames * channelCount_);
+            }
+        }
+
+    private:
+        static constexpr size_t kChunkFrames = 1024;
+        static constexpr UInt32 kMaxPlanarChannels = 64;
+
+        audio_tap::ReplayHistoryBuffer *history_{nullptr};
+        UInt32 channelCount_{0};
+        bool isNonInterleaved_{false};
+        audio_tap::kernels::InterleaveFn interleave_{nullptr};
+        std::vector<float> scratch_;
+    };
+
+    // `history_` and `historySink_` must outlive `ioProcHandle_`, which writes into them.
+    std::shared_ptr<audio_tap::ReplayHistoryBuffer> history_;
+    HistorySink historySink_;
+    std::optional<audio_tap::IOProcHandle<HistorySink>> ioProcHandle_;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Impl)
+};
+
+InstantReplayRecorder::InstantReplayRecorder()
+{
+    pImpl_ = std::make_unique<Impl>();
+}
+InstantReplayRecorder::~InstantReplayRecorder() = default;
+
+auto InstantReplayRecorder::start(int historySeconds) -> bool
+{
+    return pImpl_->start(historySeconds);
+}
+auto InstantReplayRecorder::stop() -> void
+{
+    pImpl_->stop();
+}
+auto InstantReplayRecorder::isRunning() const -> bool
+{
+    return pImpl_->isRunning();
+}
+auto InstantReplayRecorder::saveLastSeconds(const juce::File &outputFile, int seconds,
+                                            const audio_tap::OutputFormat &outputFormat) -> bool
+{
+    return pImpl_->saveLastSeconds(outputFile, seconds, outputFormat);
+}
+
+} // namespace pg
@@ -0,0 +1,217 @@
+// Drives the recorder state machine through `SimulatedAudioBackend`: a take that survives a
+// device overload and a format change, a take ended by the device going away, a start that
+// fails, and a controller destroyed with its stop still queued.
+
+#include "CaptureController.h"
+#include "DropoutLog.h"
+#include "SimulatedAudioBackend.h"
+#include "TestSupport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr double kSampleRate = 48000.0;
+    constexpr uint32_t kChannelCount = 2;
+    constexpr uint32_t kFramesPerBuffer = 512;
+    constexpr uint64_t kDropoutFrames = 4800;
+
+    // Stands in for the message thread: tasks queue up until the test runs them.
+    class TaskQueue
+    {
+    public:
+        auto getDispatcher() -> CaptureController::Dispatcher
+        {
+            return [this](std::function<void()> task)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                tasks_.push_back(std::move(task));
+            };
+        }
+
+        // Runs the queued tasks, and any they queue, on the calling thread.
+        void pump()
+        {
+            for (;;) {
+                std::function<void()> task;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (tasks_.empty()) { return; }
+                    task = std::move(tasks_.front());
+                    tasks_.pop_front();
+                }
+                task();
+            }
+        }
+
+    private:
+        std::mutex mutex_;
+        std::deque<std::function<void()>> tasks_;
+    };
+
+    auto installBackend(bool failTapCreation = false) -> std::shared_ptr<SimulatedAudioBackend>
+    {
+        SimulatedAudioBackend::Options options;
+        options.sampleRate = kSampleRate;
+        options.channelCount = kChannelCount;
+        options.framesPerBuffer = kFramesPerBuffer;
+        options.failTapCreation = failTapCreation;
+        auto backend = std::make_shared<SimulatedAudioBackend>(options);
+        setAudioHardwareBackend(backend);
+        return backend;
+    }
+
+    // Waits until the device has made `count` more callbacks. Returns false after five seconds.
+    auto waitForCallbacks(const SimulatedAudioBackend &backend, uint64_t count) -> bool
+    {
+        const uint64_t target = backend.getCallbackCount() + count;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (backend.getCallbackCount() < target) {
+            if (std::chrono::steady_clock::now() > deadline) { return false; }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    // Longest run of frames whose samples are all zero.
+    auto getLongestSilence(const std::vector<float> &samples) -> size_t
+    {
+        size_t longest = 0;
+        size_t run = 0;
+        for (size_t frame = 0; frame + kChannelCount <= samples.size(); frame += kChannelCount) {
+            bool silent = true;
+            for (uint32_t channel = 0; channel < kChannelCount; ++channel) {
+                silent = silent && samples[frame + channel] == 0.0f;
+            }
+            run = silent ? run + 1 : 0;
+            longest = std::max(longest, run);
+        }
+        return longest;
+    }
+
+    void testTakeSurvivesOverloadAndFormatChange()
+    {
+        const auto backend = installBackend();
+        const test::TemporaryDirectory directory("capture_controller");
+        const std::string path = directory.file("take.caf");
+        TaskQueue queue;
+        CaptureController controller(queue.getDispatcher());
+
+        OutputFormat format;
+        format.fillGaps = true;
+        if (!PG_CHECK(controller.startRecording(path, format))) { return; }
+        PG_CHECK(controller.isRecording());
+        PG_CHECK(backend->getTapCount() == 1);
+        PG_CHECK(waitForCallbacks(*backend, 10));
+
+        backend->injectDropout(kDropoutFrames);
+        PG_CHECK(waitForCallbacks(*backend, 10));
+
+        // The listener queues the switch; until it runs, the old handler takes the new buffers.
+        backend->changeFormat(44100.0, kChannelCount);
+        queue.pump();
+        PG_CHECK(controller.isRecording());
+        PG_CHECK(waitForCallbacks(*backend, 20));
+
+        controller.stopRecording();
+        PG_CHECK(controller.isRecording()); // Stopping until the queued stop runs.
+        queue.pump();
+        const uint64_t callbackCount = backend->getCallbackCount();
+
+        PG_CHECK(controller.hasRecordingFinished());
+        PG_CHECK(!controller.isRecording());
+        PG_CHECK(controller.getStopReason() == CaptureController::StopReason::UserRequested);
+        PG_CHECK(backend->getTapCount() == 0);
+
+        // The overload is logged and filled with silence, at the take's rate.
+        const auto dropouts = controller.getDropoutLog();
+        if (PG_CHECK(dropouts != nullptr)) {
+            PG_CHECK(dropouts->getCount(Dropout::Kind::Gap) == 1);
+            PG_CHECK(dropouts->getFrameCount(Dropout::Kind::Gap) == kDropoutFrames);
+        }
+        const auto saved = DropoutLog::load(DropoutLog::getLogPath(path));
+        if (PG_CHECK(saved != nullptr)) { PG_CHECK(saved->getCount(Dropout::Kind::Gap) == 1); }
+
+        // The file stays at 48 kHz stereo: every buffer adds 512 frames, or about 557 once the
+        // 44.1 kHz stream is converted. The resampler may hold back a few frames at the splice.
+        std::vector<float> samples;
+        if (!PG_CHECK(test::readCafFloats(path, samples))) { return; }
+        PG_CHECK(samples.size() % kChannelCount == 0);
+        const uint64_t frameCount = samples.size() / kChannelCount;
+        PG_CHECK(frameCount >= kDropoutFrames + (callbackCount - 2) * kFramesPerBuffer);
+        PG_CHECK(frameCount <= kDropoutFrames + callbackCount * 558);
+        PG_CHECK(getLongestSilence(samples) >= kDropoutFrames);
+    }
+
+    void testDeviceRemovalEndsTake()
+    {
+        const auto backend = installBackend();
+        const test::TemporaryDirectory directory("capture_controller_removal");
+        TaskQueue queue;
+        CaptureController controller(queue.getDispatcher());
+
+        if (!PG_CHECK(controller.startRecording(directory.file("take.caf"), {}))) { return; }
+        PG_CHECK(waitForCallbacks(*backend, 5));
+
+        backend->removeDevice();
+        PG_CHECK(controller.isRecording());
+        queue.pump();
+
+        PG_CHECK(controller.hasRecordingFinished());
+        PG_CHECK(controller.getStopReason() == CaptureController::StopReason::DeviceRemoved);
+        PG_CHECK(backend->getTapCount() == 0);
+        std::vector<float> samples;
+        PG_CHECK(test::readCafFloats(directory.file("take.caf"), samples));
+        PG_CHECK(!samples.empty());
+    }
+
+    void testStartFailsWithoutTap()
+    {
+        const auto backend = installBackend(true);
+        const test::TemporaryDirectory directory("capture_controller_no_tap");
+        TaskQueue queue;
+        CaptureController controller(queue.getDispatcher());
+
+        PG_CHECK(!controller.startRecording(directory.file("take.caf"), {}));
+        PG_CHECK(controller.hasRecordingFinished());
+        PG_CHECK(!controller.isRecording());
+        PG_CHECK(backend->getCallbackCount() == 0);
+    }
+
+    void testDestroyingWithQueuedStopFinishesTake()
+    {
+        const auto backend = installBackend();
+        const test::TemporaryDirectory directory("capture_controller_destroy");
+        TaskQueue queue;
+        {
+            CaptureController controller(queue.getDispatcher());
+            if (!PG_CHECK(controller.startRecording(directory.file("take.caf"), {}))) { return; }
+            PG_CHECK(waitForCallbacks(*backend, 5));
+            controller.stopRecording();
+        }
+        queue.pump(); // The queued stop must find the controller gone and do nothing.
+
+        PG_CHECK(backend->getTapCount() == 0);
+        std::vector<float> samples;
+        PG_CHECK(test::readCafFloats(directory.file("take.caf"), samples));
+        PG_CHECK(samples.size() >= 5 * kFramesPerBuffer * kChannelCount);
+    }
+} // namespace
+
+int main()
+{
+    testTakeSurvivesOverloadAndFormatChange();
+    testDeviceRemovalEndsTake();
+    testStartFailsWithoutTap();
+    testDestroyingWithQueuedStopFinishesTake();
+    return pg::audio_tap::test::finish();
+}
@@ -0,0 +1,193 @@
+// Simulates a process killed mid-take: a complete recording is cut at 200 byte offsets per
+// format and its header is left either as it was when the file was opened or as the finished
+// file has it. Recovery must keep exactly the whole frames before the cut, byte for byte, and
+// make the header agree with them.
+
+#include "CafFileWriter.h"
+#include "CaptureRecovery.h"
+#include "FlacFileWriter.h"
+#include "TestSupport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr double kSampleRate = 48000.0;
+    constexpr uint32_t kChannelCount = 2;
+    constexpr int kTruncationsPerFormat = 200;
+
+    auto writeFile(const std::string &path, const std::vector<uint8_t> &bytes) -> bool
+    {
+        std::FILE *file = std::fopen(path.c_str(), "wb");
+        if (!file) { return false; }
+        const bool written = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        return std::fclose(file) == 0 && written;
+    }
+
+    // A tone with a little noise, so FLAC frames differ in size.
+    auto makeSignal(size_t frameCount) -> std::vector<float>
+    {
+        std::minstd_rand random(7);
+        std::uniform_real_distribution<float> noise(-0.05f, 0.05f);
+        std::vector<float> samples(frameCount * kChannelCount);
+        for (size_t f = 0; f < frameCount; ++f) {
+            const float tone = 0.5f * static_cast<float>(std::sin(0.031 * static_cast<double>(f)));
+            for (uint32_t ch = 0; ch < kChannelCount; ++ch) {
+                samples[f * kChannelCount + ch] = tone + noise(random);
+            }
+        }
+        return samples;
+    }
+
+    // Cut offsets in [first, last]: just before, at and after every interesting boundary,
+    // then random ones up to `kTruncationsPerFormat` in total.
+    auto makeCuts(const std::vector<uint64_t> &boundaries, uint64_t first, uint64_t last)
+            -> std::vector<uint64_t>
+    {
+        std::vector<uint64_t> cuts;
+        for (const uint64_t boundary : boundaries) {
+            for (const uint64_t cut : {boundary - 1, boundary, boundary + 1}) {
+                if (cut >= first && cut <= last && cuts.size() < kTruncationsPerFormat / 2) {
+                    cuts.push_back(cut);
+                }
+            }
+        }
+        std::minstd_rand random(11);
+        std::uniform_int_distribution<uint64_t> offset(first, last);
+        while (cuts.size() < kTruncationsPerFormat) { cuts.push_back(offset(random)); }
+        return cuts;
+    }
+
+    void testCafTornTail()
+    {
+        const test::TemporaryDirectory directory("recovery_caf");
+        const std::string completePath = directory.file("complete.caf");
+        const std::string tornPath = directory.file("torn.caf");
+        const CaptureFormat format{kSampleRate, kChannelCount};
+        const uint64_t bytesPerFrame = kChannelCount * sizeof(float);
+
+        const std::vector<float> signal = makeSignal(20000);
+        {
+            auto writer = CafFileWriter::open(completePath, format);
+            if (!PG_CHECK(writer != nullptr)) { return; }
+            PG_CHECK(writer->write(signal.data(), signal.size() / kChannelCount));
+            PG_CHECK(writer->finalize());
+        }
+        const std::vector<uint8_t> complete = test::readFile(completePath);
+        const uint64_t audioStart = complete.size() - signal.size() * sizeof(float);
+        const uint64_t dataSizeOffset = audioStart - 4 - 8;
+
+        std::vector<uint64_t> boundaries;
+        for (uint64_t frame = 0; frame < 64; ++frame) {
+            boundaries.push_back(audioStart + frame * bytesPerFrame);
+        }
+        for (const uint64_t cut : makeCuts(boundaries, audioStart, complete.size())) {
+            std::vector<uint8_t> torn(complete.begin(), complete.begin() + cut);
+            if (cut % 2 == 0) {
+                // As opened: the data chunk runs to the end of the file.
+                std::fill(torn.begin() + dataSizeOffset, torn.begin() + dataSizeOffset + 8, 0xff);
+            }
+            if (!PG_CHECK(writeFile(tornPath, torn))) { return; }
+
+            const uint64_t expectedFrames = (cut - audioStart) / bytesPerFrame;
+            const RecoveryResult result = recoverCaptureFile(tornPath);
+            PG_CHECK(result.ok);
+            PG_CHECK(result.frameCount == expectedFrames);
+            PG_CHECK(result.discardedBytes == (cut - audioStart) % bytesPerFrame);
+
+            std::vector<float> samples;
+            PG_CHECK(test::readCafFloats(tornPath, samples));
+            PG_CHECK(samples.size() == expectedFrames * kChannelCount);
+            PG_CHECK(std::equal(samples.begin(), samples.end(), signal.begin()));
+
+            // A recovered file is well formed and needs nothing more.
+            const RecoveryResult again = recoverCaptureFile(tornPath);
+            PG_CHECK(again.ok && !again.repaired && again.frameCount == expectedFrames);
+        }
+    }
+
+    void testFlacTornTail()
+    {
+        const test::TemporaryDirectory directory("recovery_flac");
+        const std::string completePath = directory.file("complete.flac");
+        const std::string tornPath = directory.file("torn.flac");
+        const CaptureFormat format{kSampleRate, kChannelCount};
+        OutputFormat outputFormat;
+        outputFormat.fileType = FileType::Flac;
+        outputFormat.sampleFormat = SampleFormat::Int24;
+        constexpr size_t kBlockSize = 4096;
+
+        // A checkpoint after each block flushes exactly the frames encoded so far, so the file
+        // size then is the end of a frame.
+        const std::vector<float> signal = makeSignal(40 * kBlockSize + 1000);
+        std::vector<uint64_t> frameEnds;
+        {
+            auto writer = FlacFileWriter::open(completePath, format, outputFormat);
+            if (!PG_CHECK(writer != nullptr)) { return; }
+            PG_CHECK(writer->checkpoint());
+            frameEnds.push_back(std::filesystem::file_size(completePath));
+            for (size_t frame = 0; frame + kBlockSize <= signal.size() / kChannelCount;
+                 frame += kBlockSize) {
+                PG_CHECK(writer->write(signal.data() + frame * kChannelCount, kBlockSize));
+                PG_CHECK(writer->checkpoint());
+                frameEnds.push_back(std::filesystem::file_size(completePath));
+            }
+            const size_t written = (frameEnds.size() - 1) * kBlockSize;
+            PG_CHECK(writer->write(signal.data() + written * kChannelCount,
+                                   signal.size() / kChannelCount - written));
+            PG_CHECK(writer->finalize());
+        }
+        const std::vector<uint8_t> complete = test::readFile(completePath);
+        frameEnds.push_back(complete.size()); // The final short block.
+        const uint64_t audioStart = frameEnds.front();
+
+        for (const uint64_t cut : makeCuts(frameEnds, audioStart, complete.size())) {
+            std::vector<uint8_t> torn(complete.begin(), complete.begin() + cut);
+            if (cut % 2 == 0) {
+                // As opened: STREAMINFO claims no samples.
+                torn[21] &= 0xf0;
+                std::fill(torn.begin() + 22, torn.begin() + 26, 0);
+            }
+            if (!PG_CHECK(writeFile(tornPath, torn))) { return; }
+
+            const size_t wholeFrames =
+                    std::upper_bound(frameEnds.begin(), frameEnds.end(), cut) - frameEnds.begin() -
+                    1;
+            const uint64_t expectedEnd = frameEnds[wholeFrames];
+            const uint64_t expectedFrames =
+                    wholeFrames == frameEnds.size() - 1
+                            ? signal.size() / kChannelCount
+                            : static_cast<uint64_t>(wholeFrames) * kBlockSize;
+
+            const RecoveryResult result = recoverCaptureFile(tornPath);
+            PG_CHECK(result.ok);
+            PG_CHECK(result.frameCount == expectedFrames);
+            PG_CHECK(result.discardedBytes == cut - expectedEnd);
+
+            // The audio is untouched and only STREAMINFO (bytes 8 to 42) may differ.
+            const std::vector<uint8_t> recovered = test::readFile(tornPath);
+            PG_CHECK(recovered.size() == expectedEnd);
+            PG_CHECK(std::equal(recovered.begin() + 42, recovered.end(), complete.begin() + 42));
+            const uint64_t total = (static_cast<uint64_t>(recovered[21] & 0x0f) << 32) |
+                                   test::readBigEndian(recovered.data() + 22, 4);
+            PG_CHECK(total == expectedFrames);
+
+            const RecoveryResult again = recoverCaptureFile(tornPath);
+            PG_CHECK(again.ok && !again.repaired && again.frameCount == expectedFrames);
+        }
+    }
+} // namespace
+
+int main()
+{
+    testCafTornTail();
+    testFlacTornTail();
+    return pg::audio_tap::test::finish();
+}
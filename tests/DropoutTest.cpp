@@ -0,0 +1,198 @@
+// Checks dropout detection from device sample times, the dropout log and its file format, and
+// how `AudioDataHandler` fills gaps: at most a second of silence, with the rest of a longer gap
+// logged as unfilled.
+
+#include "AudioDataHandler.h"
+#include "DropoutDetector.h"
+#include "DropoutLog.h"
+#include "TestSupport.h"
+
+#include <fstream>
+#include <memory>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr double kSampleRate = 48000.0;
+
+    void testDetectorFindsGapsAndOverlaps()
+    {
+        DropoutDetector detector;
+        PG_CHECK(detector.process(1000.0, 512) == 0); // The first callback sets the reference.
+        PG_CHECK(detector.process(1512.0, 512) == 0);
+        PG_CHECK(detector.process(2124.0, 512) == 100);
+        PG_CHECK(detector.process(2586.0, 512) == -50);
+        PG_CHECK(detector.process(3098.0, 512) == 0);
+
+        PG_CHECK(detector.getGapCount() == 1);
+        PG_CHECK(detector.getOverlapCount() == 1);
+        PG_CHECK(detector.getMissingFrameCount() == 100);
+        PG_CHECK(detector.getRepeatedFrameCount() == 50);
+    }
+
+    void testDetectorIgnoresJumpsWithinTolerance()
+    {
+        DropoutDetector detector;
+        detector.process(0.0, 512);
+        PG_CHECK(detector.process(512.4, 512) == 0);
+        PG_CHECK(detector.process(1024.0, 512) == 0);
+        PG_CHECK(detector.getGapCount() == 0);
+        PG_CHECK(detector.getOverlapCount() == 0);
+
+        DropoutDetector loose(4.0);
+        loose.process(0.0, 512);
+        PG_CHECK(loose.process(515.0, 512) == 0);
+        PG_CHECK(loose.process(1032.0, 512) == 5);
+    }
+
+    void testDetectorResetForgetsPreviousCallback()
+    {
+        DropoutDetector detector;
+        detector.process(0.0, 512);
+        detector.reset();
+        // The device restarted its clock: not a dropout.
+        PG_CHECK(detector.process(0.0, 512) == 0);
+        PG_CHECK(detector.process(512.0, 512) == 0);
+        PG_CHECK(detector.getGapCount() == 0);
+        PG_CHECK(detector.getOverlapCount() == 0);
+    }
+
+    void testLogMergesOverflowsAndRoundTrips()
+    {
+        DropoutLog log(kSampleRate, 16);
+        log.report({Dropout::Kind::Gap, 4800, 96000, 48000});
+        log.report({Dropout::Kind::Overflow, 9600, 512});
+        log.report({Dropout::Kind::Overflow, 9600, 512}); // Same place: one dropout.
+        log.report({Dropout::Kind::Overlap, 20000, 64});
+        log.collect();
+
+        PG_CHECK(log.getDropoutCount() == 3);
+        PG_CHECK(log.getCount(Dropout::Kind::Overflow) == 2);
+        PG_CHECK(log.getFrameCount(Dropout::Kind::Overflow) == 1024);
+        PG_CHECK(log.getFrameCount(Dropout::Kind::Gap) == 96000);
+
+        const test::TemporaryDirectory directory("dropout_log");
+        const std::string path = directory.file("take.dropouts");
+        PG_CHECK(log.save(path));
+        const auto loaded = DropoutLog::load(path);
+        if (!PG_CHECK(loaded != nullptr)) { return; }
+
+        PG_CHECK(loaded->getSampleRate() == kSampleRate);
+        const std::vector<Dropout> expected = log.getDropouts();
+        const std::vector<Dropout> actual = loaded->getDropouts();
+        if (!PG_CHECK(actual.size() == expected.size())) { return; }
+        for (size_t i = 0; i < actual.size(); ++i) {
+            PG_CHECK(actual[i].kind == expected[i].kind);
+            PG_CHECK(actual[i].frame == expected[i].frame);
+            PG_CHECK(actual[i].frameCount == expected[i].frameCount);
+            PG_CHECK(actual[i].unfilledFrameCount == expected[i].unfilledFrameCount);
+        }
+    }
+
+    void testLogLoadsVersionOne()
+    {
+        const test::TemporaryDirectory directory("dropout_log_v1");
+        const std::string path = directory.file("take.dropouts");
+        {
+            std::ofstream file(path);
+            file << "# audio capture dropout log v1\nsample_rate 48000\ndropouts 2\n"
+                    "gap 100 480\noverflow 200 512\n";
+        }
+        const auto loaded = DropoutLog::load(path);
+        if (!PG_CHECK(loaded != nullptr)) { return; }
+        const std::vector<Dropout> dropouts = loaded->getDropouts();
+        if (!PG_CHECK(dropouts.size() == 2)) { return; }
+        PG_CHECK(dropouts[0].kind == Dropout::Kind::Gap);
+        PG_CHECK(dropouts[0].unfilledFrameCount == 480);
+        PG_CHECK(dropouts[1].kind == Dropout::Kind::Overflow);
+        PG_CHECK(dropouts[1].unfilledFrameCount == 0);
+    }
+
+    // Keeps everything written to it.
+    class CapturingSink : public SampleSink
+    {
+    public:
+        explicit CapturingSink(std::vector<float> &samples) : samples_(samples) {}
+
+        auto write(const float *interleaved, size_t frameCount) -> bool override
+        {
+            samples_.insert(samples_.end(), interleaved, interleaved + frameCount);
+            return true;
+        }
+        auto finalize() -> bool override { return true; }
+
+    private:
+        std::vector<float> &samples_;
+    };
+
+    void testHandlerFillsAtMostASecondPerGap()
+    {
+        AudioStreamBasicDescription format{};
+        format.mSampleRate = kSampleRate;
+        format.mFormatID = kAudioFormatLinearPCM;
+        format.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked;
+        format.mChannelsPerFrame = 1;
+        format.mBitsPerChannel = 32;
+
+        std::vector<float> samples;
+        AudioDataHandler::BufferOptions options;
+        // The producer only writes to prefaulted pages, so the whole test must fit.
+        options.durationInSeconds = 2;
+        options.prefaultedSeconds = 2;
+        auto handler = std::make_unique<AudioDataHandler>(
+                format, std::make_unique<CapturingSink>(samples), options);
+        const auto log = std::make_shared<DropoutLog>(kSampleRate);
+        handler->setDropoutLog(log, true);
+        PG_CHECK(handler->start());
+
+        constexpr UInt32 kFrames = 512;
+        std::vector<float> block(kFrames, 1.0f);
+        AudioBufferList list{};
+        list.mNumberBuffers = 1;
+        list.mBuffers[0].mNumberChannels = 1;
+        list.mBuffers[0].mDataByteSize = kFrames * sizeof(float);
+        list.mBuffers[0].mData = block.data();
+
+        AudioTimeStamp time{};
+        time.mFlags = kAudioTimeStampSampleTimeValid;
+        const auto deliver = [&](double sampleTime)
+        {
+            time.mSampleTime = sampleTime;
+            handler->process(&list, &time);
+        };
+
+        // A short gap is filled completely; a long one up to a second.
+        deliver(0.0);
+        deliver(kFrames + 100.0);
+        const double longGapStart = 2.0 * kFrames + 100.0;
+        deliver(longGapStart + 2.0 * kSampleRate);
+        PG_CHECK(handler->finish());
+        log->collect();
+
+        const size_t expectedFrames = 3 * kFrames + 100 + static_cast<size_t>(kSampleRate);
+        PG_CHECK(samples.size() == expectedFrames);
+
+        const std::vector<Dropout> dropouts = log->getDropouts();
+        if (!PG_CHECK(dropouts.size() == 2)) { return; }
+        PG_CHECK(dropouts[0].kind == Dropout::Kind::Gap);
+        PG_CHECK(dropouts[0].frame == kFrames);
+        PG_CHECK(dropouts[0].frameCount == 100);
+        PG_CHECK(dropouts[0].unfilledFrameCount == 0);
+        PG_CHECK(dropouts[1].kind == Dropout::Kind::Gap);
+        PG_CHECK(dropouts[1].frame == 2 * kFrames + 100);
+        PG_CHECK(dropouts[1].frameCount == static_cast<uint64_t>(2.0 * kSampleRate));
+        PG_CHECK(dropouts[1].unfilledFrameCount == static_cast<uint64_t>(kSampleRate));
+    }
+} // namespace
+
+int main()
+{
+    testDetectorFindsGapsAndOverlaps();
+    testDetectorIgnoresJumpsWithinTolerance();
+    testDetectorResetForgetsPreviousCallback();
+    testLogMergesOverflowsAndRoundTrips();
+    testLogLoadsVersionOne();
+    testHandlerFillsAtMostASecondPerGap();
+    return pg::audio_tap::test::finish();
+}
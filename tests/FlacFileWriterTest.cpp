@@ -0,0 +1,420 @@
+// Decodes what `FlacFileWriter` writes and compares it with the quantised input: STREAMINFO
+// totals and frame size bounds, every frame's header CRC-8 and CRC-16, sequential frame
+// numbers, and the samples themselves through each subframe type and stereo decorrelation mode.
+// The decoder here covers the subset of FLAC the writer emits.
+
+#include "FlacCrc.h"
+#include "FlacFileWriter.h"
+#include "SampleConversion.h"
+#include "TestSupport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr double kTwoPi = 6.283185307179586;
+    constexpr size_t kBlockSize = 4096;
+
+    class BitReader
+    {
+    public:
+        BitReader(const std::vector<uint8_t> &bytes, size_t offset)
+          : bytes_(bytes), position_(offset * 8)
+        {
+        }
+
+        auto read(uint32_t bitCount) -> uint64_t
+        {
+            uint64_t value = 0;
+            for (uint32_t i = 0; i < bitCount; ++i) {
+                if (position_ >= bytes_.size() * 8) {
+                    overrun_ = true;
+                    return 0;
+                }
+                const uint8_t byte = bytes_[position_ / 8];
+                value = (value << 1) | ((byte >> (7 - position_ % 8)) & 1);
+                ++position_;
+            }
+            return value;
+        }
+
+        auto readSigned(uint32_t bitCount) -> int64_t
+        {
+            const uint64_t value = read(bitCount);
+            const uint64_t sign = uint64_t(1) << (bitCount - 1);
+            return static_cast<int64_t>(value ^ sign) - static_cast<int64_t>(sign);
+        }
+
+        auto readRice(uint32_t parameter) -> int32_t
+        {
+            uint64_t quotient = 0;
+            while (!overrun_ && read(1) == 0) { ++quotient; }
+            const uint64_t value = (quotient << parameter) | read(parameter);
+            return static_cast<int32_t>((value >> 1) ^ (~(value & 1) + 1));
+        }
+
+        void alignToByte() { position_ = (position_ + 7) / 8 * 8; }
+        auto getByteOffset() const -> size_t { return position_ / 8; }
+        auto hasOverrun() const -> bool { return overrun_; }
+
+    private:
+        const std::vector<uint8_t> &bytes_;
+        size_t position_;
+        bool overrun_{false};
+    };
+
+    struct DecodedStream
+    {
+        uint32_t minBlockSize{0};
+        uint32_t maxBlockSize{0};
+        uint32_t minFrameBytes{0};
+        uint32_t maxFrameBytes{0};
+        uint32_t sampleRate{0};
+        uint32_t channelCount{0};
+        uint32_t bitsPerSample{0};
+        uint64_t totalFrames{0};
+
+        std::vector<int32_t> samples; // Interleaved.
+        std::vector<uint32_t> frameBytes;
+        std::set<uint32_t> channelAssignments;
+        std::set<uint32_t> subframeTypes; // 0 constant, 1 verbatim, 8 + order fixed.
+    };
+
+    auto decodeSubframe(BitReader &reader, uint32_t bitsPerSample, size_t blockSize,
+                        std::vector<int64_t> &out, std::set<uint32_t> &types) -> bool
+    {
+        if (reader.read(1) != 0) { return false; }
+        const auto type = static_cast<uint32_t>(reader.read(6));
+        if (reader.read(1) != 0) { return false; } // The writer never uses wasted bits.
+        types.insert(type);
+
+        out.assign(blockSize, 0);
+        if (type == 0) {
+            const int64_t value = reader.readSigned(bitsPerSample);
+            std::fill(out.begin(), out.end(), value);
+            return true;
+        }
+        if (type == 1) {
+            for (auto &sample : out) { sample = reader.readSigned(bitsPerSample); }
+            return true;
+        }
+        if (type < 8 || type > 12) { return false; }
+
+        const uint32_t order = type - 8;
+        for (uint32_t i = 0; i < order; ++i) { out[i] = reader.readSigned(bitsPerSample); }
+
+        const auto method = reader.read(2);
+        if (method > 1) { return false; }
+        const uint32_t parameterBits = method == 0 ? 4 : 5;
+        const auto partitionOrder = static_cast<uint32_t>(reader.read(4));
+        const size_t partitions = size_t(1) << partitionOrder;
+        size_t index = order;
+        for (size_t p = 0; p < partitions; ++p) {
+            const auto parameter = static_cast<uint32_t>(reader.read(parameterBits));
+            if (parameter == (1u << parameterBits) - 1) { return false; } // Escape: unused.
+            const size_t count = (blockSize >> partitionOrder) - (p == 0 ? order : 0);
+            for (size_t i = 0; i < count; ++i) { out[index++] = reader.readRice(parameter); }
+        }
+
+        static const int64_t kCoefficients[5][4] = {
+                {0, 0, 0, 0}, {1, 0, 0, 0}, {2, -1, 0, 0}, {3, -3, 1, 0}, {4, -6, 4, -1}};
+        for (size_t i = order; i < blockSize; ++i) {
+            int64_t prediction = 0;
+            for (uint32_t k = 0; k < order; ++k) {
+                prediction += kCoefficients[order][k] * out[i - 1 - k];
+            }
+            out[i] += prediction;
+        }
+        return !reader.hasOverrun();
+    }
+
+    auto decodeFrame(const std::vector<uint8_t> &bytes, size_t &offset, uint64_t frameNumber,
+                     DecodedStream &stream) -> bool
+    {
+        const size_t start = offset;
+        BitReader reader(bytes, offset);
+        if (!PG_CHECK(reader.read(16) == 0xfff8)) { return false; }
+
+        const auto blockSizeCode = reader.read(4);
+        PG_CHECK(reader.read(4) == 0); // Sample rate from STREAMINFO.
+        const auto assignment = static_cast<uint32_t>(reader.read(4));
+        const auto sampleSizeCode = reader.read(3);
+        PG_CHECK(reader.read(1) == 0);
+        PG_CHECK(sampleSizeCode == (stream.bitsPerSample == 16 ? 4u : 6u));
+
+        uint64_t number = reader.read(8);
+        if (number >= 0x80) {
+            uint32_t extraBytes = 0;
+            for (uint64_t mask = 0x40; (number & mask) != 0; mask >>= 1) { ++extraBytes; }
+            number &= (0x3fu >> extraBytes);
+            for (uint32_t i = 0; i < extraBytes; ++i) {
+                number = (number << 6) | (reader.read(8) & 0x3f);
+            }
+        }
+        PG_CHECK(number == frameNumber);
+
+        size_t blockSize = 0;
+        if (blockSizeCode == 12) {
+            blockSize = kBlockSize;
+        } else if (PG_CHECK(blockSizeCode == 7)) {
+            blockSize = static_cast<size_t>(reader.read(16)) + 1;
+        } else {
+            return false;
+        }
+
+        const size_t headerEnd = reader.getByteOffset();
+        const auto headerCrc = static_cast<uint8_t>(reader.read(8));
+        if (!PG_CHECK(headerCrc == flac::crc8(bytes.data() + start, headerEnd - start))) {
+            return false;
+        }
+
+        const uint32_t channels = assignment < 8 ? assignment + 1 : 2;
+        if (!PG_CHECK(channels == stream.channelCount)) { return false; }
+        stream.channelAssignments.insert(assignment);
+
+        std::vector<std::vector<int64_t>> planes(channels);
+        for (uint32_t ch = 0; ch < channels; ++ch) {
+            const bool isSide = (assignment == 8 && ch == 1) || (assignment == 9 && ch == 0) ||
+                                (assignment == 10 && ch == 1);
+            if (!PG_CHECK(decodeSubframe(reader, stream.bitsPerSample + (isSide ? 1 : 0),
+                                         blockSize, planes[ch], stream.subframeTypes))) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < blockSize; ++i) {
+            int64_t left = planes[0][i];
+            int64_t right = channels > 1 ? planes[1][i] : 0;
+            if (assignment == 8) {
+                right = left - right;
+            } else if (assignment == 9) {
+                left = left + right;
+            } else if (assignment == 10) {
+                const int64_t mid = (planes[0][i] * 2) | (planes[1][i] & 1);
+                left = (mid + planes[1][i]) >> 1;
+                right = (mid - planes[1][i]) >> 1;
+            }
+            for (uint32_t ch = 0; ch < channels; ++ch) {
+                const int64_t value = ch == 0 ? left : ch == 1 ? right : planes[ch][i];
+                stream.samples.push_back(static_cast<int32_t>(value));
+            }
+        }
+
+        reader.alignToByte();
+        const size_t bodyEnd = reader.getByteOffset();
+        const auto frameCrc = static_cast<uint16_t>(reader.read(16));
+        if (!PG_CHECK(!reader.hasOverrun())) { return false; }
+        if (!PG_CHECK(frameCrc == flac::crc16(bytes.data() + start, bodyEnd - start))) {
+            return false;
+        }
+
+        offset = reader.getByteOffset();
+        stream.frameBytes.push_back(static_cast<uint32_t>(offset - start));
+        return true;
+    }
+
+    auto decodeFile(const std::string &path, DecodedStream &stream) -> bool
+    {
+        const std::vector<uint8_t> bytes = test::readFile(path);
+        if (!PG_CHECK(bytes.size() >= 42)) { return false; }
+        if (!PG_CHECK(std::memcmp(bytes.data(), "fLaC", 4) == 0)) { return false; }
+        // STREAMINFO, flagged as the last metadata block.
+        if (!PG_CHECK(bytes[4] == 0x80 && test::readBigEndian(bytes.data() + 5, 3) == 34)) {
+            return false;
+        }
+
+        BitReader info(bytes, 8);
+        stream.minBlockSize = static_cast<uint32_t>(info.read(16));
+        stream.maxBlockSize = static_cast<uint32_t>(info.read(16));
+        stream.minFrameBytes = static_cast<uint32_t>(info.read(24));
+        stream.maxFrameBytes = static_cast<uint32_t>(info.read(24));
+        stream.sampleRate = static_cast<uint32_t>(info.read(20));
+        stream.channelCount = static_cast<uint32_t>(info.read(3)) + 1;
+        stream.bitsPerSample = static_cast<uint32_t>(info.read(5)) + 1;
+        stream.totalFrames = info.read(36);
+
+        size_t offset = 42;
+        for (uint64_t frameNumber = 0; offset < bytes.size(); ++frameNumber) {
+            if (!decodeFrame(bytes, offset, frameNumber, stream)) { return false; }
+        }
+        return true;
+    }
+
+    auto quantize(const std::vector<float> &samples, uint32_t bitsPerSample)
+            -> std::vector<int32_t>
+    {
+        std::vector<int32_t> quantized(samples.size());
+        kernels::floatToInt32(samples.data(), nullptr, samples.size(), bitsPerSample,
+                              quantized.data());
+        return quantized;
+    }
+
+    // Writes `samples` in uneven chunks, so blocks fill across calls.
+    auto writeFlac(const std::string &path, const CaptureFormat &format, SampleFormat sampleFormat,
+                   const std::vector<float> &samples) -> bool
+    {
+        OutputFormat outputFormat;
+        outputFormat.fileType = FileType::Flac;
+        outputFormat.sampleFormat = sampleFormat;
+        outputFormat.dither = false; // Keeps the quantised samples predictable.
+        auto writer = FlacFileWriter::open(path, format, outputFormat);
+        if (!PG_CHECK(writer != nullptr)) { return false; }
+
+        const size_t frameCount = samples.size() / format.channelCount;
+        size_t written = 0;
+        for (size_t chunk = 1; written < frameCount; chunk = chunk * 7 % 3001 + 1) {
+            const size_t frames = std::min(chunk, frameCount - written);
+            if (!PG_CHECK(writer->write(samples.data() + written * format.channelCount, frames))) {
+                return false;
+            }
+            written += frames;
+        }
+        const bool finalized = PG_CHECK(writer->finalize());
+        PG_CHECK(writer->getFramesWritten() == frameCount); // Includes the final short block.
+        return finalized;
+    }
+
+    void checkStreamInfo(const DecodedStream &stream, const CaptureFormat &format,
+                         uint32_t bitsPerSample, size_t frameCount)
+    {
+        PG_CHECK(stream.minBlockSize == kBlockSize);
+        PG_CHECK(stream.maxBlockSize == kBlockSize);
+        PG_CHECK(stream.sampleRate == static_cast<uint32_t>(format.sampleRate));
+        PG_CHECK(stream.channelCount == format.channelCount);
+        PG_CHECK(stream.bitsPerSample == bitsPerSample);
+        PG_CHECK(stream.totalFrames == frameCount);
+        PG_CHECK(stream.frameBytes.size() == (frameCount + kBlockSize - 1) / kBlockSize);
+        if (!stream.frameBytes.empty()) {
+            PG_CHECK(stream.minFrameBytes ==
+                     *std::min_element(stream.frameBytes.begin(), stream.frameBytes.end()));
+            PG_CHECK(stream.maxFrameBytes ==
+                     *std::max_element(stream.frameBytes.begin(), stream.frameBytes.end()));
+        }
+    }
+
+    void testCrcMatchesStandardCheckValues()
+    {
+        const auto *check = reinterpret_cast<const uint8_t *>("123456789");
+        PG_CHECK(flac::crc8(check, 9) == 0xf4);
+        PG_CHECK(flac::crc16(check, 9) == 0xfee8);
+    }
+
+    void testStereoRoundTrips()
+    {
+        // One block each of identical, opposite and unrelated channels, then a short noisy one.
+        const CaptureFormat format{48000.0, 2};
+        const size_t frameCount = 3 * kBlockSize + 1000;
+        std::vector<float> samples(frameCount * 2);
+        std::mt19937 random(7);
+        std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+        for (size_t i = 0; i < frameCount; ++i) {
+            const auto t = static_cast<double>(i) / format.sampleRate;
+            const auto tone = static_cast<float>(0.5 * std::sin(kTwoPi * 440.0 * t));
+            const auto other = static_cast<float>(0.3 * std::sin(kTwoPi * 1234.5 * t));
+            float left = tone;
+            float right = tone;
+            if (i >= kBlockSize) { right = -tone; }
+            if (i >= 2 * kBlockSize) { right = other; }
+            if (i >= 3 * kBlockSize) {
+                left = noise(random);
+                right = noise(random);
+            }
+            samples[2 * i] = left;
+            samples[2 * i + 1] = right;
+        }
+
+        const test::TemporaryDirectory directory("flac_stereo");
+        const std::string path = directory.file("take.flac");
+        if (!writeFlac(path, format, SampleFormat::Int24, samples)) { return; }
+
+        DecodedStream stream;
+        if (!decodeFile(path, stream)) { return; }
+        checkStreamInfo(stream, format, 24, frameCount);
+        PG_CHECK(stream.samples == quantize(samples, 24));
+        // Identical channels leave a zero side channel, which one of the side modes encodes.
+        PG_CHECK(stream.channelAssignments.size() > 1);
+        PG_CHECK(*stream.channelAssignments.rbegin() >= 8);
+        PG_CHECK(stream.subframeTypes.count(0) == 1);
+    }
+
+    void testMono16BitRoundTrips()
+    {
+        // Silence, a clipped square wave and full-scale noise: constant, fixed and verbatim.
+        const CaptureFormat format{44100.0, 1};
+        const size_t frameCount = 4 * kBlockSize - 17;
+        std::vector<float> samples(frameCount);
+        std::mt19937 random(11);
+        std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+        for (size_t i = 0; i < frameCount; ++i) {
+            if (i < kBlockSize) {
+                samples[i] = 0.0f;
+            } else if (i < 2 * kBlockSize) {
+                samples[i] = (i / 50) % 2 == 0 ? 1.5f : -1.5f;
+            } else {
+                samples[i] = noise(random);
+            }
+        }
+
+        const test::TemporaryDirectory directory("flac_mono");
+        const std::string path = directory.file("take.flac");
+        if (!writeFlac(path, format, SampleFormat::Int16, samples)) { return; }
+
+        DecodedStream stream;
+        if (!decodeFile(path, stream)) { return; }
+        checkStreamInfo(stream, format, 16, frameCount);
+        PG_CHECK(stream.samples == quantize(samples, 16));
+        PG_CHECK(stream.channelAssignments == std::set<uint32_t>{0});
+        PG_CHECK(stream.subframeTypes.count(0) == 1);
+        PG_CHECK(stream.subframeTypes.count(1) == 1);
+    }
+
+    void testMultichannelRoundTrips()
+    {
+        const CaptureFormat format{96000.0, 6};
+        const size_t frameCount = kBlockSize + 5;
+        std::vector<float> samples(frameCount * format.channelCount);
+        for (size_t i = 0; i < samples.size(); ++i) {
+            const auto channel = static_cast<double>(i % format.channelCount);
+            samples[i] = static_cast<float>(
+                    0.1 * (channel + 1) * std::sin(0.001 * (channel + 1) * static_cast<double>(i)));
+        }
+
+        const test::TemporaryDirectory directory("flac_multichannel");
+        const std::string path = directory.file("take.flac");
+        if (!writeFlac(path, format, SampleFormat::Float32, samples)) { return; }
+
+        DecodedStream stream;
+        if (!decodeFile(path, stream)) { return; }
+        checkStreamInfo(stream, format, 24, frameCount); // Float32 is stored as 24-bit.
+        PG_CHECK(stream.samples == quantize(samples, 24));
+        PG_CHECK(stream.channelAssignments == std::set<uint32_t>{5});
+    }
+
+    void testEmptyStreamIsValid()
+    {
+        const CaptureFormat format{48000.0, 2};
+        const test::TemporaryDirectory directory("flac_empty");
+        const std::string path = directory.file("take.flac");
+        if (!writeFlac(path, format, SampleFormat::Int24, {})) { return; }
+
+        DecodedStream stream;
+        if (!decodeFile(path, stream)) { return; }
+        checkStreamInfo(stream, format, 24, 0);
+        PG_CHECK(stream.samples.empty());
+    }
+} // namespace
+
+int main()
+{
+    testCrcMatchesStandardCheckValues();
+    testStereoRoundTrips();
+    testMono16BitRoundTrips();
+    testMultichannelRoundTrips();
+    testEmptyStreamIsValid();
+    return pg::audio_tap::test::finish();
+}
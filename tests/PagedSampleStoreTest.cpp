@@ -0,0 +1,114 @@
+// Checks that `PagedSampleStore` keeps the producer off first-touch page faults: the prefaulted
+// pages are resident before anything is written, a producer that outruns the consumer takes no
+// faults while `preparePages()` keeps up, and everything it wrote comes back in order. Also
+// checks that a store whose memory cannot be reserved refuses writes, and that `CaptureWriter`
+// will not start on one.
+
+#include "CaptureWriter.h"
+#include "PagedSampleStore.h"
+#include "RealtimeMemoryPool.h"
+#include "TestSupport.h"
+
+#include <memory>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr size_t kChannelCount = 2;
+    constexpr size_t kSamplesPerPage = 4096 * kChannelCount;
+    constexpr size_t kBlockSamples = 512 * kChannelCount;
+
+    auto getPageBytes() -> size_t
+    {
+        const size_t pageSize = RealtimeMemoryPool::getSystemPageSize();
+        return (kSamplesPerPage * sizeof(float) + pageSize - 1) / pageSize * pageSize;
+    }
+
+    void testPrefaultedPagesAreResident()
+    {
+        constexpr size_t kPagesAhead = 3;
+        PagedSampleStore store(kSamplesPerPage, 32, kPagesAhead, false);
+        if (!PG_CHECK(store.isValid())) { return; }
+        PG_CHECK(store.getResidentBytes() >= kPagesAhead * getPageBytes());
+
+        // Once a page is queued, topping up prefaults one more to keep the reserve.
+        const std::vector<float> block(kSamplesPerPage, 0.5f);
+        PG_CHECK(store.write(block.data(), block.size()));
+        PG_CHECK(store.preparePages());
+        PG_CHECK(store.getResidentBytes() >= (kPagesAhead + 1) * getPageBytes());
+    }
+
+    // The producer writes six pages' worth of blocks without the consumer reading any, while the
+    // consumer prepares pages between blocks as the writer thread would.
+    void testProducerTakesNoFaults()
+    {
+        constexpr size_t kPageCount = 16;
+        constexpr size_t kBacklogPages = 6;
+        PagedSampleStore store(kSamplesPerPage, kPageCount, 2, false);
+        if (!PG_CHECK(store.isValid())) { return; }
+
+        const size_t blockCount = kBacklogPages * kSamplesPerPage / kBlockSamples + 3;
+        std::vector<float> samples(blockCount * kBlockSamples);
+        for (size_t i = 0; i < samples.size(); ++i) { samples[i] = static_cast<float>(i); }
+
+        PageFaultCounter faults;
+        faults.setEnabled(true);
+        bool written = true;
+        for (size_t block = 0; block < blockCount; ++block) {
+            faults.begin();
+            written = store.write(samples.data() + block * kBlockSamples, kBlockSamples) &&
+                      written;
+            faults.end();
+            store.preparePages();
+        }
+        PG_CHECK(written);
+        PG_CHECK(faults.getFaultCount() == 0);
+        PG_CHECK(store.getPeakPagesInUse() > kBacklogPages);
+        PG_CHECK(store.getResidentBytes() >= (kBacklogPages + 1) * getPageBytes());
+
+        std::vector<float> read;
+        const size_t readCount = store.readAll([&](const float *page, size_t count)
+                                               { read.insert(read.end(), page, page + count); });
+        PG_CHECK(readCount == samples.size());
+        PG_CHECK(read == samples);
+    }
+
+    class DiscardingSink : public SampleSink
+    {
+    public:
+        auto write(const float *, size_t) -> bool override { return true; }
+        auto finalize() -> bool override { return true; }
+    };
+
+    void testUnreservableStoreIsRejected()
+    {
+        // Far more address space than any process has: 4 TiB pages, 256 TiB in all.
+        const size_t hugePage = size_t{1} << 40;
+        PagedSampleStore store(hugePage, 64, 1, false);
+        PG_CHECK(!store.isValid());
+        PG_CHECK(store.getResidentBytes() == 0);
+        const float sample = 0.0f;
+        PG_CHECK(!store.write(&sample, 1));
+        PG_CHECK(!store.preparePages());
+
+        CaptureWriter::BufferOptions options;
+        options.capacityInFrames = 64 * 4096;
+        CaptureWriter writer(1u << 28, options, std::make_unique<DiscardingSink>());
+        PG_CHECK(!writer.start());
+        PG_CHECK(!writer.push(&sample, 1));
+        PG_CHECK(writer.getDroppedSampleCount() == 1);
+
+        CaptureWriter usable(2, options, std::make_unique<DiscardingSink>());
+        PG_CHECK(usable.start());
+        PG_CHECK(usable.stop());
+    }
+} // namespace
+
+int main()
+{
+    testPrefaultedPagesAreResident();
+    testProducerTakesNoFaults();
+    testUnreservableStoreIsRejected();
+    return pg::audio_tap::test::finish();
+}
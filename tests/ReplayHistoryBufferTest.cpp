@@ -0,0 +1,187 @@
+// Checks `ReplayHistoryBuffer` reads across the wrap point and at the edges of the history, and
+// that concurrent readers never accept a torn copy: a writer thread streams frames whose samples
+// encode their own position, wrapping the history many times over, while readers copy the
+// oldest frames (which the writer is about to overwrite) and take snapshots. Every read that
+// reports success must hold exactly the frames it asked for, and reads the writer lapped must be
+// reported as failed.
+
+#include "ReplayHistoryBuffer.h"
+#include "TestSupport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr uint32_t kChannelCount = 2;
+
+    // Exact in a float for the first 2^24 samples, then repeating.
+    auto getSampleValue(uint64_t frame, uint32_t channel) -> float
+    {
+        return static_cast<float>((frame * kChannelCount + channel) % (uint64_t{1} << 24));
+    }
+
+    void fill(std::vector<float> &block, uint64_t firstFrame)
+    {
+        const size_t frameCount = block.size() / kChannelCount;
+        for (size_t f = 0; f < frameCount; ++f) {
+            for (uint32_t ch = 0; ch < kChannelCount; ++ch) {
+                block[f * kChannelCount + ch] = getSampleValue(firstFrame + f, ch);
+            }
+        }
+    }
+
+    // Index of the first sample of `samples` that is not frame `firstFrame` onwards, or
+    // `samples.size()` if they all are.
+    auto findMismatch(const float *samples, size_t frameCount, uint64_t firstFrame) -> size_t
+    {
+        for (size_t f = 0; f < frameCount; ++f) {
+            for (uint32_t ch = 0; ch < kChannelCount; ++ch) {
+                if (samples[f * kChannelCount + ch] != getSampleValue(firstFrame + f, ch)) {
+                    return f * kChannelCount + ch;
+                }
+            }
+        }
+        return frameCount * kChannelCount;
+    }
+
+    // Checks that snapshots are contiguous runs of frames.
+    class CheckingSink : public SampleSink
+    {
+    public:
+        auto write(const float *interleaved, size_t frameCount) -> bool override
+        {
+            if (frameCount == 0) { return true; }
+            if (frames_ == 0) {
+                firstFrame_ = static_cast<uint64_t>(interleaved[0]) / kChannelCount;
+            }
+            if (findMismatch(interleaved, frameCount, firstFrame_ + frames_) !=
+                frameCount * kChannelCount) {
+                torn_ = true;
+            }
+            frames_ += frameCount;
+            return true;
+        }
+        auto finalize() -> bool override { return true; }
+
+        auto isTorn() const -> bool { return torn_; }
+        auto getFrameCount() const -> uint64_t { return frames_; }
+
+    private:
+        uint64_t firstFrame_{0};
+        uint64_t frames_{0};
+        bool torn_{false};
+    };
+
+    void testReadsAroundWrap()
+    {
+        constexpr size_t kCapacity = 1000;
+        ReplayHistoryBuffer history(kChannelCount, kCapacity);
+        std::vector<float> out(kCapacity * kChannelCount);
+        PG_CHECK(!history.read(0, out.data(), 1)); // Not written yet.
+
+        // 2.5 capacities in blocks that do not divide it, so blocks straddle the wrap point.
+        std::vector<float> block(300 * kChannelCount);
+        uint64_t written = 0;
+        while (written < 2500) {
+            fill(block, written);
+            history.write(block.data(), block.size());
+            written += block.size() / kChannelCount;
+        }
+        PG_CHECK(history.getTotalFramesWritten() == written);
+
+        const uint64_t oldest = written - kCapacity;
+        PG_CHECK(history.read(oldest, out.data(), kCapacity));
+        PG_CHECK(findMismatch(out.data(), kCapacity, oldest) == kCapacity * kChannelCount);
+
+        const uint64_t acrossWrap = written - written % kCapacity - 50;
+        PG_CHECK(history.read(acrossWrap, out.data(), 100));
+        PG_CHECK(findMismatch(out.data(), 100, acrossWrap) == 100 * kChannelCount);
+
+        PG_CHECK(!history.read(oldest - 1, out.data(), 10));  // Partly overwritten.
+        PG_CHECK(!history.read(written - 5, out.data(), 10)); // Partly not written yet.
+        PG_CHECK(!history.read(oldest, out.data(), kCapacity + 1));
+
+        // A block longer than the history keeps only its newest frames.
+        std::vector<float> oversized((kCapacity + 234) * kChannelCount);
+        fill(oversized, written);
+        history.write(oversized.data(), oversized.size());
+        written += kCapacity + 234;
+        PG_CHECK(history.getTotalFramesWritten() == written);
+        PG_CHECK(history.read(written - kCapacity, out.data(), kCapacity));
+        PG_CHECK(findMismatch(out.data(), kCapacity, written - kCapacity) ==
+                 kCapacity * kChannelCount);
+
+        CheckingSink sink;
+        PG_CHECK(history.writeLatestTo(sink, 600) == 600);
+        PG_CHECK(!sink.isTorn() && sink.getFrameCount() == 600);
+    }
+
+    // A small history so the writer laps it every few microseconds, and readers that aim at the
+    // oldest frames. Runs until some reads have succeeded and some were lapped mid-copy, or a
+    // time limit passes on a machine too quiet to interleave them.
+    void testConcurrentReadsAreNeverTorn()
+    {
+        constexpr size_t kCapacity = 2048;
+        constexpr size_t kWriteFrames = 64;
+        ReplayHistoryBuffer history(kChannelCount, kCapacity);
+
+        std::atomic<bool> running{true};
+        std::thread writer(
+                [&]
+                {
+                    std::vector<float> block(kWriteFrames * kChannelCount);
+                    for (uint64_t frame = 0; running.load(std::memory_order_relaxed);
+                         frame += kWriteFrames) {
+                        fill(block, frame);
+                        history.write(block.data(), block.size());
+                    }
+                });
+
+        std::vector<float> out(kCapacity * kChannelCount);
+        uint64_t succeeded = 0, lapped = 0, torn = 0, snapshots = 0, tornSnapshots = 0;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while ((succeeded < 1000 || lapped < 1000) && std::chrono::steady_clock::now() < deadline) {
+            const uint64_t published = history.getTotalFramesWritten();
+            if (published < kCapacity) { continue; }
+
+            // Alternate between the whole history, which the next write laps, and a short range
+            // a little way in, which a quick read may finish in time.
+            const bool whole = (succeeded + lapped) % 2 == 0;
+            const uint64_t first = whole ? published - kCapacity : published - kCapacity / 2;
+            const size_t count = whole ? kCapacity : kWriteFrames;
+            if (history.read(first, out.data(), count)) {
+                ++succeeded;
+                if (findMismatch(out.data(), count, first) != count * kChannelCount) { ++torn; }
+            } else {
+                ++lapped;
+            }
+
+            if ((succeeded + lapped) % 64 == 0) {
+                CheckingSink sink;
+                history.writeLatestTo(sink, kCapacity);
+                ++snapshots;
+                if (sink.isTorn()) { ++tornSnapshots; }
+            }
+        }
+        running.store(false);
+        writer.join();
+
+        PG_CHECK(torn == 0);
+        PG_CHECK(tornSnapshots == 0);
+        PG_CHECK(succeeded > 0);
+        PG_CHECK(lapped > 0);
+        PG_CHECK(snapshots > 0);
+    }
+} // namespace
+
+int main()
+{
+    testReadsAroundWrap();
+    testConcurrentReadsAreNeverTorn();
+    return pg::audio_tap::test::finish();
+}
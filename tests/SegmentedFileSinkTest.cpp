@@ -0,0 +1,155 @@
+// Rotates a segmented CAF recording more than a thousand times, writing blocks whose sizes do
+// not line up with the segment length, and checks that the segments read back in index order
+// are exactly the audio that was written: no frame lost, repeated or reordered.
+
+#include "CafFileWriter.h"
+#include "FilePaths.h"
+#include "SegmentedFileSink.h"
+#include "TestSupport.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr double kSampleRate = 48000.0;
+    constexpr uint32_t kChannelCount = 2;
+
+    struct IndexEntry
+    {
+        uint64_t firstFrame{0};
+        uint64_t frameCount{0};
+        std::string fileName;
+    };
+
+    auto readIndex(const std::string &path) -> std::vector<IndexEntry>
+    {
+        std::vector<IndexEntry> entries;
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#' || line.compare(0, 11, "sample_rate") == 0 ||
+                line.compare(0, 8, "channels") == 0 || line.compare(0, 8, "segments") == 0) {
+                continue;
+            }
+            IndexEntry entry;
+            std::istringstream fields(line);
+            fields >> entry.firstFrame >> entry.frameCount >> entry.fileName;
+            entries.push_back(entry);
+        }
+        return entries;
+    }
+
+    // Sample `channel` of frame `frame` in the test signal: distinct everywhere and exact in
+    // float for the lengths written here.
+    auto sampleAt(uint64_t frame, uint32_t channel) -> float
+    {
+        return static_cast<float>(frame * kChannelCount + channel);
+    }
+
+    // Writes `totalFrames` of the test signal through a segmented sink with `options` and
+    // checks the index and the segment files against it. Returns the number of segments.
+    auto writeAndVerify(const std::string &name, const SegmentOptions &options,
+                        uint64_t totalFrames) -> size_t
+    {
+        const test::TemporaryDirectory directory(name);
+        const std::string basePath = directory.file("take.caf");
+        const CaptureFormat format{kSampleRate, kChannelCount};
+
+        auto sink = SegmentedFileSink::create(basePath, format, options,
+                                              [&](const std::string &path)
+                                                      -> std::unique_ptr<SampleSink>
+                                              { return CafFileWriter::open(path, format); });
+        if (!PG_CHECK(sink != nullptr)) { return 0; }
+
+        // Block sizes cycle through awkward values, including single frames.
+        const size_t blockSizes[] = {1, 7, 128, 333, 479, 480, 481, 1021, 4096};
+        std::vector<float> block;
+        uint64_t written = 0;
+        for (size_t i = 0; written < totalFrames; ++i) {
+            const size_t frames = static_cast<size_t>(std::min<uint64_t>(
+                    blockSizes[i % std::size(blockSizes)], totalFrames - written));
+            block.resize(frames * kChannelCount);
+            for (size_t f = 0; f < frames; ++f) {
+                for (uint32_t ch = 0; ch < kChannelCount; ++ch) {
+                    block[f * kChannelCount + ch] = sampleAt(written + f, ch);
+                }
+            }
+            if (!PG_CHECK(sink->write(block.data(), frames))) { return 0; }
+            written += frames;
+            // Checkpoints in the middle of a segment must not disturb rotation.
+            if (i % 97 == 0) { PG_CHECK(sink->checkpoint()); }
+        }
+        const size_t segmentCount = sink->getSegmentCount();
+        PG_CHECK(sink->finalize());
+        const std::string indexPath = sink->getIndexPath();
+        sink.reset();
+
+        const std::vector<IndexEntry> entries = readIndex(indexPath);
+        PG_CHECK(entries.size() == segmentCount);
+
+        uint64_t expectedFirstFrame = 0;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            const IndexEntry &entry = entries[i];
+            PG_CHECK(entry.firstFrame == expectedFirstFrame);
+            PG_CHECK(entry.frameCount > 0);
+            PG_CHECK(entry.fileName ==
+                     paths::fileName(SegmentedFileSink::getSegmentPath(basePath, i)));
+
+            std::vector<float> samples;
+            const std::string segmentPath = directory.file(entry.fileName);
+            if (!PG_CHECK(test::readCafFloats(segmentPath, samples))) { return 0; }
+            if (!PG_CHECK(samples.size() == entry.frameCount * kChannelCount)) { return 0; }
+            for (uint64_t f = 0; f < entry.frameCount; ++f) {
+                for (uint32_t ch = 0; ch < kChannelCount; ++ch) {
+                    if (samples[f * kChannelCount + ch] != sampleAt(entry.firstFrame + f, ch)) {
+                        std::fprintf(stderr, "%s: frame %" PRIu64 " of %s is wrong\n",
+                                     name.c_str(), f, entry.fileName.c_str());
+                        PG_CHECK(false);
+                        return 0;
+                    }
+                }
+            }
+            expectedFirstFrame += entry.frameCount;
+        }
+        PG_CHECK(expectedFirstFrame == totalFrames);
+
+        // The segment opened ahead for the next rotation is removed again.
+        PG_CHECK(!std::filesystem::exists(
+                SegmentedFileSink::getSegmentPath(basePath, entries.size())));
+        return entries.size();
+    }
+
+    void testDurationLimitRotatesSampleExactly()
+    {
+        // 480 frames per segment; 1,000 rotations plus a short final segment.
+        SegmentOptions options;
+        options.maxSeconds = 0.01;
+        const uint64_t framesPerSegment = 480;
+        const uint64_t totalFrames = 1000 * framesPerSegment + 123;
+
+        const size_t segmentCount = writeAndVerify("segments_duration", options, totalFrames);
+        PG_CHECK(segmentCount == 1001);
+    }
+
+    void testSizeLimitKeepsEveryFrame()
+    {
+        // Segments end after the write that crosses the limit, so only continuity is exact.
+        SegmentOptions options;
+        options.maxBytes = 2 * 1024;
+        const size_t segmentCount = writeAndVerify("segments_size", options, 400000);
+        PG_CHECK(segmentCount > 200);
+    }
+} // namespace
+
+int main()
+{
+    testDurationLimitRotatesSampleExactly();
+    testSizeLimitKeepsEveryFrame();
+    return pg::audio_tap::test::finish();
+}
@@ -0,0 +1,270 @@
+// Checks `SilenceIndex` lookups, expansion and file format, and that a session recorded through
+// `SilenceGatingSink` expands back to the captured samples: exactly where the gaps are digital
+// silence, and to within the threshold where they are merely quiet.
+
+#include "CafFileWriter.h"
+#include "SilenceGatingSink.h"
+#include "SilenceIndex.h"
+#include "TestSupport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr double kSampleRate = 48000.0;
+    constexpr uint32_t kChannelCount = 2;
+    constexpr double kTwoPi = 6.283185307179586;
+
+    void testRunsAroundSpans()
+    {
+        SilenceIndex index({kSampleRate, kChannelCount});
+        index.addSpan(100, 50);
+        index.addSpan(300, 10);
+        index.addSpan(400, 0); // Ignored.
+        PG_CHECK(index.getSpans().size() == 2);
+        PG_CHECK(index.getSilentFrameCount() == 60);
+
+        auto run = index.getRun(0);
+        PG_CHECK(!run.silent && run.frameCount == 100 && run.storedFrame == 0);
+        run = index.getRun(99);
+        PG_CHECK(!run.silent && run.frameCount == 1 && run.storedFrame == 99);
+        run = index.getRun(100);
+        PG_CHECK(run.silent && run.frameCount == 50);
+        run = index.getRun(149);
+        PG_CHECK(run.silent && run.frameCount == 1);
+        run = index.getRun(150);
+        PG_CHECK(!run.silent && run.frameCount == 150 && run.storedFrame == 100);
+        run = index.getRun(305);
+        PG_CHECK(run.silent && run.frameCount == 5);
+        run = index.getRun(310);
+        PG_CHECK(!run.silent && run.frameCount == UINT64_MAX && run.storedFrame == 250);
+
+        SilenceIndex leading({kSampleRate, kChannelCount});
+        leading.addSpan(0, 10);
+        run = leading.getRun(0);
+        PG_CHECK(run.silent && run.frameCount == 10);
+        run = leading.getRun(10);
+        PG_CHECK(!run.silent && run.storedFrame == 0);
+
+        const SilenceIndex empty({kSampleRate, kChannelCount});
+        run = empty.getRun(12345);
+        PG_CHECK(!run.silent && run.frameCount == UINT64_MAX && run.storedFrame == 12345);
+    }
+
+    void testForEachRunSplitsRange()
+    {
+        SilenceIndex index({kSampleRate, kChannelCount});
+        index.addSpan(100, 50);
+        index.addSpan(300, 10);
+
+        struct Visit
+        {
+            bool silent;
+            uint64_t offset;
+            uint64_t count;
+            uint64_t storedFrame;
+        };
+        std::vector<Visit> visits;
+        PG_CHECK(index.forEachRun(90, 230,
+                                  [&](const SilenceIndex::Run &run, uint64_t offset, uint64_t count)
+                                  {
+                                      visits.push_back({run.silent, offset, count,
+                                                        run.silent ? 0 : run.storedFrame});
+                                      return true;
+                                  }));
+        if (!PG_CHECK(visits.size() == 5)) { return; }
+        PG_CHECK(!visits[0].silent && visits[0].offset == 0 && visits[0].count == 10 &&
+                 visits[0].storedFrame == 90);
+        PG_CHECK(visits[1].silent && visits[1].offset == 10 && visits[1].count == 50);
+        PG_CHECK(!visits[2].silent && visits[2].offset == 60 && visits[2].count == 150 &&
+                 visits[2].storedFrame == 100);
+        PG_CHECK(visits[3].silent && visits[3].offset == 210 && visits[3].count == 10);
+        PG_CHECK(!visits[4].silent && visits[4].offset == 220 && visits[4].count == 10 &&
+                 visits[4].storedFrame == 250);
+
+        int calls = 0;
+        PG_CHECK(!index.forEachRun(0, 1000,
+                                   [&](const SilenceIndex::Run &, uint64_t, uint64_t)
+                                   { return ++calls < 2; }));
+        PG_CHECK(calls == 2);
+        PG_CHECK(index.forEachRun(0, 0,
+                                  [&](const SilenceIndex::Run &, uint64_t, uint64_t)
+                                  { return false; }));
+    }
+
+    void testSaveAndLoad()
+    {
+        const test::TemporaryDirectory directory("silence_index");
+        const std::string path = directory.file("take.silence");
+
+        SilenceIndex index({44100.0, 6});
+        index.addSpan(0, 4410);
+        index.addSpan(1ull << 33, 123); // Beyond 32 bits.
+        PG_CHECK(index.save(path, (1ull << 33) + 1000));
+
+        const auto loaded = SilenceIndex::load(path);
+        if (!PG_CHECK(loaded != nullptr)) { return; }
+        PG_CHECK(loaded->getFormat().sampleRate == 44100.0);
+        PG_CHECK(loaded->getFormat().channelCount == 6);
+        if (!PG_CHECK(loaded->getSpans().size() == 2)) { return; }
+        PG_CHECK(loaded->getSpans()[1].timelineFrame == (1ull << 33));
+        PG_CHECK(loaded->getSpans()[1].frameCount == 123);
+        PG_CHECK(loaded->getSilentFrameCount() == 4533);
+        PG_CHECK(loaded->getRun((1ull << 33) + 123).storedFrame == (1ull << 33) - 4410);
+
+        PG_CHECK(SilenceIndex::load(directory.file("missing.silence")) == nullptr);
+
+        const std::string overlapping = directory.file("overlapping.silence");
+        std::ofstream(overlapping) << "# audio capture silence index v1\nsample_rate 48000\n"
+                                      "channels 2\ntimeline_frames 1000\nspans 2\n0 100\n50 10\n";
+        PG_CHECK(SilenceIndex::load(overlapping) == nullptr);
+
+        const std::string truncated = directory.file("truncated.silence");
+        std::ofstream(truncated) << "# audio capture silence index v1\nsample_rate 48000\n"
+                                    "channels 2\ntimeline_frames 1000\nspans 2\n0 100\n";
+        PG_CHECK(SilenceIndex::load(truncated) == nullptr);
+
+        const std::string other = directory.file("other.silence");
+        std::ofstream(other) << "# something else\n";
+        PG_CHECK(SilenceIndex::load(other) == nullptr);
+
+        PG_CHECK(SilenceIndex::getIndexPath("/tmp/session/take.caf") ==
+                 "/tmp/session/take.silence");
+    }
+
+    // Songs separated by a digital-silence gap, a pause shorter than the hold time, a quiet gap
+    // of low noise and trailing silence.
+    auto makeSession(float quietLevel) -> std::vector<float>
+    {
+        const auto frames = [](double seconds)
+        { return static_cast<size_t>(seconds * kSampleRate); };
+        std::vector<float> samples;
+        std::mt19937 random(5);
+        std::uniform_real_distribution<float> quiet(-quietLevel, quietLevel);
+        auto song = [&](double seconds, double frequency)
+        {
+            for (size_t f = 0; f < frames(seconds); ++f) {
+                const double t = static_cast<double>(f) / kSampleRate;
+                const double phase = kTwoPi * frequency * t;
+                samples.push_back(static_cast<float>(0.4 * std::sin(phase)));
+                samples.push_back(static_cast<float>(0.3 * std::sin(1.5 * phase)));
+            }
+        };
+        auto silence = [&](double seconds)
+        { samples.resize(samples.size() + frames(seconds) * kChannelCount); };
+        auto noise = [&](double seconds)
+        {
+            for (size_t i = 0; i < frames(seconds) * kChannelCount; ++i) {
+                samples.push_back(quiet(random));
+            }
+        };
+
+        song(0.5, 440.0);
+        silence(0.5);
+        song(0.3, 330.0);
+        silence(0.05);
+        song(0.4, 550.0);
+        noise(1.0);
+        song(0.2, 660.0);
+        silence(0.4);
+        return samples;
+    }
+
+    // Records `session` through the gate in 512-frame writes and expands the file back.
+    auto recordAndExpand(const std::vector<float> &session, const SilenceOptions &options,
+                         const std::string &path, std::vector<float> &expanded)
+            -> std::unique_ptr<SilenceIndex>
+    {
+        const CaptureFormat format{kSampleRate, kChannelCount};
+        const std::string indexPath = SilenceIndex::getIndexPath(path);
+        auto sink = SilenceGatingSink::create(CafFileWriter::open(path, format), format, options,
+                                              indexPath);
+        if (!PG_CHECK(sink != nullptr)) { return nullptr; }
+
+        const size_t frameCount = session.size() / kChannelCount;
+        for (size_t frame = 0; frame < frameCount; frame += 512) {
+            PG_CHECK(sink->write(session.data() + frame * kChannelCount,
+                                 std::min<size_t>(512, frameCount - frame)));
+        }
+        PG_CHECK(sink->finalize());
+        PG_CHECK(sink->getTimelineFrameCount() == frameCount);
+
+        auto index = SilenceIndex::load(indexPath);
+        std::vector<float> stored;
+        if (!PG_CHECK(index != nullptr) || !PG_CHECK(test::readCafFloats(path, stored))) {
+            return nullptr;
+        }
+        PG_CHECK(sink->getStoredFrameCount() == stored.size() / kChannelCount);
+        PG_CHECK(stored.size() / kChannelCount + index->getSilentFrameCount() == frameCount);
+
+        expanded.assign(session.size(), -1.0f);
+        PG_CHECK(index->forEachRun(
+                0, frameCount,
+                [&](const SilenceIndex::Run &run, uint64_t offset, uint64_t count)
+                {
+                    float *destination = expanded.data() + offset * kChannelCount;
+                    if (run.silent) {
+                        std::fill(destination, destination + count * kChannelCount, 0.0f);
+                        return true;
+                    }
+                    if ((run.storedFrame + count) * kChannelCount > stored.size()) { return false; }
+                    std::copy_n(stored.data() + run.storedFrame * kChannelCount,
+                                count * kChannelCount, destination);
+                    return true;
+                }));
+        return index;
+    }
+
+    void testDigitalSilenceExpandsExactly()
+    {
+        const std::vector<float> session = makeSession(0.0f);
+        const test::TemporaryDirectory directory("silence_gating_exact");
+        std::vector<float> expanded;
+        const auto index = recordAndExpand(session, {0.0f, 0.1},
+                                           directory.file("take.caf"), expanded);
+        if (!index) { return; }
+
+        // The 50 ms pause is shorter than the hold time and stays in the file.
+        PG_CHECK(index->getSpans().size() == 3);
+        PG_CHECK(index->getSilentFrameCount() > static_cast<uint64_t>(1.5 * kSampleRate));
+        PG_CHECK(expanded == session);
+    }
+
+    void testQuietGapExpandsWithinThreshold()
+    {
+        constexpr float kThreshold = 0.001f;
+        const std::vector<float> session = makeSession(kThreshold / 2);
+        const test::TemporaryDirectory directory("silence_gating_quiet");
+        std::vector<float> expanded;
+        const auto index = recordAndExpand(session, {kThreshold, 0.1},
+                                           directory.file("take.caf"), expanded);
+        if (!index) { return; }
+
+        PG_CHECK(index->getSpans().size() == 3);
+        size_t differing = 0;
+        for (size_t i = 0; i < session.size(); ++i) {
+            if (expanded[i] == session[i]) { continue; }
+            ++differing;
+            const auto run = index->getRun(i / kChannelCount);
+            PG_CHECK(run.silent && expanded[i] == 0.0f && std::fabs(session[i]) <= kThreshold);
+        }
+        PG_CHECK(differing > 0);
+    }
+} // namespace
+
+int main()
+{
+    testRunsAroundSpans();
+    testForEachRunSplitsRange();
+    testSaveAndLoad();
+    testDigitalSilenceExpandsExactly();
+    testQuietGapExpandsWithinThreshold();
+    return pg::audio_tap::test::finish();
+}
@@ -0,0 +1,217 @@
+// Splices segments at differing rates and channel counts through `StreamSplicer` and checks the
+// recording: its length, that every segment comes out at the session rate and layout, and that
+// no splice steps further from one frame to the next than the crossfade allows.
+
+#include "StreamSplicer.h"
+#include "TestSupport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace {
+    using namespace pg::audio_tap;
+
+    constexpr double kTwoPi = 6.283185307179586;
+    constexpr double kHalfPi = kTwoPi / 4.0;
+    constexpr double kToneFrequency = 440.0;
+    constexpr double kToneLevel = 0.3;
+    constexpr double kOffset = 0.4; // Alternates in sign, so a hard cut would jump by 0.8.
+    constexpr size_t kWriteFrames = 480;
+
+    // Keeps everything written to it.
+    class CapturingSink : public SampleSink
+    {
+    public:
+        explicit CapturingSink(std::vector<float> &samples, uint32_t channelCount)
+          : samples_(samples), channelCount_(channelCount)
+        {
+        }
+
+        auto write(const float *interleaved, size_t frameCount) -> bool override
+        {
+            samples_.insert(samples_.end(), interleaved, interleaved + frameCount * channelCount_);
+            return true;
+        }
+        auto finalize() -> bool override { return true; }
+
+    private:
+        std::vector<float> &samples_;
+        const uint32_t channelCount_;
+    };
+
+    struct Segment
+    {
+        CaptureFormat format;
+        size_t frameCount;
+        double offset;
+    };
+
+    // A tone on a DC offset, the same on every channel.
+    auto render(const Segment &segment) -> std::vector<float>
+    {
+        const uint32_t channels = segment.format.channelCount;
+        std::vector<float> samples(segment.frameCount * channels);
+        for (size_t f = 0; f < segment.frameCount; ++f) {
+            const double t = static_cast<double>(f) / segment.format.sampleRate;
+            const double tone = kToneLevel * std::sin(kTwoPi * kToneFrequency * t);
+            const auto value = static_cast<float>(segment.offset + tone);
+            std::fill_n(samples.data() + f * channels, channels, value);
+        }
+        return samples;
+    }
+
+    // Frequency of the tone in channel `channel` over [begin, end) frames, from crossings of
+    // the mean.
+    auto measureFrequency(const std::vector<float> &samples, uint32_t channels, uint32_t channel,
+                          size_t begin, size_t end, double sampleRate) -> double
+    {
+        double mean = 0.0;
+        for (size_t f = begin; f < end; ++f) { mean += samples[f * channels + channel]; }
+        mean /= static_cast<double>(end - begin);
+
+        size_t first = 0, last = 0, crossings = 0;
+        for (size_t f = begin + 1; f < end; ++f) {
+            const bool below = samples[(f - 1) * channels + channel] < mean;
+            const bool above = samples[f * channels + channel] >= mean;
+            if (below && above) {
+                if (crossings == 0) { first = f; }
+                last = f;
+                ++crossings;
+            }
+        }
+        if (crossings < 2) { return 0.0; }
+        return static_cast<double>(crossings - 1) * sampleRate / static_cast<double>(last - first);
+    }
+
+    auto getMean(const std::vector<float> &samples, uint32_t channels, size_t begin, size_t end)
+            -> double
+    {
+        double sum = 0.0;
+        for (size_t f = begin; f < end; ++f) { sum += samples[f * channels]; }
+        return sum / static_cast<double>(end - begin);
+    }
+
+    void testSplicesAcrossFormats()
+    {
+        const CaptureFormat session{48000.0, 2};
+        const std::vector<Segment> segments = {
+                {{48000.0, 2}, 48000, kOffset},   // The session format: passes straight through.
+                {{44100.0, 1}, 22050, -kOffset},  // Resampled and spread to both channels.
+                {{96000.0, 4}, 96000, kOffset},   // Folded down to two channels and resampled.
+                {{48000.0, 2}, 24000, -kOffset},
+        };
+
+        std::vector<float> output;
+        StreamSplicer splicer(std::make_unique<CapturingSink>(output, session.channelCount),
+                              session);
+        const auto crossfadeFrames = static_cast<size_t>(
+                std::llround(StreamSplicer::kDefaultCrossfadeSeconds * session.sampleRate));
+
+        std::vector<uint64_t> starts;
+        uint64_t expectedFrames = 0;
+        for (const Segment &segment : segments) {
+            auto sink = splicer.beginSegment(segment.format);
+            if (!PG_CHECK(sink != nullptr)) { return; }
+            PG_CHECK(splicer.beginSegment(segment.format) == nullptr); // Still open.
+            starts.push_back(splicer.getSegmentStartFrame());
+
+            const std::vector<float> samples = render(segment);
+            const uint32_t channels = segment.format.channelCount;
+            for (size_t f = 0; f < segment.frameCount; f += kWriteFrames) {
+                PG_CHECK(sink->write(samples.data() + f * channels,
+                                     std::min(kWriteFrames, segment.frameCount - f)));
+            }
+            PG_CHECK(sink->finalize());
+
+            expectedFrames += static_cast<uint64_t>(
+                    std::llround(static_cast<double>(segment.frameCount) * session.sampleRate /
+                                 segment.format.sampleRate));
+        }
+        PG_CHECK(splicer.finalize());
+        PG_CHECK(splicer.getSegmentCount() == segments.size());
+
+        // Each splice overlaps the crossfade length of the two segments.
+        expectedFrames -= (segments.size() - 1) * crossfadeFrames;
+        const uint32_t channels = session.channelCount;
+        if (!PG_CHECK(output.size() == expectedFrames * channels)) { return; }
+        PG_CHECK(splicer.getWrittenFrameCount() == expectedFrames);
+
+        // Each segment lands where the previous one's crossfade starts.
+        for (size_t i = 1; i < segments.size(); ++i) {
+            const auto previousLength = static_cast<uint64_t>(
+                    std::llround(static_cast<double>(segments[i - 1].frameCount) *
+                                 session.sampleRate / segments[i - 1].format.sampleRate));
+            PG_CHECK(starts[i] == starts[i - 1] + previousLength - crossfadeFrames);
+        }
+
+        // Away from the splices, every segment plays its tone at the session rate, on its own
+        // offset, identically in both channels.
+        for (size_t i = 0; i < segments.size(); ++i) {
+            const size_t end = i + 1 < segments.size() ? static_cast<size_t>(starts[i + 1])
+                                                       : static_cast<size_t>(expectedFrames);
+            const size_t begin = static_cast<size_t>(starts[i]) + 2 * crossfadeFrames;
+            const size_t stop = end - crossfadeFrames;
+            if (!PG_CHECK(stop > begin + 4800)) { continue; }
+
+            for (uint32_t ch = 0; ch < channels; ++ch) {
+                const double frequency =
+                        measureFrequency(output, channels, ch, begin, stop, session.sampleRate);
+                PG_CHECK(std::fabs(frequency - kToneFrequency) < 1.0);
+            }
+            const double mean = getMean(output, channels, begin, stop);
+            PG_CHECK(std::fabs(mean - segments[i].offset) < 0.01); // Folded channels average.
+            float difference = 0.0f;
+            for (size_t f = begin; f < stop; ++f) {
+                difference = std::max(difference,
+                                      std::fabs(output[f * channels] - output[f * channels + 1]));
+            }
+            PG_CHECK(difference < 1e-6f);
+        }
+
+        // What a frame-to-frame step may reach: the tone's steepest slope under the equal-power
+        // gains (at most sqrt(2) together), plus each segment's peak times the largest gain
+        // change per frame. A hard cut would step by the full difference in offsets.
+        const double toneStep = kToneLevel * kTwoPi * kToneFrequency / session.sampleRate;
+        const double gainStep = kHalfPi / static_cast<double>(crossfadeFrames);
+        const double allowed = std::sqrt(2.0) * toneStep + 2.0 * (kOffset + kToneLevel) * gainStep;
+        double largest = 0.0;
+        for (size_t f = 1; f < expectedFrames; ++f) {
+            for (uint32_t ch = 0; ch < channels; ++ch) {
+                largest = std::max(largest, double{std::fabs(output[f * channels + ch] -
+                                                              output[(f - 1) * channels + ch])});
+            }
+        }
+        PG_CHECK(largest <= allowed);
+        PG_CHECK(allowed < 0.1 * 2.0 * kOffset); // Far below the hard cut's step.
+    }
+
+    void testSegmentShorterThanCrossfade()
+    {
+        const CaptureFormat session{48000.0, 2};
+        std::vector<float> output;
+        StreamSplicer splicer(std::make_unique<CapturingSink>(output, 2), session);
+
+        const std::vector<Segment> segments = {
+                {{48000.0, 2}, 4800, kOffset}, {{48000.0, 2}, 100, -kOffset},
+                {{48000.0, 2}, 4800, kOffset}};
+        for (const Segment &segment : segments) {
+            auto sink = splicer.beginSegment(segment.format);
+            if (!PG_CHECK(sink != nullptr)) { return; }
+            const std::vector<float> samples = render(segment);
+            PG_CHECK(sink->write(samples.data(), segment.frameCount));
+            PG_CHECK(sink->finalize());
+        }
+        PG_CHECK(splicer.finalize());
+        PG_CHECK(!output.empty());
+        for (const float sample : output) { PG_CHECK(std::isfinite(sample)); }
+    }
+} // namespace
+
+int main()
+{
+    testSplicesAcrossFormats();
+    testSegmentShorterThanCrossfade();
+    return pg::audio_tap::test::finish();
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Checks `condition` and reports it with its location if it does not hold. Unlike `assert`, it
+// is not compiled out of release builds.
+#define PG_CHECK(condition)                                                                    \
+    ::pg::audio_tap::test::check(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
+
+namespace pg {
+namespace audio_tap {
+    namespace test {
+
+        inline int failureCount = 0;
+
+        inline auto check(bool passed, const char *expression, const char *file, int line) -> bool
+        {
+            if (!passed) {
+                ++failureCount;
+                std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+            }
+            return passed;
+        }
+
+        // Exit status of a test executable: zero if every check passed.
+        inline auto finish() -> int
+        {
+            if (failureCount > 0) { std::fprintf(stderr, "%d check(s) failed\n", failureCount); }
+            return failureCount > 0 ? 1 : 0;
+        }
+
+        // Creates an empty directory for the files of test `name` and removes it again when
+        // the test is done.
+        class TemporaryDirectory
+        {
+        public:
+            explicit TemporaryDirectory(const std::string &name)
+              : path_(std::filesystem::temp_directory_path() / ("pg_audio_tap_" + name))
+            {
+                std::error_code error;
+                std::filesystem::remove_all(path_, error);
+                std::filesystem::create_directories(path_, error);
+            }
+
+            ~TemporaryDirectory()
+            {
+                std::error_code error;
+                std::filesystem::remove_all(path_, error);
+            }
+
+            TemporaryDirectory(const TemporaryDirectory &) = delete;
+            TemporaryDirectory &operator=(const TemporaryDirectory &) = delete;
+
+            auto file(const std::string &name) const -> std::string
+            {
+                return (path_ / name).string();
+            }
+
+        private:
+            std::filesystem::path path_;
+        };
+
+        inline auto readFile(const std::string &path) -> std::vector<uint8_t>
+        {
+            std::vector<uint8_t> bytes;
+            if (std::FILE *file = std::fopen(path.c_str(), "rb")) {
+                uint8_t buffer[64 * 1024];
+                size_t count = 0;
+                while ((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+                    bytes.insert(bytes.end(), buffer, buffer + count);
+                }
+                std::fclose(file);
+            }
+            return bytes;
+        }
+
+        inline auto readBigEndian(const uint8_t *bytes, int byteCount) -> uint64_t
+        {
+            uint64_t value = 0;
+            for (int i = 0; i < byteCount; ++i) { value = (value << 8) | bytes[i]; }
+            return value;
+        }
+
+        // Samples of a float32 CAF file as `CafFileWriter` writes it, honouring the size in the
+        // `data` chunk header. Returns false if the file is not one.
+        inline auto readCafFloats(const std::string &path, std::vector<float> &samples) -> bool
+        {
+            const std::vector<uint8_t> bytes = readFile(path);
+            if (bytes.size() < 8 || std::memcmp(bytes.data(), "caff", 4) != 0) { return false; }
+
+            size_t offset = 8;
+            while (offset + 12 <= bytes.size()) {
+                const uint8_t *chunk = bytes.data() + offset;
+                const auto size = static_cast<int64_t>(readBigEndian(chunk + 4, 8));
+                if (std::memcmp(chunk, "data", 4) == 0) {
+                    const size_t begin = offset + 12 + 4; // After the edit count.
+                    size_t end = size < 0 ? bytes.size() : offset + 12 + static_cast<size_t>(size);
+                    if (begin > bytes.size() || end > bytes.size() || end < begin) {
+                        return false;
+                    }
+                    end -= (end - begin) % sizeof(float);
+                    samples.resize((end - begin) / sizeof(float));
+                    std::memcpy(samples.data(), bytes.data() + begin, end - begin);
+                    return true;
+                }
+                if (size < 0) { return false; }
+                offset += 12 + static_cast<size_t>(size);
+            }
+            return false;
+        }
+
+    } // namespace test
+} // namespace audio_tap
+} // namespace pg